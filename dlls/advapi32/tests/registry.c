@@ -3438,6 +3438,158 @@ static void test_delete_key_value(void)
     RegCloseKey(subkey);
 }
 
+static void test_large_key(void)
+{
+    char name[32], buffer[32];
+    DWORD i, j, size, data;
+    HKEY hkey, subkey;
+    LONG ret;
+
+    ret = RegCreateKeyA(hkey_main, "Large", &hkey);
+    ok(!ret, "RegCreateKeyA failed: %d\n", ret);
+
+    /* create enough subkeys and values to need an index, in a non-sorted order */
+    for (i = 0; i < 500; i++)
+    {
+        j = (i * 263) % 500;
+        sprintf(name, "key%03u", j);
+        ret = RegCreateKeyA(hkey, name, &subkey);
+        ok(!ret, "RegCreateKeyA %s failed: %d\n", name, ret);
+        RegCloseKey(subkey);
+        sprintf(name, "value%03u", j);
+        ret = RegSetValueExA(hkey, name, 0, REG_DWORD, (const BYTE *)&j, sizeof(j));
+        ok(!ret, "RegSetValueExA %s failed: %d\n", name, ret);
+    }
+
+    ret = RegOpenKeyA(hkey, "KEY123", &subkey);
+    ok(!ret, "RegOpenKeyA failed: %d\n", ret);
+    RegCloseKey(subkey);
+    ret = RegOpenKeyA(hkey, "key500", &subkey);
+    ok(ret == ERROR_FILE_NOT_FOUND, "got %d\n", ret);
+
+    size = sizeof(data);
+    ret = RegQueryValueExA(hkey, "VALUE321", NULL, NULL, (BYTE *)&data, &size);
+    ok(!ret, "RegQueryValueExA failed: %d\n", ret);
+    ok(data == 321, "got %u\n", data);
+
+    /* subkeys are enumerated in sorted order */
+    for (i = 0; i < 500; i++)
+    {
+        sprintf(name, "key%03u", i);
+        ret = RegEnumKeyA(hkey, i, buffer, sizeof(buffer));
+        ok(!ret, "RegEnumKeyA %u failed: %d\n", i, ret);
+        ok(!strcmp(buffer, name), "%u: got %s\n", i, buffer);
+    }
+    ret = RegEnumKeyA(hkey, i, buffer, sizeof(buffer));
+    ok(ret == ERROR_NO_MORE_ITEMS, "got %d\n", ret);
+
+    /* delete half of the entries and add new ones */
+    for (i = 0; i < 500; i += 2)
+    {
+        sprintf(name, "key%03u", i);
+        ret = RegDeleteKeyA(hkey, name);
+        ok(!ret, "RegDeleteKeyA %s failed: %d\n", name, ret);
+        sprintf(name, "Value%03u", i);
+        ret = RegDeleteValueA(hkey, name);
+        ok(!ret, "RegDeleteValueA %s failed: %d\n", name, ret);
+    }
+    ret = RegCreateKeyA(hkey, "aaa", &subkey);
+    ok(!ret, "RegCreateKeyA failed: %d\n", ret);
+    RegCloseKey(subkey);
+
+    ret = RegEnumKeyA(hkey, 0, buffer, sizeof(buffer));
+    ok(!ret, "RegEnumKeyA failed: %d\n", ret);
+    ok(!strcmp(buffer, "aaa"), "got %s\n", buffer);
+    for (i = 1; i <= 250; i++)
+    {
+        sprintf(name, "key%03u", 2 * i - 1);
+        ret = RegEnumKeyA(hkey, i, buffer, sizeof(buffer));
+        ok(!ret, "RegEnumKeyA %u failed: %d\n", i, ret);
+        ok(!strcmp(buffer, name), "%u: got %s\n", i, buffer);
+    }
+
+    for (i = 0; i < 500; i++)
+    {
+        sprintf(name, "value%03u", i);
+        size = sizeof(data);
+        ret = RegQueryValueExA(hkey, name, NULL, NULL, (BYTE *)&data, &size);
+        if (i % 2) ok(!ret && data == i, "%s: got %d %u\n", name, ret, data);
+        else ok(ret == ERROR_FILE_NOT_FOUND, "%s: got %d\n", name, ret);
+    }
+    for (i = 0; ; i++)
+    {
+        size = sizeof(buffer);
+        if (RegEnumValueA(hkey, i, buffer, &size, NULL, NULL, NULL, NULL)) break;
+    }
+    ok(i == 250, "got %u values\n", i);
+
+    delete_key(hkey);
+    RegCloseKey(hkey);
+}
+
+static double elapsed_ms( const LARGE_INTEGER *start, const LARGE_INTEGER *freq )
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter( &now );
+    return (now.QuadPart - start->QuadPart) * 1000.0 / freq->QuadPart;
+}
+
+/* not a conformance test, run with "registry benchmark" */
+static void benchmark_large_key(void)
+{
+    static const DWORD count = 20000;
+    LARGE_INTEGER freq, start;
+    char name[32], buffer[32];
+    HKEY hkey, subkey;
+    DWORD i, j;
+    LONG ret;
+
+    QueryPerformanceFrequency( &freq );
+    ret = RegCreateKeyA( hkey_main, "Benchmark", &hkey );
+    ok( !ret, "RegCreateKeyA failed: %d\n", ret );
+
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < count; i++)
+    {
+        j = (i * 7919) % count;
+        sprintf( name, "key%05u", j );
+        RegCreateKeyA( hkey, name, &subkey );
+        RegCloseKey( subkey );
+        sprintf( name, "value%05u", j );
+        RegSetValueExA( hkey, name, 0, REG_DWORD, (const BYTE *)&j, sizeof(j) );
+    }
+    trace( "create %u subkeys and values: %.1f ms\n", count, elapsed_ms( &start, &freq ) );
+
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < count; i++)
+    {
+        sprintf( name, "key%05u", (i * 4999) % count );
+        if (!RegOpenKeyA( hkey, name, &subkey )) RegCloseKey( subkey );
+    }
+    trace( "open %u subkeys: %.1f ms\n", count, elapsed_ms( &start, &freq ) );
+
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < count; i++) RegEnumKeyA( hkey, i, buffer, sizeof(buffer) );
+    trace( "enumerate %u subkeys: %.1f ms\n", count, elapsed_ms( &start, &freq ) );
+
+    /* delete the values in random order, and the subkeys from the start like RegDeleteTree */
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < count; i++)
+    {
+        sprintf( name, "value%05u", (i * 4999) % count );
+        RegDeleteValueA( hkey, name );
+    }
+    trace( "delete %u values: %.1f ms\n", count, elapsed_ms( &start, &freq ) );
+
+    QueryPerformanceCounter( &start );
+    while (!RegEnumKeyA( hkey, 0, buffer, sizeof(buffer) )) RegDeleteKeyA( hkey, buffer );
+    trace( "delete %u subkeys: %.1f ms\n", count, elapsed_ms( &start, &freq ) );
+
+    delete_key( hkey );
+    RegCloseKey( hkey );
+}
+
 static void test_RegOpenCurrentUser(void)
 {
     HKEY key;
@@ -4421,9 +4573,21 @@ static void test_EnumDynamicTimeZoneInformation(void)
 
 START_TEST(registry)
 {
+    char **argv;
+    int argc;
+
     /* Load pointers for functions that are not available in all Windows versions */
     InitFunctionPtrs();
 
+    argc = winetest_get_mainargs( &argv );
+    if (argc >= 3 && !strcmp( argv[2], "benchmark" ))
+    {
+        setup_main_key();
+        benchmark_large_key();
+        delete_key( hkey_main );
+        return;
+    }
+
     setup_main_key();
     check_user_privs();
     test_set_value();
@@ -4452,6 +4616,7 @@ START_TEST(registry)
     test_deleted_key();
     test_delete_value();
     test_delete_key_value();
+    test_large_key();
     test_RegOpenCurrentUser();
     test_RegNotifyChangeKeyValue();
     test_performance_keys();
@@ -5451,10 +5451,10 @@ static void test_GetFileAttributesExW(void)
 static void test_post_completion(void)
 {
     OVERLAPPED ovl, ovl2, *povl;
-    OVERLAPPED_ENTRY entries[2];
+    OVERLAPPED_ENTRY entries[2], *many;
     ULONG_PTR key;
     HANDLE port;
-    ULONG count;
+    ULONG count, i;
     DWORD size;
     BOOL ret;
 
@@ -5553,6 +5553,37 @@ static void test_post_completion(void)
 
     SleepEx(0, TRUE);
 
+    /* many packets are dequeued in order, up to the size of the array */
+    many = HeapAlloc( GetProcessHeap(), 0, 150 * sizeof(*many) );
+    for (i = 0; i < 200; i++)
+    {
+        ret = PostQueuedCompletionStatus( port, i, 1000 + i, (OVERLAPPED *)(ULONG_PTR)(i + 1) );
+        ok(ret, "PostQueuedCompletionStatus failed: %u\n", GetLastError());
+    }
+
+    count = 0xdeadbeef;
+    ret = pGetQueuedCompletionStatusEx( port, many, 150, &count, 0, FALSE );
+    ok(ret, "GetQueuedCompletionStatusEx failed\n");
+    ok(count == 150, "wrong count %u\n", count);
+    for (i = 0; i < count; i++)
+    {
+        ok(many[i].lpCompletionKey == 1000 + i, "%u: wrong key %lu\n", i, many[i].lpCompletionKey);
+        ok(many[i].lpOverlapped == (OVERLAPPED *)(ULONG_PTR)(i + 1), "%u: wrong ovl %p\n", i, many[i].lpOverlapped);
+        ok(many[i].dwNumberOfBytesTransferred == i, "%u: wrong size %u\n", i, many[i].dwNumberOfBytesTransferred);
+    }
+
+    count = 0xdeadbeef;
+    ret = pGetQueuedCompletionStatusEx( port, many, 150, &count, 0, FALSE );
+    ok(ret, "GetQueuedCompletionStatusEx failed\n");
+    ok(count == 50, "wrong count %u\n", count);
+    for (i = 0; i < count; i++)
+        ok(many[i].lpCompletionKey == 1150 + i, "%u: wrong key %lu\n", i, many[i].lpCompletionKey);
+
+    ret = pGetQueuedCompletionStatusEx( port, many, 150, &count, 0, FALSE );
+    ok(!ret, "GetQueuedCompletionStatusEx succeeded\n");
+    ok(GetLastError() == WAIT_TIMEOUT, "wrong error %u\n", GetLastError());
+    HeapFree( GetProcessHeap(), 0, many );
+
     CloseHandle( port );
 }
 
@@ -30,6 +30,8 @@
 #include "winbase.h"
 #include "winternl.h"
 #include "winnls.h"
+#include "winreg.h"
+#include "tlhelp32.h"
 #include "wine/test.h"
 #include "delayloadhandler.h"
 
@@ -60,6 +62,7 @@ static NTSTATUS (WINAPI *pNtQuerySection)(HANDLE, SECTION_INFORMATION_CLASS, voi
 static NTSTATUS (WINAPI *pNtMapViewOfSection)(HANDLE, HANDLE, PVOID *, ULONG_PTR, SIZE_T, const LARGE_INTEGER *, SIZE_T *, ULONG, ULONG, ULONG);
 static NTSTATUS (WINAPI *pNtUnmapViewOfSection)(HANDLE, PVOID);
 static NTSTATUS (WINAPI *pNtQueryInformationProcess)(HANDLE, PROCESSINFOCLASS, PVOID, ULONG, PULONG);
+static NTSTATUS (WINAPI *pNtQueryInformationThread)(HANDLE, THREADINFOCLASS, PVOID, ULONG, PULONG);
 static NTSTATUS (WINAPI *pNtSetInformationProcess)(HANDLE, PROCESSINFOCLASS, PVOID, ULONG);
 static NTSTATUS (WINAPI *pNtTerminateProcess)(HANDLE, DWORD);
 static void (WINAPI *pLdrShutdownProcess)(void);
@@ -3992,6 +3995,242 @@ static void test_dll_file( const char *name )
 #undef OK_FIELD
 }
 
+static void check_module_imports( HMODULE module )
+{
+    const IMAGE_IMPORT_DESCRIPTOR *imports;
+    const IMAGE_THUNK_DATA *names, *thunks;
+    const IMAGE_IMPORT_BY_NAME *by_name;
+    const char *base = (const char *)module, *name;
+    HMODULE imp;
+    ULONG size;
+
+    imports = pRtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_IMPORT, &size );
+    if (!imports) return;
+
+    for (; imports->Name && imports->FirstThunk; imports++)
+    {
+        name = base + imports->Name;
+        if (!imports->u.OriginalFirstThunk) continue;
+        if (!_strnicmp( name, "api-ms-", 7 ) || !_strnicmp( name, "ext-ms-", 7 )) continue;
+        names = (const IMAGE_THUNK_DATA *)(base + imports->u.OriginalFirstThunk);
+        thunks = (const IMAGE_THUNK_DATA *)(base + imports->FirstThunk);
+        if (!names->u1.AddressOfData) continue;  /* unused import */
+
+        imp = GetModuleHandleA( name );
+        ok( imp != NULL, "%s not loaded\n", name );
+        if (!imp) continue;
+
+        for (; names->u1.AddressOfData; names++, thunks++)
+        {
+            if (IMAGE_SNAP_BY_ORDINAL( names->u1.Ordinal )) continue;
+            by_name = (const IMAGE_IMPORT_BY_NAME *)(base + names->u1.AddressOfData);
+            ok( (FARPROC)thunks->u1.Function == GetProcAddress( imp, (const char *)by_name->Name ),
+                "wrong address %p for %s.%s\n", (void *)thunks->u1.Function, name, by_name->Name );
+        }
+    }
+}
+
+/* count the threads of the current process that were started in ntdll, such as the loader workers */
+static unsigned int count_ntdll_threads(void)
+{
+    HMODULE ntdll = GetModuleHandleA( "ntdll.dll" );
+    const IMAGE_NT_HEADERS *nt = (const IMAGE_NT_HEADERS *)((char *)ntdll + ((IMAGE_DOS_HEADER *)ntdll)->e_lfanew);
+    THREADENTRY32 entry = { sizeof(entry) };
+    unsigned int count = 0;
+    HANDLE snapshot, thread;
+    void *start;
+    BOOL ret;
+
+    snapshot = CreateToolhelp32Snapshot( TH32CS_SNAPTHREAD, 0 );
+    ok( snapshot != INVALID_HANDLE_VALUE, "CreateToolhelp32Snapshot failed %u\n", GetLastError() );
+    if (snapshot == INVALID_HANDLE_VALUE) return 0;
+    for (ret = Thread32First( snapshot, &entry ); ret; ret = Thread32Next( snapshot, &entry ))
+    {
+        if (entry.th32OwnerProcessID != GetCurrentProcessId()) continue;
+        if (!(thread = OpenThread( THREAD_QUERY_INFORMATION, FALSE, entry.th32ThreadID ))) continue;
+        if (!pNtQueryInformationThread( thread, ThreadQuerySetWin32StartAddress, &start, sizeof(start), NULL ) &&
+            (char *)start >= (char *)ntdll && (char *)start < (char *)ntdll + nt->OptionalHeader.SizeOfImage)
+            count++;
+        CloseHandle( thread );
+    }
+    CloseHandle( snapshot );
+    return count;
+}
+
+static void child_parallel_load(void)
+{
+    static const char * const dlls[] =
+    {
+        "shell32.dll", "ole32.dll", "oleaut32.dll", "comctl32.dll", "setupapi.dll", "wininet.dll", "crypt32.dll",
+    };
+    HMODULE modules[ARRAY_SIZE(dlls)];
+    char value[8] = "";
+    unsigned int i;
+
+    GetEnvironmentVariableA( "WINEPARALLELLOAD", value, sizeof(value) );
+    for (i = 0; i < ARRAY_SIZE(dlls); i++)
+    {
+        modules[i] = LoadLibraryA( dlls[i] );
+        ok( modules[i] != NULL, "failed to load %s, error %u\n", dlls[i], GetLastError() );
+    }
+
+    /* the loader workers are only started to preload imports that aren't loaded yet */
+    if (!strcmp( winetest_platform, "wine" ) && value[0] == '1')
+        ok( count_ntdll_threads() > 0, "no loader worker was started\n" );
+
+    for (i = 0; i < ARRAY_SIZE(dlls); i++)
+    {
+        if (!modules[i]) continue;
+        check_module_imports( modules[i] );
+        FreeLibrary( modules[i] );
+    }
+}
+
+static void test_parallel_load(void)
+{
+    static const char * const values[] = { "0", "1" };
+    STARTUPINFOA si = { sizeof(si) };
+    PROCESS_INFORMATION pi;
+    char cmdline[MAX_PATH + 32];
+    char **argv;
+    unsigned int i;
+    BOOL ret;
+
+    winetest_get_mainargs( &argv );
+    sprintf( cmdline, "\"%s\" loader parallel_load", argv[0] );
+
+    for (i = 0; i < ARRAY_SIZE(values); i++)
+    {
+        SetEnvironmentVariableA( "WINEPARALLELLOAD", values[i] );
+        ret = CreateProcessA( argv[0], cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi );
+        ok( ret, "CreateProcess(%s) error %u\n", cmdline, GetLastError() );
+        if (!ret) continue;
+        wait_child_process( pi.hProcess );
+        CloseHandle( pi.hThread );
+        CloseHandle( pi.hProcess );
+    }
+    SetEnvironmentVariableA( "WINEPARALLELLOAD", NULL );
+}
+
+/* get the DOS path of the loader snapshot file, in the prefix directory */
+static WCHAR *get_loader_snapshot_path(void)
+{
+    char * (CDECL *pwine_get_unix_file_name)( const WCHAR * );
+    WCHAR * (CDECL *pwine_get_dos_file_name)( const char * );
+    char *unix_name, *path, *p;
+    WCHAR *ret = NULL;
+
+    pwine_get_unix_file_name = (void *)GetProcAddress( GetModuleHandleA( "kernel32.dll" ), "wine_get_unix_file_name" );
+    pwine_get_dos_file_name = (void *)GetProcAddress( GetModuleHandleA( "kernel32.dll" ), "wine_get_dos_file_name" );
+    if (!pwine_get_unix_file_name || !pwine_get_dos_file_name) return NULL;
+
+    if (!(unix_name = pwine_get_unix_file_name( L"C:\\" ))) return NULL;
+    if ((p = strstr( unix_name, "/dosdevices/" )))
+    {
+        path = HeapAlloc( GetProcessHeap(), 0, (p - unix_name) + sizeof("/loader-snapshot") );
+        memcpy( path, unix_name, p - unix_name );
+        strcpy( path + (p - unix_name), "/loader-snapshot" );
+        ret = pwine_get_dos_file_name( path );
+        HeapFree( GetProcessHeap(), 0, path );
+    }
+    HeapFree( GetProcessHeap(), 0, unix_name );
+    return ret;
+}
+
+/* return the number of records in the snapshot file, or -1 if it doesn't exist */
+static int get_loader_snapshot_count( const WCHAR *path )
+{
+    unsigned int header[3];  /* magic, version, count */
+    DWORD size;
+    HANDLE file;
+    BOOL ret;
+
+    file = CreateFileW( path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, 0 );
+    if (file == INVALID_HANDLE_VALUE) return -1;
+    ret = ReadFile( file, header, sizeof(header), &size, NULL );
+    CloseHandle( file );
+    ok( ret && size == sizeof(header), "failed to read the snapshot header, error %u\n", GetLastError() );
+    if (!ret || size != sizeof(header)) return -1;
+    ok( header[0] == 0x70616e73, "got magic %#x\n", header[0] );
+    return header[2];
+}
+
+static void run_loader_snapshot_child( const char *cmdline )
+{
+    STARTUPINFOA si = { sizeof(si) };
+    PROCESS_INFORMATION pi;
+    char **argv;
+    BOOL ret;
+
+    winetest_get_mainargs( &argv );
+    ret = CreateProcessA( argv[0], (char *)cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi );
+    ok( ret, "CreateProcess(%s) error %u\n", cmdline, GetLastError() );
+    if (!ret) return;
+    wait_child_process( pi.hProcess );
+    CloseHandle( pi.hThread );
+    CloseHandle( pi.hProcess );
+}
+
+static void test_loader_snapshot(void)
+{
+    char cmdline[MAX_PATH + 32];
+    int count, count2;
+    WCHAR *path;
+    char **argv;
+    HKEY key;
+    LONG res;
+
+    if (strcmp( winetest_platform, "wine" ))
+    {
+        skip( "the loader snapshot is specific to Wine\n" );
+        return;
+    }
+    if (!(path = get_loader_snapshot_path()))
+    {
+        skip( "can't find the prefix directory\n" );
+        return;
+    }
+    if (get_loader_snapshot_count( path ) != -1)
+    {
+        skip( "a loader snapshot is already in use\n" );
+        HeapFree( GetProcessHeap(), 0, path );
+        return;
+    }
+
+    winetest_get_mainargs( &argv );
+    sprintf( cmdline, "\"%s\" loader parallel_load", argv[0] );
+    SetEnvironmentVariableA( "WINELOADERSNAPSHOT", "1" );
+
+    /* the first child records the lookups */
+    run_loader_snapshot_child( cmdline );
+    count = get_loader_snapshot_count( path );
+    ok( count > 0, "got %d records\n", count );
+
+    /* the second one finds them all, so it has nothing to add */
+    run_loader_snapshot_child( cmdline );
+    count2 = get_loader_snapshot_count( path );
+    ok( count2 == count, "got %d records, expected %d\n", count2, count );
+
+    /* the load order records depend on the overrides, a change makes the child look them up again */
+    res = RegCreateKeyExA( HKEY_CURRENT_USER, "Software\\Wine\\DllOverrides", 0, NULL, 0,
+                           KEY_ALL_ACCESS, NULL, &key, NULL );
+    ok( !res, "RegCreateKeyEx failed %d\n", res );
+    if (!res)
+    {
+        res = RegSetValueExA( key, "winetestnone", 0, REG_SZ, (const BYTE *)"native", sizeof("native") );
+        ok( !res, "RegSetValueEx failed %d\n", res );
+        run_loader_snapshot_child( cmdline );
+        count2 = get_loader_snapshot_count( path );
+        ok( count2 > count, "got %d records, expected more than %d\n", count2, count );
+        RegDeleteValueA( key, "winetestnone" );
+        RegCloseKey( key );
+    }
+
+    SetEnvironmentVariableA( "WINELOADERSNAPSHOT", NULL );
+    DeleteFileW( path );
+    HeapFree( GetProcessHeap(), 0, path );
+}
+
 static void test_LoadPackagedLibrary(void)
 {
     HMODULE h;
@@ -4051,6 +4290,7 @@ START_TEST(loader)
     pNtUnmapViewOfSection = (void *)GetProcAddress(ntdll, "NtUnmapViewOfSection");
     pNtTerminateProcess = (void *)GetProcAddress(ntdll, "NtTerminateProcess");
     pNtQueryInformationProcess = (void *)GetProcAddress(ntdll, "NtQueryInformationProcess");
+    pNtQueryInformationThread = (void *)GetProcAddress(ntdll, "NtQueryInformationThread");
     pNtSetInformationProcess = (void *)GetProcAddress(ntdll, "NtSetInformationProcess");
     pLdrShutdownProcess = (void *)GetProcAddress(ntdll, "LdrShutdownProcess");
     pRtlDllShutdownInProgress = (void *)GetProcAddress(ntdll, "RtlDllShutdownInProgress");
@@ -4092,6 +4332,11 @@ START_TEST(loader)
         *child_failures = -1;
 
     argc = winetest_get_mainargs(&argv);
+    if (argc == 3 && !strcmp(argv[2], "parallel_load"))
+    {
+        child_parallel_load();
+        return;
+    }
     if (argc > 4)
     {
         test_dll_phase = atoi(argv[4]);
@@ -4107,6 +4352,8 @@ START_TEST(loader)
     test_ExitProcess();
     test_InMemoryOrderModuleList();
     test_LoadPackagedLibrary();
+    test_parallel_load();
+    test_loader_snapshot();
     test_wow64_redirection();
     test_dll_file( "ntdll.dll" );
     test_dll_file( "kernel32.dll" );
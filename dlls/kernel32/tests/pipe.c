@@ -25,6 +25,7 @@
 #define WIN32_NO_STATUS
 #include "windef.h"
 #include "winbase.h"
+#include "winnls.h"
 #include "winternl.h"
 #include "winioctl.h"
 #include "wine/test.h"
@@ -4184,6 +4185,185 @@ static void test_exit_process_async(void)
     CloseHandle(server);
 }
 
+static void child_process_direct_pipe(void)
+{
+    HANDLE server, server2, client, connecting;
+    OVERLAPPED overlapped, read_overlapped;
+    char buf[64];
+    DWORD size;
+    BOOL ret;
+    int i;
+
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    server = create_overlapped_server(&overlapped);
+    ret = DuplicateHandle(GetCurrentProcess(), server, GetCurrentProcess(), &server2, 0, FALSE, DUPLICATE_SAME_ACCESS);
+    ok(ret, "DuplicateHandle failed: %u\n", GetLastError());
+    connecting = server;
+
+    for (i = 0; i < 3; i++)
+    {
+        client = CreateFileA(PIPENAME, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        ok(client != INVALID_HANDLE_VALUE, "CreateFile failed: %u\n", GetLastError());
+        test_overlapped_result(connecting, &overlapped, 0, FALSE);
+
+        /* both server handles use the socket of the current connection */
+        ret = WriteFile(client, "data", 4, &size, NULL);
+        ok(ret && size == 4, "WriteFile returned %x (%u), size %u\n", ret, GetLastError(), size);
+        ret = PeekNamedPipe(server2, NULL, 0, NULL, &size, NULL);
+        ok(ret && size == 4, "PeekNamedPipe returned %x (%u), avail %u\n", ret, GetLastError(), size);
+        overlapped_read_sync(server, buf, sizeof(buf), 4, FALSE);
+        ok(!memcmp(buf, "data", 4), "got %s\n", debugstr_an(buf, 4));
+
+        overlapped_write_sync(server2, (void *)"back", 4);
+        ret = ReadFile(client, buf, sizeof(buf), &size, NULL);
+        ok(ret && size == 4, "ReadFile returned %x (%u), size %u\n", ret, GetLastError(), size);
+        ok(!memcmp(buf, "back", 4), "got %s\n", debugstr_an(buf, 4));
+
+        /* a pending read completes when the data arrives */
+        overlapped_read_async(server2, buf, sizeof(buf), &read_overlapped);
+        ret = WriteFile(client, "more", 4, &size, NULL);
+        ok(ret && size == 4, "WriteFile returned %x (%u), size %u\n", ret, GetLastError(), size);
+        ok(!WaitForSingleObject(read_overlapped.hEvent, 5000), "read not completed\n");
+        test_overlapped_result(server2, &read_overlapped, 4, FALSE);
+        ok(!memcmp(buf, "more", 4), "got %s\n", debugstr_an(buf, 4));
+
+        if (i == 1)
+        {
+            /* the client goes away first */
+            CloseHandle(client);
+            memset(&read_overlapped, 0, sizeof(read_overlapped));
+            SetLastError(0xdeadbeef);
+            ret = ReadFile(server, buf, sizeof(buf), &size, &read_overlapped);
+            ok(!ret && GetLastError() == ERROR_BROKEN_PIPE, "ReadFile returned %x (%u)\n", ret, GetLastError());
+        }
+
+        ret = DisconnectNamedPipe(connecting);
+        ok(ret, "DisconnectNamedPipe failed: %u\n", GetLastError());
+
+        if (i != 1)
+        {
+            SetLastError(0xdeadbeef);
+            ret = ReadFile(client, buf, sizeof(buf), &size, NULL);
+            ok(!ret && (GetLastError() == ERROR_PIPE_NOT_CONNECTED || GetLastError() == ERROR_BROKEN_PIPE),
+               "ReadFile returned %x (%u)\n", ret, GetLastError());
+            CloseHandle(client);
+        }
+        if (i == 2) break;
+
+        /* reconnect through the other handle */
+        connecting = (connecting == server) ? server2 : server;
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        ret = ConnectNamedPipe(connecting, &overlapped);
+        ok(!ret && GetLastError() == ERROR_IO_PENDING, "ConnectNamedPipe returned %x (%u)\n", ret, GetLastError());
+    }
+
+    CloseHandle(server2);
+    CloseHandle(server);
+}
+
+/* run the direct pipe tests in a child process that uses its own wineserver, started with
+ * WINEDIRECTPIPE set; the child's prefix links to the files of the current one */
+static void test_direct_pipe(void)
+{
+    static const char script_fmt[] =
+        "T='%s'\n"
+        "P='%s'\n"
+        "L='%s'\n"
+        "mkdir \"$T\" || exit 1\n"
+        "for f in \"$P\"/* \"$P\"/.update-timestamp; do test -e \"$f\" && ln -s \"$f\" \"$T\"/; done\n"
+        "WINEPREFIX=\"$T\" WINEDIRECTPIPE=1 \"$L\" '%s' pipe directpipe\n"
+        "echo $? >\"$T.tmp\"\n"
+        "S=${WINESERVER:-$(dirname \"$L\")/wineserver}\n"
+        "test -x \"$S\" || S=$(dirname \"$L\")/../server/wineserver\n"
+        "WINEPREFIX=\"$T\" \"$S\" -w\n"
+        "rm -rf \"$T\"\n"
+        "mv \"$T.tmp\" \"$T.res\"\n";
+    char * (CDECL *pwine_get_unix_file_name)(const WCHAR *);
+    WCHAR * (CDECL *pwine_get_dos_file_name)(const char *);
+    char loader[MAX_PATH], base[MAX_PATH], path[MAX_PATH + 8], script[4 * MAX_PATH + sizeof(script_fmt)];
+    WCHAR temp[MAX_PATH], cmdline[MAX_PATH + 8], *shell, *script_name, *result_name;
+    char *unix_temp, *prefix, *p, **argv;
+    STARTUPINFOW si = { sizeof(si) };
+    PROCESS_INFORMATION pi;
+    DWORD size, i;
+    HANDLE file;
+    BOOL ret;
+
+    if (strcmp(winetest_platform, "wine"))
+    {
+        skip("direct pipes are specific to Wine\n");
+        return;
+    }
+    pwine_get_unix_file_name = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "wine_get_unix_file_name");
+    pwine_get_dos_file_name = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "wine_get_dos_file_name");
+    size = GetEnvironmentVariableA("WINELOADER", loader, sizeof(loader));
+    if (!pwine_get_unix_file_name || !pwine_get_dos_file_name || !size || size >= sizeof(loader))
+    {
+        skip("can't find the Wine loader\n");
+        return;
+    }
+
+    winetest_get_mainargs(&argv);
+    GetTempPathW(ARRAY_SIZE(temp), temp);
+    unix_temp = pwine_get_unix_file_name(temp);
+    prefix = pwine_get_unix_file_name(L"C:\\");
+    p = prefix ? strstr(prefix, "/dosdevices/") : NULL;
+    if (!unix_temp || !p)
+    {
+        skip("can't find the prefix directory\n");
+        HeapFree(GetProcessHeap(), 0, unix_temp);
+        HeapFree(GetProcessHeap(), 0, prefix);
+        return;
+    }
+    *p = 0;
+    if ((p = strrchr(unix_temp, '/')) && !p[1]) *p = 0;
+    sprintf(base, "%s/winetest_directpipe_%x", unix_temp, GetCurrentProcessId());
+    sprintf(script, script_fmt, base, prefix, loader, argv[0]);
+    HeapFree(GetProcessHeap(), 0, unix_temp);
+    HeapFree(GetProcessHeap(), 0, prefix);
+
+    sprintf(path, "%s.sh", base);
+    script_name = pwine_get_dos_file_name(path);
+    file = CreateFileW(script_name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "CreateFile failed: %u\n", GetLastError());
+    ret = WriteFile(file, script, strlen(script), &size, NULL);
+    ok(ret, "WriteFile failed: %u\n", GetLastError());
+    CloseHandle(file);
+
+    /* the shell is a Unix binary, so there's no process handle to wait for */
+    shell = pwine_get_dos_file_name("/bin/sh");
+    lstrcpyW(cmdline, L"sh \"");
+    MultiByteToWideChar(CP_ACP, 0, path, -1, cmdline + 4, MAX_PATH);
+    lstrcatW(cmdline, L"\"");
+    ret = CreateProcessW(shell, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi);
+    ok(ret, "CreateProcess failed: %u\n", GetLastError());
+
+    sprintf(path, "%s.res", base);
+    result_name = pwine_get_dos_file_name(path);
+    for (i = 0; ret && i < 600; i++)
+    {
+        if (GetFileAttributesW(result_name) != INVALID_FILE_ATTRIBUTES) break;
+        Sleep(100);
+    }
+    file = CreateFileW(result_name, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "the child didn't complete\n");
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        memset(script, 0, sizeof(script));
+        ReadFile(file, script, sizeof(script) - 1, &size, NULL);
+        CloseHandle(file);
+        ok(!atoi(script), "the child failed with %s", script);
+    }
+
+    DeleteFileW(result_name);
+    DeleteFileW(script_name);
+    HeapFree(GetProcessHeap(), 0, result_name);
+    HeapFree(GetProcessHeap(), 0, script_name);
+    HeapFree(GetProcessHeap(), 0, shell);
+}
+
 START_TEST(pipe)
 {
     char **argv;
@@ -4202,6 +4382,11 @@ START_TEST(pipe)
 
     argc = winetest_get_mainargs(&argv);
 
+    if (argc > 2 && !strcmp(argv[2], "directpipe"))
+    {
+        child_process_direct_pipe();
+        return;
+    }
     if (argc > 3)
     {
         if (!strcmp(argv[2], "writepipe"))
@@ -4264,4 +4449,5 @@ START_TEST(pipe)
     test_nowait(PIPE_TYPE_MESSAGE);
     test_GetOverlappedResultEx();
     test_exit_process_async();
+    test_direct_pipe();
 }
@@ -679,6 +679,59 @@ static void CALLBACK iocp_callback(DWORD dwErrorCode, DWORD dwNumberOfBytesTrans
 
 static BOOL (WINAPI *p_BindIoCompletionCallback)( HANDLE FileHandle, LPOVERLAPPED_COMPLETION_ROUTINE Function, ULONG Flags) = NULL;
 
+static unsigned int timer_apc_order[4], timer_apc_count;
+
+static void CALLBACK timer_order_apc(void *arg, DWORD low, DWORD high)
+{
+    if (timer_apc_count < ARRAY_SIZE(timer_apc_order))
+        timer_apc_order[timer_apc_count] = (ULONG_PTR)arg;
+    timer_apc_count++;
+}
+
+/* timers which expire at the same time fire in the order they were set */
+static void test_waitable_timer_order(void)
+{
+    HANDLE timers[ARRAY_SIZE(timer_apc_order)];
+    LARGE_INTEGER due;
+    FILETIME ft;
+    DWORD ret, start;
+    unsigned int i;
+    BOOL res;
+
+    GetSystemTimeAsFileTime(&ft);
+    due.u.LowPart = ft.dwLowDateTime;
+    due.u.HighPart = ft.dwHighDateTime;
+    due.QuadPart += 100 * 10000;
+
+    timer_apc_count = 0;
+    for (i = 0; i < ARRAY_SIZE(timers); i++)
+    {
+        timers[i] = CreateWaitableTimerA(NULL, TRUE, NULL);
+        ok(timers[i] != NULL, "CreateWaitableTimer failed with error %u\n", GetLastError());
+        res = SetWaitableTimer(timers[i], &due, 0, timer_order_apc, (void *)(ULONG_PTR)i, FALSE);
+        ok(res, "SetWaitableTimer failed with error %u\n", GetLastError());
+    }
+
+    /* setting a timer again moves it after the others */
+    res = SetWaitableTimer(timers[1], &due, 0, timer_order_apc, (void *)(ULONG_PTR)1, FALSE);
+    ok(res, "SetWaitableTimer failed with error %u\n", GetLastError());
+
+    start = GetTickCount();
+    while (timer_apc_count < ARRAY_SIZE(timers) && GetTickCount() - start < 5000)
+        SleepEx(1000, TRUE);
+
+    ok(timer_apc_count == ARRAY_SIZE(timers), "got %u APCs\n", timer_apc_count);
+    ok(timer_apc_order[0] == 0 && timer_apc_order[1] == 2 && timer_apc_order[2] == 3 && timer_apc_order[3] == 1,
+       "got order %u %u %u %u\n", timer_apc_order[0], timer_apc_order[1], timer_apc_order[2], timer_apc_order[3]);
+
+    for (i = 0; i < ARRAY_SIZE(timers); i++)
+    {
+        ret = WaitForSingleObject(timers[i], 0);
+        ok(ret == WAIT_OBJECT_0, "timer %u: WaitForSingleObject returned %u\n", i, ret);
+        CloseHandle(timers[i]);
+    }
+}
+
 static void test_iocp_callback(void)
 {
     char temp_path[MAX_PATH];
@@ -2778,6 +2831,195 @@ static void test_QueueUserAPC(void)
     ok(apc_count == 1, "APC count %u\n", apc_count);
 }
 
+static LONG fsync_inside, fsync_count;
+
+static DWORD WINAPI fsync_owner_thread(LPVOID arg)
+{
+    HANDLE *mutexes = arg;
+    DWORD result;
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        result = WaitForSingleObject(mutexes[i], 0);
+        ok(result == WAIT_OBJECT_0, "%d: got %u\n", i, result);
+    }
+    /* one of them taken by a server-side wait */
+    result = WaitForMultipleObjects(2, mutexes + 3, TRUE, 0);
+    ok(result == WAIT_OBJECT_0, "got %u\n", result);
+    /* exit without releasing them */
+    return 0;
+}
+
+static DWORD WINAPI fsync_race_thread(LPVOID arg)
+{
+    HANDLE *objs = arg;
+    DWORD result;
+    int i;
+
+    for (i = 0; i < 500; i++)
+    {
+        /* alternate between client-side waits and server-side wait-all */
+        if (i % 2) result = WaitForSingleObject(objs[0], 1000);
+        else result = WaitForMultipleObjects(2, objs, TRUE, 1000);
+        ok(result == WAIT_OBJECT_0, "got %u\n", result);
+        ok(InterlockedIncrement(&fsync_inside) == 1, "mutex not exclusive\n");
+        fsync_count++;
+        InterlockedDecrement(&fsync_inside);
+        ReleaseMutex(objs[0]);
+    }
+    return 0;
+}
+
+static DWORD WINAPI fsync_semaphore_thread(LPVOID arg)
+{
+    HANDLE sem = arg;
+    DWORD result;
+    int i;
+
+    for (i = 0; i < 500; i++)
+    {
+        result = WaitForSingleObject(sem, 1000);
+        ok(result == WAIT_OBJECT_0, "got %u\n", result);
+        InterlockedIncrement(&fsync_count);
+    }
+    return 0;
+}
+
+/* run in a child started with WINEFSYNC=1, the objects then live in shared memory when the server supports it */
+static void test_fsync_objects(void)
+{
+    HANDLE event, sem, mutex, objs[3], race_objs[2], mutexes[5], threads[4];
+    DWORD result;
+    LONG prev;
+    BOOL ret;
+    int i;
+
+    event = CreateEventA(NULL, FALSE, TRUE, NULL);
+    result = WaitForSingleObject(event, 0);
+    ok(result == WAIT_OBJECT_0, "got %u\n", result);
+    result = WaitForSingleObject(event, 0);
+    ok(result == WAIT_TIMEOUT, "got %u\n", result);
+    SetEvent(event);
+    SetEvent(event);
+    result = WaitForSingleObject(event, 0);
+    ok(result == WAIT_OBJECT_0, "got %u\n", result);
+    result = WaitForSingleObject(event, 0);
+    ok(result == WAIT_TIMEOUT, "got %u\n", result);
+    CloseHandle(event);
+
+    event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    SetEvent(event);
+    result = WaitForSingleObject(event, 0);
+    ok(result == WAIT_OBJECT_0, "got %u\n", result);
+    result = WaitForSingleObject(event, 0);
+    ok(result == WAIT_OBJECT_0, "got %u\n", result);
+    ResetEvent(event);
+    result = WaitForSingleObject(event, 0);
+    ok(result == WAIT_TIMEOUT, "got %u\n", result);
+
+    sem = CreateSemaphoreA(NULL, 1, 2, NULL);
+    ret = ReleaseSemaphore(sem, 1, &prev);
+    ok(ret, "ReleaseSemaphore failed %u\n", GetLastError());
+    ok(prev == 1, "got %d\n", prev);
+    SetLastError(0xdeadbeef);
+    ret = ReleaseSemaphore(sem, 1, &prev);
+    ok(!ret && GetLastError() == ERROR_TOO_MANY_POSTS, "got %d, error %u\n", ret, GetLastError());
+    result = WaitForSingleObject(sem, 0);
+    ok(result == WAIT_OBJECT_0, "got %u\n", result);
+    result = WaitForSingleObject(sem, 0);
+    ok(result == WAIT_OBJECT_0, "got %u\n", result);
+    result = WaitForSingleObject(sem, 0);
+    ok(result == WAIT_TIMEOUT, "got %u\n", result);
+
+    mutex = CreateMutexA(NULL, TRUE, NULL);
+    result = WaitForSingleObject(mutex, 0);
+    ok(result == WAIT_OBJECT_0, "got %u\n", result);
+    ok(ReleaseMutex(mutex), "ReleaseMutex failed %u\n", GetLastError());
+    ok(ReleaseMutex(mutex), "ReleaseMutex failed %u\n", GetLastError());
+    SetLastError(0xdeadbeef);
+    ret = ReleaseMutex(mutex);
+    ok(!ret && GetLastError() == ERROR_NOT_OWNER, "got %d, error %u\n", ret, GetLastError());
+
+    /* wait-all takes nothing until everything is available */
+    objs[0] = event;
+    objs[1] = sem;
+    objs[2] = mutex;
+    SetEvent(event);
+    result = WaitForMultipleObjects(3, objs, TRUE, 0);
+    ok(result == WAIT_TIMEOUT, "got %u\n", result);
+    result = WaitForSingleObject(mutex, 0);
+    ok(result == WAIT_OBJECT_0, "got %u\n", result);
+    ok(ReleaseMutex(mutex), "ReleaseMutex failed %u\n", GetLastError());
+    ReleaseSemaphore(sem, 1, NULL);
+    result = WaitForMultipleObjects(3, objs, TRUE, 0);
+    ok(result == WAIT_OBJECT_0, "got %u\n", result);
+    result = WaitForSingleObject(sem, 0);
+    ok(result == WAIT_TIMEOUT, "got %u\n", result);
+    ok(ReleaseMutex(mutex), "ReleaseMutex failed %u\n", GetLastError());
+    CloseHandle(event);
+
+    /* mutexes held by a thread are abandoned when it exits, whichever way they were taken */
+    for (i = 0; i < 5; i++) mutexes[i] = CreateMutexA(NULL, FALSE, NULL);
+    threads[0] = CreateThread(NULL, 0, fsync_owner_thread, mutexes, 0, NULL);
+    result = WaitForSingleObject(threads[0], 5000);
+    ok(result == WAIT_OBJECT_0, "got %u\n", result);
+    CloseHandle(threads[0]);
+    for (i = 0; i < 5; i++)
+    {
+        result = WaitForSingleObject(mutexes[i], 0);
+        ok(result == WAIT_ABANDONED_0, "%d: got %u\n", i, result);
+        result = WaitForSingleObject(mutexes[i], 0);
+        ok(result == WAIT_OBJECT_0, "%d: got %u\n", i, result);
+        ok(ReleaseMutex(mutexes[i]), "ReleaseMutex failed %u\n", GetLastError());
+        ok(ReleaseMutex(mutexes[i]), "ReleaseMutex failed %u\n", GetLastError());
+        CloseHandle(mutexes[i]);
+    }
+
+    /* threads taking the mutex on the client side race with those taking it in the server */
+    race_objs[0] = mutex;
+    race_objs[1] = CreateEventA(NULL, TRUE, TRUE, NULL);
+    fsync_count = 0;
+    for (i = 0; i < 4; i++) threads[i] = CreateThread(NULL, 0, fsync_race_thread, race_objs, 0, NULL);
+    result = WaitForMultipleObjects(4, threads, TRUE, 30000);
+    ok(result == WAIT_OBJECT_0, "got %u\n", result);
+    ok(fsync_count == 2000, "got %d\n", fsync_count);
+    for (i = 0; i < 4; i++) CloseHandle(threads[i]);
+    CloseHandle(race_objs[1]);
+    CloseHandle(mutex);
+
+    /* semaphore counts are neither lost nor duplicated */
+    fsync_count = 0;
+    for (i = 0; i < 4; i++) threads[i] = CreateThread(NULL, 0, fsync_semaphore_thread, sem, 0, NULL);
+    for (i = 0; i < 1000; i++) while (!ReleaseSemaphore(sem, 2, NULL)) Sleep(0);
+    result = WaitForMultipleObjects(4, threads, TRUE, 30000);
+    ok(result == WAIT_OBJECT_0, "got %u\n", result);
+    ok(fsync_count == 2000, "got %d\n", fsync_count);
+    result = WaitForSingleObject(sem, 0);
+    ok(result == WAIT_TIMEOUT, "got %u\n", result);
+    for (i = 0; i < 4; i++) CloseHandle(threads[i]);
+    CloseHandle(sem);
+}
+
+static void test_fsync(void)
+{
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = { sizeof(si) };
+    char cmdline[MAX_PATH];
+    char **argv;
+    DWORD ret;
+
+    winetest_get_mainargs(&argv);
+    sprintf(cmdline, "\"%s\" sync fsync", argv[0]);
+    SetEnvironmentVariableA("WINEFSYNC", "1");
+    ret = CreateProcessA(argv[0], cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi);
+    SetEnvironmentVariableA("WINEFSYNC", NULL);
+    ok(ret, "CreateProcess failed with %u\n", GetLastError());
+    wait_child_process(pi.hProcess);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+}
+
 START_TEST(sync)
 {
     char **argv;
@@ -2818,6 +3060,7 @@ START_TEST(sync)
         {
             for (;;) SleepEx(INFINITE, TRUE);
         }
+        if (!strcmp(argv[2], "fsync")) test_fsync_objects();
         return;
     }
 
@@ -2830,6 +3073,7 @@ START_TEST(sync)
     test_event();
     test_semaphore();
     test_waitable_timer();
+    test_waitable_timer_order();
     test_iocp_callback();
     test_timer_queue();
     test_WaitForSingleObject();
@@ -2844,4 +3088,5 @@ START_TEST(sync)
     test_alertable_wait();
     test_apc_deadlock();
     test_crit_section();
+    test_fsync();
 }
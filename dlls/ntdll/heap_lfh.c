@@ -79,17 +79,27 @@ typedef struct LFH_slist LFH_slist;
 #define TOTAL_BLOCK_CLASS_COUNT (MEDIUM_CLASS_LAST + 1)
 #define TOTAL_LARGE_CLASS_COUNT (LARGE_CLASS_LAST + 1)
 
+#define MAGAZINE_SIZE     32 /* max number of free blocks cached per small class */
+#define MAGAZINE_MAX_SIZE 0x10000 /* max total size of the free blocks cached by a thread */
+#define REMOTE_BATCH_SIZE 32 /* number of blocks freed for another thread before returning them */
+#define REMOTE_BATCH_MAX_SIZE 0x4000 /* max total size of the blocks held for another thread */
+
 struct LFH_slist
 {
     LFH_slist *next;
 };
 
-static inline void LFH_slist_push(LFH_slist **list, LFH_slist *entry)
+static inline void LFH_slist_push_chain(LFH_slist **list, LFH_slist *first, LFH_slist *last)
 {
     /* There will be no ABA issue here, other threads can only replace
      * list->next with a different entry, or NULL. */
-    entry->next = __atomic_load_n(list, __ATOMIC_RELAXED);
-    while (!__atomic_compare_exchange_n(list, &entry->next, entry, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+    last->next = __atomic_load_n(list, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(list, &last->next, first, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+}
+
+static inline void LFH_slist_push(LFH_slist **list, LFH_slist *entry)
+{
+    LFH_slist_push_chain(list, entry, entry);
 }
 
 static inline LFH_slist *LFH_slist_flush(LFH_slist **list)
@@ -159,10 +169,22 @@ struct LFH_heap
     LFH_class large_class[TOTAL_LARGE_CLASS_COUNT];
 
     SLIST_ENTRY entry_orphan;
+
+    /* free small blocks cached by the owner thread, still counted as used in their arena */
+    LFH_slist *magazine[SMALL_CLASS_COUNT];
+    unsigned short magazine_count[SMALL_CLASS_COUNT];
+    size_t magazine_size;
+
+    /* blocks of another heap freed by the owner thread, returned to it in a single push */
+    LFH_heap *remote_heap;
+    LFH_slist *remote_first;
+    LFH_slist *remote_last;
+    size_t remote_count;
+    size_t remote_size;
 #ifdef _WIN64
-    void *pad[0xc2];
+    void *pad[0x6c];
 #else
-    void *pad[0xc3];
+    void *pad[0x5d];
 #endif
 };
 
@@ -532,6 +554,104 @@ static inline BOOLEAN LFH_deallocate_block(LFH_heap *heap, LFH_arena *arena, LFH
     return LFH_release_arena(heap, arena);
 }
 
+static inline BOOLEAN LFH_class_has_magazine(LFH_heap *heap, LFH_class *class)
+{
+    return class >= heap->block_class + SMALL_CLASS_FIRST && class <= heap->block_class + SMALL_CLASS_LAST;
+}
+
+static inline LFH_block *LFH_magazine_pop(LFH_heap *heap, LFH_class *class)
+{
+    size_t index = class - heap->block_class - SMALL_CLASS_FIRST;
+    LFH_slist *entry = heap->magazine[index];
+
+    if (!entry) return NULL;
+    heap->magazine[index] = entry->next;
+    heap->magazine_count[index]--;
+    heap->magazine_size -= class->size;
+    return LIST_ENTRY(entry, LFH_block, entry_defer);
+}
+
+/* return all but the most recently freed blocks of a magazine to their arenas */
+static BOOLEAN LFH_magazine_trim(LFH_heap *heap, size_t index, size_t keep)
+{
+    LFH_slist *entry, **next = &heap->magazine[index];
+    BOOLEAN ret = TRUE;
+    size_t count;
+
+    for (count = 0; count < keep && *next; count++) next = &(*next)->next;
+    entry = *next;
+    *next = NULL;
+    heap->magazine_count[index] = count;
+
+    while (entry)
+    {
+        LFH_block *block = LIST_ENTRY(entry, LFH_block, entry_defer);
+        entry = entry->next;
+
+        heap->magazine_size -= LFH_block_get_class_size(block);
+
+        if (!LFH_deallocate_block(heap, LFH_arena_from_block(block), block))
+            ret = FALSE;
+    }
+
+    return ret;
+}
+
+static inline BOOLEAN LFH_magazine_push(LFH_heap *heap, LFH_class *class, LFH_block *block)
+{
+    size_t index = class - heap->block_class - SMALL_CLASS_FIRST;
+
+    if (heap->magazine_count[index] >= MAGAZINE_SIZE && !LFH_magazine_trim(heap, index, MAGAZINE_SIZE / 2))
+        return FALSE;
+
+    /* the other classes hold the whole budget, don't cache the block */
+    if (heap->magazine_size + class->size > MAGAZINE_MAX_SIZE)
+        return LFH_deallocate_block(heap, LFH_arena_from_block(block), block);
+
+    block->entry_defer.next = heap->magazine[index];
+    heap->magazine[index] = &block->entry_defer;
+    heap->magazine_count[index]++;
+    heap->magazine_size += class->size;
+    return TRUE;
+}
+
+static void LFH_flush_magazines(LFH_heap *heap)
+{
+    size_t i;
+
+    for (i = 0; i < SMALL_CLASS_COUNT; ++i)
+        if (heap->magazine[i]) LFH_magazine_trim(heap, i, 0);
+}
+
+static inline void LFH_flush_remote_blocks(LFH_heap *heap)
+{
+    if (!heap->remote_count) return;
+
+    LFH_slist_push_chain(&heap->remote_heap->list_defer, heap->remote_first, heap->remote_last);
+    heap->remote_heap = NULL;
+    heap->remote_first = NULL;
+    heap->remote_last = NULL;
+    heap->remote_count = 0;
+    heap->remote_size = 0;
+}
+
+/* queue a block owned by another heap, so that several blocks are returned at once */
+static inline void LFH_free_remote_block(LFH_heap *heap, LFH_heap *owner, LFH_block *block)
+{
+    if (heap->remote_heap != owner)
+    {
+        LFH_flush_remote_blocks(heap);
+        heap->remote_heap = owner;
+        heap->remote_last = &block->entry_defer;
+    }
+
+    block->entry_defer.next = heap->remote_first;
+    heap->remote_first = &block->entry_defer;
+    heap->remote_size += LFH_block_get_class_size(block);
+    if (++heap->remote_count >= REMOTE_BATCH_SIZE || heap->remote_size >= REMOTE_BATCH_MAX_SIZE)
+        LFH_flush_remote_blocks(heap);
+}
+
 static void LFH_heap_initialize(LFH_heap *heap)
 {
     size_t i;
@@ -543,6 +663,19 @@ static void LFH_heap_initialize(LFH_heap *heap)
 
     heap->list_defer = NULL;
     heap->cached_large_arena = NULL;
+
+    for (i = 0; i < SMALL_CLASS_COUNT; ++i)
+    {
+        heap->magazine[i] = NULL;
+        heap->magazine_count[i] = 0;
+    }
+    heap->magazine_size = 0;
+
+    heap->remote_heap = NULL;
+    heap->remote_first = NULL;
+    heap->remote_last = NULL;
+    heap->remote_count = 0;
+    heap->remote_size = 0;
 }
 
 static SLIST_HEADER *LFH_orphan_list(void)
@@ -578,6 +711,7 @@ static void LFH_heap_finalize(LFH_heap *heap)
     LFH_arena *arena;
 
     LFH_deallocate_deferred_blocks(heap);
+    LFH_flush_magazines(heap);
 
     for (size_t i = 0; i < TOTAL_BLOCK_CLASS_COUNT; ++i)
     {
@@ -853,6 +987,26 @@ static BOOLEAN LFH_validate_heap_defer_blocks(ULONG flags, const LFH_heap *heap)
     return TRUE;
 }
 
+static BOOLEAN LFH_validate_heap_magazines(ULONG flags, const LFH_heap *heap)
+{
+    size_t i;
+
+    for (i = 0; i < SMALL_CLASS_COUNT; ++i)
+    {
+        const LFH_slist *entry = heap->magazine[i];
+
+        while (entry)
+        {
+            const LFH_block *block = LIST_ENTRY(entry, LFH_block, entry_defer);
+            if (!LFH_validate_free_block(flags, block))
+                return FALSE;
+            entry = entry->next;
+        }
+    }
+
+    return TRUE;
+}
+
 static BOOLEAN LFH_validate_heap(ULONG flags, const LFH_heap *heap)
 {
     const char *err = NULL;
@@ -864,6 +1018,8 @@ static BOOLEAN LFH_validate_heap(ULONG flags, const LFH_heap *heap)
         err = "unable to validate foreign heap";
     else if (!LFH_validate_heap_defer_blocks(flags, heap))
         err = "invalid heap defer blocks";
+    else if (!LFH_validate_heap_magazines(flags, heap))
+        err = "invalid heap magazine blocks";
     else
     {
         for (i = 0; err == NULL && i < TOTAL_BLOCK_CLASS_COUNT; ++i)
@@ -917,8 +1073,11 @@ static FORCEINLINE LFH_ptr *LFH_allocate(ULONG flags, size_t size)
 
     if ((class = LFH_heap_get_class(heap, class_size)))
     {
-        arena = LFH_acquire_arena(heap, class);
-        if (arena) block = LFH_allocate_block(heap, class, arena);
+        if (!LFH_class_has_magazine(heap, class) || !(block = LFH_magazine_pop(heap, class)))
+        {
+            arena = LFH_acquire_arena(heap, class);
+            if (arena) block = LFH_allocate_block(heap, class, arena);
+        }
         if (block) LFH_block_initialize(block, flags, 0, size, LFH_block_get_class_size(block));
     }
     else
@@ -938,9 +1097,10 @@ static FORCEINLINE BOOLEAN LFH_free(ULONG flags, LFH_ptr *ptr)
 {
     LFH_block *block = LFH_block_from_ptr(ptr);
     LFH_arena *arena = LFH_arena_from_block(block);
-    LFH_heap *heap = LFH_heap_from_arena(arena);
+    LFH_heap *heap = LFH_heap_from_arena(arena), *thread_heap;
+    LFH_class *class = LFH_class_from_arena(arena);
 
-    if (!LFH_class_from_arena(arena))
+    if (!class)
         return LFH_memory_deallocate(arena, LFH_block_get_class_size(block));
 
     if (flags & HEAP_FREE_CHECKING_ENABLED)
@@ -953,8 +1113,16 @@ static FORCEINLINE BOOLEAN LFH_free(ULONG flags, LFH_ptr *ptr)
 
     block->type = LFH_block_type_free;
 
-    if (heap == LFH_thread_heap(FALSE) && !(flags & HEAP_FREE_CHECKING_ENABLED))
-        LFH_deallocate_block(heap, LFH_arena_from_block(block), block);
+    if (flags & HEAP_FREE_CHECKING_ENABLED)
+        LFH_slist_push(&heap->list_defer, &block->entry_defer);
+    else if (heap == (thread_heap = LFH_thread_heap(FALSE)))
+    {
+        if (LFH_class_has_magazine(heap, class))
+            return LFH_magazine_push(heap, class, block);
+        LFH_deallocate_block(heap, arena, block);
+    }
+    else if (thread_heap)
+        LFH_free_remote_block(thread_heap, heap, block);
     else
         LFH_slist_push(&heap->list_defer, &block->entry_defer);
 
@@ -1116,6 +1284,12 @@ void HEAP_lfh_notify_thread_destroy(BOOLEAN last)
     SLIST_ENTRY *entry_orphan = NULL;
     LFH_heap *heap;
 
+    if ((heap = LFH_thread_heap(FALSE)))
+    {
+        LFH_flush_remote_blocks(heap);
+        LFH_flush_magazines(heap);
+    }
+
     if (last)
     {
         while ((entry_orphan || (entry_orphan = RtlInterlockedFlushSList(list_orphan))))
@@ -1135,6 +1309,8 @@ void HEAP_lfh_set_debug_flags(ULONG flags)
     LFH_heap *heap = LFH_thread_heap(FALSE);
     if (!heap) return;
 
+    LFH_flush_remote_blocks(heap);
+    LFH_flush_magazines(heap);
     LFH_deallocate_deferred_blocks(heap);
     LFH_deallocated_cached_arenas(heap);
 }
@@ -128,6 +128,12 @@ struct file_id
     BYTE ObjectId[16];
 };
 
+struct export_hash_entry
+{
+    DWORD hash;   /* hash of the export name */
+    DWORD index;  /* index in the export names table, plus one */
+};
+
 /* internal representation of loaded modules */
 typedef struct _wine_modref
 {
@@ -136,8 +142,14 @@ typedef struct _wine_modref
     int                   alloc_deps;
     int                   nDeps;
     struct _wine_modref **deps;
+    struct export_hash_entry *export_hash;  /* hash index of the export names, built on first use */
+    DWORD                 export_hash_mask;
+    FARPROC              *forwards;         /* resolved forwarded exports, indexed by ordinal */
 } WINE_MODREF;
 
+/* modules with fewer named exports than this are searched without a hash index */
+#define EXPORT_HASH_MIN_NAMES 16
+
 static UINT tls_module_count;      /* number of modules with TLS directory */
 static IMAGE_TLS_DIRECTORY *tls_dirs;  /* array of TLS directories */
 LIST_ENTRY tls_links = { &tls_links, &tls_links };
@@ -184,8 +196,53 @@ static WINE_MODREF *cached_modref;
 static WINE_MODREF *current_modref;
 static WINE_MODREF *last_failed_modref;
 
+/* dll mapped ahead of time by a loader worker thread */
+struct preload_entry
+{
+    struct list               entry;        /* entry in preload_list */
+    struct list               queue_entry;  /* entry in preload_queue while waiting for a worker */
+    const WCHAR              *name;         /* dll file name */
+    const WCHAR              *paths;        /* search path */
+    UNICODE_STRING            nt_name;      /* file found by the worker */
+    HANDLE                    mapping;      /* image section, owned by the loading thread once claimed */
+    SECTION_IMAGE_INFORMATION image_info;
+    struct file_id            id;
+    void                     *module;       /* view mapped by the worker */
+    BOOL                      relocated;    /* view has been relocated by the worker */
+    NTSTATUS                  status;
+    BOOL                      queued;       /* still waiting for a worker */
+    BOOL                      done;         /* worker is done with it */
+    BOOL                      claimed;      /* mapping has been handed to load_dll */
+};
+
+/* The loader workers are started on first use and then kept for the lifetime of the process.
+ * They skip the thread initialization and never exit, so they get no DLL thread attach or
+ * detach notifications, no TLS slots and no FLS callbacks; they only map and relocate files. */
+#define PRELOAD_MAX_WORKERS 4
+
+static unsigned int preload_workers;    /* number of loader workers to use, 0 if disabled */
+static unsigned int preload_threads;    /* number of loader workers started */
+static int preload_depth;               /* recursion depth of fixup_imports sharing the preload list */
+static struct list preload_list = LIST_INIT( preload_list );    /* protected by loader_section */
+static struct list preload_queue = LIST_INIT( preload_queue );  /* protected by preload_section */
+static RTL_CONDITION_VARIABLE preload_queued = RTL_CONDITION_VARIABLE_INIT;
+static RTL_CONDITION_VARIABLE preload_done = RTL_CONDITION_VARIABLE_INIT;
+
+static RTL_CRITICAL_SECTION preload_section;
+static RTL_CRITICAL_SECTION_DEBUG preload_critsect_debug =
+{
+    0, 0, &preload_section,
+    { &preload_critsect_debug.ProcessLocksList, &preload_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": preload_section") }
+};
+static RTL_CRITICAL_SECTION preload_section = { &preload_critsect_debug, -1, 0, 0, 0, 0 };
+
 static NTSTATUS load_dll( const WCHAR *load_path, const WCHAR *libname, const WCHAR *default_ext,
                           DWORD flags, WINE_MODREF** pwm );
+static void preload_imports( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *imports, int count,
+                             LPCWSTR load_path );
+static void finish_preload(void);
+static NTSTATUS find_actctx_dll( LPCWSTR libname, LPWSTR *fullname );
 static NTSTATUS process_attach( WINE_MODREF *wm, LPVOID lpReserved );
 static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
                                     DWORD exp_size, DWORD ordinal, LPCWSTR load_path );
@@ -710,7 +767,22 @@ static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY
     /* if the address falls into the export dir, it's a forward */
     if (((const char *)proc >= (const char *)exports) && 
         ((const char *)proc < (const char *)exports + exp_size))
-        return find_forwarded_export( module, (const char *)proc, load_path );
+    {
+        WINE_MODREF *wm;
+
+        /* relay and snoop thunks depend on the importing module, don't cache them */
+        if (TRACE_ON(relay) || TRACE_ON(snoop) || !(wm = get_modref( module )))
+            return find_forwarded_export( module, (const char *)proc, load_path );
+
+        if (wm->forwards && wm->forwards[ordinal]) return wm->forwards[ordinal];
+        if ((proc = find_forwarded_export( module, (const char *)proc, load_path )))
+        {
+            if (!wm->forwards) wm->forwards = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                                               exports->NumberOfFunctions * sizeof(*wm->forwards) );
+            if (wm->forwards) wm->forwards[ordinal] = proc;
+        }
+        return proc;
+    }
 
     if (TRACE_ON(snoop))
     {
@@ -749,6 +821,71 @@ static int find_name_in_exports( HMODULE module, const IMAGE_EXPORT_DIRECTORY *e
 }
 
 
+/*************************************************************************
+ *		hash_export_name
+ */
+static DWORD hash_export_name( const char *name )
+{
+    DWORD hash = 0x811c9dc5;
+
+    while (*name) hash = (hash ^ (BYTE)*name++) * 0x01000193;
+    return hash;
+}
+
+
+/*************************************************************************
+ *		build_export_hash
+ *
+ * Build the hash index of the export names of a module.
+ * The loader_section must be locked while calling this function.
+ */
+static BOOL build_export_hash( WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports )
+{
+    const DWORD *names = get_rva( wm->ldr.DllBase, exports->AddressOfNames );
+    struct export_hash_entry *entry;
+    DWORD i, hash, pos, mask, size = 2 * EXPORT_HASH_MIN_NAMES;
+
+    while (size < 2 * exports->NumberOfNames) size *= 2;
+    if (!(wm->export_hash = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, size * sizeof(*entry) )))
+        return FALSE;
+    wm->export_hash_mask = mask = size - 1;
+
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        pos = hash = hash_export_name( get_rva( wm->ldr.DllBase, names[i] ));
+        for (entry = &wm->export_hash[pos & mask]; entry->index; entry = &wm->export_hash[++pos & mask])
+            ;
+        entry->hash = hash;
+        entry->index = i + 1;
+    }
+    return TRUE;
+}
+
+
+/*************************************************************************
+ *		find_hashed_name_in_exports
+ *
+ * Find an export name using the hash index of the module.
+ * The loader_section must be locked while calling this function.
+ */
+static int find_hashed_name_in_exports( WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports, const char *name )
+{
+    const WORD *ordinals = get_rva( wm->ldr.DllBase, exports->AddressOfNameOrdinals );
+    const DWORD *names = get_rva( wm->ldr.DllBase, exports->AddressOfNames );
+    DWORD hash = hash_export_name( name ), pos = hash;
+    const struct export_hash_entry *entry;
+
+    for (entry = &wm->export_hash[pos & wm->export_hash_mask]; entry->index;
+         entry = &wm->export_hash[++pos & wm->export_hash_mask])
+    {
+        if (entry->hash != hash) continue;
+        if (!strcmp( get_rva( wm->ldr.DllBase, names[entry->index - 1] ), name ))
+            return ordinals[entry->index - 1];
+    }
+    return -1;
+}
+
+
 /*************************************************************************
  *		find_named_export
  *
@@ -760,6 +897,7 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 {
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
+    WINE_MODREF *wm;
     int ordinal;
 
     /* first check the hint */
@@ -770,10 +908,15 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path );
     }
 
-    /* then do a binary search */
-    if ((ordinal = find_name_in_exports( module, exports, name )) == -1) return NULL;
-    return find_ordinal_export( module, exports, exp_size, ordinal, load_path );
+    /* then use the hash index if the module has enough exports, or do a binary search */
+    if (exports->NumberOfNames >= EXPORT_HASH_MIN_NAMES && (wm = get_modref( module )) &&
+        (wm->export_hash || build_export_hash( wm, exports )))
+        ordinal = find_hashed_name_in_exports( wm, exports, name );
+    else
+        ordinal = find_name_in_exports( module, exports, name );
 
+    if (ordinal == -1) return NULL;
+    return find_ordinal_export( module, exports, exp_size, ordinal, load_path );
 }
 
 
@@ -1185,6 +1328,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     prev = current_modref;
     current_modref = wm;
     status = STATUS_SUCCESS;
+    preload_imports( wm->ldr.DllBase, imports, nb_imports, load_path );
     for (i = 0; i < nb_imports; i++)
     {
         dep = wm->nDeps++;
@@ -1196,6 +1340,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
         }
         wm->deps[dep] = imp;
     }
+    finish_preload();
     current_modref = prev;
     if (wm->ldr.ActivationContext) RtlDeactivateActivationContext( 0, cookie );
     return status;
@@ -1907,11 +2052,11 @@ static NTSTATUS perform_relocations( void *module, IMAGE_NT_HEADERS *nt, SIZE_T
 /*************************************************************************
  *		build_module
  *
- * Build the module data for a mapped dll.
+ * Build the module data for a mapped dll. relocated is set for views already relocated by a loader worker.
  */
 static NTSTATUS build_module( LPCWSTR load_path, const UNICODE_STRING *nt_name, void **module,
                               const SECTION_IMAGE_INFORMATION *image_info, const struct file_id *id,
-                              DWORD flags, WINE_MODREF **pwm )
+                              DWORD flags, BOOL relocated, WINE_MODREF **pwm )
 {
     static const char builtin_signature[] = "Wine builtin DLL";
     char *signature = (char *)((IMAGE_DOS_HEADER *)*module + 1);
@@ -1924,7 +2069,7 @@ static NTSTATUS build_module( LPCWSTR load_path, const UNICODE_STRING *nt_name,
     if (!(nt = RtlImageNtHeader( *module ))) return STATUS_INVALID_IMAGE_FORMAT;
 
     map_size = (nt->OptionalHeader.SizeOfImage + page_size - 1) & ~(page_size - 1);
-    if ((status = perform_relocations( *module, nt, map_size ))) return status;
+    if (!relocated && (status = perform_relocations( *module, nt, map_size ))) return status;
 
     is_builtin = ((char *)nt - signature >= sizeof(builtin_signature) &&
                   !memcmp( signature, builtin_signature, sizeof(builtin_signature) ));
@@ -2286,12 +2431,13 @@ static NTSTATUS get_dll_load_path_search_flags( LPCWSTR module, DWORD flags, WCH
 
 
 /***********************************************************************
- *	open_dll_file
+ *	open_dll_section
  *
- * Open a file for a new dll. Helper for find_dll_file.
+ * Open a dll file and create an image section for it. If pwm is set, the
+ * file is first compared with the already loaded modules.
  */
-static NTSTATUS open_dll_file( UNICODE_STRING *nt_name, WINE_MODREF **pwm, HANDLE *mapping,
-                               SECTION_IMAGE_INFORMATION *image_info, struct file_id *id )
+static NTSTATUS open_dll_section( UNICODE_STRING *nt_name, WINE_MODREF **pwm, HANDLE *mapping,
+                                  SECTION_IMAGE_INFORMATION *image_info, struct file_id *id )
 {
     FILE_BASIC_INFORMATION info;
     OBJECT_ATTRIBUTES attr;
@@ -2301,8 +2447,6 @@ static NTSTATUS open_dll_file( UNICODE_STRING *nt_name, WINE_MODREF **pwm, HANDL
     NTSTATUS status;
     HANDLE handle;
 
-    if ((*pwm = find_fullname_module( nt_name ))) return STATUS_SUCCESS;
-
     attr.Length = sizeof(attr);
     attr.RootDirectory = 0;
     attr.Attributes = OBJ_CASE_INSENSITIVE;
@@ -2327,7 +2471,7 @@ static NTSTATUS open_dll_file( UNICODE_STRING *nt_name, WINE_MODREF **pwm, HANDL
     if (!NtFsControlFile( handle, 0, NULL, NULL, &io, FSCTL_GET_OBJECT_ID, NULL, 0, &fid, sizeof(fid) ))
     {
         memcpy( id, fid.ObjectId, sizeof(*id) );
-        if ((*pwm = find_fileid_module( id )))
+        if (pwm && (*pwm = find_fileid_module( id )))
         {
             TRACE( "%s is the same file as existing module %p %s\n", debugstr_w( nt_name->Buffer ),
                    (*pwm)->ldr.DllBase, debugstr_w( (*pwm)->ldr.FullDllName.Buffer ));
@@ -2356,6 +2500,330 @@ static NTSTATUS open_dll_file( UNICODE_STRING *nt_name, WINE_MODREF **pwm, HANDL
 }
 
 
+/***********************************************************************
+ *	map_preloaded_dll
+ *
+ * Search, map and relocate a dll on a loader worker thread.
+ * The module lists must not be accessed from here.
+ */
+static NTSTATUS map_preloaded_dll( struct preload_entry *entry )
+{
+    const WCHAR *paths = entry->paths, *ptr;
+    IMAGE_NT_HEADERS *nt;
+    WCHAR *name;
+    SIZE_T len;
+    NTSTATUS status = STATUS_DLL_NOT_FOUND;
+
+    len = wcslen( paths ) + wcslen( entry->name ) + 2;
+    if (!(name = RtlAllocateHeap( GetProcessHeap(), 0, len * sizeof(WCHAR) ))) return STATUS_NO_MEMORY;
+
+    while (*paths)
+    {
+        ptr = paths;
+        while (*ptr && *ptr != ';') ptr++;
+        len = ptr - paths;
+        if (*ptr == ';') ptr++;
+        memcpy( name, paths, len * sizeof(WCHAR) );
+        if (len && name[len - 1] != '\\') name[len++] = '\\';
+        wcscpy( name + len, entry->name );
+        paths = ptr;
+
+        if ((status = RtlDosPathNameToNtPathName_U_WithStatus( name, &entry->nt_name, NULL, NULL ))) break;
+        memset( &entry->id, 0, sizeof(entry->id) );
+        status = open_dll_section( &entry->nt_name, NULL, &entry->mapping, &entry->image_info, &entry->id );
+        if (status != STATUS_DLL_NOT_FOUND && status != STATUS_IMAGE_MACHINE_TYPE_MISMATCH) break;
+        RtlFreeUnicodeString( &entry->nt_name );
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, name );
+    if (status) return status;
+
+    NtCurrentTeb()->Tib.ArbitraryUserPointer = entry->nt_name.Buffer + 4;
+    len = 0;
+    status = NtMapViewOfSection( entry->mapping, NtCurrentProcess(), &entry->module, 0, 0, NULL, &len,
+                                 ViewShare, 0, PAGE_EXECUTE_READ );
+    NtCurrentTeb()->Tib.ArbitraryUserPointer = NULL;
+    if (status == STATUS_IMAGE_NOT_AT_BASE) status = STATUS_SUCCESS;
+    if (status) return status;
+
+    if (!(nt = RtlImageNtHeader( entry->module ))) return STATUS_INVALID_IMAGE_FORMAT;
+    /* images that need to be converted are relocated by the loading thread */
+    if (nt->OptionalHeader.Magic != IMAGE_NT_OPTIONAL_HDR_MAGIC) return STATUS_SUCCESS;
+    if (entry->module == (void *)nt->OptionalHeader.ImageBase) return STATUS_SUCCESS;
+
+    len = (nt->OptionalHeader.SizeOfImage + page_size - 1) & ~(page_size - 1);
+    if (!(status = perform_relocations( entry->module, nt, len ))) entry->relocated = TRUE;
+    return status;
+}
+
+
+/***********************************************************************
+ *	preload_worker_proc
+ *
+ * Loader worker thread. LdrInitializeThunk recognizes its start address and
+ * skips the thread initialization, so it can run while the loading thread
+ * holds the loader_section. It never exits, so LdrShutdownThread is not run;
+ * see PRELOAD_MAX_WORKERS.
+ */
+static void CALLBACK preload_worker_proc( void *arg )
+{
+    struct preload_entry *entry;
+    NTSTATUS status;
+
+    for (;;)
+    {
+        RtlEnterCriticalSection( &preload_section );
+        while (list_empty( &preload_queue ))
+            RtlSleepConditionVariableCS( &preload_queued, &preload_section, NULL );
+        entry = LIST_ENTRY( list_head( &preload_queue ), struct preload_entry, queue_entry );
+        list_remove( &entry->queue_entry );
+        entry->queued = FALSE;
+        RtlLeaveCriticalSection( &preload_section );
+
+        status = map_preloaded_dll( entry );
+        TRACE( "%s status %x module %p\n", debugstr_w(entry->name), status, entry->module );
+
+        RtlEnterCriticalSection( &preload_section );
+        entry->status = status;
+        entry->done = TRUE;
+        RtlWakeAllConditionVariable( &preload_done );
+        RtlLeaveCriticalSection( &preload_section );
+    }
+}
+
+
+/***********************************************************************
+ *	wait_preload_entry
+ *
+ * Wait for a worker to be done with an entry, or take it back from the queue.
+ */
+static void wait_preload_entry( struct preload_entry *entry )
+{
+    RtlEnterCriticalSection( &preload_section );
+    if (entry->queued)
+    {
+        list_remove( &entry->queue_entry );
+        entry->queued = FALSE;
+        entry->status = STATUS_CANCELLED;
+        entry->done = TRUE;
+    }
+    while (!entry->done) RtlSleepConditionVariableCS( &preload_done, &preload_section, NULL );
+    RtlLeaveCriticalSection( &preload_section );
+}
+
+
+/***********************************************************************
+ *	take_preloaded_dll
+ *
+ * Use the section created by a loader worker for a dll file, if any.
+ * The loader_section must be locked while calling this function.
+ */
+static BOOL take_preloaded_dll( const UNICODE_STRING *nt_name, WINE_MODREF **pwm, HANDLE *mapping,
+                                SECTION_IMAGE_INFORMATION *image_info, struct file_id *id )
+{
+    static const struct file_id zero_id;
+    struct preload_entry *entry;
+    const WCHAR *name = nt_name->Buffer + nt_name->Length / sizeof(WCHAR);
+    SIZE_T len = 0;
+
+    if (list_empty( &preload_list )) return FALSE;
+
+    while (name > nt_name->Buffer && name[-1] != '\\') { name--; len++; }
+
+    LIST_FOR_EACH_ENTRY( entry, &preload_list, struct preload_entry, entry )
+    {
+        if (entry->claimed) continue;
+        if (wcslen( entry->name ) != len || wcsnicmp( entry->name, name, len )) continue;
+        wait_preload_entry( entry );
+        if (entry->status || !RtlEqualUnicodeString( &entry->nt_name, nt_name, TRUE )) continue;
+
+        if (memcmp( &entry->id, &zero_id, sizeof(zero_id) ) && (*pwm = find_fileid_module( &entry->id )))
+        {
+            TRACE( "%s is the same file as existing module %p %s\n", debugstr_us(nt_name),
+                   (*pwm)->ldr.DllBase, debugstr_w( (*pwm)->ldr.FullDllName.Buffer ));
+            return TRUE;
+        }
+        TRACE( "using %s mapped at %p by loader worker\n", debugstr_us(nt_name), entry->module );
+        *mapping = entry->mapping;
+        *image_info = entry->image_info;
+        *id = entry->id;
+        entry->mapping = 0;
+        entry->claimed = TRUE;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+
+/***********************************************************************
+ *	free_preload_entry
+ */
+static void free_preload_entry( struct preload_entry *entry )
+{
+    list_remove( &entry->entry );
+    RtlFreeUnicodeString( &entry->nt_name );
+    RtlFreeHeap( GetProcessHeap(), 0, entry );
+}
+
+
+/***********************************************************************
+ *	take_preloaded_view
+ *
+ * Get the view mapped by a loader worker for a claimed section, and whether it has been relocated.
+ * The loader_section must be locked while calling this function.
+ */
+static void *take_preloaded_view( const UNICODE_STRING *nt_name, BOOL *relocated )
+{
+    struct preload_entry *entry;
+    void *module;
+
+    *relocated = FALSE;
+    LIST_FOR_EACH_ENTRY( entry, &preload_list, struct preload_entry, entry )
+    {
+        if (!entry->claimed || !RtlEqualUnicodeString( &entry->nt_name, nt_name, TRUE )) continue;
+        module = entry->module;
+        *relocated = entry->relocated;
+        free_preload_entry( entry );
+        return module;
+    }
+    return NULL;
+}
+
+
+/***********************************************************************
+ *	start_preload_workers
+ */
+static BOOL start_preload_workers(void)
+{
+    HANDLE thread;
+
+    while (preload_threads < preload_workers)
+    {
+        if (NtCreateThreadEx( &thread, THREAD_ALL_ACCESS, NULL, GetCurrentProcess(), preload_worker_proc,
+                              NULL, THREAD_CREATE_FLAGS_SKIP_THREAD_ATTACH, 0, 0, 0, NULL ))
+            break;
+        NtClose( thread );
+        preload_threads++;
+    }
+    return preload_threads > 0;
+}
+
+
+/***********************************************************************
+ *	preload_imports
+ *
+ * Queue the imports of a module that are not loaded yet to the loader workers,
+ * so that they get mapped and relocated while the loading thread processes
+ * them in order. The loader_section must be locked while calling this function.
+ */
+static void preload_imports( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *imports, int count,
+                             LPCWSTR load_path )
+{
+    struct preload_entry *entry, *next;
+    const IMAGE_THUNK_DATA *import_list;
+    const WCHAR *paths = load_path ? load_path : default_load_path;
+    struct list queue = LIST_INIT( queue );
+    WCHAR buffer[MAX_PATH], *fullname;
+    const char *name;
+    SIZE_T len;
+    int i;
+
+    if (!preload_workers) return;
+    preload_depth++;
+
+    /* the worker threads are started through kernel32 */
+    if (!pBaseThreadInitThunk || is_prefix_bootstrap) return;
+
+    for (i = 0; i < count; i++)
+    {
+        import_list = get_rva( module, imports[i].u.OriginalFirstThunk ?
+                               (DWORD)imports[i].u.OriginalFirstThunk : (DWORD)imports[i].FirstThunk );
+        if (!import_list->u1.Ordinal) continue;
+
+        name = get_rva( module, imports[i].Name );
+        len = strlen( name );
+        while (len && name[len - 1] == ' ') len--;
+        if (len + 5 > ARRAY_SIZE(buffer)) continue;
+        ascii_to_unicode( buffer, name, len );
+        buffer[len] = 0;
+        if (!wcsrchr( buffer, '.' )) wcscat( buffer, L".dll" );
+        if (contains_path( buffer )) continue;
+
+        if (find_basename_module( buffer )) continue;
+        fullname = NULL;
+        if (find_actctx_dll( buffer, &fullname ) != STATUS_SXS_KEY_NOT_FOUND)
+        {
+            RtlFreeHeap( GetProcessHeap(), 0, fullname );
+            continue;
+        }
+        LIST_FOR_EACH_ENTRY( entry, &preload_list, struct preload_entry, entry )
+            if (!wcsicmp( entry->name, buffer )) break;
+        if (&entry->entry != &preload_list) continue;
+
+        len = wcslen( buffer ) + 1;
+        if (!(entry = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                       sizeof(*entry) + (len + wcslen( paths ) + 1) * sizeof(WCHAR) )))
+            break;
+        entry->name = wcscpy( (WCHAR *)(entry + 1), buffer );
+        entry->paths = wcscpy( (WCHAR *)(entry + 1) + len, paths );
+        entry->queued = TRUE;
+        list_add_tail( &preload_list, &entry->entry );
+        list_add_tail( &queue, &entry->queue_entry );
+    }
+
+    if (list_empty( &queue )) return;
+
+    if (!start_preload_workers())
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( entry, next, &queue, struct preload_entry, queue_entry )
+            free_preload_entry( entry );
+        return;
+    }
+
+    RtlEnterCriticalSection( &preload_section );
+    /* the loading thread goes depth first, so dependencies of dependencies come first */
+    list_move_head( &preload_queue, &queue );
+    RtlWakeAllConditionVariable( &preload_queued );
+    RtlLeaveCriticalSection( &preload_section );
+}
+
+
+/***********************************************************************
+ *	finish_preload
+ *
+ * Release the dlls preloaded for the outermost import fixup that were not used.
+ * The loader_section must be locked while calling this function.
+ */
+static void finish_preload(void)
+{
+    struct preload_entry *entry, *next;
+
+    if (!preload_workers || --preload_depth) return;
+
+    LIST_FOR_EACH_ENTRY_SAFE( entry, next, &preload_list, struct preload_entry, entry )
+    {
+        wait_preload_entry( entry );
+        TRACE( "releasing unused %s\n", debugstr_w(entry->name) );
+        if (entry->module) NtUnmapViewOfSection( NtCurrentProcess(), entry->module );
+        if (entry->mapping) NtClose( entry->mapping );
+        free_preload_entry( entry );
+    }
+}
+
+
+/***********************************************************************
+ *	open_dll_file
+ *
+ * Open a file for a new dll. Helper for find_dll_file.
+ */
+static NTSTATUS open_dll_file( UNICODE_STRING *nt_name, WINE_MODREF **pwm, HANDLE *mapping,
+                               SECTION_IMAGE_INFORMATION *image_info, struct file_id *id )
+{
+    if ((*pwm = find_fullname_module( nt_name ))) return STATUS_SUCCESS;
+    if (take_preloaded_dll( nt_name, pwm, mapping, image_info, id )) return STATUS_SUCCESS;
+    return open_dll_section( nt_name, pwm, mapping, image_info, id );
+}
+
+
 /******************************************************************************
  *	find_existing_module
  *
@@ -2390,11 +2858,13 @@ static NTSTATUS load_native_dll( LPCWSTR load_path, const UNICODE_STRING *nt_nam
                                  const SECTION_IMAGE_INFORMATION *image_info, const struct file_id *id,
                                  DWORD flags, WINE_MODREF** pwm )
 {
-    void *module = NULL;
+    BOOL relocated;
+    void *module = take_preloaded_view( nt_name, &relocated );
     SIZE_T len = 0;
-    NTSTATUS status = NtMapViewOfSection( mapping, NtCurrentProcess(), &module, 0, 0, NULL, &len,
-                                          ViewShare, 0, PAGE_EXECUTE_READ );
+    NTSTATUS status = STATUS_SUCCESS;
 
+    if (!module) status = NtMapViewOfSection( mapping, NtCurrentProcess(), &module, 0, 0, NULL, &len,
+                                              ViewShare, 0, PAGE_EXECUTE_READ );
     if (status == STATUS_IMAGE_NOT_AT_BASE) status = STATUS_SUCCESS;
     if (status) return status;
 
@@ -2410,7 +2880,7 @@ static NTSTATUS load_native_dll( LPCWSTR load_path, const UNICODE_STRING *nt_nam
 #ifdef _WIN64
     if (!convert_to_pe64( module, image_info )) status = STATUS_INVALID_IMAGE_FORMAT;
 #endif
-    if (!status) status = build_module( load_path, nt_name, &module, image_info, id, flags, pwm );
+    if (!status) status = build_module( load_path, nt_name, &module, image_info, id, flags, relocated, pwm );
     if (status && module) NtUnmapViewOfSection( NtCurrentProcess(), module );
     return status;
 }
@@ -2445,7 +2915,7 @@ static NTSTATUS load_so_dll( LPCWSTR load_path, const UNICODE_STRING *nt_name,
     {
         SECTION_IMAGE_INFORMATION image_info = { 0 };
 
-        if ((status = build_module( load_path, &win_name, &module, &image_info, NULL, flags, &wm )))
+        if ((status = build_module( load_path, &win_name, &module, &image_info, NULL, flags, FALSE, &wm )))
         {
             if (module) NtUnmapViewOfSection( NtCurrentProcess(), module );
             return status;
@@ -2490,7 +2960,7 @@ static WINE_MODREF *build_main_module(void)
 #endif
     status = RtlDosPathNameToNtPathName_U_WithStatus( params->ImagePathName.Buffer, &nt_name, NULL, NULL );
     if (status) goto failed;
-    status = build_module( NULL, &nt_name, &module, &info, NULL, DONT_RESOLVE_DLL_REFERENCES, &wm );
+    status = build_module( NULL, &nt_name, &module, &info, NULL, DONT_RESOLVE_DLL_REFERENCES, FALSE, &wm );
     RtlFreeUnicodeString( &nt_name );
     if (!status) return wm;
 failed:
@@ -2761,6 +3231,100 @@ done:
 }
 
 
+#define SEARCH_SNAPSHOT_MAX_DIRS 16
+
+/* loader snapshot record of a dll search result */
+struct search_snapshot
+{
+    ULONG index;  /* index of the search path element where the dll was found */
+    struct
+    {
+        ULONG         hash;  /* hash of the NT name of the directory */
+        LARGE_INTEGER time;  /* last write time of the directory */
+    } dirs[SEARCH_SNAPSHOT_MAX_DIRS];  /* state of the directories searched before it */
+};
+
+/***********************************************************************
+ *	get_search_path_name
+ *
+ * Build the file name for the next element of a search path.
+ */
+static LPCWSTR get_search_path_name( LPCWSTR paths, LPCWSTR search, WCHAR *name )
+{
+    LPCWSTR ptr = paths;
+    ULONG len;
+
+    while (*ptr && *ptr != ';') ptr++;
+    len = ptr - paths;
+    if (*ptr == ';') ptr++;
+    memcpy( name, paths, len * sizeof(WCHAR) );
+    if (len && name[len - 1] != '\\') name[len++] = '\\';
+    wcscpy( name + len, search );
+    return ptr;
+}
+
+/***********************************************************************
+ *	get_search_dir_state
+ *
+ * Get the hash and last write time of the directory containing a file.
+ */
+static BOOL get_search_dir_state( const UNICODE_STRING *nt_name, ULONG *hash, LARGE_INTEGER *time )
+{
+    FILE_NETWORK_OPEN_INFORMATION info;
+    OBJECT_ATTRIBUTES attr;
+    UNICODE_STRING dir = *nt_name;
+
+    while (dir.Length && dir.Buffer[dir.Length / sizeof(WCHAR) - 1] != '\\') dir.Length -= sizeof(WCHAR);
+    if (dir.Length) dir.Length -= sizeof(WCHAR);
+    InitializeObjectAttributes( &attr, &dir, OBJ_CASE_INSENSITIVE, 0, NULL );
+    if (NtQueryFullAttributesFile( &attr, &info )) return FALSE;
+    RtlHashUnicodeString( &dir, TRUE, HASH_STRING_ALGORITHM_X65599, hash );
+    *time = info.LastWriteTime;
+    return TRUE;
+}
+
+/***********************************************************************
+ *	get_search_snapshot
+ *
+ * Look up the loader snapshot for a dll search, and return the number of search
+ * path elements that can be skipped. The dll can't have appeared in these since
+ * their directories have not been modified since the search was recorded.
+ */
+static ULONG get_search_snapshot( LPCWSTR paths, LPCWSTR search, WCHAR *name,
+                                  const void *key, ULONG key_size, BOOL *record )
+{
+    struct search_snapshot snapshot;
+    UNICODE_STRING nt_name;
+    LARGE_INTEGER time;
+    ULONG i, hash, size = sizeof(snapshot);
+    NTSTATUS status;
+    BOOL valid;
+
+    *record = FALSE;
+    if (!key) return 0;
+    status = unix_funcs->get_loader_snapshot( SNAPSHOT_DLL_SEARCH, key, key_size, &snapshot, &size );
+    if (status == STATUS_NOT_SUPPORTED) return 0;
+    *record = TRUE;
+    if (status) return 0;
+    if (size != offsetof( struct search_snapshot, dirs[snapshot.index] )) return 0;
+
+    for (i = 0; i < snapshot.index; i++)
+    {
+        if (!*paths) return 0;
+        paths = get_search_path_name( paths, search, name );
+        if (RtlDosPathNameToNtPathName_U_WithStatus( name, &nt_name, NULL, NULL )) return 0;
+        valid = (get_search_dir_state( &nt_name, &hash, &time ) &&
+                 hash == snapshot.dirs[i].hash &&
+                 time.QuadPart == snapshot.dirs[i].time.QuadPart &&
+                 !find_fullname_module( &nt_name ));
+        RtlFreeUnicodeString( &nt_name );
+        if (!valid) return 0;
+    }
+    TRACE( "skipping %u search path elements for %s\n", snapshot.index, debugstr_w(search) );
+    *record = FALSE;
+    return snapshot.index;
+}
+
 /***********************************************************************
  *	search_dll_file
  *
@@ -2770,10 +3334,11 @@ static NTSTATUS search_dll_file( LPCWSTR paths, LPCWSTR search, UNICODE_STRING *
                                  WINE_MODREF **pwm, HANDLE *mapping, SECTION_IMAGE_INFORMATION *image_info,
                                  struct file_id *id )
 {
-    WCHAR *name;
-    BOOL found_image = FALSE;
+    struct search_snapshot snapshot;
+    WCHAR *name, *key = NULL;
+    BOOL found_image = FALSE, record = FALSE;
     NTSTATUS status = STATUS_DLL_NOT_FOUND;
-    ULONG len;
+    ULONG i, skip = 0, len, key_size = 0;
 
     if (!paths) paths = default_load_path;
     len = wcslen( paths );
@@ -2784,23 +3349,48 @@ static NTSTATUS search_dll_file( LPCWSTR paths, LPCWSTR search, UNICODE_STRING *
     if (!(name = RtlAllocateHeap( GetProcessHeap(), 0, len * sizeof(WCHAR) )))
         return STATUS_NO_MEMORY;
 
-    while (*paths)
+    /* the key is the search name followed by the search path */
+    if (!is_prefix_bootstrap && len <= 0x7fff &&
+        (key = RtlAllocateHeap( GetProcessHeap(), 0, len * sizeof(WCHAR) )))
     {
-        LPCWSTR ptr = paths;
+        key_size = wcslen( search ) + 1;
+        memcpy( key, search, key_size * sizeof(WCHAR) );
+        _wcslwr( key );
+        wcscpy( key + key_size, paths );
+        key_size = (key_size + wcslen( paths )) * sizeof(WCHAR);
+        skip = get_search_snapshot( paths, search, name, key, key_size, &record );
+    }
 
-        while (*ptr && *ptr != ';') ptr++;
-        len = ptr - paths;
-        if (*ptr == ';') ptr++;
-        memcpy( name, paths, len * sizeof(WCHAR) );
-        if (len && name[len - 1] != '\\') name[len++] = '\\';
-        wcscpy( name + len, search );
+    for (i = 0; *paths; i++)
+    {
+        LPCWSTR ptr = get_search_path_name( paths, search, name );
+
+        if (i < skip)
+        {
+            paths = ptr;
+            continue;
+        }
 
         nt_name->Buffer = NULL;
         if ((status = RtlDosPathNameToNtPathName_U_WithStatus( name, nt_name, NULL, NULL ))) goto done;
 
+        if (record && (i >= SEARCH_SNAPSHOT_MAX_DIRS ||
+                       !get_search_dir_state( nt_name, &snapshot.dirs[i].hash, &snapshot.dirs[i].time )))
+            record = FALSE;
+
         status = open_dll_file( nt_name, pwm, mapping, image_info, id );
         if (status == STATUS_IMAGE_MACHINE_TYPE_MISMATCH) found_image = TRUE;
-        else if (status != STATUS_DLL_NOT_FOUND) goto done;
+        else if (status != STATUS_DLL_NOT_FOUND)
+        {
+            /* a directory containing an image for another machine can't be skipped */
+            if (!status && record && !found_image)
+            {
+                snapshot.index = i;
+                unix_funcs->set_loader_snapshot( SNAPSHOT_DLL_SEARCH, key, key_size, &snapshot,
+                                                 offsetof( struct search_snapshot, dirs[i] ));
+            }
+            goto done;
+        }
         RtlFreeUnicodeString( nt_name );
         paths = ptr;
     }
@@ -2811,6 +3401,7 @@ static NTSTATUS search_dll_file( LPCWSTR paths, LPCWSTR search, UNICODE_STRING *
         status = find_builtin_without_file( search, nt_name, pwm, mapping, image_info, id );
 
 done:
+    RtlFreeHeap( GetProcessHeap(), 0, key );
     RtlFreeHeap( GetProcessHeap(), 0, name );
     return status;
 }
@@ -3470,6 +4061,27 @@ void WINAPI LdrShutdownThread(void)
 }
 
 
+/***********************************************************************
+ *           flush_forwarded_exports
+ *
+ * Forget the resolved forwarded exports, since they may point to a module being unloaded.
+ * The loader_section must be locked while calling this function.
+ */
+static void flush_forwarded_exports(void)
+{
+    PLIST_ENTRY mark, entry;
+    WINE_MODREF *wm;
+
+    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
+    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
+    {
+        wm = CONTAINING_RECORD( entry, WINE_MODREF, ldr.InLoadOrderLinks );
+        RtlFreeHeap( GetProcessHeap(), 0, wm->forwards );
+        wm->forwards = NULL;
+    }
+}
+
+
 /***********************************************************************
  *           free_modref
  *
@@ -3491,8 +4103,11 @@ static void free_modref( WINE_MODREF *wm )
     RtlReleaseActivationContext( wm->ldr.ActivationContext );
     NtUnmapViewOfSection( NtCurrentProcess(), wm->ldr.DllBase );
     if (cached_modref == wm) cached_modref = NULL;
+    flush_forwarded_exports();
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
     RtlFreeHeap( GetProcessHeap(), 0, wm->deps );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->export_hash );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->forwards );
     RtlFreeHeap( GetProcessHeap(), 0, wm );
 }
 
@@ -3663,11 +4278,18 @@ static void load_global_options(void)
     OBJECT_ATTRIBUTES attr;
     UNICODE_STRING name_str, val_str;
     HANDLE hkey;
+    WCHAR buffer[8];
 
     RtlInitUnicodeString( &name_str, L"WINEBOOTSTRAPMODE" );
     val_str.MaximumLength = 0;
     is_prefix_bootstrap = RtlQueryEnvironmentVariable_U( NULL, &name_str, &val_str ) != STATUS_VARIABLE_NOT_FOUND;
 
+    RtlInitUnicodeString( &name_str, L"WINEPARALLELLOAD" );
+    val_str.Buffer = buffer;
+    val_str.MaximumLength = sizeof(buffer);
+    if (!RtlQueryEnvironmentVariable_U( NULL, &name_str, &val_str ) && val_str.Length && buffer[0] != '0')
+        preload_workers = min( max( NtCurrentTeb()->Peb->NumberOfProcessors, 1 ), PRELOAD_MAX_WORKERS );
+
     attr.Length = sizeof(attr);
     attr.RootDirectory = 0;
     attr.ObjectName = &name_str;
@@ -3817,6 +4439,9 @@ void WINAPI LdrInitializeThunk( CONTEXT *context, ULONG_PTR unknown2, ULONG_PTR
 
     if (process_detaching) NtTerminateThread( GetCurrentThread(), 0 );
 
+    /* loader workers run while the loading thread holds the loader_section */
+    if (*entry == (void *)preload_worker_proc) signal_start_thread( context );
+
     RtlEnterCriticalSection( &loader_section );
 
     if (!imports_fixup_done)
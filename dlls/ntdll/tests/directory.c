@@ -841,6 +841,209 @@ done:
     pRtlFreeUnicodeString(&ntdirname);
 }
 
+#define LARGE_DIR_FILES 5000
+#define LARGE_DIR_OTHER_FILES 100
+
+static int count_large_dir_entries( HANDLE dirh, UNICODE_STRING *mask, BYTE *seen, BOOLEAN restart )
+{
+    BYTE data[8192];
+    FILE_DIRECTORY_INFORMATION *info;
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+    int count = 0, index, i;
+
+    memset( seen, 0, LARGE_DIR_FILES );
+    for (;;)
+    {
+        status = pNtQueryDirectoryFile( dirh, NULL, NULL, NULL, &io, data, sizeof(data),
+                                        FileDirectoryInformation, FALSE, mask, restart );
+        restart = FALSE;
+        if (status == STATUS_NO_MORE_FILES) break;
+        ok( status == STATUS_SUCCESS, "NtQueryDirectoryFile failed %x\n", status );
+        if (status) break;
+
+        for (info = (FILE_DIRECTORY_INFORMATION *)data; ;
+             info = (FILE_DIRECTORY_INFORMATION *)((BYTE *)info + info->NextEntryOffset))
+        {
+            if (info->FileNameLength == 11 * sizeof(WCHAR) && info->FileName[0] == 'f' &&
+                !memcmp( info->FileName + 6, L".txt", 4 * sizeof(WCHAR) ))
+            {
+                for (i = 1, index = 0; i < 6; i++) index = index * 10 + info->FileName[i] - '0';
+                ok( index >= 0 && index < LARGE_DIR_FILES, "unexpected file %s\n",
+                    wine_dbgstr_wn( info->FileName, 11 ) );
+                if (index >= 0 && index < LARGE_DIR_FILES)
+                {
+                    ok( !seen[index], "%s returned twice\n", wine_dbgstr_wn( info->FileName, 11 ) );
+                    seen[index] = 1;
+                    count++;
+                    ok( !(info->FileAttributes & FILE_ATTRIBUTE_DIRECTORY), "got attributes %#x\n", info->FileAttributes );
+                    ok( !info->EndOfFile.QuadPart, "got size %s\n", wine_dbgstr_longlong(info->EndOfFile.QuadPart) );
+                    ok( info->LastWriteTime.QuadPart != 0, "got no write time\n" );
+                }
+            }
+            else if (mask && info->FileName[0] != '.')
+                ok( 0, "unexpected file %s\n", wine_dbgstr_wn( info->FileName, info->FileNameLength / sizeof(WCHAR) ) );
+            if (!info->NextEntryOffset) break;
+        }
+    }
+    return count;
+}
+
+static void test_NtQueryDirectoryFile_large(void)
+{
+    char testdir[MAX_PATH], buf[MAX_PATH + 16];
+    WCHAR testdir_w[MAX_PATH], maskW[] = L"*7.txt", large_maskW[] = L"f0*.txt";
+    UNICODE_STRING ntdirname, mask;
+    OBJECT_ATTRIBUTES attr;
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+    BYTE *seen;
+    HANDLE dirh, h;
+    int i, count;
+
+    ok( GetTempPathA( MAX_PATH, testdir ), "couldn't get temp dir\n" );
+    strcat( testdir, "large.tmp" );
+    CreateDirectoryA( testdir, NULL );
+    for (i = 0; i < LARGE_DIR_FILES; i++)
+    {
+        sprintf( buf, "%s\\f%05u.txt", testdir, i );
+        h = CreateFileA( buf, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0 );
+        ok( h != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", buf, GetLastError() );
+        CloseHandle( h );
+    }
+    for (i = 0; i < LARGE_DIR_OTHER_FILES; i++)
+    {
+        sprintf( buf, "%s\\g%05u.txt", testdir, i );
+        h = CreateFileA( buf, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0 );
+        ok( h != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", buf, GetLastError() );
+        CloseHandle( h );
+    }
+
+    pRtlMultiByteToUnicodeN( testdir_w, sizeof(testdir_w), NULL, testdir, strlen(testdir) + 1 );
+    if (!pRtlDosPathNameToNtPathName_U( testdir_w, &ntdirname, NULL, NULL ))
+    {
+        ok( 0, "RtlDosPathNametoNtPathName_U failed\n" );
+        goto done;
+    }
+    InitializeObjectAttributes( &attr, &ntdirname, OBJ_CASE_INSENSITIVE, 0, NULL );
+    seen = HeapAlloc( GetProcessHeap(), 0, LARGE_DIR_FILES );
+
+    status = pNtOpenFile( &dirh, SYNCHRONIZE | FILE_LIST_DIRECTORY, &attr, &io, FILE_SHARE_READ,
+                          FILE_SYNCHRONOUS_IO_NONALERT | FILE_OPEN_FOR_BACKUP_INTENT | FILE_DIRECTORY_FILE );
+    ok( !status, "failed to open dir '%s', status %x\n", testdir, status );
+    count = count_large_dir_entries( dirh, NULL, seen, FALSE );
+    ok( count == LARGE_DIR_FILES, "got %u files\n", count );
+    count = count_large_dir_entries( dirh, NULL, seen, TRUE );
+    ok( count == LARGE_DIR_FILES, "got %u files after restart\n", count );
+    pNtClose( dirh );
+
+    status = pNtOpenFile( &dirh, SYNCHRONIZE | FILE_LIST_DIRECTORY, &attr, &io, FILE_SHARE_READ,
+                          FILE_SYNCHRONOUS_IO_NONALERT | FILE_OPEN_FOR_BACKUP_INTENT | FILE_DIRECTORY_FILE );
+    ok( !status, "failed to open dir '%s', status %x\n", testdir, status );
+    pRtlInitUnicodeString( &mask, maskW );
+    count = count_large_dir_entries( dirh, &mask, seen, FALSE );
+    ok( count == LARGE_DIR_FILES / 10, "got %u files matching %s\n", count, wine_dbgstr_w(maskW) );
+    for (i = 0; i < LARGE_DIR_FILES; i++)
+        if (seen[i]) ok( i % 10 == 7, "unexpected file %u\n", i );
+    pNtClose( dirh );
+
+    /* enough matches to be returned in several batches */
+    status = pNtOpenFile( &dirh, SYNCHRONIZE | FILE_LIST_DIRECTORY, &attr, &io, FILE_SHARE_READ,
+                          FILE_SYNCHRONOUS_IO_NONALERT | FILE_OPEN_FOR_BACKUP_INTENT | FILE_DIRECTORY_FILE );
+    ok( !status, "failed to open dir '%s', status %x\n", testdir, status );
+    pRtlInitUnicodeString( &mask, large_maskW );
+    count = count_large_dir_entries( dirh, &mask, seen, FALSE );
+    ok( count == LARGE_DIR_FILES, "got %u files matching %s\n", count, wine_dbgstr_w(large_maskW) );
+    count = count_large_dir_entries( dirh, &mask, seen, TRUE );
+    ok( count == LARGE_DIR_FILES, "got %u files matching %s after restart\n", count, wine_dbgstr_w(large_maskW) );
+    pNtClose( dirh );
+
+    HeapFree( GetProcessHeap(), 0, seen );
+    pRtlFreeUnicodeString( &ntdirname );
+
+done:
+    for (i = 0; i < LARGE_DIR_FILES; i++)
+    {
+        sprintf( buf, "%s\\f%05u.txt", testdir, i );
+        DeleteFileA( buf );
+    }
+    for (i = 0; i < LARGE_DIR_OTHER_FILES; i++)
+    {
+        sprintf( buf, "%s\\g%05u.txt", testdir, i );
+        DeleteFileA( buf );
+    }
+    RemoveDirectoryA( testdir );
+}
+
+/* case-insensitive lookups in a large directory must see the changes made after the first one */
+static void test_dir_cache_invalidation(void)
+{
+    char testdir[MAX_PATH], buf[MAX_PATH + 16], buf2[MAX_PATH + 16];
+    HANDLE h;
+    DWORD attrs;
+    BOOL ret;
+    int i;
+
+    ok( GetTempPathA( MAX_PATH, testdir ), "couldn't get temp dir\n" );
+    strcat( testdir, "dircache.tmp" );
+    CreateDirectoryA( testdir, NULL );
+    for (i = 0; i < 100; i++)
+    {
+        sprintf( buf, "%s\\f%03u.txt", testdir, i );
+        h = CreateFileA( buf, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0 );
+        ok( h != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", buf, GetLastError() );
+        CloseHandle( h );
+    }
+
+    sprintf( buf, "%s\\F042.TXT", testdir );
+    attrs = GetFileAttributesA( buf );
+    ok( attrs != INVALID_FILE_ATTRIBUTES, "%s not found, error %u\n", buf, GetLastError() );
+    sprintf( buf, "%s\\NEW.TXT", testdir );
+    attrs = GetFileAttributesA( buf );
+    ok( attrs == INVALID_FILE_ATTRIBUTES, "%s found\n", buf );
+
+    /* create */
+    sprintf( buf, "%s\\new.txt", testdir );
+    h = CreateFileA( buf, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0 );
+    ok( h != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", buf, GetLastError() );
+    CloseHandle( h );
+    sprintf( buf, "%s\\NEW.TXT", testdir );
+    attrs = GetFileAttributesA( buf );
+    ok( attrs != INVALID_FILE_ATTRIBUTES, "%s not found after create, error %u\n", buf, GetLastError() );
+
+    /* rename */
+    sprintf( buf, "%s\\f007.txt", testdir );
+    sprintf( buf2, "%s\\renamed.txt", testdir );
+    ret = MoveFileA( buf, buf2 );
+    ok( ret, "failed to rename %s, error %u\n", buf, GetLastError() );
+    sprintf( buf, "%s\\F007.TXT", testdir );
+    attrs = GetFileAttributesA( buf );
+    ok( attrs == INVALID_FILE_ATTRIBUTES, "%s found after rename\n", buf );
+    sprintf( buf, "%s\\RENAMED.TXT", testdir );
+    attrs = GetFileAttributesA( buf );
+    ok( attrs != INVALID_FILE_ATTRIBUTES, "%s not found after rename, error %u\n", buf, GetLastError() );
+
+    /* delete */
+    sprintf( buf, "%s\\f042.txt", testdir );
+    ret = DeleteFileA( buf );
+    ok( ret, "failed to delete %s, error %u\n", buf, GetLastError() );
+    sprintf( buf, "%s\\F042.TXT", testdir );
+    attrs = GetFileAttributesA( buf );
+    ok( attrs == INVALID_FILE_ATTRIBUTES, "%s found after delete\n", buf );
+    ok( GetLastError() == ERROR_FILE_NOT_FOUND, "got error %u\n", GetLastError() );
+
+    for (i = 0; i < 100; i++)
+    {
+        sprintf( buf, "%s\\f%03u.txt", testdir, i );
+        DeleteFileA( buf );
+    }
+    sprintf( buf, "%s\\new.txt", testdir );
+    DeleteFileA( buf );
+    sprintf( buf, "%s\\renamed.txt", testdir );
+    DeleteFileA( buf );
+    RemoveDirectoryA( testdir );
+}
+
 static NTSTATUS get_file_id( FILE_INTERNAL_INFORMATION *info, const WCHAR *root, const WCHAR *name )
 {
     OBJECT_ATTRIBUTES attr;
@@ -1034,5 +1237,7 @@ START_TEST(directory)
     test_directory_sort( sysdir );
     test_NtQueryDirectoryFile();
     test_NtQueryDirectoryFile_case();
+    test_NtQueryDirectoryFile_large();
+    test_dir_cache_invalidation();
     test_redirection();
 }
@@ -3870,6 +3870,113 @@ static void test_file_completion_information(void)
     CloseHandle(h);
 }
 
+static void test_overlapped_file_io(void)
+{
+    static const char data[] = "overlapped file I/O test data";
+    char buffer[64], buffers[8][4];
+    OVERLAPPED ovl, ovls[8], *pov;
+    IO_STATUS_BLOCK cancel_io;
+    HANDLE file, port, event;
+    ULONG_PTR key;
+    NTSTATUS status;
+    DWORD size, i;
+    BOOL ret;
+
+    if (!(file = create_temp_file( FILE_FLAG_OVERLAPPED ))) return;
+    event = CreateEventW( NULL, TRUE, FALSE, NULL );
+
+    memset( &ovl, 0, sizeof(ovl) );
+    ovl.hEvent = event;
+    ret = WriteFile( file, data, sizeof(data), NULL, &ovl );
+    ok( ret || GetLastError() == ERROR_IO_PENDING, "WriteFile failed %u\n", GetLastError() );
+    ret = GetOverlappedResult( file, &ovl, &size, TRUE );
+    ok( ret, "GetOverlappedResult failed %u\n", GetLastError() );
+    ok( size == sizeof(data), "got size %u\n", size );
+
+    /* without an event, the file is signaled on completion */
+    memset( &ovl, 0, sizeof(ovl) );
+    memset( buffer, 0, sizeof(buffer) );
+    ret = ReadFile( file, buffer, sizeof(buffer), NULL, &ovl );
+    ok( ret || GetLastError() == ERROR_IO_PENDING, "ReadFile failed %u\n", GetLastError() );
+    ok( !WaitForSingleObject( file, 5000 ), "file not signaled\n" );
+    ok( ovl.Internal == STATUS_SUCCESS, "got status %#lx\n", ovl.Internal );
+    ok( ovl.InternalHigh == sizeof(data), "got size %lu\n", ovl.InternalHigh );
+    ok( !memcmp( buffer, data, sizeof(data) ), "got wrong data\n" );
+
+    memset( &ovl, 0, sizeof(ovl) );
+    ovl.Offset = 4096;
+    ovl.hEvent = event;
+    ret = ReadFile( file, buffer, sizeof(buffer), &size, &ovl );
+    if (!ret && GetLastError() == ERROR_IO_PENDING) ret = GetOverlappedResult( file, &ovl, &size, TRUE );
+    ok( !ret && GetLastError() == ERROR_HANDLE_EOF, "got ret %d, error %u\n", ret, GetLastError() );
+
+    /* several reads in flight, completed through a port */
+    port = CreateIoCompletionPort( file, NULL, 0xdead, 0 );
+    ok( port != NULL, "CreateIoCompletionPort failed %u\n", GetLastError() );
+    for (i = 0; i < ARRAY_SIZE(ovls); i++)
+    {
+        memset( &ovls[i], 0, sizeof(ovls[i]) );
+        ovls[i].Offset = i;
+        ret = ReadFile( file, buffers[i], sizeof(buffers[i]), NULL, &ovls[i] );
+        ok( ret || GetLastError() == ERROR_IO_PENDING, "ReadFile failed %u\n", GetLastError() );
+    }
+    for (i = 0; i < ARRAY_SIZE(ovls); i++)
+    {
+        pov = NULL;
+        ret = GetQueuedCompletionStatus( port, &size, &key, &pov, 5000 );
+        ok( ret, "GetQueuedCompletionStatus failed %u\n", GetLastError() );
+        if (!ret) break;
+        ok( key == 0xdead, "got key %#lx\n", key );
+        ok( size == sizeof(buffers[0]), "got size %u\n", size );
+        ok( !memcmp( buffers[pov - ovls], data + (pov - ovls), sizeof(buffers[0]) ),
+            "got wrong data for read %u\n", (DWORD)(pov - ovls) );
+    }
+
+    /* a cancelled read either completes or is aborted, and is reported either way */
+    memset( &ovl, 0, sizeof(ovl) );
+    ret = ReadFile( file, buffer, sizeof(buffer), NULL, &ovl );
+    ok( ret || GetLastError() == ERROR_IO_PENDING, "ReadFile failed %u\n", GetLastError() );
+    status = pNtCancelIoFileEx( file, (IO_STATUS_BLOCK *)&ovl, &cancel_io );
+    ok( !status || status == STATUS_NOT_FOUND, "NtCancelIoFileEx returned %#x\n", status );
+    pov = NULL;
+    ret = GetQueuedCompletionStatus( port, &size, &key, &pov, 5000 );
+    ok( pov == &ovl, "got overlapped %p\n", pov );
+    ok( ret ? size == sizeof(data) : GetLastError() == ERROR_OPERATION_ABORTED,
+        "got ret %d, size %u, error %u\n", ret, size, GetLastError() );
+
+    /* the completion of a read is still reported if the file is closed */
+    memset( &ovl, 0, sizeof(ovl) );
+    ret = ReadFile( file, buffer, sizeof(buffer), NULL, &ovl );
+    ok( ret || GetLastError() == ERROR_IO_PENDING, "ReadFile failed %u\n", GetLastError() );
+    CloseHandle( file );
+    pov = NULL;
+    GetQueuedCompletionStatus( port, &size, &key, &pov, 5000 );
+    ok( pov == &ovl, "got overlapped %p\n", pov );
+
+    CloseHandle( port );
+    CloseHandle( event );
+}
+
+/* Wine only uses io_uring for overlapped file I/O when WINEIOURING is set */
+static void test_overlapped_file_io_uring(void)
+{
+    STARTUPINFOA si = { sizeof(si) };
+    PROCESS_INFORMATION pi;
+    char cmdline[MAX_PATH * 2], **argv;
+    BOOL ret;
+
+    winetest_get_mainargs( &argv );
+    sprintf( cmdline, "\"%s\" file overlapped", argv[0] );
+    SetEnvironmentVariableA( "WINEIOURING", "1" );
+    ret = CreateProcessA( NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi );
+    SetEnvironmentVariableA( "WINEIOURING", NULL );
+    ok( ret, "CreateProcess failed %u\n", GetLastError() );
+    if (!ret) return;
+    wait_child_process( pi.hProcess );
+    CloseHandle( pi.hThread );
+    CloseHandle( pi.hProcess );
+}
+
 static void test_file_id_information(void)
 {
     BY_HANDLE_FILE_INFORMATION info;
@@ -5245,6 +5352,9 @@ START_TEST(file)
 {
     HMODULE hkernel32 = GetModuleHandleA("kernel32.dll");
     HMODULE hntdll = GetModuleHandleA("ntdll.dll");
+    char **argv;
+    int argc;
+
     if (!hntdll)
     {
         skip("not running on NT, skipping test\n");
@@ -5282,6 +5392,13 @@ START_TEST(file)
     pNtQueryFullAttributesFile = (void *)GetProcAddress(hntdll, "NtQueryFullAttributesFile");
     pNtFlushBuffersFile = (void *)GetProcAddress(hntdll, "NtFlushBuffersFile");
 
+    argc = winetest_get_mainargs( &argv );
+    if (argc > 2 && !strcmp( argv[2], "overlapped" ))
+    {
+        test_overlapped_file_io();
+        return;
+    }
+
     test_read_write();
     test_NtCreateFile();
     create_file_test();
@@ -5302,6 +5419,8 @@ START_TEST(file)
     test_file_link_information();
     test_file_disposition_information();
     test_file_completion_information();
+    test_overlapped_file_io();
+    test_overlapped_file_io_uring();
     test_file_id_information();
     test_file_access_information();
     test_file_attribute_tag_information();
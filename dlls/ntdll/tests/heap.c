@@ -0,0 +1,129 @@
+/*
+ * Unit test suite for ntdll heap functions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "ntdll_test.h"
+
+#define STRESS_BLOCKS     256
+#define STRESS_ITERATIONS 5000
+#define STRESS_THREADS    4
+
+struct stress_thread
+{
+    HANDLE  heap;
+    HANDLE  start;
+    void  **shared;     /* blocks handed over between the threads */
+    ULONG   seed;
+    LONG    errors;
+};
+
+static ULONG stress_rand( struct stress_thread *info )
+{
+    return info->seed = info->seed * 1103515245 + 12345;
+}
+
+static DWORD WINAPI stress_thread_proc( void *arg )
+{
+    struct stress_thread *info = arg;
+    unsigned char *blocks[STRESS_BLOCKS] = { 0 };
+    SIZE_T sizes[STRESS_BLOCKS];
+    ULONG i, j, index;
+
+    WaitForSingleObject( info->start, INFINITE );
+
+    for (i = 0; i < STRESS_ITERATIONS; i++)
+    {
+        index = stress_rand( info ) % STRESS_BLOCKS;
+        if (blocks[index])
+        {
+            for (j = 0; j < sizes[index]; j++) if (blocks[index][j] != (unsigned char)index) break;
+            if (j < sizes[index]) info->errors++;
+
+            /* swap every eighth block with the other threads, to exercise cross-thread frees */
+            if (!(i % 8)) blocks[index] = InterlockedExchangePointer( &info->shared[index], blocks[index] );
+            if (blocks[index] && !RtlFreeHeap( info->heap, 0, blocks[index] )) info->errors++;
+        }
+        sizes[index] = (stress_rand( info ) >> 8) % ((i % 32) ? 256 : 4096);
+        if (!(blocks[index] = RtlAllocateHeap( info->heap, 0, sizes[index] )))
+        {
+            info->errors++;
+            continue;
+        }
+        memset( blocks[index], index, sizes[index] );
+    }
+
+    for (i = 0; i < STRESS_BLOCKS; i++) if (blocks[i]) RtlFreeHeap( info->heap, 0, blocks[i] );
+    return 0;
+}
+
+static void test_heap_stress( HANDLE heap, const char *name )
+{
+    struct stress_thread info[STRESS_THREADS];
+    HANDLE threads[STRESS_THREADS], start;
+    void *shared[STRESS_BLOCKS] = { 0 };
+    ULONG i;
+
+    start = CreateEventW( NULL, TRUE, FALSE, NULL );
+
+    for (i = 0; i < STRESS_THREADS; i++)
+    {
+        info[i].heap   = heap;
+        info[i].start  = start;
+        info[i].shared = shared;
+        info[i].seed   = i + 1;
+        info[i].errors = 0;
+        threads[i] = CreateThread( NULL, 0, stress_thread_proc, &info[i], 0, NULL );
+        ok( threads[i] != NULL, "CreateThread failed %u\n", GetLastError() );
+    }
+
+    SetEvent( start );
+    WaitForMultipleObjects( STRESS_THREADS, threads, TRUE, INFINITE );
+
+    for (i = 0; i < STRESS_THREADS; i++)
+    {
+        ok( !info[i].errors, "%s: thread %u got %u errors\n", name, i, info[i].errors );
+        CloseHandle( threads[i] );
+    }
+    for (i = 0; i < STRESS_BLOCKS; i++)
+        if (shared[i]) ok( RtlFreeHeap( heap, 0, shared[i] ), "%s: RtlFreeHeap failed\n", name );
+
+    ok( RtlValidateHeap( heap, 0, NULL ), "%s: heap is corrupted\n", name );
+
+    CloseHandle( start );
+}
+
+static void test_lfh_stress(void)
+{
+    ULONG compat = 2;
+    NTSTATUS status;
+    HANDLE heap;
+
+    heap = RtlCreateHeap( HEAP_GROWABLE, NULL, 0, 0, NULL, NULL );
+    ok( heap != NULL, "RtlCreateHeap failed\n" );
+    test_heap_stress( heap, "default" );
+
+    status = RtlSetHeapInformation( heap, HeapCompatibilityInformation, &compat, sizeof(compat) );
+    ok( !status, "RtlSetHeapInformation failed %x\n", status );
+    test_heap_stress( heap, "lfh" );
+
+    RtlDestroyHeap( heap );
+}
+
+START_TEST(heap)
+{
+    test_lfh_stress();
+}
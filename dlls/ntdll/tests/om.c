@@ -2853,6 +2853,51 @@ static void test_duplicate_object(void)
     if (!status) pNtClose( handle );
 }
 
+static void test_handle_info(void)
+{
+    OBJECT_DATA_INFORMATION data;
+    OBJECT_BASIC_INFORMATION info;
+    NTSTATUS status;
+    HANDLE handle, dup;
+    ULONG len;
+    BOOL ret;
+
+    handle = CreateEventA( NULL, FALSE, FALSE, NULL );
+    ok( handle != NULL, "CreateEvent failed %u\n", GetLastError() );
+
+    status = pNtQueryObject( handle, ObjectDataInformation, &data, sizeof(data), &len );
+    ok( !status, "NtQueryObject failed %x\n", status );
+    ok( !data.InheritHandle, "got InheritHandle %u\n", data.InheritHandle );
+    ok( !data.ProtectFromClose, "got ProtectFromClose %u\n", data.ProtectFromClose );
+    ok( len == sizeof(data), "wrong len %u\n", len );
+
+    ret = SetHandleInformation( handle, HANDLE_FLAG_INHERIT | HANDLE_FLAG_PROTECT_FROM_CLOSE,
+                                HANDLE_FLAG_INHERIT | HANDLE_FLAG_PROTECT_FROM_CLOSE );
+    ok( ret, "SetHandleInformation failed %u\n", GetLastError() );
+    status = pNtQueryObject( handle, ObjectDataInformation, &data, sizeof(data), &len );
+    ok( !status, "NtQueryObject failed %x\n", status );
+    ok( data.InheritHandle, "got InheritHandle %u\n", data.InheritHandle );
+    ok( data.ProtectFromClose, "got ProtectFromClose %u\n", data.ProtectFromClose );
+
+    ret = SetHandleInformation( handle, HANDLE_FLAG_PROTECT_FROM_CLOSE, 0 );
+    ok( ret, "SetHandleInformation failed %u\n", GetLastError() );
+    status = pNtQueryObject( handle, ObjectDataInformation, &data, sizeof(data), &len );
+    ok( !status, "NtQueryObject failed %x\n", status );
+    ok( data.InheritHandle, "got InheritHandle %u\n", data.InheritHandle );
+    ok( !data.ProtectFromClose, "got ProtectFromClose %u\n", data.ProtectFromClose );
+
+    status = pNtClose( handle );
+    ok( !status, "NtClose failed %x\n", status );
+
+    status = pNtQueryObject( handle, ObjectDataInformation, &data, sizeof(data), &len );
+    ok( status == STATUS_INVALID_HANDLE, "NtQueryObject returned %x\n", status );
+    status = pNtQueryObject( handle, ObjectBasicInformation, &info, sizeof(info), &len );
+    ok( status == STATUS_INVALID_HANDLE, "NtQueryObject returned %x\n", status );
+    status = pNtDuplicateObject( GetCurrentProcess(), handle, GetCurrentProcess(), &dup,
+                                 0, 0, DUPLICATE_SAME_ACCESS );
+    ok( status == STATUS_INVALID_HANDLE, "NtDuplicateObject returned %x\n", status );
+}
+
 static void test_object_types(void)
 {
     static const struct { const WCHAR *name; GENERIC_MAPPING mapping; ULONG mask, broken; } tests[] =
@@ -3111,6 +3156,7 @@ START_TEST(om)
     test_process();
     test_token();
     test_duplicate_object();
+    test_handle_info();
     test_object_types();
     test_get_next_thread();
 }
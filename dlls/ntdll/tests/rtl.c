@@ -82,6 +82,7 @@ static NTSTATUS  (WINAPI *pRtlInitializeCriticalSectionEx)(CRITICAL_SECTION *, U
 static NTSTATUS  (WINAPI *pLdrEnumerateLoadedModules)(void *, void *, void *);
 static NTSTATUS  (WINAPI *pLdrRegisterDllNotification)(ULONG, PLDR_DLL_NOTIFICATION_FUNCTION, void *, void **);
 static NTSTATUS  (WINAPI *pLdrUnregisterDllNotification)(void *);
+static void *    (WINAPI *pRtlFindExportedRoutineByName)(HMODULE,const char*);
 
 static HMODULE hkernel32 = 0;
 static BOOL      (WINAPI *pIsWow64Process)(HANDLE, PBOOL);
@@ -122,6 +123,7 @@ static void InitFunctionPtrs(void)
         pLdrEnumerateLoadedModules = (void *)GetProcAddress(hntdll, "LdrEnumerateLoadedModules");
         pLdrRegisterDllNotification = (void *)GetProcAddress(hntdll, "LdrRegisterDllNotification");
         pLdrUnregisterDllNotification = (void *)GetProcAddress(hntdll, "LdrUnregisterDllNotification");
+        pRtlFindExportedRoutineByName = (void *)GetProcAddress(hntdll, "RtlFindExportedRoutineByName");
     }
     hkernel32 = LoadLibraryA("kernel32.dll");
     ok(hkernel32 != 0, "LoadLibrary failed\n");
@@ -3682,6 +3684,61 @@ static void test_RtlDestroyHeap(void)
     RtlRemoveVectoredExceptionHandler( handler );
 }
 
+static void test_export_lookup(void)
+{
+    static const WCHAR *dlls[] = { L"ntdll.dll", L"kernel32.dll", L"advapi32.dll", L"msvcrt.dll",
+                                   L"user32.dll", L"ole32.dll" };
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    ULONG i, j, size;
+    const DWORD *names;
+    HMODULE module;
+    ANSI_STRING str;
+    NTSTATUS status;
+    void *proc, *ptr;
+
+    if (!pRtlFindExportedRoutineByName)
+    {
+        win_skip( "RtlFindExportedRoutineByName is not available\n" );
+        return;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(dlls); i++)
+    {
+        if (!(module = LoadLibraryW( dlls[i] ))) continue;
+        exports = RtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_EXPORT, &size );
+        ok( exports != NULL, "%s: no exports\n", wine_dbgstr_w(dlls[i]) );
+        names = (const DWORD *)((char *)module + exports->AddressOfNames);
+
+        for (j = 0; j < exports->NumberOfNames; j++)
+        {
+            const char *name = (const char *)module + names[j];
+
+            ptr = pRtlFindExportedRoutineByName( module, name );
+            RtlInitAnsiString( &str, name );
+            status = LdrGetProcedureAddress( module, &str, 0, &proc );
+
+            /* forwarded exports are resolved only by LdrGetProcedureAddress, check that the
+             * second lookup, which may be cached, agrees with the first one */
+            if ((char *)ptr >= (char *)exports && (char *)ptr < (char *)exports + size)
+            {
+                if (status) continue;
+                ptr = proc;
+                status = LdrGetProcedureAddress( module, &str, 0, &proc );
+                ok( !status, "%s: %s not found again %x\n", wine_dbgstr_w(dlls[i]), name, status );
+                ok( proc == ptr, "%s: %s got %p, expected %p\n", wine_dbgstr_w(dlls[i]), name, proc, ptr );
+                continue;
+            }
+            ok( !status, "%s: %s not found %x\n", wine_dbgstr_w(dlls[i]), name, status );
+            ok( proc == ptr, "%s: %s got %p, expected %p\n", wine_dbgstr_w(dlls[i]), name, proc, ptr );
+        }
+
+        RtlInitAnsiString( &str, "wine_no_such_export" );
+        status = LdrGetProcedureAddress( module, &str, 0, &proc );
+        ok( status == STATUS_PROCEDURE_NOT_FOUND, "%s: got %x\n", wine_dbgstr_w(dlls[i]), status );
+        FreeLibrary( module );
+    }
+}
+
 START_TEST(rtl)
 {
     InitFunctionPtrs();
@@ -3725,4 +3782,5 @@ START_TEST(rtl)
     test_LdrRegisterDllNotification();
     test_DbgPrint();
     test_RtlDestroyHeap();
+    test_export_lookup();
 }
@@ -811,6 +811,204 @@ static void test_tp_work_scheduler(void)
     pTpReleasePool(pool);
 }
 
+#define CONCURRENT_THREADS   4
+#define CONCURRENT_CALLBACKS 300
+
+struct concurrent_info
+{
+    TP_CALLBACK_ENVIRON_V3 environment;
+    LONG                   remaining;
+    LONG                   priorities[3];
+    HANDLE                 done;
+};
+
+static void CALLBACK concurrent_high_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
+{
+    struct concurrent_info *info = userdata;
+    InterlockedIncrement(&info->priorities[TP_CALLBACK_PRIORITY_HIGH]);
+    if (!InterlockedDecrement(&info->remaining)) SetEvent(info->done);
+}
+
+static void CALLBACK concurrent_normal_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
+{
+    struct concurrent_info *info = userdata;
+    InterlockedIncrement(&info->priorities[TP_CALLBACK_PRIORITY_NORMAL]);
+    if (!InterlockedDecrement(&info->remaining)) SetEvent(info->done);
+}
+
+static void CALLBACK concurrent_low_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
+{
+    struct concurrent_info *info = userdata;
+    InterlockedIncrement(&info->priorities[TP_CALLBACK_PRIORITY_LOW]);
+    if (!InterlockedDecrement(&info->remaining)) SetEvent(info->done);
+}
+
+static DWORD CALLBACK concurrent_thread(void *arg)
+{
+    static const PTP_SIMPLE_CALLBACK callbacks[] = { concurrent_high_cb, concurrent_normal_cb, concurrent_low_cb };
+    struct concurrent_info *info = arg;
+    TP_CALLBACK_ENVIRON_V3 environment = info->environment;
+    NTSTATUS status;
+    int i;
+
+    for (i = 0; i < CONCURRENT_CALLBACKS; ++i)
+    {
+        environment.CallbackPriority = i % 3;
+        status = pTpSimpleTryPost(callbacks[i % 3], info, (TP_CALLBACK_ENVIRON *)&environment);
+        ok(!status, "TpSimpleTryPost failed with status %x\n", status);
+    }
+    return 0;
+}
+
+static void run_tp_simple_concurrent(TP_POOL *pool)
+{
+    HANDLE threads[CONCURRENT_THREADS];
+    struct concurrent_info info;
+    DWORD result;
+    int i;
+
+    memset(&info, 0, sizeof(info));
+    info.environment.Version = 3;
+    info.environment.Pool = pool;
+    info.environment.Size = sizeof(info.environment);
+    info.remaining = CONCURRENT_THREADS * CONCURRENT_CALLBACKS;
+    info.done = CreateEventA(NULL, TRUE, FALSE, NULL);
+    ok(info.done != NULL, "CreateEventA failed %u\n", GetLastError());
+
+    for (i = 0; i < CONCURRENT_THREADS; ++i)
+    {
+        threads[i] = CreateThread(NULL, 0, concurrent_thread, &info, 0, NULL);
+        ok(threads[i] != NULL, "CreateThread failed %u\n", GetLastError());
+    }
+    result = WaitForSingleObject(info.done, 5000);
+    ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+
+    WaitForMultipleObjects(CONCURRENT_THREADS, threads, TRUE, INFINITE);
+    for (i = 0; i < CONCURRENT_THREADS; ++i) CloseHandle(threads[i]);
+
+    ok(!info.remaining, "%u callbacks were not executed\n", info.remaining);
+    for (i = 0; i < 3; ++i)
+        ok(info.priorities[i] == CONCURRENT_THREADS * (CONCURRENT_CALLBACKS / 3 + (i < CONCURRENT_CALLBACKS % 3)),
+           "got %u callbacks with priority %u\n", info.priorities[i], i);
+    CloseHandle(info.done);
+}
+
+static void test_tp_simple_concurrent(void)
+{
+    NTSTATUS status;
+    TP_POOL *pool;
+
+    run_tp_simple_concurrent(NULL);
+
+    pool = NULL;
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %x\n", status);
+    pTpSetPoolMaxThreads(pool, 8);
+    run_tp_simple_concurrent(pool);
+
+    /* a single thread still executes everything */
+    pTpSetPoolMaxThreads(pool, 1);
+    run_tp_simple_concurrent(pool);
+    pTpReleasePool(pool);
+}
+
+struct priority_info
+{
+    HANDLE started;
+    HANDLE release;
+    HANDLE done;
+    LONG   count;
+    int    order[6];
+};
+
+static void CALLBACK priority_block_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
+{
+    struct priority_info *info = userdata;
+    DWORD result;
+
+    SetEvent(info->started);
+    result = WaitForSingleObject(info->release, 5000);
+    ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+}
+
+static void record_priority(struct priority_info *info, int priority)
+{
+    LONG index = InterlockedIncrement(&info->count) - 1;
+    if (index < ARRAY_SIZE(info->order)) info->order[index] = priority;
+    if (index == ARRAY_SIZE(info->order) - 1) SetEvent(info->done);
+}
+
+static void CALLBACK priority_high_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
+{
+    record_priority(userdata, TP_CALLBACK_PRIORITY_HIGH);
+}
+
+static void CALLBACK priority_normal_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
+{
+    record_priority(userdata, TP_CALLBACK_PRIORITY_NORMAL);
+}
+
+static void CALLBACK priority_low_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
+{
+    record_priority(userdata, TP_CALLBACK_PRIORITY_LOW);
+}
+
+static void test_tp_simple_priority(void)
+{
+    static const PTP_SIMPLE_CALLBACK callbacks[] = { priority_high_cb, priority_normal_cb, priority_low_cb };
+    static const int posted[] = { TP_CALLBACK_PRIORITY_LOW, TP_CALLBACK_PRIORITY_NORMAL, TP_CALLBACK_PRIORITY_HIGH,
+                                  TP_CALLBACK_PRIORITY_LOW, TP_CALLBACK_PRIORITY_HIGH, TP_CALLBACK_PRIORITY_NORMAL };
+    static const int expected[] = { TP_CALLBACK_PRIORITY_HIGH, TP_CALLBACK_PRIORITY_HIGH, TP_CALLBACK_PRIORITY_NORMAL,
+                                    TP_CALLBACK_PRIORITY_NORMAL, TP_CALLBACK_PRIORITY_LOW, TP_CALLBACK_PRIORITY_LOW };
+    TP_CALLBACK_ENVIRON_V3 environment;
+    struct priority_info info;
+    NTSTATUS status;
+    TP_POOL *pool;
+    DWORD result;
+    int i;
+
+    memset(&info, 0, sizeof(info));
+    info.started = CreateEventA(NULL, FALSE, FALSE, NULL);
+    info.release = CreateEventA(NULL, FALSE, FALSE, NULL);
+    info.done = CreateEventA(NULL, FALSE, FALSE, NULL);
+
+    pool = NULL;
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %x\n", status);
+    pTpSetPoolMaxThreads(pool, 1);
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 3;
+    environment.Pool = pool;
+    environment.Size = sizeof(environment);
+
+    /* keep the only worker busy while the callbacks are queued */
+    environment.CallbackPriority = TP_CALLBACK_PRIORITY_NORMAL;
+    status = pTpSimpleTryPost(priority_block_cb, &info, (TP_CALLBACK_ENVIRON *)&environment);
+    ok(!status, "TpSimpleTryPost failed with status %x\n", status);
+    result = WaitForSingleObject(info.started, 1000);
+    ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+
+    for (i = 0; i < ARRAY_SIZE(posted); ++i)
+    {
+        environment.CallbackPriority = posted[i];
+        status = pTpSimpleTryPost(callbacks[posted[i]], &info, (TP_CALLBACK_ENVIRON *)&environment);
+        ok(!status, "TpSimpleTryPost failed with status %x\n", status);
+    }
+    SetEvent(info.release);
+
+    result = WaitForSingleObject(info.done, 1000);
+    ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+    ok(info.count == ARRAY_SIZE(expected), "got %u callbacks\n", info.count);
+    for (i = 0; i < ARRAY_SIZE(expected); ++i)
+        ok(info.order[i] == expected[i], "callback %u: got priority %u, expected %u\n", i, info.order[i], expected[i]);
+
+    pTpReleasePool(pool);
+    CloseHandle(info.started);
+    CloseHandle(info.release);
+    CloseHandle(info.done);
+}
+
 static void CALLBACK simple_release_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
 {
     HANDLE *semaphores = userdata;
@@ -2370,6 +2568,8 @@ START_TEST(threadpool)
     test_tp_simple();
     test_tp_work();
     test_tp_work_scheduler();
+    test_tp_simple_concurrent();
+    test_tp_simple_priority();
     test_tp_group_wait();
     test_tp_group_cancel();
     test_tp_instance();
@@ -1005,6 +1005,256 @@ static void perform_relocations( void *module, INT_PTR delta )
 }
 
 
+#define RELOC_CHILDREN 4
+
+/* load a DLL away from its preferred base, and return the number of private pages in its image */
+static DWORD child_relocated_image(void)
+{
+    MEMORY_WORKING_SET_EX_INFORMATION *info;
+    IMAGE_DOS_HEADER dos;
+    IMAGE_NT_HEADERS nt;
+    char path[MAX_PATH];
+    SIZE_T i, count;
+    DWORD size, private = 0;
+    HANDLE file;
+    HMODULE module;
+    BYTE byte;
+    void *reserved;
+
+    GetSystemDirectoryA( path, MAX_PATH );
+    strcat( path, "\\dbghelp.dll" );
+    file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0 );
+    if (file == INVALID_HANDLE_VALUE) return ~0u;
+    ReadFile( file, &dos, sizeof(dos), &size, NULL );
+    SetFilePointer( file, dos.e_lfanew, NULL, FILE_BEGIN );
+    ReadFile( file, &nt, sizeof(nt), &size, NULL );
+    CloseHandle( file );
+
+    reserved = VirtualAlloc( (void *)nt.OptionalHeader.ImageBase, nt.OptionalHeader.SizeOfImage,
+                             MEM_RESERVE, PAGE_NOACCESS );
+    if (!(module = LoadLibraryA( path ))) return ~0u;
+    if (module == (HMODULE)nt.OptionalHeader.ImageBase || !reserved) return ~0u;
+
+    /* touch all the readable pages, as if the whole DLL was used */
+    count = nt.OptionalHeader.SizeOfImage / page_size;
+    info = HeapAlloc( GetProcessHeap(), 0, count * sizeof(*info) );
+    for (i = 0; i < count; i++)
+    {
+        info[i].VirtualAddress = (char *)module + i * page_size;
+        ReadProcessMemory( GetCurrentProcess(), info[i].VirtualAddress, &byte, 1, NULL );
+    }
+    if (NtQueryVirtualMemory( GetCurrentProcess(), module, MemoryWorkingSetExInformation,
+                              info, count * sizeof(*info), NULL )) return ~0u;
+    for (i = 0; i < count; i++)
+        if (info[i].VirtualAttributes.Valid && !info[i].VirtualAttributes.Shared) private++;
+    return private;
+}
+
+static void test_relocated_image_sharing(void)
+{
+    DWORD code, private[2];
+    HANDLE process;
+    int cache, i;
+
+    for (cache = 0; cache < 2; cache++)
+    {
+        SetEnvironmentVariableA( "WINERELOCCACHE", cache ? "1" : NULL );
+        private[cache] = 0;
+        for (i = 0; i < RELOC_CHILDREN; i++)
+        {
+            process = create_target_process( "reloc" );
+            ok( WaitForSingleObject( process, 10000 ) == WAIT_OBJECT_0, "child didn't exit\n" );
+            GetExitCodeProcess( process, &code );
+            CloseHandle( process );
+            if (code == ~0u)
+            {
+                skip( "could not load a relocated dll\n" );
+                SetEnvironmentVariableA( "WINERELOCCACHE", NULL );
+                return;
+            }
+            private[cache] += code;
+        }
+        trace( "relocated dll in %u processes, %s cache: %u private pages\n",
+               RELOC_CHILDREN, cache ? "with" : "without", private[cache] );
+    }
+    SetEnvironmentVariableA( "WINERELOCCACHE", NULL );
+
+    trace( "resident memory saving: %d KB\n", (int)(private[0] - private[1]) * (int)(page_size / 1024) );
+}
+
+#define PROTECT_THREADS    4
+#define PROTECT_ITERATIONS 1000
+#define PROTECT_PAGES      16
+
+struct protect_thread
+{
+    HANDLE start;
+    LONG   errors;
+};
+
+static DWORD WINAPI protect_thread_proc( void *arg )
+{
+    struct protect_thread *info = arg;
+    SIZE_T size, region_size = PROTECT_PAGES * page_size;
+    void *region = NULL, *addr;
+    NTSTATUS status;
+    ULONG i, prot;
+    char *page;
+
+    WaitForSingleObject( info->start, INFINITE );
+
+    for (i = 0; i < PROTECT_ITERATIONS; i++)
+    {
+        /* replace the region from time to time to also exercise changes to the views tree */
+        if (!(i % 256))
+        {
+            if (region)
+            {
+                size = 0;
+                NtFreeVirtualMemory( NtCurrentProcess(), &region, &size, MEM_RELEASE );
+            }
+            region = NULL;
+            size = region_size;
+            status = NtAllocateVirtualMemory( NtCurrentProcess(), &region, 0, &size, MEM_RESERVE, PAGE_NOACCESS );
+            if (status)
+            {
+                info->errors++;
+                return 0;
+            }
+        }
+
+        page = (char *)region + (i % PROTECT_PAGES) * page_size;
+        addr = page;
+        size = page_size;
+        status = NtAllocateVirtualMemory( NtCurrentProcess(), &addr, 0, &size, MEM_COMMIT, PAGE_READWRITE );
+        if (status) info->errors++;
+        *page = i;
+
+        addr = page;
+        size = page_size;
+        status = NtProtectVirtualMemory( NtCurrentProcess(), &addr, &size, PAGE_READONLY, &prot );
+        if (status || prot != PAGE_READWRITE) info->errors++;
+        if (*page != (char)i) info->errors++;
+
+        status = NtProtectVirtualMemory( NtCurrentProcess(), &addr, &size, PAGE_READWRITE, &prot );
+        if (status || prot != PAGE_READONLY) info->errors++;
+    }
+
+    size = 0;
+    NtFreeVirtualMemory( NtCurrentProcess(), &region, &size, MEM_RELEASE );
+    return 0;
+}
+
+static void test_concurrent_protect(void)
+{
+    struct protect_thread info[PROTECT_THREADS];
+    HANDLE threads[PROTECT_THREADS], start;
+    ULONG i;
+
+    start = CreateEventW( NULL, TRUE, FALSE, NULL );
+    for (i = 0; i < PROTECT_THREADS; i++)
+    {
+        info[i].start  = start;
+        info[i].errors = 0;
+        threads[i] = CreateThread( NULL, 0, protect_thread_proc, &info[i], 0, NULL );
+        ok( threads[i] != NULL, "CreateThread failed %u\n", GetLastError() );
+    }
+    SetEvent( start );
+    WaitForMultipleObjects( PROTECT_THREADS, threads, TRUE, INFINITE );
+    for (i = 0; i < PROTECT_THREADS; i++)
+    {
+        ok( !info[i].errors, "thread %u got %u errors\n", i, info[i].errors );
+        CloseHandle( threads[i] );
+    }
+    CloseHandle( start );
+}
+
+static void check_write_watch( void *base, SIZE_T size, ULONG_PTR expect_count, void *expect_addr )
+{
+    void *results[16];
+    ULONG_PTR count = ARRAY_SIZE(results);
+    ULONG pagesize;
+    NTSTATUS status;
+
+    status = NtGetWriteWatch( NtCurrentProcess(), WRITE_WATCH_FLAG_RESET, base, size, results, &count, &pagesize );
+    ok( !status, "NtGetWriteWatch failed %x\n", status );
+    ok( count == expect_count, "got %lu written pages\n", count );
+    if (count) ok( results[0] == expect_addr, "got %p, expected %p\n", results[0], expect_addr );
+}
+
+/* reading into write watched pages goes through the locked read path */
+static void test_write_watch_read(void)
+{
+    char path[MAX_PATH], *buffer;
+    SIZE_T size;
+    void *base, *addr;
+    DWORD bytes;
+    NTSTATUS status;
+    HANDLE file;
+    BOOL ret;
+
+    GetTempPathA( MAX_PATH, path );
+    GetTempFileNameA( path, "wat", 0, path );
+    file = CreateFileA( path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_DELETE_ON_CLOSE, 0 );
+    ok( file != INVALID_HANDLE_VALUE, "CreateFile failed %u\n", GetLastError() );
+    buffer = HeapAlloc( GetProcessHeap(), 0, page_size );
+    memset( buffer, 0x55, page_size );
+    ret = WriteFile( file, buffer, page_size, &bytes, NULL );
+    ok( ret && bytes == page_size, "WriteFile failed %u\n", GetLastError() );
+
+    /* a buffer across two pages of a single view */
+    base = NULL;
+    size = 2 * page_size;
+    status = NtAllocateVirtualMemory( NtCurrentProcess(), &base, 0, &size,
+                                      MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH, PAGE_READWRITE );
+    if (status == STATUS_NOT_SUPPORTED)
+    {
+        win_skip( "MEM_WRITE_WATCH not supported\n" );
+        goto done;
+    }
+    ok( !status, "NtAllocateVirtualMemory failed %x\n", status );
+    check_write_watch( base, size, 0, NULL );
+    SetFilePointer( file, 0, NULL, FILE_BEGIN );
+    ret = ReadFile( file, (char *)base + page_size / 2, page_size, &bytes, NULL );
+    ok( ret && bytes == page_size, "ReadFile failed %u\n", GetLastError() );
+    ok( !memcmp( (char *)base + page_size / 2, buffer, page_size ), "wrong data\n" );
+    check_write_watch( base, size, 2, base );
+    size = 0;
+    NtFreeVirtualMemory( NtCurrentProcess(), &base, &size, MEM_RELEASE );
+
+    /* a buffer across two adjacent views */
+    base = NULL;
+    size = 0x20000;
+    status = NtAllocateVirtualMemory( NtCurrentProcess(), &base, 0, &size, MEM_RESERVE, PAGE_NOACCESS );
+    ok( !status, "NtAllocateVirtualMemory failed %x\n", status );
+    size = 0;
+    NtFreeVirtualMemory( NtCurrentProcess(), &base, &size, MEM_RELEASE );
+    addr = base;
+    size = 0x10000;
+    status = NtAllocateVirtualMemory( NtCurrentProcess(), &addr, 0, &size,
+                                      MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH, PAGE_READWRITE );
+    ok( !status, "NtAllocateVirtualMemory failed %x\n", status );
+    addr = (char *)base + 0x10000;
+    size = 0x10000;
+    status = NtAllocateVirtualMemory( NtCurrentProcess(), &addr, 0, &size,
+                                      MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH, PAGE_READWRITE );
+    ok( !status, "NtAllocateVirtualMemory failed %x\n", status );
+    SetFilePointer( file, 0, NULL, FILE_BEGIN );
+    ret = ReadFile( file, (char *)base + 0x10000 - page_size / 2, page_size, &bytes, NULL );
+    ok( ret && bytes == page_size, "ReadFile failed %u\n", GetLastError() );
+    ok( !memcmp( (char *)base + 0x10000 - page_size / 2, buffer, page_size ), "wrong data\n" );
+    check_write_watch( base, 0x10000, 1, (char *)base + 0x10000 - page_size );
+    check_write_watch( addr, 0x10000, 1, addr );
+    size = 0;
+    NtFreeVirtualMemory( NtCurrentProcess(), &base, &size, MEM_RELEASE );
+    size = 0;
+    NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+
+done:
+    HeapFree( GetProcessHeap(), 0, buffer );
+    CloseHandle( file );
+}
+
 static void test_syscalls(void)
 {
     HMODULE module = GetModuleHandleW( L"ntdll.dll" );
@@ -1104,6 +1354,12 @@ START_TEST(virtual)
             Sleep(5000); /* spawned process runs for at most 5 seconds */
             return;
         }
+        if (!strcmp(argv[2], "reloc"))
+        {
+            NtQuerySystemInformation(SystemBasicInformation, &sbi, sizeof(sbi), NULL);
+            page_size = sbi.PageSize;
+            ExitProcess( child_relocated_image() );
+        }
         return;
     }
 
@@ -1128,4 +1384,7 @@ START_TEST(virtual)
     test_NtMapViewOfSection();
     test_user_shared_data();
     test_syscalls();
+    test_relocated_image_sharing();
+    test_concurrent_protect();
+    test_write_watch_read();
 }
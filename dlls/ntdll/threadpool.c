@@ -98,8 +98,30 @@ struct timer_queue
  */
 
 #define THREADPOOL_WORKER_TIMEOUT 5000
+#define THREADPOOL_LOCAL_QUEUE_SIZE 256  /* must be a power of two */
 #define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
 
+struct threadpool_object;
+
+/* queue of private callbacks owned by a worker thread. Only the owner adds
+ * objects to it, but any worker can take them. */
+struct threadpool_local_queue
+{
+    LONG                      head;  /* index of the next object to take */
+    LONG                      tail;  /* index of the next free slot */
+    struct threadpool_object *objects[THREADPOOL_LOCAL_QUEUE_SIZE];
+};
+
+/* internal worker thread representation, kept until the pool is destroyed */
+struct threadpool_worker
+{
+    struct threadpool_worker *next;
+    struct threadpool       *pool;
+    BOOL                    active;  /* locked via .pool->cs */
+    /* order matches TP_CALLBACK_PRIORITY - high, normal, low */
+    struct threadpool_local_queue queues[3];
+};
+
 /* internal threadpool representation */
 struct threadpool
 {
@@ -109,12 +131,18 @@ struct threadpool
     CRITICAL_SECTION        cs;
     /* Pools of work items, locked via .cs, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
     struct list             pools[3];
-    RTL_CONDITION_VARIABLE  update_event;
-    /* information about worker threads, locked via .cs */
+    /* Private callbacks submitted without taking .cs, same order as above. */
+    SLIST_HEADER            submitted[3];
+    LONG                    num_private_pending;
+    /* Worker threads, only added to the list while holding .cs. */
+    struct threadpool_worker *workers;
+    LONG                    num_idle_workers;
+    LONG                    wake_seq;
+    /* information about worker threads, modified while holding .cs */
     int                     max_workers;
     int                     min_workers;
-    int                     num_workers;
-    int                     num_busy_workers;
+    LONG                    num_workers;
+    LONG                    num_busy_workers;
     HANDLE                  compl_port;
     TP_POOL_STACK_INFORMATION stack_info;
 };
@@ -155,6 +183,7 @@ struct threadpool_object
     BOOL                    is_group_member;
     /* information about the pool, locked via .pool->cs */
     struct list             pool_entry;
+    SLIST_ENTRY             submit_entry;
     RTL_CONDITION_VARIABLE  finished_event;
     RTL_CONDITION_VARIABLE  group_finished_event;
     HANDLE                  completed_event;
@@ -363,6 +392,7 @@ static inline struct threadpool_instance *impl_from_TP_CALLBACK_INSTANCE( TP_CAL
 }
 
 static void CALLBACK threadpool_worker_proc( void *param );
+static void tp_threadpool_wake( struct threadpool *pool, BOOL all );
 static void tp_object_submit( struct threadpool_object *object, BOOL signaled );
 static void tp_object_execute( struct threadpool_object *object, BOOL wait_thread );
 static void tp_object_prepare_shutdown( struct threadpool_object *object );
@@ -1141,15 +1171,30 @@ static void CALLBACK timerqueue_thread_proc( void *param )
  */
 static NTSTATUS tp_new_worker_thread( struct threadpool *pool )
 {
+    struct threadpool_worker *worker;
     HANDLE thread;
     NTSTATUS status;
 
+    /* reuse the state of a terminated worker, its local queues are empty */
+    for (worker = pool->workers; worker; worker = worker->next)
+        if (!worker->active) break;
+
+    if (!worker)
+    {
+        if (!(worker = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*worker) )))
+            return STATUS_NO_MEMORY;
+        worker->pool = pool;
+        worker->next = pool->workers;
+        InterlockedExchangePointer( (void **)&pool->workers, worker );
+    }
+
     status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, 0, 0, 0,
-                                  threadpool_worker_proc, pool, &thread, NULL );
+                                  threadpool_worker_proc, worker, &thread, NULL );
     if (status == STATUS_SUCCESS)
     {
         InterlockedIncrement( &pool->refcount );
         pool->num_workers++;
+        worker->active = TRUE;
         NtClose( thread );
     }
     return status;
@@ -1670,7 +1715,12 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
 
     for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
         list_init( &pool->pools[i] );
-    RtlInitializeConditionVariable( &pool->update_event );
+    for (i = 0; i < ARRAY_SIZE(pool->submitted); ++i)
+        RtlInitializeSListHead( &pool->submitted[i] );
+    pool->num_private_pending     = 0;
+    pool->workers                 = NULL;
+    pool->num_idle_workers        = 0;
+    pool->wake_seq                = 0;
 
     pool->max_workers             = 500;
     pool->min_workers             = 0;
@@ -1697,7 +1747,7 @@ static void tp_threadpool_shutdown( struct threadpool *pool )
     assert( pool != default_threadpool );
 
     pool->shutdown = TRUE;
-    RtlWakeAllConditionVariable( &pool->update_event );
+    tp_threadpool_wake( pool, TRUE );
 }
 
 /***********************************************************************
@@ -1707,6 +1757,7 @@ static void tp_threadpool_shutdown( struct threadpool *pool )
  */
 static BOOL tp_threadpool_release( struct threadpool *pool )
 {
+    struct threadpool_worker *worker;
     unsigned int i;
 
     if (InterlockedDecrement( &pool->refcount ))
@@ -1716,9 +1767,17 @@ static BOOL tp_threadpool_release( struct threadpool *pool )
 
     assert( pool->shutdown );
     assert( !pool->objcount );
+    assert( !pool->num_private_pending );
     for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
         assert( list_empty( &pool->pools[i] ) );
 
+    while ((worker = pool->workers))
+    {
+        assert( !worker->active );
+        pool->workers = worker->next;
+        RtlFreeHeap( GetProcessHeap(), 0, worker );
+    }
+
     pool->cs.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &pool->cs );
 
@@ -1777,22 +1836,25 @@ static NTSTATUS tp_threadpool_lock( struct threadpool **out, TP_CALLBACK_ENVIRON
         pool = default_threadpool;
     }
 
-    RtlEnterCriticalSection( &pool->cs );
-
-    /* Make sure that the threadpool has at least one thread. */
+    /* Make sure that the threadpool has at least one thread. If the last
+     * one is terminating concurrently, submitting a callback starts a new
+     * one, so the lock is only needed when there are no threads at all. */
     if (!pool->num_workers)
-        status = tp_new_worker_thread( pool );
+    {
+        RtlEnterCriticalSection( &pool->cs );
+        if (!pool->num_workers)
+            status = tp_new_worker_thread( pool );
+        RtlLeaveCriticalSection( &pool->cs );
+    }
 
     /* Keep a reference, and increment objcount to ensure that the
      * last thread doesn't terminate. */
     if (status == STATUS_SUCCESS)
     {
         InterlockedIncrement( &pool->refcount );
-        pool->objcount++;
+        InterlockedIncrement( &pool->objcount );
     }
 
-    RtlLeaveCriticalSection( &pool->cs );
-
     if (status != STATUS_SUCCESS)
         return status;
 
@@ -1807,12 +1869,24 @@ static NTSTATUS tp_threadpool_lock( struct threadpool **out, TP_CALLBACK_ENVIRON
  */
 static void tp_threadpool_unlock( struct threadpool *pool )
 {
-    RtlEnterCriticalSection( &pool->cs );
-    pool->objcount--;
-    RtlLeaveCriticalSection( &pool->cs );
+    InterlockedDecrement( &pool->objcount );
     tp_threadpool_release( pool );
 }
 
+/***********************************************************************
+ *           tp_threadpool_wake    (internal)
+ *
+ * Wakes up one or all of the idle worker threads of a pool.
+ */
+static void tp_threadpool_wake( struct threadpool *pool, BOOL all )
+{
+    InterlockedIncrement( &pool->wake_seq );
+    if (all)
+        RtlWakeAddressAll( &pool->wake_seq );
+    else
+        RtlWakeAddressSingle( &pool->wake_seq );
+}
+
 /***********************************************************************
  *           tp_group_alloc    (internal)
  *
@@ -1957,12 +2031,53 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
         tp_object_release( object );
 }
 
+/* Simple callbacks without a cleanup group can neither be waited for nor
+ * cancelled, so they are queued and executed without taking the pool lock. */
+static inline BOOL tp_object_is_private( const struct threadpool_object *object )
+{
+    return object->type == TP_OBJECT_TYPE_SIMPLE && !object->group;
+}
+
 static void tp_object_prio_queue( struct threadpool_object *object )
 {
-    ++object->pool->num_busy_workers;
+    InterlockedIncrement( &object->pool->num_busy_workers );
     list_add_tail( &object->pool->pools[object->priority], &object->pool_entry );
 }
 
+/***********************************************************************
+ *           tp_object_submit_private    (internal)
+ *
+ * Submits a private callback to the associated threadpool without taking
+ * the pool lock, unless a new worker thread has to be started.
+ */
+static void tp_object_submit_private( struct threadpool_object *object )
+{
+    struct threadpool *pool = object->pool;
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+    InterlockedIncrement( &object->refcount );
+    object->num_pending_callbacks = 1;
+
+    /* The pending count has to be visible before an idle worker goes to sleep,
+     * and the number of workers is read after it, see threadpool_worker_proc. */
+    InterlockedIncrement( &pool->num_busy_workers );
+    InterlockedIncrement( &pool->num_private_pending );
+    RtlInterlockedPushEntrySList( &pool->submitted[object->priority], &object->submit_entry );
+
+    /* Start new worker threads if required. */
+    if (pool->num_busy_workers >= pool->num_workers && pool->num_workers < pool->max_workers)
+    {
+        RtlEnterCriticalSection( &pool->cs );
+        if (pool->num_busy_workers >= pool->num_workers && pool->num_workers < pool->max_workers)
+            status = tp_new_worker_thread( pool );
+        RtlLeaveCriticalSection( &pool->cs );
+    }
+
+    /* No new thread started - wake up one existing thread. */
+    if (status != STATUS_SUCCESS && pool->num_idle_workers)
+        tp_threadpool_wake( pool, FALSE );
+}
+
 /***********************************************************************
  *           tp_object_submit    (internal)
  *
@@ -1977,6 +2092,12 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
     assert( !object->shutdown );
     assert( !pool->shutdown );
 
+    if (tp_object_is_private( object ))
+    {
+        tp_object_submit_private( object );
+        return;
+    }
+
     RtlEnterCriticalSection( &pool->cs );
 
     /* Start new worker threads if required. */
@@ -1997,7 +2118,7 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
     if (status != STATUS_SUCCESS)
     {
         assert( pool->num_workers > 0 );
-        RtlWakeConditionVariable( &pool->update_event );
+        if (pool->num_idle_workers) tp_threadpool_wake( pool, FALSE );
     }
 
     RtlLeaveCriticalSection( &pool->cs );
@@ -2160,7 +2281,7 @@ static struct list *threadpool_get_next_item( const struct threadpool *pool )
  *           tp_object_execute    (internal)
  *
  * Executes a threadpool object callback, object->pool->cs has to be
- * held.
+ * held unless the object is private.
  */
 static void tp_object_execute( struct threadpool_object *object, BOOL wait_thread )
 {
@@ -2168,6 +2289,7 @@ static void tp_object_execute( struct threadpool_object *object, BOOL wait_threa
     struct threadpool_instance instance;
     struct io_completion completion;
     struct threadpool *pool = object->pool;
+    BOOL is_private = tp_object_is_private( object );
     TP_WAIT_RESULT wait_result = 0;
     NTSTATUS status;
 
@@ -2188,7 +2310,7 @@ static void tp_object_execute( struct threadpool_object *object, BOOL wait_threa
     /* Leave critical section and do the actual callback. */
     object->num_associated_callbacks++;
     object->num_running_callbacks++;
-    RtlLeaveCriticalSection( &pool->cs );
+    if (!is_private) RtlLeaveCriticalSection( &pool->cs );
     if (wait_thread) RtlLeaveCriticalSection( &waitqueue.cs );
 
     /* Initialize threadpool instance struct. */
@@ -2294,6 +2416,16 @@ static void tp_object_execute( struct threadpool_object *object, BOOL wait_threa
 
 skip_cleanup:
     if (wait_thread) RtlEnterCriticalSection( &waitqueue.cs );
+
+    /* Nobody can wait for a private object, no need to signal anything. */
+    if (is_private)
+    {
+        object->shutdown = TRUE;
+        object->num_running_callbacks--;
+        if (instance.associated) object->num_associated_callbacks--;
+        return;
+    }
+
     RtlEnterCriticalSection( &pool->cs );
 
     /* Simple callbacks are automatically shutdown after execution. */
@@ -2315,23 +2447,151 @@ skip_cleanup:
     }
 }
 
+/***********************************************************************
+ *           tp_local_queue_push    (internal)
+ *
+ * Adds an object to the local queue of the current worker thread.
+ */
+static BOOL tp_local_queue_push( struct threadpool_local_queue *queue, struct threadpool_object *object )
+{
+    ULONG tail = queue->tail;
+
+    if (tail - (ULONG)queue->head >= THREADPOOL_LOCAL_QUEUE_SIZE) return FALSE;
+    queue->objects[tail & (THREADPOOL_LOCAL_QUEUE_SIZE - 1)] = object;
+    InterlockedExchange( &queue->tail, tail + 1 );
+    return TRUE;
+}
+
+/***********************************************************************
+ *           tp_local_queue_pop    (internal)
+ *
+ * Takes the oldest object from the local queue of a worker thread.
+ */
+static struct threadpool_object *tp_local_queue_pop( struct threadpool_local_queue *queue, BOOL owner )
+{
+    struct threadpool_object *object;
+    ULONG head, tail;
+
+    for (;;)
+    {
+        head = queue->head;
+        /* other threads need to see the object stored before the tail was updated */
+        tail = owner ? queue->tail : InterlockedCompareExchange( &queue->tail, 0, 0 );
+        if (head == tail) return NULL;
+        object = queue->objects[head & (THREADPOOL_LOCAL_QUEUE_SIZE - 1)];
+        if (InterlockedCompareExchange( &queue->head, head + 1, head ) == head) return object;
+    }
+}
+
+/***********************************************************************
+ *           tp_worker_take_submitted    (internal)
+ *
+ * Moves the oldest private callbacks submitted to a pool to the local
+ * queue of a worker thread.
+ */
+static void tp_worker_take_submitted( struct threadpool_worker *worker, unsigned int priority )
+{
+    struct threadpool_local_queue *queue = &worker->queues[priority];
+    SLIST_ENTRY *entry, *next, *list = NULL;
+
+    if (!(entry = RtlInterlockedFlushSList( &worker->pool->submitted[priority] ))) return;
+
+    /* the list is in LIFO order, reverse it */
+    for (; entry; entry = next)
+    {
+        next = entry->Next;
+        entry->Next = list;
+        list = entry;
+    }
+
+    for (entry = list; entry; entry = next)
+    {
+        /* the object may be executed as soon as it has been pushed */
+        next = entry->Next;
+        if (!tp_local_queue_push( queue, CONTAINING_RECORD( entry, struct threadpool_object, submit_entry ) ))
+            break;
+    }
+
+    /* the local queue is full, give the remaining objects back to the other workers */
+    for (; entry; entry = next)
+    {
+        next = entry->Next;
+        RtlInterlockedPushEntrySList( &worker->pool->submitted[priority], entry );
+    }
+}
+
+/***********************************************************************
+ *           tp_worker_get_private    (internal)
+ *
+ * Returns the next private callback of the given priority, looking at
+ * the local queue of the worker first, then at the callbacks submitted
+ * to the pool, and finally at the local queues of the other workers.
+ */
+static struct threadpool_object *tp_worker_get_private( struct threadpool_worker *worker, unsigned int priority )
+{
+    struct threadpool *pool = worker->pool;
+    struct threadpool_worker *other = worker;
+    struct threadpool_object *object;
+
+    if (!(object = tp_local_queue_pop( &worker->queues[priority], TRUE )))
+    {
+        tp_worker_take_submitted( worker, priority );
+        object = tp_local_queue_pop( &worker->queues[priority], TRUE );
+    }
+
+    while (!object)
+    {
+        if (!(other = other->next)) other = pool->workers;
+        if (other == worker) return NULL;
+        object = tp_local_queue_pop( &other->queues[priority], FALSE );
+    }
+
+    InterlockedDecrement( &pool->num_private_pending );
+    return object;
+}
+
 /***********************************************************************
  *           threadpool_worker_proc    (internal)
  */
 static void CALLBACK threadpool_worker_proc( void *param )
 {
-    struct threadpool *pool = param;
+    struct threadpool_worker *worker = param;
+    struct threadpool *pool = worker->pool;
+    struct threadpool_object *object;
     LARGE_INTEGER timeout;
     struct list *ptr;
+    NTSTATUS status;
+    unsigned int i;
+    LONG seq;
 
     TRACE( "starting worker thread for pool %p\n", pool );
 
-    RtlEnterCriticalSection( &pool->cs );
     for (;;)
     {
-        while ((ptr = threadpool_get_next_item( pool )))
+        /* Private callbacks are executed without taking the lock, as long as
+         * there are no locked work items with the same or a higher priority. */
+        for (i = 0, object = NULL; i < ARRAY_SIZE(pool->pools); ++i)
         {
-            struct threadpool_object *object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
+            if (pool->num_private_pending && (object = tp_worker_get_private( worker, i ))) break;
+            if (!list_empty( &pool->pools[i] )) break;  /* only a hint, checked again below */
+        }
+
+        if (object)
+        {
+            tp_object_execute( object, FALSE );
+
+            assert(pool->num_busy_workers);
+            InterlockedDecrement( &pool->num_busy_workers );
+
+            tp_object_release( object );
+            continue;
+        }
+
+        RtlEnterCriticalSection( &pool->cs );
+
+        if ((ptr = threadpool_get_next_item( pool )))
+        {
+            object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
             assert( object->num_pending_callbacks > 0 );
 
             /* If further pending callbacks are queued, move the work item to
@@ -2343,31 +2603,56 @@ static void CALLBACK threadpool_worker_proc( void *param )
             tp_object_execute( object, FALSE );
 
             assert(pool->num_busy_workers);
-            pool->num_busy_workers--;
+            InterlockedDecrement( &pool->num_busy_workers );
 
+            RtlLeaveCriticalSection( &pool->cs );
             tp_object_release( object );
+            continue;
         }
 
         /* Shutdown worker thread if requested. */
-        if (pool->shutdown)
+        if (pool->shutdown && !pool->num_private_pending)
             break;
 
-        /* Wait for new tasks or until the timeout expires. A thread only terminates
-         * when no new tasks are available, and the number of threads can be
-         * decreased without violating the min_workers limit. An exception is when
-         * min_workers == 0, then objcount is used to detect if the last thread
-         * can be terminated. */
-        timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
-        if (RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout ) == STATUS_TIMEOUT &&
-            !threadpool_get_next_item( pool ) && (pool->num_workers > max( pool->min_workers, 1 ) ||
-            (!pool->min_workers && !pool->objcount)))
+        /* Wait for new tasks or until the timeout expires. The wake sequence has
+         * to be read before checking for private callbacks one last time, since
+         * they are submitted without the lock. */
+        seq = pool->wake_seq;
+        InterlockedIncrement( &pool->num_idle_workers );
+        status = STATUS_SUCCESS;
+        if (!pool->num_private_pending && !pool->shutdown)
         {
-            break;
+            RtlLeaveCriticalSection( &pool->cs );
+            timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+            status = RtlWaitOnAddress( &pool->wake_seq, &seq, sizeof(seq), &timeout );
+            RtlEnterCriticalSection( &pool->cs );
+        }
+        InterlockedDecrement( &pool->num_idle_workers );
+
+        /* A thread only terminates when no new tasks are available, and the number
+         * of threads can be decreased without violating the min_workers limit. An
+         * exception is when min_workers == 0, then objcount is used to detect if
+         * the last thread can be terminated. Private callbacks submitted meanwhile
+         * either see the decreased number of threads, or are seen here. */
+        if (status == STATUS_TIMEOUT && !threadpool_get_next_item( pool ) &&
+            (pool->num_workers > max( pool->min_workers, 1 ) || (!pool->min_workers && !pool->objcount)))
+        {
+            InterlockedDecrement( &pool->num_workers );
+            if (!pool->num_private_pending)
+            {
+                worker->active = FALSE;
+                RtlLeaveCriticalSection( &pool->cs );
+                goto done;
+            }
+            pool->num_workers++;
         }
+        RtlLeaveCriticalSection( &pool->cs );
     }
     pool->num_workers--;
+    worker->active = FALSE;
     RtlLeaveCriticalSection( &pool->cs );
 
+done:
     TRACE( "terminating worker thread for pool %p\n", pool );
     tp_threadpool_release( pool );
     RtlExitUserThread( 0 );
@@ -1499,17 +1499,17 @@ static void add_registry_environment( WCHAR **env, SIZE_T *pos, SIZE_T *size )
     if (!NtOpenKey( &key, KEY_READ, &attr ))
     {
         add_registry_variables( env, pos, size, key );
-        NtClose( key );
+        close_handle_deferred( key );
     }
     if (!open_hkcu_key( "Environment", &key ))
     {
         add_registry_variables( env, pos, size, key );
-        NtClose( key );
+        close_handle_deferred( key );
     }
     if (!open_hkcu_key( "Volatile Environment", &key ))
     {
         add_registry_variables( env, pos, size, key );
-        NtClose( key );
+        close_handle_deferred( key );
     }
 
     /* set the user profile variables */
@@ -1530,7 +1530,7 @@ static void add_registry_environment( WCHAR **env, SIZE_T *pos, SIZE_T *size )
             set_env_var( env, pos, size, publicW, wcslen(publicW), value );
             free( value );
         }
-        NtClose( key );
+        close_handle_deferred( key );
     }
 
     /* set the ProgramFiles variables */
@@ -1575,7 +1575,7 @@ static void add_registry_environment( WCHAR **env, SIZE_T *pos, SIZE_T *size )
                 set_env_var( env, pos, size, commonfilesW, wcslen(commonfilesW), value );
         }
         free( value );
-        NtClose( key );
+        close_handle_deferred( key );
     }
 
     /* set the computer name */
@@ -1588,7 +1588,7 @@ static void add_registry_environment( WCHAR **env, SIZE_T *pos, SIZE_T *size )
             set_env_var( env, pos, size, computernameW, wcslen(computernameW), value );
             free( value );
         }
-        NtClose( key );
+        close_handle_deferred( key );
     }
 }
 
@@ -1976,7 +1976,7 @@ static void load_global_options( const UNICODE_STRING *image )
         peb->HeapSegmentCommit = get_dword_option( key, heapcommitW, 0x10000 );
         peb->HeapDeCommitTotalFreeThreshold = get_dword_option( key, heapdecommittotalW, 0x10000 );
         peb->HeapDeCommitFreeBlockThreshold = get_dword_option( key, heapdecommitblockW, 0x1000 );
-        NtClose( key );
+        close_handle_deferred( key );
     }
     init_unicode_string( &nameW, optionsW );
     if (!NtOpenKey( &key, KEY_QUERY_VALUE, &attr ))
@@ -1988,9 +1988,9 @@ static void load_global_options( const UNICODE_STRING *image )
         if (!NtOpenKey( &key, KEY_QUERY_VALUE, &attr ))
         {
             peb->NtGlobalFlag = get_dword_option( key, globalflagW, peb->NtGlobalFlag );
-            NtClose( key );
+            close_handle_deferred( key );
         }
-        NtClose( attr.RootDirectory );
+        close_handle_deferred( attr.RootDirectory );
     }
 }
 
@@ -108,6 +108,9 @@
 #ifdef HAVE_SYS_STATFS_H
 #include <sys/statfs.h>
 #endif
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 #include <time.h>
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
@@ -135,6 +138,7 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(file);
 WINE_DECLARE_DEBUG_CHANNEL(winediag);
+WINE_DECLARE_DEBUG_CHANNEL(dircache);
 
 #define MAX_DOS_DRIVES 26
 
@@ -226,11 +230,15 @@ struct dir_data
     struct file_identity    id;      /* directory file identity */
     struct dir_data_names  *names;   /* directory file names */
     struct dir_data_buffer *buffer;  /* head of data buffers list */
+    BOOL                    stream;  /* entries are read on demand instead of all at once */
+    DIR                    *dir;     /* directory stream for the next entries, NULL once at the end */
+    UNICODE_STRING          mask;    /* copy of the mask for entries read on demand */
 };
 
 static const unsigned int dir_data_buffer_initial_size = 4096;
 static const unsigned int dir_data_cache_initial_size  = 256;
 static const unsigned int dir_data_names_initial_size  = 64;
+static const unsigned int dir_data_stream_batch_size   = 4096;  /* directories with more entries are streamed */
 
 static struct dir_data **dir_data_cache;
 static unsigned int dir_data_cache_size;
@@ -436,18 +444,28 @@ static BOOL add_dir_data_names( struct dir_data *data, const WCHAR *long_name,
     return TRUE;
 }
 
-/* free the complete directory data structure */
-static void free_dir_data( struct dir_data *data )
+/* free the directory names, keeping the names array for reuse */
+static void clear_dir_data_names( struct dir_data *data )
 {
     struct dir_data_buffer *buffer, *next;
 
-    if (!data) return;
-
     for (buffer = data->buffer; buffer; buffer = next)
     {
         next = buffer->next;
         free( buffer );
     }
+    data->buffer = NULL;
+    data->count = data->pos = 0;
+}
+
+/* free the complete directory data structure */
+static void free_dir_data( struct dir_data *data )
+{
+    if (!data) return;
+
+    clear_dir_data_names( data );
+    if (data->dir) closedir( data->dir );
+    free( data->mask.Buffer );
     free( data->names );
     free( data );
 }
@@ -1491,17 +1509,62 @@ static int fd_get_file_info( int fd, unsigned int options, struct stat *st, ULON
 
 
 /* get the stat info and file attributes for a file (by name) */
+#ifdef HAVE_STATX
+/* stat a file, fetching only the fields used for the file information classes;
+ * this is also called from the directory info workers, which can't use the debug channels */
+static int stat_file_info( const char *path, struct stat *st, BOOL follow )
+{
+    static int no_statx;
+    struct statx stx;
+    int ret;
+
+    if (__atomic_load_n( &no_statx, __ATOMIC_RELAXED )) return follow ? stat( path, st ) : lstat( path, st );
+
+    if (statx( AT_FDCWD, path, follow ? 0 : AT_SYMLINK_NOFOLLOW,
+               STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_INO | STATX_SIZE | STATX_BLOCKS |
+               STATX_ATIME | STATX_MTIME | STATX_CTIME, &stx ) == -1)
+    {
+        if (errno == ENOENT || errno == ENOTDIR) return -1;
+        /* statx may be missing, or blocked by a seccomp filter or a sandbox */
+        if (errno == ENOSYS || errno == EPERM) __atomic_store_n( &no_statx, 1, __ATOMIC_RELAXED );
+        ret = follow ? stat( path, st ) : lstat( path, st );
+        /* statx failed where stat succeeded, use stat from now on */
+        if (!ret) __atomic_store_n( &no_statx, 1, __ATOMIC_RELAXED );
+        return ret;
+    }
+    memset( st, 0, sizeof(*st) );
+    st->st_dev   = makedev( stx.stx_dev_major, stx.stx_dev_minor );
+    st->st_ino   = stx.stx_ino;
+    st->st_mode  = stx.stx_mode;
+    st->st_nlink = stx.stx_nlink;
+    st->st_size  = stx.stx_size;
+    st->st_blocks = stx.stx_blocks;
+    st->st_atim.tv_sec  = stx.stx_atime.tv_sec;
+    st->st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+    st->st_mtim.tv_sec  = stx.stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+    st->st_ctim.tv_sec  = stx.stx_ctime.tv_sec;
+    st->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+    return 0;
+}
+#else
+static inline int stat_file_info( const char *path, struct stat *st, BOOL follow )
+{
+    return follow ? stat( path, st ) : lstat( path, st );
+}
+#endif
+
 static int get_file_info( const char *path, struct stat *st, ULONG *attr )
 {
     char *parent_path;
     int ret;
 
     *attr = 0;
-    ret = lstat( path, st );
+    ret = stat_file_info( path, st, FALSE );
     if (ret == -1) return ret;
     if (S_ISLNK( st->st_mode ))
     {
-        ret = stat( path, st );
+        ret = stat_file_info( path, st, TRUE );
         if (ret == -1) return ret;
         /* is a symbolic link and a directory, consider these "reparse points" */
         if (S_ISDIR( st->st_mode )) *attr |= FILE_ATTRIBUTE_REPARSE_POINT;
@@ -2004,21 +2067,151 @@ static NTSTATUS get_mountmgr_fs_info( HANDLE handle, int fd, struct mountmgr_uni
 }
 
 
+/* attributes of directory entries, fetched ahead of time */
+struct dir_data_info
+{
+    struct stat st;
+    ULONG       attributes;
+    int         ret;          /* return value of get_file_info */
+};
+
+#define DIR_INFO_MAX_WORKERS 4    /* max number of threads fetching attributes with the caller */
+#define DIR_INFO_MIN_BATCH   32   /* smaller batches are fetched one by one */
+#define DIR_INFO_MAX_BATCH   256
+
+struct dir_info_job
+{
+    const struct dir_data_names *names;
+    struct dir_data_info        *info;
+    LONG                         count;
+    LONG                         next;   /* next entry to fetch */
+    unsigned int                 users;  /* number of workers running the job */
+};
+
+static pthread_mutex_t dir_info_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dir_info_start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t dir_info_done_cond = PTHREAD_COND_INITIALIZER;
+static struct dir_info_job *dir_info_job;
+static unsigned int dir_info_serial;
+static int dir_info_workers = -1;
+
+static void run_dir_info_job( struct dir_info_job *job )
+{
+    LONG i;
+
+    while ((i = InterlockedIncrement( &job->next ) - 1) < job->count)
+        job->info[i].ret = get_file_info( job->names[i].unix_name, &job->info[i].st, &job->info[i].attributes );
+}
+
+static void *dir_info_worker( void *arg )
+{
+    struct dir_info_job *job;
+    unsigned int serial = 0;
+
+    pthread_mutex_lock( &dir_info_mutex );
+    for (;;)
+    {
+        while (!dir_info_job || dir_info_serial == serial)
+            pthread_cond_wait( &dir_info_start_cond, &dir_info_mutex );
+        job = dir_info_job;
+        serial = dir_info_serial;
+        job->users++;
+        pthread_mutex_unlock( &dir_info_mutex );
+
+        run_dir_info_job( job );
+
+        pthread_mutex_lock( &dir_info_mutex );
+        if (!--job->users) pthread_cond_signal( &dir_info_done_cond );
+    }
+    return NULL;
+}
+
+/* start the worker threads on first use; they only make system calls, so they don't need a TEB */
+static BOOL start_dir_info_workers(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    sigset_t all_set, old_set;
+    long cpus;
+    int i, count;
+
+    if (dir_info_workers != -1) return dir_info_workers > 0;
+
+    cpus = sysconf( _SC_NPROCESSORS_ONLN );
+    count = min( DIR_INFO_MAX_WORKERS, max( 1, cpus - 1 ));
+
+    sigfillset( &all_set );
+    pthread_sigmask( SIG_SETMASK, &all_set, &old_set );
+    pthread_attr_init( &attr );
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+    pthread_attr_setstacksize( &attr, 0x10000 );
+    for (i = 0; i < count; i++) if (pthread_create( &thread, &attr, dir_info_worker, NULL )) break;
+    pthread_attr_destroy( &attr );
+    pthread_sigmask( SIG_SETMASK, &old_set, NULL );
+
+    TRACE( "started %u workers\n", i );
+    dir_info_workers = i;
+    return i > 0;
+}
+
+/***********************************************************************
+ *           fetch_dir_data_info
+ *
+ * Fetch the attributes of a batch of directory entries, spreading the work over the worker threads.
+ * Must be called with dir_mutex held, from the directory being read.
+ */
+static void fetch_dir_data_info( const struct dir_data_names *names, struct dir_data_info *info,
+                                 unsigned int count )
+{
+    struct dir_info_job job = { names, info, count, 0, 0 };
+    BOOL shared = count >= DIR_INFO_MIN_BATCH && start_dir_info_workers();
+
+    if (shared)
+    {
+        pthread_mutex_lock( &dir_info_mutex );
+        dir_info_job = &job;
+        dir_info_serial++;
+        pthread_cond_broadcast( &dir_info_start_cond );
+        pthread_mutex_unlock( &dir_info_mutex );
+    }
+
+    run_dir_info_job( &job );
+
+    if (shared)
+    {
+        pthread_mutex_lock( &dir_info_mutex );
+        dir_info_job = NULL;
+        while (job.users) pthread_cond_wait( &dir_info_done_cond, &dir_info_mutex );
+        pthread_mutex_unlock( &dir_info_mutex );
+    }
+}
+
+
 /***********************************************************************
  *           get_dir_data_entry
  *
- * Return a directory entry from the cached data.
+ * Return a directory entry from the cached data, using the prefetched attributes if available.
  */
 static NTSTATUS get_dir_data_entry( struct dir_data *dir_data, void *info_ptr, IO_STATUS_BLOCK *io,
                                     ULONG max_length, FILE_INFORMATION_CLASS class,
-                                    union file_directory_info **last_info )
+                                    union file_directory_info **last_info,
+                                    const struct dir_data_info *prefetched )
 {
     const struct dir_data_names *names = &dir_data->names[dir_data->pos];
     union file_directory_info *info;
     struct stat st;
     ULONG name_len, start, dir_size, attributes;
+    int ret;
 
-    if (get_file_info( names->unix_name, &st, &attributes ) == -1)
+    if (prefetched)
+    {
+        st = prefetched->st;
+        attributes = prefetched->attributes;
+        ret = prefetched->ret;
+    }
+    else ret = get_file_info( names->unix_name, &st, &attributes );
+
+    if (ret == -1)
     {
         TRACE( "file no longer exists %s\n", names->unix_name );
         return STATUS_SUCCESS;
@@ -2244,6 +2437,18 @@ static NTSTATUS read_directory_data_readdir( struct dir_data *data, const UNICOD
     {
         if (!strcmp( de->d_name, "." ) || !strcmp( de->d_name, ".." )) continue;
         if (!append_entry( data, de->d_name, NULL, mask )) goto done;
+        if (data->count < dir_data_stream_batch_size) continue;
+
+        /* the directory is large, return the rest of the entries as they are read */
+        if (mask)
+        {
+            if (!(data->mask.Buffer = malloc( mask->Length ))) goto done;
+            memcpy( data->mask.Buffer, mask->Buffer, mask->Length );
+            data->mask.Length = data->mask.MaximumLength = mask->Length;
+        }
+        data->stream = TRUE;
+        data->dir = dir;
+        return STATUS_SUCCESS;
     }
     status = STATUS_SUCCESS;
 
@@ -2253,10 +2458,67 @@ done:
 }
 
 
+/***********************************************************************
+ *           read_directory_data_stream
+ *
+ * Replace the directory data with the next batch of entries of a streamed directory.
+ */
+static NTSTATUS read_directory_data_stream( struct dir_data *data )
+{
+    const UNICODE_STRING *mask = data->mask.Buffer ? &data->mask : NULL;
+    struct dirent *de;
+
+    if (!data->dir) return STATUS_NO_MORE_FILES;
+
+    clear_dir_data_names( data );
+    while (data->count < dir_data_stream_batch_size)
+    {
+        long pos = telldir( data->dir );
+
+        if (!(de = readdir( data->dir )))
+        {
+            closedir( data->dir );
+            data->dir = NULL;
+            break;
+        }
+        if (!strcmp( de->d_name, "." ) || !strcmp( de->d_name, ".." )) continue;
+        if (!append_entry( data, de->d_name, NULL, mask ))
+        {
+            /* read that entry again on the next call */
+            seekdir( data->dir, pos );
+            if (data->count) break;
+            return STATUS_NO_MEMORY;
+        }
+    }
+    TRACE( "read %u more entries\n", data->count );
+    return data->count ? STATUS_SUCCESS : STATUS_NO_MORE_FILES;
+}
+
+
+/***********************************************************************
+ *           restart_directory_data_stream
+ *
+ * Start reading a streamed directory from the beginning again.
+ */
+static NTSTATUS restart_directory_data_stream( struct dir_data *data )
+{
+    const UNICODE_STRING *mask = data->mask.Buffer ? &data->mask : NULL;
+
+    if (data->dir) rewinddir( data->dir );
+    else if (!(data->dir = opendir( "." ))) return errno_to_status( errno );
+
+    clear_dir_data_names( data );
+    if (!append_entry( data, ".", NULL, mask ) || !append_entry( data, "..", NULL, mask ))
+        return STATUS_NO_MEMORY;
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           read_directory_data
  *
- * Read the full contents of a directory, using one of the above helper functions.
+ * Read the contents of a directory, using one of the above helper functions.
+ * Large directories read with readdir are returned in batches.
  */
 static NTSTATUS read_directory_data( struct dir_data *data, int fd, const UNICODE_STRING *mask )
 {
@@ -2317,11 +2579,12 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
         return status;
     }
 
-    /* sort filenames, but not "." and ".." */
+    /* sort filenames, but not "." and ".."; streamed directories are returned in the order they are read */
     i = 0;
     if (i < data->count && !strcmp( data->names[i].unix_name, "." )) i++;
     if (i < data->count && !strcmp( data->names[i].unix_name, ".." )) i++;
-    if (i < data->count) qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
+    if (i < data->count && !data->stream)
+        qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
 
     if (data->count)
     {
@@ -2330,7 +2593,8 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
         data->id.ino = st.st_ino;
     }
 
-    TRACE( "mask %s found %u files\n", debugstr_us( mask ), data->count );
+    TRACE( "mask %s found %u files%s\n", debugstr_us( mask ), data->count,
+           data->stream ? ", streaming the rest" : "" );
     for (i = 0; i < data->count; i++)
         TRACE( "%s %s\n", debugstr_w(data->names[i].long_name), debugstr_w(data->names[i].short_name) );
 
@@ -2460,20 +2724,48 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event, PIO_APC_ROUTI
         if (!(status = get_cached_dir_data( handle, &data, fd, mask )))
         {
             union file_directory_info *last_info = NULL;
+            struct dir_data_info *info = NULL;
+            unsigned int info_start = 0, info_count = 0;
+            NTSTATUS stream_status = STATUS_SUCCESS;
 
-            if (restart_scan) data->pos = 0;
+            if (restart_scan)
+            {
+                if (data->stream) status = restart_directory_data_stream( data );
+                else data->pos = 0;
+            }
 
-            while (!status && data->pos < data->count)
+            while (!status)
             {
-                status = get_dir_data_entry( data, buffer, io, length, info_class, &last_info );
+                if (data->pos == data->count)
+                {
+                    if (!data->stream) break;
+                    if ((stream_status = read_directory_data_stream( data ))) break;
+                    info_count = 0;
+                }
+                if (!single_entry && (data->pos < info_start || data->pos >= info_start + info_count))
+                {
+                    /* fetch the attributes of the entries that are likely to fit in the buffer */
+                    info_start = data->pos;
+                    info_count = min( data->count - data->pos, DIR_INFO_MAX_BATCH );
+                    info_count = min( info_count, length / dir_info_size( info_class, 8 ) + 1 );
+                    if (info_count < DIR_INFO_MIN_BATCH ||
+                        (!info && !(info = malloc( DIR_INFO_MAX_BATCH * sizeof(*info) ))))
+                        info_count = 0;
+                    else
+                        fetch_dir_data_info( data->names + info_start, info, info_count );
+                }
+                status = get_dir_data_entry( data, buffer, io, length, info_class, &last_info,
+                                             info_count ? &info[data->pos - info_start] : NULL );
                 if (!status || status == STATUS_BUFFER_OVERFLOW) data->pos++;
                 if (single_entry && last_info) break;
             }
 
-            if (!last_info) status = STATUS_NO_MORE_FILES;
+            if (!last_info)
+                status = (stream_status == STATUS_NO_MEMORY) ? stream_status : STATUS_NO_MORE_FILES;
             else if (status == STATUS_MORE_ENTRIES) status = STATUS_SUCCESS;
 
             io->u.Status = status;
+            free( info );
         }
         if (cwd == -1 || fchdir( cwd ) == -1) chdir( "/" );
     }
@@ -2488,6 +2780,423 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event, PIO_APC_ROUTI
 }
 
 
+/* Cache of the case-folded contents of large directories, used for case-insensitive lookups.
+ * The cached directories are watched with inotify, and kept up to date with the events it reports. */
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#define DIR_CACHE_MAX_DIRS    64  /* max number of cached directories */
+#define DIR_CACHE_MIN_ENTRIES 64  /* directories with fewer entries are cheap enough to scan */
+
+struct dir_cache_name
+{
+    struct dir_cache_name *next;     /* next name in the hash bucket */
+    unsigned int           hash;     /* hash of the case-folded name */
+    USHORT                 len;      /* length of the case-folded name */
+    WCHAR                  name[1];  /* case-folded name, followed by the null-terminated unix name */
+};
+
+struct dir_cache
+{
+    struct list             entry;        /* entry in LRU list */
+    struct file_identity    id;           /* directory identity */
+    int                     wd;           /* inotify watch descriptor */
+    unsigned int            count;        /* number of names */
+    unsigned int            size;         /* number of hash buckets, always a power of 2 */
+    struct dir_cache_name **names;        /* long names hash table */
+    struct dir_cache_name **short_names;  /* short names hash table, created on demand */
+};
+
+static struct list dir_caches = LIST_INIT( dir_caches );
+static unsigned int dir_cache_count;
+static int dir_cache_fd = -1;  /* inotify fd, only open while some directory is cached */
+static BOOL dir_cache_disabled;  /* inotify is not available */
+static unsigned int dir_cache_hits, dir_cache_scans, dir_cache_updates;
+static pthread_mutex_t dir_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int hash_dir_cache_name( const WCHAR *name, int len )
+{
+    unsigned int hash = 2166136261u;
+    while (len--) hash = (hash ^ ntdll_towupper( *name++ )) * 16777619;
+    return hash;
+}
+
+static inline char *dir_cache_unix_name( struct dir_cache_name *entry )
+{
+    return (char *)(entry->name + entry->len);
+}
+
+static struct dir_cache_name *alloc_dir_cache_name( const WCHAR *name, int len, const char *unix_name )
+{
+    struct dir_cache_name *entry;
+    size_t unix_len = strlen( unix_name ) + 1;
+    int i;
+
+    if (!(entry = malloc( offsetof( struct dir_cache_name, name[len] ) + unix_len ))) return NULL;
+    entry->hash = hash_dir_cache_name( name, len );
+    entry->len = len;
+    for (i = 0; i < len; i++) entry->name[i] = ntdll_towupper( name[i] );
+    memcpy( dir_cache_unix_name( entry ), unix_name, unix_len );
+    return entry;
+}
+
+static void free_dir_cache_table( struct dir_cache_name **table, unsigned int size )
+{
+    struct dir_cache_name *entry, *next;
+    unsigned int i;
+
+    if (!table) return;
+    for (i = 0; i < size; i++)
+        for (entry = table[i]; entry; entry = next)
+        {
+            next = entry->next;
+            free( entry );
+        }
+    free( table );
+}
+
+static struct dir_cache_name *find_dir_cache_name( struct dir_cache_name **table, unsigned int size,
+                                                   const WCHAR *name, int len )
+{
+    unsigned int hash = hash_dir_cache_name( name, len );
+    struct dir_cache_name *entry;
+    int i;
+
+    for (entry = table[hash & (size - 1)]; entry; entry = entry->next)
+    {
+        if (entry->hash != hash || entry->len != len) continue;
+        for (i = 0; i < len; i++) if (entry->name[i] != ntdll_towupper( name[i] )) break;
+        if (i == len) return entry;
+    }
+    return NULL;
+}
+
+/* build the short names table from the long names, the same way as find_file_in_dir */
+static BOOL build_dir_cache_short_names( struct dir_cache *cache )
+{
+    struct dir_cache_name *entry, *short_entry;
+    WCHAR buffer[MAX_DIR_ENTRY_LEN], short_nameW[12];
+    unsigned int i;
+    int len;
+
+    if (!(cache->short_names = calloc( cache->size, sizeof(*cache->short_names) ))) return FALSE;
+    for (i = 0; i < cache->size; i++)
+    {
+        for (entry = cache->names[i]; entry; entry = entry->next)
+        {
+            /* the short name hash depends on the original case */
+            len = ntdll_umbstowcs( dir_cache_unix_name( entry ), strlen( dir_cache_unix_name( entry ) ),
+                                   buffer, MAX_DIR_ENTRY_LEN );
+            if (is_legal_8dot3_name( buffer, len )) continue;
+            len = hash_short_file_name( buffer, len, short_nameW );
+            if (!(short_entry = alloc_dir_cache_name( short_nameW, len, dir_cache_unix_name( entry ) )))
+            {
+                free_dir_cache_table( cache->short_names, cache->size );
+                cache->short_names = NULL;
+                return FALSE;
+            }
+            short_entry->next = cache->short_names[short_entry->hash & (cache->size - 1)];
+            cache->short_names[short_entry->hash & (cache->size - 1)] = short_entry;
+        }
+    }
+    return TRUE;
+}
+
+static BOOL add_dir_cache_name( struct dir_cache *cache, const char *unix_name )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    struct dir_cache_name *entry, *next, **table;
+    unsigned int i, size;
+    int len;
+
+    len = ntdll_umbstowcs( unix_name, strlen(unix_name), buffer, MAX_DIR_ENTRY_LEN );
+    if (!(entry = alloc_dir_cache_name( buffer, len, unix_name ))) return FALSE;
+
+    if (cache->count >= 2 * cache->size)  /* grow the hash table */
+    {
+        size = cache->size * 4;
+        if ((table = calloc( size, sizeof(*table) )))
+        {
+            for (i = 0; i < cache->size; i++)
+                for (next = cache->names[i]; next; )
+                {
+                    struct dir_cache_name *cur = next;
+                    next = cur->next;
+                    cur->next = table[cur->hash & (size - 1)];
+                    table[cur->hash & (size - 1)] = cur;
+                }
+            free( cache->names );
+            free_dir_cache_table( cache->short_names, cache->size );
+            cache->short_names = NULL;
+            cache->names = table;
+            cache->size = size;
+        }
+    }
+    entry->next = cache->names[entry->hash & (cache->size - 1)];
+    cache->names[entry->hash & (cache->size - 1)] = entry;
+    cache->count++;
+    return TRUE;
+}
+
+static void remove_dir_cache_name( struct dir_cache *cache, const char *unix_name )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    struct dir_cache_name **entry, *found;
+    unsigned int hash;
+    int len;
+
+    len = ntdll_umbstowcs( unix_name, strlen(unix_name), buffer, MAX_DIR_ENTRY_LEN );
+    hash = hash_dir_cache_name( buffer, len );
+    for (entry = &cache->names[hash & (cache->size - 1)]; *entry; entry = &(*entry)->next)
+    {
+        if ((*entry)->hash != hash || strcmp( dir_cache_unix_name( *entry ), unix_name )) continue;
+        found = *entry;
+        *entry = found->next;
+        free( found );
+        cache->count--;
+        break;
+    }
+}
+
+static void free_dir_cache( struct dir_cache *cache )
+{
+    if (cache->wd != -1) inotify_rm_watch( dir_cache_fd, cache->wd );
+    free_dir_cache_table( cache->names, cache->size );
+    free_dir_cache_table( cache->short_names, cache->size );
+    free( cache );
+}
+
+static void flush_dir_caches(void)
+{
+    struct dir_cache *cache, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE( cache, next, &dir_caches, struct dir_cache, entry )
+    {
+        list_remove( &cache->entry );
+        free_dir_cache( cache );
+    }
+    dir_cache_count = 0;
+}
+
+/* the inotify instances are limited per user, don't hold one when nothing is cached */
+static void close_dir_cache_fd(void)
+{
+    close( dir_cache_fd );
+    dir_cache_fd = -1;
+}
+
+/* apply the pending inotify events to the cached directories */
+static void process_dir_cache_events(void)
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    struct dir_cache *cache;
+    ssize_t size;
+    char *ptr;
+
+    while ((size = read( dir_cache_fd, buffer, sizeof(buffer) )) > 0)
+    {
+        for (ptr = buffer; ptr < buffer + size; ptr += sizeof(*event) + event->len)
+        {
+            event = (const struct inotify_event *)ptr;
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                WARN_(dircache)( "event queue overflow, flushing all directories\n" );
+                flush_dir_caches();
+                continue;
+            }
+
+            LIST_FOR_EACH_ENTRY( cache, &dir_caches, struct dir_cache, entry )
+                if (cache->wd == event->wd) break;
+            if (&cache->entry == &dir_caches) continue;
+
+            dir_cache_updates++;
+            if (event->mask & (IN_DELETE_SELF | IN_IGNORED | IN_UNMOUNT))
+            {
+                if (event->mask & IN_IGNORED) cache->wd = -1;
+                list_remove( &cache->entry );
+                free_dir_cache( cache );
+                dir_cache_count--;
+                continue;
+            }
+            if (!event->len) continue;
+
+            free_dir_cache_table( cache->short_names, cache->size );
+            cache->short_names = NULL;
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM)) remove_dir_cache_name( cache, event->name );
+            if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && !add_dir_cache_name( cache, event->name ))
+            {
+                list_remove( &cache->entry );
+                free_dir_cache( cache );
+                dir_cache_count--;
+            }
+        }
+    }
+    if (!dir_cache_count) close_dir_cache_fd();
+}
+
+/* inotify doesn't report the changes made by other hosts */
+static BOOL is_dir_cache_supported( int fd )
+{
+#ifdef linux
+    struct statfs stfs;
+
+    if (fstatfs( fd, &stfs ) == -1) return FALSE;
+    switch ((unsigned int)stfs.f_type)
+    {
+    case 0x6969:      /* NFS */
+    case 0x517b:      /* SMB */
+    case 0xff534d42:  /* CIFS */
+    case 0xfe534d42:  /* SMB2 */
+    case 0x65735546:  /* FUSE */
+    case 0x01021997:  /* 9P */
+    case 0x6b414653:  /* AFS */
+    case 0x564c:      /* NCP */
+        return FALSE;
+    }
+#endif
+    return TRUE;
+}
+
+static struct dir_cache *find_dir_cache( const struct stat *st )
+{
+    struct dir_cache *cache;
+
+    LIST_FOR_EACH_ENTRY( cache, &dir_caches, struct dir_cache, entry )
+        if (is_same_file( &cache->id, st )) return cache;
+    return NULL;
+}
+
+static struct dir_cache *create_dir_cache( DIR *dir, const char *unix_name, const struct stat *st )
+{
+    struct dir_cache *cache;
+    struct dirent *de;
+
+    if (!(cache = calloc( 1, sizeof(*cache) ))) return NULL;
+    cache->id.dev = st->st_dev;
+    cache->id.ino = st->st_ino;
+    cache->size = 16;
+    /* start watching before reading the directory again, so that no change gets lost */
+    cache->wd = inotify_add_watch( dir_cache_fd, unix_name, IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                   IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR );
+    if (cache->wd == -1 || !(cache->names = calloc( cache->size, sizeof(*cache->names) ))) goto failed;
+
+    rewinddir( dir );
+    while ((de = readdir( dir ))) if (!add_dir_cache_name( cache, de->d_name )) goto failed;
+    return cache;
+
+failed:
+    free_dir_cache( cache );
+    return NULL;
+}
+
+/***********************************************************************
+ *           add_dir_cache
+ *
+ * Cache the contents of a directory that had to be scanned entirely.
+ */
+static void add_dir_cache( DIR *dir, const char *unix_name, unsigned int count )
+{
+    struct dir_cache *cache;
+    struct stat st;
+
+    if (count < DIR_CACHE_MIN_ENTRIES) return;
+    if (fstat( dirfd( dir ), &st ) == -1 || !is_dir_cache_supported( dirfd( dir ) )) return;
+
+    mutex_lock( &dir_cache_mutex );
+
+    if (dir_cache_fd == -1 && !dir_cache_disabled &&
+        (dir_cache_fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC )) == -1)
+    {
+        WARN_(dircache)( "inotify not available (%s), directory cache disabled\n", strerror(errno) );
+        dir_cache_disabled = TRUE;
+    }
+
+    if (dir_cache_fd != -1 && !find_dir_cache( &st ) && (cache = create_dir_cache( dir, unix_name, &st )))
+    {
+        dir_cache_scans++;
+        TRACE_(dircache)( "%s: %u entries, %u cache hits, %u scans, %u updates\n",
+                          debugstr_a(unix_name), cache->count, dir_cache_hits, dir_cache_scans,
+                          dir_cache_updates );
+        list_add_head( &dir_caches, &cache->entry );
+        if (++dir_cache_count > DIR_CACHE_MAX_DIRS)
+        {
+            struct dir_cache *oldest = LIST_ENTRY( list_tail( &dir_caches ), struct dir_cache, entry );
+            list_remove( &oldest->entry );
+            free_dir_cache( oldest );
+            dir_cache_count--;
+        }
+    }
+    if (dir_cache_fd != -1 && !dir_cache_count) close_dir_cache_fd();
+
+    mutex_unlock( &dir_cache_mutex );
+}
+
+/***********************************************************************
+ *           find_file_in_dir_cache
+ *
+ * Look for a file in the cached contents of an open directory.
+ * Returns STATUS_NOT_SUPPORTED if the directory isn't cached.
+ */
+static NTSTATUS find_file_in_dir_cache( DIR *dir, char *unix_name, int pos, const WCHAR *name, int length,
+                                        BOOLEAN is_name_8_dot_3 )
+{
+    struct dir_cache *cache;
+    struct dir_cache_name *entry = NULL;
+    struct stat st;
+    NTSTATUS status = STATUS_OBJECT_PATH_NOT_FOUND;
+
+    /* nothing cached is the common case, don't pay for the lock then */
+    if (!__atomic_load_n( &dir_cache_count, __ATOMIC_RELAXED )) return STATUS_NOT_SUPPORTED;
+    if (fstat( dirfd( dir ), &st ) == -1) return STATUS_NOT_SUPPORTED;
+
+    mutex_lock( &dir_cache_mutex );
+
+    /* the pending events are only applied on hits, they may drop the directory */
+    if (find_dir_cache( &st ))
+    {
+        process_dir_cache_events();
+        cache = find_dir_cache( &st );
+    }
+    else cache = NULL;
+    if (!cache)
+    {
+        mutex_unlock( &dir_cache_mutex );
+        return STATUS_NOT_SUPPORTED;
+    }
+    list_remove( &cache->entry );  /* move it to the head of the LRU list */
+    list_add_head( &dir_caches, &cache->entry );
+    dir_cache_hits++;
+
+    entry = find_dir_cache_name( cache->names, cache->size, name, length );
+    if (!entry && is_name_8_dot_3 && (cache->short_names || build_dir_cache_short_names( cache )))
+        entry = find_dir_cache_name( cache->short_names, cache->size, name, length );
+    if (entry)
+    {
+        unix_name[pos - 1] = '/';
+        strcpy( unix_name + pos, dir_cache_unix_name( entry ) );
+        status = STATUS_SUCCESS;
+    }
+
+    mutex_unlock( &dir_cache_mutex );
+    return status;
+}
+
+#else  /* HAVE_SYS_INOTIFY_H */
+
+static void add_dir_cache( DIR *dir, const char *unix_name, unsigned int count )
+{
+}
+
+static NTSTATUS find_file_in_dir_cache( DIR *dir, char *unix_name, int pos, const WCHAR *name, int length,
+                                        BOOLEAN is_name_8_dot_3 )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+#endif  /* HAVE_SYS_INOTIFY_H */
+
+
 /***********************************************************************
  *           find_file_in_dir
  *
@@ -2500,9 +3209,11 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
 {
     WCHAR buffer[MAX_DIR_ENTRY_LEN];
     BOOLEAN is_name_8_dot_3;
+    NTSTATUS status;
     DIR *dir;
     struct dirent *de;
     struct stat st;
+    unsigned int count = 0;
     int ret;
 
     /* try a shortcut for this directory */
@@ -2580,9 +3291,18 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
 
     if (!(dir = opendir( unix_name ))) return errno_to_status( errno );
 
+    status = find_file_in_dir_cache( dir, unix_name, pos, name, length, is_name_8_dot_3 );
+    if (status != STATUS_NOT_SUPPORTED)
+    {
+        closedir( dir );
+        if (status == STATUS_SUCCESS) return status;
+        goto not_found;
+    }
+
     unix_name[pos - 1] = '/';
     while ((de = readdir( dir )))
     {
+        count++;
         ret = ntdll_umbstowcs( de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
         if (ret == length && !wcsnicmp( buffer, name, ret ))
         {
@@ -2605,6 +3325,10 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
             }
         }
     }
+    /* the whole directory has been scanned, cache it if that was expensive */
+    if (pos > 1) unix_name[pos - 1] = 0;
+    else unix_name[1] = 0;
+    add_dir_cache( dir, unix_name, count );
     closedir( dir );
 
 not_found:
@@ -4095,6 +4819,7 @@ NTSTATUS WINAPI NtQueryInformationFile( HANDLE handle, IO_STATUS_BLOCK *io,
     int fd, needs_close = FALSE;
     ULONG attr;
     unsigned int options;
+    enum server_fd_type type;
     NTSTATUS status;
 
     TRACE( "(%p,%p,%p,0x%08x,0x%08x)\n", handle, io, ptr, len, class);
@@ -4108,11 +4833,16 @@ NTSTATUS WINAPI NtQueryInformationFile( HANDLE handle, IO_STATUS_BLOCK *io,
     if (len < info_sizes[class])
         return io->u.Status = STATUS_INFO_LENGTH_MISMATCH;
 
-    if ((status = server_get_unix_fd( handle, 0, &fd, &needs_close, NULL, &options )))
+    if ((status = server_get_unix_fd( handle, 0, &fd, &needs_close, &type, &options )))
     {
         if (status != STATUS_BAD_DEVICE_TYPE) return io->u.Status = status;
         return server_get_file_info( handle, io, ptr, len, class );
     }
+    if (type == FD_TYPE_PIPE)  /* the socket of a direct pipe, the server knows about the pipe */
+    {
+        if (needs_close) close( fd );
+        return server_get_file_info( handle, io, ptr, len, class );
+    }
 
     switch (class)
     {
@@ -4701,23 +5431,51 @@ static NTSTATUS irp_completion( void *user, ULONG_PTR *info, NTSTATUS status )
     return status;
 }
 
+/* wait for data on the socket of a direct pipe without consuming it; returns 0 on EOF */
+static int peek_pipe_data( int fd )
+{
+    char dummy;
+    int ret;
+
+    while ((ret = recv( fd, &dummy, 1, MSG_PEEK | MSG_DONTWAIT )) == -1 && errno == ECONNRESET) ;
+    return ret;
+}
+
+/* read from a file; pipe sockets report once that the peer has been closed with unread data,
+ * the data that was sent to us is still there though */
+static int read_pipe_or_file( int fd, enum server_fd_type type, void *buffer, size_t size )
+{
+    int ret;
+
+    while ((ret = virtual_locked_read( fd, buffer, size )) == -1 && errno == ECONNRESET &&
+           type == FD_TYPE_PIPE) ;
+    return ret;
+}
+
 static NTSTATUS async_read_proc( void *user, ULONG_PTR *info, NTSTATUS status )
 {
     struct async_fileio_read *fileio = user;
     int fd, needs_close, result;
+    enum server_fd_type type;
 
     switch (status)
     {
     case STATUS_ALERTED: /* got some new data */
         /* check to see if the data is ready (non-blocking) */
         if ((status = server_get_unix_fd( fileio->io.handle, FILE_READ_DATA, &fd,
-                                          &needs_close, NULL, NULL )))
+                                          &needs_close, &type, NULL )))
             break;
 
-        result = virtual_locked_read(fd, &fileio->buffer[fileio->already], fileio->count-fileio->already);
+        if (type == FD_TYPE_PIPE && !fileio->count)
+            result = peek_pipe_data( fd );
+        else
+            result = read_pipe_or_file( fd, type, &fileio->buffer[fileio->already],
+                                        fileio->count - fileio->already );
         if (needs_close) close( fd );
 
-        if (result < 0)
+        if (type == FD_TYPE_PIPE && !fileio->count && result > 0)
+            status = STATUS_SUCCESS;
+        else if (result < 0)
         {
             if (errno == EAGAIN || errno == EINTR)
                 status = STATUS_PENDING;
@@ -4775,6 +5533,7 @@ static NTSTATUS async_write_proc( void *user, ULONG_PTR *info, NTSTATUS status )
         if (result < 0)
         {
             if (errno == EAGAIN || errno == EINTR) status = STATUS_PENDING;
+            else if (errno == EPIPE && type == FD_TYPE_PIPE) status = STATUS_PIPE_CLOSING;
             else status = errno_to_status( errno );
         }
         else
@@ -5039,6 +5798,7 @@ static NTSTATUS get_io_avail_mode( HANDLE handle, enum server_fd_type type, BOOL
     }
     case FD_TYPE_MAILSLOT:
     case FD_TYPE_SOCKET:
+    case FD_TYPE_PIPE:
     case FD_TYPE_CHAR:
         *avail_mode = TRUE;
         break;
@@ -5150,6 +5910,10 @@ NTSTATUS WINAPI NtReadFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, vo
 
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
         {
+            if (async_read && uring_read_file( handle, unix_handle, needs_close, event, apc, apc_user,
+                                               io, buffer, length, offset->QuadPart ) == STATUS_PENDING)
+                return STATUS_PENDING;
+
             /* async I/O doesn't make sense on regular files */
             while ((result = virtual_locked_pread( unix_handle, buffer, length, offset->QuadPart )) == -1)
             {
@@ -5192,7 +5956,18 @@ NTSTATUS WINAPI NtReadFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, vo
 
     for (;;)
     {
-        if ((result = virtual_locked_read( unix_handle, (char *)buffer + total, length - total )) >= 0)
+        if (type == FD_TYPE_PIPE && !length)
+        {
+            /* zero-length reads wait for data, without consuming it */
+            if ((result = peek_pipe_data( unix_handle )) > 0)
+            {
+                status = STATUS_SUCCESS;
+                goto done;
+            }
+        }
+        else result = read_pipe_or_file( unix_handle, type, (char *)buffer + total, length - total );
+
+        if (result >= 0)
         {
             total += result;
             if (!result || total == length)
@@ -5230,6 +6005,12 @@ NTSTATUS WINAPI NtReadFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, vo
             goto err;
         }
 
+        if (total && type == FD_TYPE_PIPE)  /* return the data that was available */
+        {
+            status = STATUS_SUCCESS;
+            goto done;
+        }
+
         if (async_read)
         {
             BOOL avail_mode;
@@ -5337,6 +6118,11 @@ NTSTATUS WINAPI NtReadFileScatter( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
         goto error;
     }
 
+    if (offset && offset->QuadPart >= 0 &&
+        uring_read_file_scatter( file, unix_handle, needs_close, event, apc, apc_user, io,
+                                 segments, length, offset->QuadPart ) == STATUS_PENDING)
+        return STATUS_PENDING;
+
     while (length)
     {
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
@@ -5461,6 +6247,9 @@ NTSTATUS WINAPI NtWriteFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, v
                 status = STATUS_INVALID_PARAMETER;
                 goto done;
             }
+            else if (async_write && uring_write_file( handle, unix_handle, needs_close, event, apc, apc_user,
+                                                      io, buffer, length, off ) == STATUS_PENDING)
+                return STATUS_PENDING;
 
             /* async I/O doesn't make sense on regular files */
             while ((result = pwrite( unix_handle, buffer, length, off )) == -1)
@@ -5515,6 +6304,7 @@ NTSTATUS WINAPI NtWriteFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, v
             if (!total)
             {
                 if (errno == EFAULT) status = STATUS_INVALID_USER_BUFFER;
+                else if (errno == EPIPE && type == FD_TYPE_PIPE) status = STATUS_PIPE_CLOSING;
                 else status = errno_to_status( errno );
             }
             goto err;
@@ -5926,14 +6716,20 @@ NTSTATUS WINAPI NtFlushBuffersFile( HANDLE handle, IO_STATUS_BLOCK *io )
 NTSTATUS WINAPI NtCancelIoFile( HANDLE handle, IO_STATUS_BLOCK *io_status )
 {
     NTSTATUS status;
+    BOOL cancelled;
 
     TRACE( "%p %p\n", handle, io_status );
 
+    cancelled = sock_cancel_io( handle, NULL, TRUE );
+    cancelled |= uring_cancel_io( handle, NULL, TRUE );
+
     SERVER_START_REQ( cancel_async )
     {
         req->handle      = wine_server_obj_handle( handle );
         req->only_thread = TRUE;
-        if (!(status = wine_server_call( req )))
+        status = wine_server_call( req );
+        if (status == STATUS_NOT_FOUND && cancelled) status = STATUS_SUCCESS;
+        if (!status)
         {
             io_status->u.Status = status;
             io_status->Information = 0;
@@ -5951,14 +6747,20 @@ NTSTATUS WINAPI NtCancelIoFile( HANDLE handle, IO_STATUS_BLOCK *io_status )
 NTSTATUS WINAPI NtCancelIoFileEx( HANDLE handle, IO_STATUS_BLOCK *io, IO_STATUS_BLOCK *io_status )
 {
     NTSTATUS status;
+    BOOL cancelled;
 
     TRACE( "%p %p %p\n", handle, io, io_status );
 
+    cancelled = sock_cancel_io( handle, io, FALSE );
+    cancelled |= uring_cancel_io( handle, io, FALSE );
+
     SERVER_START_REQ( cancel_async )
     {
         req->handle = wine_server_obj_handle( handle );
         req->iosb   = wine_server_client_ptr( io );
-        if (!(status = wine_server_call( req )))
+        status = wine_server_call( req );
+        if (status == STATUS_NOT_FOUND && cancelled) status = STATUS_SUCCESS;
+        if (!status)
         {
             io_status->u.Status = status;
             io_status->Information = 0;
@@ -6394,10 +7196,16 @@ NTSTATUS WINAPI NtQueryVolumeInformationFile( HANDLE handle, IO_STATUS_BLOCK *io
                                               FS_INFORMATION_CLASS info_class )
 {
     int fd, needs_close;
+    enum server_fd_type type;
     struct stat st;
     NTSTATUS status;
 
-    status = server_get_unix_fd( handle, 0, &fd, &needs_close, NULL, NULL );
+    status = server_get_unix_fd( handle, 0, &fd, &needs_close, &type, NULL );
+    if (!status && type == FD_TYPE_PIPE)  /* the socket of a direct pipe */
+    {
+        if (needs_close) close( fd );
+        status = STATUS_BAD_DEVICE_TYPE;
+    }
     if (status == STATUS_BAD_DEVICE_TYPE)
     {
         struct async_irp *async;
@@ -6731,9 +7539,14 @@ NTSTATUS WINAPI NtQueryObject( HANDLE handle, OBJECT_INFORMATION_CLASS info_clas
     case ObjectBasicInformation:
     {
         OBJECT_BASIC_INFORMATION *p = ptr;
+        unsigned int access, flags;
 
         if (len < sizeof(*p)) return STATUS_INFO_LENGTH_MISMATCH;
 
+        /* the reference counts are only known by the server */
+        if (get_handle_shm( handle, &access, &flags ) && !(flags & HANDLE_SHM_IN_USE))
+            return STATUS_INVALID_HANDLE;
+
         SERVER_START_REQ( get_object_info )
         {
             req->handle = wine_server_obj_handle( handle );
@@ -6884,9 +7697,19 @@ NTSTATUS WINAPI NtQueryObject( HANDLE handle, OBJECT_INFORMATION_CLASS info_clas
     case ObjectDataInformation:
     {
         OBJECT_DATA_INFORMATION* p = ptr;
+        unsigned int access, flags;
 
         if (len < sizeof(*p)) return STATUS_INVALID_BUFFER_SIZE;
 
+        if (get_handle_shm( handle, &access, &flags ))
+        {
+            if (!(flags & HANDLE_SHM_IN_USE)) return STATUS_INVALID_HANDLE;
+            p->InheritHandle = (flags & HANDLE_SHM_INHERIT) != 0;
+            p->ProtectFromClose = (flags & HANDLE_SHM_PROTECT) != 0;
+            if (used_len) *used_len = sizeof(*p);
+            return STATUS_SUCCESS;
+        }
+
         SERVER_START_REQ( set_handle_info )
         {
             req->handle = wine_server_obj_handle( handle );
@@ -0,0 +1,622 @@
+/*
+ * Client-side synchronization objects
+ *
+ * Copyright (C) 2021 Wine contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#if 0
+#pragma makedep unix
+#endif
+
+#include "config.h"
+#include "wine/port.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+#include <time.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+#include "wine/server.h"
+#include "wine/debug.h"
+#include "unix_private.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(fsync);
+
+/* Events, semaphores and mutexes created while WINEFSYNC is set keep their
+ * state in a slot of an array shared with the server and the other clients.
+ * Signaling them and waiting for them is then done with atomic operations
+ * and futexes; everything else (creation, names, queries, alertable and
+ * wait-all waits) still goes through the server, which sees the same state.
+ *
+ * A thread lists the mutexes it owns in its own slots, linked from a list
+ * head slot given by the server, so that the server can abandon them when
+ * the thread dies. The list is only modified by its thread while it runs.
+ *
+ * The functions below return STATUS_NOT_IMPLEMENTED when the operation has
+ * to be done by the server instead. */
+
+#ifdef __linux__
+
+#define FUTEX_WAKE 1
+#define FUTEX_WAIT_BITSET 9
+#define FUTEX_BITSET_MATCH_ANY 0xffffffff
+
+#ifndef __NR_futex_waitv
+#define __NR_futex_waitv 449
+#endif
+#define FUTEX2_SIZE_U32 0x02
+
+struct futex_waitv
+{
+    ULONG64 val;
+    ULONG64 uaddr;
+    UINT    flags;
+    UINT    reserved;
+};
+
+struct kernel_timespec
+{
+    LONGLONG tv_sec;
+    LONGLONG tv_nsec;
+};
+
+union fsync_cache_entry
+{
+    LONG64 data;
+    struct
+    {
+        unsigned int slot;              /* slot index, 0 if the object has none */
+        unsigned int type : 8;          /* enum fsync_type */
+        unsigned int cached : 1;        /* the entry is valid */
+        unsigned int can_wait : 1;      /* the handle has SYNCHRONIZE access */
+        unsigned int can_modify : 1;    /* the handle has access to signal the object */
+    } s;
+};
+
+C_ASSERT( sizeof(union fsync_cache_entry) == sizeof(LONG64) );
+
+#define FSYNC_CACHE_BLOCK_SIZE  (65536 / sizeof(union fsync_cache_entry))
+#define FSYNC_CACHE_ENTRIES     128
+
+static union fsync_cache_entry *fsync_cache[FSYNC_CACHE_ENTRIES];
+static union fsync_cache_entry fsync_cache_initial_block[FSYNC_CACHE_BLOCK_SIZE];
+static pthread_mutex_t fsync_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int fsync_status = -1;  /* -1 if not initialized yet, otherwise enabled flag */
+static int futex_waitv_supported;
+static fsync_slot_t *fsync_slots;
+static unsigned int fsync_slot_count;
+
+static inline int futex_wake_shared( volatile int *addr, int count )
+{
+    return syscall( __NR_futex, addr, FUTEX_WAKE, count, NULL, 0, 0 );
+}
+
+static inline int futex_wait_shared( volatile int *addr, int val, const struct timespec *end )
+{
+    return syscall( __NR_futex, addr, FUTEX_WAIT_BITSET, val, end, 0, FUTEX_BITSET_MATCH_ANY );
+}
+
+static inline int futex_waitv( struct futex_waitv *waiters, unsigned int count, const struct timespec *end )
+{
+    struct kernel_timespec timeout;
+
+    if (!end) return syscall( __NR_futex_waitv, waiters, count, 0, NULL, CLOCK_MONOTONIC );
+    timeout.tv_sec = end->tv_sec;
+    timeout.tv_nsec = end->tv_nsec;
+    return syscall( __NR_futex_waitv, waiters, count, 0, &timeout, CLOCK_MONOTONIC );
+}
+
+static void init_fsync(void)
+{
+    const char *env = getenv( "WINEFSYNC" );
+    HANDLE handle = 0;
+    unsigned int count = 0;
+    SIZE_T size = 0;
+    void *ptr = NULL;
+    NTSTATUS ret;
+
+    if (!env || !atoi( env ))
+    {
+        fsync_status = 0;
+        return;
+    }
+
+    SERVER_START_REQ( get_fsync_shm )
+    {
+        if (!(ret = wine_server_call( req )))
+        {
+            handle = wine_server_ptr_handle( reply->handle );
+            count = reply->count;
+        }
+    }
+    SERVER_END_REQ;
+
+    if (ret)
+    {
+        WARN( "fsync not supported by the server, status %x\n", ret );
+        fsync_status = 0;
+        return;
+    }
+
+    ret = NtMapViewOfSection( handle, NtCurrentProcess(), &ptr, 0, 0, NULL, &size,
+                              ViewShare, 0, PAGE_READWRITE );
+    NtClose( handle );
+    if (ret)
+    {
+        ERR( "failed to map the fsync slots, status %x\n", ret );
+        fsync_status = 0;
+        return;
+    }
+
+    /* futex_waitv is needed to wait for several objects at once */
+    futex_waitv_supported = (syscall( __NR_futex_waitv, NULL, 0, 0, NULL, 0 ) == -1 && errno != ENOSYS);
+
+    TRACE( "using fsync, %u slots at %p, futex_waitv %ssupported\n",
+           count, ptr, futex_waitv_supported ? "" : "not " );
+    fsync_slots = ptr;
+    fsync_slot_count = count;
+    fsync_status = 1;
+}
+
+static BOOL do_fsync(void)
+{
+    if (fsync_status == -1)
+    {
+        sigset_t sigset;
+
+        server_enter_uninterrupted_section( &fsync_cache_mutex, &sigset );
+        if (fsync_status == -1) init_fsync();
+        server_leave_uninterrupted_section( &fsync_cache_mutex, &sigset );
+    }
+    return fsync_status > 0;
+}
+
+static inline unsigned int handle_to_index( HANDLE handle, unsigned int *entry )
+{
+    unsigned int idx = (wine_server_obj_handle(handle) >> 2) - 1;
+    *entry = idx / FSYNC_CACHE_BLOCK_SIZE;
+    return idx % FSYNC_CACHE_BLOCK_SIZE;
+}
+
+/* atomically exchange a 64-bit value */
+static inline LONG64 interlocked_xchg64( LONG64 *dest, LONG64 val )
+{
+#ifdef _WIN64
+    return (LONG64)InterlockedExchangePointer( (void **)dest, (void *)val );
+#else
+    LONG64 tmp = *dest;
+    while (InterlockedCompareExchange64( dest, val, tmp ) != tmp) tmp = *dest;
+    return tmp;
+#endif
+}
+
+/***********************************************************************
+ *           add_to_cache
+ *
+ * Caller must hold fsync_cache_mutex.
+ */
+static void add_to_cache( HANDLE handle, union fsync_cache_entry cache )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+
+    if (entry >= FSYNC_CACHE_ENTRIES) return;
+
+    if (!fsync_cache[entry])  /* do we need to allocate a new block of entries? */
+    {
+        if (!entry) fsync_cache[0] = fsync_cache_initial_block;
+        else
+        {
+            void *ptr = anon_mmap_alloc( FSYNC_CACHE_BLOCK_SIZE * sizeof(union fsync_cache_entry),
+                                         PROT_READ | PROT_WRITE );
+            if (ptr == MAP_FAILED) return;
+            fsync_cache[entry] = ptr;
+        }
+    }
+    interlocked_xchg64( &fsync_cache[entry][idx].data, cache.data );
+}
+
+static inline BOOL get_cached_object( HANDLE handle, union fsync_cache_entry *cache )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+
+    if (entry >= FSYNC_CACHE_ENTRIES || !fsync_cache[entry]) return FALSE;
+    cache->data = InterlockedCompareExchange64( &fsync_cache[entry][idx].data, 0, 0 );
+    return cache->s.cached;
+}
+
+/***********************************************************************
+ *           get_fsync_object
+ *
+ * Retrieve the slot of an object, caching the result for the handle.
+ */
+static NTSTATUS get_fsync_object( HANDLE handle, union fsync_cache_entry *cache )
+{
+    sigset_t sigset;
+    NTSTATUS ret;
+
+    if ((LONG_PTR)handle <= 0) return STATUS_NOT_IMPLEMENTED;  /* null or pseudo-handle */
+    if (!do_fsync()) return STATUS_NOT_IMPLEMENTED;
+
+    if (!get_cached_object( handle, cache ))
+    {
+        server_enter_uninterrupted_section( &fsync_cache_mutex, &sigset );
+        if (!get_cached_object( handle, cache ))
+        {
+            SERVER_START_REQ( get_fsync_slot )
+            {
+                req->handle = wine_server_obj_handle( handle );
+                if (!(ret = wine_server_call( req )) && reply->slot < fsync_slot_count)
+                {
+                    cache->data         = 0;
+                    cache->s.slot       = reply->slot;
+                    cache->s.type       = reply->slot ? reply->type : FSYNC_NONE;
+                    cache->s.cached     = 1;
+                    cache->s.can_wait   = !!(reply->access & SYNCHRONIZE);
+                    /* events and semaphores use the same access bit, mutexes don't need one */
+                    cache->s.can_modify = (reply->type == FSYNC_MUTEX ||
+                                           (reply->access & EVENT_MODIFY_STATE));
+                    add_to_cache( handle, *cache );
+                }
+            }
+            SERVER_END_REQ;
+        }
+        server_leave_uninterrupted_section( &fsync_cache_mutex, &sigset );
+
+        /* let the server report the error */
+        if (!cache->s.cached) return STATUS_NOT_IMPLEMENTED;
+    }
+    if (!cache->s.slot) return STATUS_NOT_IMPLEMENTED;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           fsync_close
+ *
+ * Remove a closed handle from the cache. Must be called after the server
+ * closed it, so that a concurrent lookup can't add it back.
+ */
+void fsync_close( HANDLE handle )
+{
+    unsigned int entry, idx;
+    sigset_t sigset;
+
+    if (fsync_status <= 0 || (LONG_PTR)handle <= 0) return;
+
+    idx = handle_to_index( handle, &entry );
+    server_enter_uninterrupted_section( &fsync_cache_mutex, &sigset );
+    if (entry < FSYNC_CACHE_ENTRIES && fsync_cache[entry])
+        interlocked_xchg64( &fsync_cache[entry][idx].data, 0 );
+    server_leave_uninterrupted_section( &fsync_cache_mutex, &sigset );
+}
+
+/* after a state change, let the server check the waiters it may have */
+static void wake_server_waiters( HANDLE handle, fsync_slot_t *slot )
+{
+    /* the state change was done with a full barrier, so either we see the waiter
+     * or the server sees the new state when it adds it */
+    if (!slot->server_waiters) return;
+
+    SERVER_START_REQ( fsync_wake )
+    {
+        req->handle = wine_server_obj_handle( handle );
+        wine_server_call( req );
+    }
+    SERVER_END_REQ;
+}
+
+static NTSTATUS get_modifiable_object( HANDLE handle, enum fsync_type type1, enum fsync_type type2,
+                                       fsync_slot_t **slot )
+{
+    union fsync_cache_entry obj;
+    NTSTATUS ret;
+
+    if ((ret = get_fsync_object( handle, &obj ))) return ret;
+    if (obj.s.type != type1 && obj.s.type != type2) return STATUS_OBJECT_TYPE_MISMATCH;
+    if (!obj.s.can_modify) return STATUS_ACCESS_DENIED;
+    *slot = &fsync_slots[obj.s.slot];
+    return STATUS_SUCCESS;
+}
+
+/* retrieve the head of the list of mutexes owned by the current thread, 0 if not available */
+static unsigned int get_owner_list(void)
+{
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+
+    if (!thread_data->fsync_owned)
+    {
+        SERVER_START_REQ( get_fsync_owner_list )
+        {
+            if (!wine_server_call( req ) && reply->slot < fsync_slot_count)
+                thread_data->fsync_owned = reply->slot;
+        }
+        SERVER_END_REQ;
+    }
+    return thread_data->fsync_owned;
+}
+
+static void add_owned( unsigned int index )
+{
+    unsigned int head_index = ntdll_get_thread_data()->fsync_owned;
+    fsync_slot_t *head = &fsync_slots[head_index], *slot = &fsync_slots[index];
+
+    slot->next = head->next;
+    slot->prev = head_index;
+    if (head->next) fsync_slots[head->next].prev = index;
+    head->next = index;
+}
+
+static void remove_owned( unsigned int index )
+{
+    fsync_slot_t *slot = &fsync_slots[index];
+
+    if (!slot->prev) return;
+    fsync_slots[slot->prev].next = slot->next;
+    if (slot->next) fsync_slots[slot->next].prev = slot->prev;
+    slot->next = slot->prev = 0;
+}
+
+NTSTATUS fsync_set_event( HANDLE handle, LONG *prev_state )
+{
+    fsync_slot_t *slot;
+    NTSTATUS ret;
+    LONG prev;
+
+    if ((ret = get_modifiable_object( handle, FSYNC_AUTO_EVENT, FSYNC_MANUAL_EVENT, &slot ))) return ret;
+
+    if (!(prev = InterlockedExchange( (LONG volatile *)&slot->state, 1 )))
+        futex_wake_shared( &slot->state, INT_MAX );
+    wake_server_waiters( handle, slot );
+    if (prev_state) *prev_state = prev;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS fsync_reset_event( HANDLE handle, LONG *prev_state )
+{
+    fsync_slot_t *slot;
+    NTSTATUS ret;
+    LONG prev;
+
+    if ((ret = get_modifiable_object( handle, FSYNC_AUTO_EVENT, FSYNC_MANUAL_EVENT, &slot ))) return ret;
+
+    prev = InterlockedExchange( (LONG volatile *)&slot->state, 0 );
+    if (prev_state) *prev_state = prev;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS fsync_release_semaphore( HANDLE handle, ULONG count, ULONG *previous )
+{
+    fsync_slot_t *slot;
+    NTSTATUS ret;
+    LONG current;
+
+    if ((ret = get_modifiable_object( handle, FSYNC_SEMAPHORE, FSYNC_SEMAPHORE, &slot ))) return ret;
+
+    do
+    {
+        current = slot->state;
+        if (count > (ULONG)(slot->count - current)) return STATUS_SEMAPHORE_LIMIT_EXCEEDED;
+    } while (InterlockedCompareExchange( (LONG volatile *)&slot->state, current + count, current ) != current);
+
+    futex_wake_shared( &slot->state, INT_MAX );
+    wake_server_waiters( handle, slot );
+    if (previous) *previous = current;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS fsync_release_mutex( HANDLE handle, LONG *prev_count )
+{
+    fsync_slot_t *slot;
+    NTSTATUS ret;
+    LONG prev;
+
+    if ((ret = get_modifiable_object( handle, FSYNC_MUTEX, FSYNC_MUTEX, &slot ))) return ret;
+
+    if (slot->state != GetCurrentThreadId() || !slot->count) return STATUS_MUTANT_NOT_OWNED;
+
+    /* only the owner modifies the recursion count */
+    prev = slot->count--;
+    if (!slot->count)
+    {
+        /* the slot can't be in two lists, so unlink it before another thread can take it */
+        remove_owned( slot - fsync_slots );
+        InterlockedExchange( (LONG volatile *)&slot->state, 0 );
+        futex_wake_shared( &slot->state, INT_MAX );
+        wake_server_waiters( handle, slot );
+    }
+    if (prev_count) *prev_count = 1 - prev;
+    return STATUS_SUCCESS;
+}
+
+/* try to acquire an object, return the value to wait on if it's not available */
+static NTSTATUS try_acquire( const union fsync_cache_entry *obj, int *wait_value )
+{
+    fsync_slot_t *slot = &fsync_slots[obj->s.slot];
+    LONG current, tid;
+
+    switch (obj->s.type)
+    {
+    case FSYNC_AUTO_EVENT:
+        if (InterlockedCompareExchange( (LONG volatile *)&slot->state, 0, 1 )) return STATUS_SUCCESS;
+        *wait_value = 0;
+        return STATUS_PENDING;
+
+    case FSYNC_MANUAL_EVENT:
+        if (slot->state) return STATUS_SUCCESS;
+        *wait_value = 0;
+        return STATUS_PENDING;
+
+    case FSYNC_SEMAPHORE:
+        while ((current = slot->state))
+        {
+            if (InterlockedCompareExchange( (LONG volatile *)&slot->state, current - 1, current ) == current)
+                return STATUS_SUCCESS;
+        }
+        *wait_value = 0;
+        return STATUS_PENDING;
+
+    case FSYNC_MUTEX:
+        tid = GetCurrentThreadId();
+        if ((current = slot->state) == tid)
+        {
+            slot->count++;
+            return STATUS_SUCCESS;
+        }
+        if (!current)
+        {
+            /* list it first, so that it's found if the thread is killed once it owns it */
+            add_owned( obj->s.slot );
+            if (!(current = InterlockedCompareExchange( (LONG volatile *)&slot->state, tid, 0 )))
+            {
+                slot->count = 1;
+                if (InterlockedExchange( (LONG volatile *)&slot->abandoned, 0 )) return STATUS_ABANDONED_WAIT_0;
+                return STATUS_SUCCESS;
+            }
+            remove_owned( obj->s.slot );
+        }
+        *wait_value = current;
+        return STATUS_PENDING;
+    }
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static void get_wait_end( struct timespec *end, const LARGE_INTEGER *timeout )
+{
+    LARGE_INTEGER now;
+    LONGLONG diff;
+
+    if (timeout->QuadPart > 0)
+    {
+        NtQuerySystemTime( &now );
+        diff = timeout->QuadPart - now.QuadPart;
+    }
+    else diff = -timeout->QuadPart;
+    if (diff < 0) diff = 0;
+
+    clock_gettime( CLOCK_MONOTONIC, end );
+    end->tv_sec += diff / TICKSPERSEC;
+    end->tv_nsec += (diff % TICKSPERSEC) * 100;
+    if (end->tv_nsec >= 1000000000)
+    {
+        end->tv_sec++;
+        end->tv_nsec -= 1000000000;
+    }
+}
+
+/***********************************************************************
+ *           fsync_wait_objects
+ *
+ * Wait for any of the objects without going through the server.
+ */
+NTSTATUS fsync_wait_objects( DWORD count, const HANDLE *handles, BOOLEAN wait_any,
+                             BOOLEAN alertable, const LARGE_INTEGER *timeout )
+{
+    union fsync_cache_entry objs[MAXIMUM_WAIT_OBJECTS];
+    struct futex_waitv waitv[MAXIMUM_WAIT_OBJECTS];
+    struct timespec end;
+    NTSTATUS ret;
+    int value;
+    DWORD i;
+
+    /* user APCs and atomic wait-all are only handled by the server */
+    if (alertable || (!wait_any && count > 1)) return STATUS_NOT_IMPLEMENTED;
+    if (count > 1 && !futex_waitv_supported) return STATUS_NOT_IMPLEMENTED;
+
+    for (i = 0; i < count; i++)
+    {
+        if ((ret = get_fsync_object( handles[i], &objs[i] ))) return ret;
+        if (!objs[i].s.can_wait) return STATUS_NOT_IMPLEMENTED;
+        if (objs[i].s.type == FSYNC_MUTEX && !get_owner_list()) return STATUS_NOT_IMPLEMENTED;
+    }
+
+    if (timeout && timeout->QuadPart == TIMEOUT_INFINITE) timeout = NULL;
+    if (timeout) get_wait_end( &end, timeout );
+
+    for (;;)
+    {
+        for (i = 0; i < count; i++)
+        {
+            ret = try_acquire( &objs[i], &value );
+            if (ret == STATUS_SUCCESS || ret == STATUS_ABANDONED_WAIT_0) return ret + i;
+            waitv[i].val      = value;
+            waitv[i].uaddr    = (ULONG_PTR)&fsync_slots[objs[i].s.slot].state;
+            waitv[i].flags    = FUTEX2_SIZE_U32;
+            waitv[i].reserved = 0;
+        }
+        if (timeout && !timeout->QuadPart) return STATUS_TIMEOUT;
+
+        if (count == 1)
+            ret = futex_wait_shared( &fsync_slots[objs[0].s.slot].state, value, timeout ? &end : NULL );
+        else
+            ret = futex_waitv( waitv, count, timeout ? &end : NULL );
+
+        if (ret == -1 && errno == ETIMEDOUT) return STATUS_TIMEOUT;
+        /* EAGAIN or EINTR, or woken up: try again */
+    }
+}
+
+#else  /* __linux__ */
+
+void fsync_close( HANDLE handle )
+{
+}
+
+NTSTATUS fsync_set_event( HANDLE handle, LONG *prev_state )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+NTSTATUS fsync_reset_event( HANDLE handle, LONG *prev_state )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+NTSTATUS fsync_release_semaphore( HANDLE handle, ULONG count, ULONG *previous )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+NTSTATUS fsync_release_mutex( HANDLE handle, LONG *prev_count )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+NTSTATUS fsync_wait_objects( DWORD count, const HANDLE *handles, BOOLEAN wait_any,
+                             BOOLEAN alertable, const LARGE_INTEGER *timeout )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+#endif  /* __linux__ */
@@ -59,6 +59,19 @@ static HANDLE std_key;
 static HANDLE app_key;
 static BOOL init_done;
 static BOOL main_exe_loaded;
+static const WCHAR *app_basename;
+
+/* state of the load order configuration, used as prefix of the loader snapshot keys */
+struct snapshot_stamp
+{
+    unsigned int  env_hash;   /* hash of WINEDLLOVERRIDES */
+    unsigned int  app_hash;   /* hash of the app name if it has its own DllOverrides key */
+    LARGE_INTEGER times[4];   /* last write times of the DllOverrides and AppDefaults keys */
+};
+
+static struct snapshot_stamp snapshot_stamp;
+static BOOL snapshot_stamp_valid;  /* FALSE if the snapshot is disabled */
+static pthread_once_t snapshot_stamp_once = PTHREAD_ONCE_INIT;
 
 
 /***************************************************************************
@@ -366,10 +379,105 @@ void set_load_order_app_name( const WCHAR *app_name )
 
     if ((p = wcsrchr( app_name, '\\' ))) app_name = p + 1;
     app_key = open_app_key( app_name );
+    app_basename = app_name;
     main_exe_loaded = TRUE;
 }
 
 
+/***************************************************************************
+ *	hash_string
+ */
+static unsigned int hash_string( const void *data, size_t size )
+{
+    const unsigned char *p = data;
+    unsigned int hash = 2166136261u;
+
+    while (size--) hash = (hash ^ *p++) * 16777619;
+    return hash;
+}
+
+
+/***************************************************************************
+ *	get_key_time
+ *
+ * Get the last write time of a registry key, or 0 if it doesn't exist.
+ */
+static void get_key_time( HANDLE key, LARGE_INTEGER *time )
+{
+    char buffer[offsetof( KEY_BASIC_INFORMATION, Name[MAX_PATH] )];
+    KEY_BASIC_INFORMATION *info = (KEY_BASIC_INFORMATION *)buffer;
+    NTSTATUS status;
+    DWORD size;
+
+    time->QuadPart = 0;
+    if (!key) return;
+    status = NtQueryKey( key, KeyBasicInformation, buffer, sizeof(buffer), &size );
+    if (!status || status == STATUS_BUFFER_OVERFLOW) *time = info->LastWriteTime;
+}
+
+
+/***************************************************************************
+ *	init_snapshot_stamp
+ *
+ * Compute the state of the configuration that the cached load orders depend on.
+ * Every registry key and value change updates the last write time of the key.
+ * Called once through snapshot_stamp_once.
+ */
+static void init_snapshot_stamp(void)
+{
+    const char *overrides = getenv( "WINEDLLOVERRIDES" );
+    struct snapshot_stamp stamp;
+    OBJECT_ATTRIBUTES attr;
+    UNICODE_STRING nameW;
+    HANDLE root, key;
+
+    if (!loader_snapshot_enabled()) return;
+
+    memset( &stamp, 0, sizeof(stamp) );
+    if (overrides) stamp.env_hash = hash_string( overrides, strlen( overrides ));
+    get_key_time( std_key, &stamp.times[0] );
+    if (!open_hkcu_key( "Software\\Wine\\AppDefaults", &root ))
+    {
+        get_key_time( root, &stamp.times[1] );
+        if (app_basename)
+        {
+            init_unicode_string( &nameW, app_basename );
+            InitializeObjectAttributes( &attr, &nameW, 0, root, NULL );
+            if (!NtOpenKey( &key, KEY_QUERY_VALUE, &attr ))
+            {
+                get_key_time( key, &stamp.times[2] );
+                NtClose( key );
+            }
+        }
+        NtClose( root );
+    }
+    if (app_key)
+    {
+        get_key_time( app_key, &stamp.times[3] );
+        stamp.app_hash = hash_string( app_basename, wcslen( app_basename ) * sizeof(WCHAR) );
+    }
+    snapshot_stamp = stamp;
+    snapshot_stamp_valid = TRUE;
+}
+
+
+/***************************************************************************
+ *	get_snapshot_key
+ *
+ * Build the loader snapshot key for the load order of a module.
+ */
+static void *get_snapshot_key( const WCHAR *path, ULONG *size )
+{
+    char *key;
+
+    *size = sizeof(snapshot_stamp) + wcslen( path ) * sizeof(WCHAR);
+    if (!(key = malloc( *size ))) return NULL;
+    memcpy( key, &snapshot_stamp, sizeof(snapshot_stamp) );
+    memcpy( key + sizeof(snapshot_stamp), path, *size - sizeof(snapshot_stamp) );
+    return key;
+}
+
+
 /***************************************************************************
  *	get_load_order   (internal)
  *
@@ -383,6 +491,8 @@ enum loadorder get_load_order( const UNICODE_STRING *nt_name )
     const WCHAR *path = nt_name->Buffer;
     const WCHAR *p;
     WCHAR *module, *basename;
+    void *key = NULL;
+    ULONG key_size, value, size = sizeof(value);
     int len;
 
     if (!init_done) init_load_order();
@@ -406,6 +516,18 @@ enum loadorder get_load_order( const UNICODE_STRING *nt_name )
     remove_dll_ext( module + 1 );
     basename = get_basename( module + 1 );
 
+    /* the load order of the main exe depends on whether it has already been loaded */
+    if (main_exe_loaded && !pthread_once( &snapshot_stamp_once, init_snapshot_stamp ) &&
+        snapshot_stamp_valid && (key = get_snapshot_key( path, &key_size )) &&
+        !get_loader_snapshot( SNAPSHOT_LOAD_ORDER, key, key_size, &value, &size ) && size == sizeof(value))
+    {
+        ret = value;
+        TRACE( "got snapshot %s for %s\n", debugstr_loadorder(ret), debugstr_w(path) );
+        free( key );
+        free( module );
+        return ret;
+    }
+
     /* first explicit module name */
     if ((ret = get_load_order_value( std_key, app_key, module+1 )) != LO_INVALID)
         goto done;
@@ -432,6 +554,12 @@ enum loadorder get_load_order( const UNICODE_STRING *nt_name )
     TRACE( "got hardcoded %s for %s\n", debugstr_loadorder(ret), debugstr_w(path) );
 
  done:
+    if (key)
+    {
+        value = ret;
+        set_loader_snapshot( SNAPSHOT_LOAD_ORDER, key, key_size, &value, sizeof(value) );
+        free( key );
+    }
     free( module );
     return ret;
 }
@@ -300,21 +300,49 @@ static NTSTATUS get_pe_file_info( OBJECT_ATTRIBUTES *attr, HANDLE *handle, pe_im
 }
 
 
+/* variables that are passed to the new process through its Unix environment */
+static const char * const unix_env_vars[] =
+{
+    "WINEDEBUG",
+    "WINEIOURING",
+    "WINERELOCCACHE",
+    "WINELOADERSNAPSHOT",
+    "WINESOCKREACTOR",
+};
+
+/***********************************************************************
+ *           is_unix_env_var
+ */
+static BOOL is_unix_env_var( const WCHAR *str, const char *name )
+{
+    while (*name && *str == (unsigned char)*name)
+    {
+        str++;
+        name++;
+    }
+    return !*name && *str == '=';
+}
+
+
 /***********************************************************************
  *           get_env_size
  */
-static ULONG get_env_size( const RTL_USER_PROCESS_PARAMETERS *params, char **winedebug )
+static ULONG get_env_size( const RTL_USER_PROCESS_PARAMETERS *params, char **unix_env )
 {
     WCHAR *ptr = params->Environment;
+    unsigned int i;
 
     while (*ptr)
     {
-        static const WCHAR WINEDEBUG[] = {'W','I','N','E','D','E','B','U','G','=',0};
-        if (!*winedebug && !wcsncmp( ptr, WINEDEBUG, ARRAY_SIZE( WINEDEBUG ) - 1 ))
+        for (i = 0; i < ARRAY_SIZE(unix_env_vars); i++)
         {
-            DWORD len = wcslen(ptr) * 3 + 1;
-            if ((*winedebug = malloc( len )))
-                ntdll_wcstoumbs( ptr, wcslen(ptr) + 1, *winedebug, len, FALSE );
+            if (!unix_env[i] && is_unix_env_var( ptr, unix_env_vars[i] ))
+            {
+                DWORD len = wcslen(ptr) * 3 + 1;
+                if ((unix_env[i] = malloc( len )))
+                    ntdll_wcstoumbs( ptr, wcslen(ptr) + 1, unix_env[i], len, FALSE );
+                break;
+            }
         }
         ptr += wcslen(ptr) + 1;
     }
@@ -419,10 +447,11 @@ static BOOL is_unix_console_handle( HANDLE handle )
  *           spawn_process
  */
 static NTSTATUS spawn_process( const RTL_USER_PROCESS_PARAMETERS *params, int socketfd,
-                               int unixdir, char *winedebug, const pe_image_info_t *pe_info )
+                               int unixdir, char **unix_env, const pe_image_info_t *pe_info )
 {
     NTSTATUS status = STATUS_SUCCESS;
     int stdin_fd = -1, stdout_fd = -1;
+    unsigned int i;
     pid_t pid;
     char **argv;
 
@@ -450,7 +479,8 @@ static NTSTATUS spawn_process( const RTL_USER_PROCESS_PARAMETERS *params, int so
             if (stdin_fd != -1 && stdin_fd != 0) close( stdin_fd );
             if (stdout_fd != -1 && stdout_fd != 1) close( stdout_fd );
 
-            if (winedebug) putenv( winedebug );
+            for (i = 0; i < ARRAY_SIZE(unix_env_vars); i++)
+                if (unix_env[i]) putenv( unix_env[i] );
             if (unixdir != -1)
             {
                 fchdir( unixdir );
@@ -627,7 +657,7 @@ NTSTATUS WINAPI NtCreateUserProcess( HANDLE *process_handle_ptr, HANDLE *thread_
     HANDLE file_handle, process_info = 0, process_handle = 0, thread_handle = 0;
     struct object_attributes *objattr;
     data_size_t attr_len;
-    char *winedebug = NULL;
+    char *unix_env[ARRAY_SIZE(unix_env_vars)] = { NULL };
     startup_info_t *startup_info = NULL;
     ULONG startup_info_size, env_size;
     int unixdir, socketfd[2] = { -1, -1 };
@@ -692,7 +722,7 @@ NTSTATUS WINAPI NtCreateUserProcess( HANDLE *process_handle_ptr, HANDLE *thread_
         goto done;
     }
     if (!(startup_info = create_startup_info( attr.ObjectName, params, &startup_info_size ))) goto done;
-    env_size = get_env_size( params, &winedebug );
+    env_size = get_env_size( params, unix_env );
 
     if ((status = alloc_object_attributes( process_attr, &objattr, &attr_len ))) goto done;
 
@@ -796,7 +826,7 @@ NTSTATUS WINAPI NtCreateUserProcess( HANDLE *process_handle_ptr, HANDLE *thread_
 
     /* create the child process */
 
-    if ((status = spawn_process( params, socketfd[0], unixdir, winedebug, &pe_info ))) goto done;
+    if ((status = spawn_process( params, socketfd[0], unixdir, unix_env, &pe_info ))) goto done;
 
     close( socketfd[0] );
     socketfd[0] = -1;
@@ -865,7 +895,7 @@ done:
     if (socketfd[0] != -1) close( socketfd[0] );
     if (unixdir != -1) close( unixdir );
     free( startup_info );
-    free( winedebug );
+    for (i = 0; i < ARRAY_SIZE(unix_env); i++) free( unix_env[i] );
     free( redir.Buffer );
     return status;
 }
@@ -102,7 +102,7 @@ WINE_DEFAULT_DEBUG_CHANNEL(server);
 #define SOCKETNAME "socket"        /* name of the socket file */
 #define LOCKNAME   "lock"          /* name of the lock file */
 
-static const char *server_dir;
+const char *server_dir = NULL;
 
 unsigned int supported_machines_count = 0;
 USHORT supported_machines[8] = { 0 };
@@ -118,6 +118,18 @@ sigset_t server_block_set;  /* signals to block during server calls */
 static int fd_socket = -1;  /* socket to exchange file descriptors with the server */
 static pid_t server_pid;
 static pthread_mutex_t fd_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t io_notify_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int io_notify_fd = -1;  /* pipe to report I/O completions from threads without a TEB */
+
+#define DEFERRED_CALLS_MAX 32  /* max number of deferred calls sent in a single batch */
+
+/* server calls whose result isn't needed, sent along with the next server call of the thread */
+struct deferred_calls
+{
+    unsigned int count;        /* number of queued requests */
+    data_size_t  size;         /* size of the queued data */
+    char         data[4096];   /* request headers followed by their data, padded to 8 bytes */
+};
 
 /* atomically exchange a 64-bit value */
 static inline LONG64 interlocked_xchg64( LONG64 *dest, LONG64 val )
@@ -267,14 +279,131 @@ static inline unsigned int wait_reply( struct __server_request_info *req )
 }
 
 
+/***********************************************************************
+ *           send_deferred_calls_singly
+ *
+ * Send the deferred calls one at a time, when the batch couldn't be executed.
+ */
+static void send_deferred_calls_singly( struct deferred_calls *calls )
+{
+    struct __server_request_info req;
+    const union generic_request *sub;
+    data_size_t pos = 0;
+
+    while (pos < calls->size)
+    {
+        sub = (const union generic_request *)(calls->data + pos);
+        pos += sizeof(*sub) + ((sub->request_header.request_size + 7) & ~7);
+
+        memset( &req, 0, sizeof(req) );
+        req.u.req = *sub;
+        req.data[0].ptr = sub + 1;
+        req.data[0].size = sub->request_header.request_size;
+        req.data_count = 1;
+        if (!send_request( &req ) && wait_reply( &req ))
+            WARN( "deferred call failed with status %08x\n", req.u.reply.reply_header.error );
+    }
+    calls->count = 0;
+    calls->size = 0;
+}
+
+
+/***********************************************************************
+ *           send_batch
+ *
+ * Send the deferred calls, followed by the specified request if any, in a
+ * single batch request and wait for the replies.
+ */
+static unsigned int send_batch( struct deferred_calls *calls, struct __server_request_info *req )
+{
+    static const char padding[8];
+    struct iovec vec[__SERVER_MAX_DATA + 4];
+    union generic_request batch;
+    union generic_reply reply, replies[DEFERRED_CALLS_MAX];
+    unsigned int i, count = 0;
+    data_size_t size;
+    int ret;
+
+    memset( &batch, 0, sizeof(batch) );
+    batch.request_header.req = REQ_batch;
+    batch.request_header.request_size = calls->size;
+    batch.request_header.reply_size = calls->count * sizeof(reply);
+    vec[count].iov_base = &batch;
+    vec[count++].iov_len = sizeof(batch);
+    vec[count].iov_base = calls->data;
+    vec[count++].iov_len = calls->size;
+    if (req)
+    {
+        size = req->u.req.request_header.request_size;
+        vec[count].iov_base = (void *)&req->u.req;
+        vec[count++].iov_len = sizeof(req->u.req);
+        for (i = 0; i < req->data_count; i++)
+        {
+            vec[count].iov_base = (void *)req->data[i].ptr;
+            vec[count++].iov_len = req->data[i].size;
+        }
+        if (size & 7)
+        {
+            vec[count].iov_base = (void *)padding;
+            vec[count++].iov_len = 8 - (size & 7);
+        }
+        batch.request_header.request_size += sizeof(req->u.req) + ((size + 7) & ~7);
+        batch.request_header.reply_size += sizeof(reply) +
+                                           ((req->u.req.request_header.reply_size + 7) & ~7);
+    }
+
+    if ((ret = writev( ntdll_get_thread_data()->request_fd, vec, count )) !=
+        batch.request_header.request_size + sizeof(batch))
+    {
+        if (ret >= 0) server_protocol_error( "partial write %d\n", ret );
+        if (errno == EPIPE) abort_thread(0);
+        if (errno == EFAULT) return STATUS_ACCESS_VIOLATION;
+        server_protocol_perror( "write" );
+    }
+
+    read_reply_data( &reply, sizeof(reply) );
+    if (reply.reply_header.error)
+    {
+        /* nothing has been executed, send the requests on their own instead */
+        WARN( "batch failed with status %08x\n", reply.reply_header.error );
+        send_deferred_calls_singly( calls );
+        if (!req) return STATUS_SUCCESS;
+        if ((ret = send_request( req ))) return ret;
+        return wait_reply( req );
+    }
+
+    read_reply_data( replies, calls->count * sizeof(replies[0]) );
+    for (i = 0; i < calls->count; i++)
+        if (replies[i].reply_header.error)
+            WARN( "deferred call %u failed with status %08x\n", i, replies[i].reply_header.error );
+    calls->count = 0;
+    calls->size = 0;
+
+    if (!req) return STATUS_SUCCESS;
+    wait_reply( req );
+    if ((size = req->u.reply.reply_header.reply_size & 7))
+    {
+        char buffer[8];
+        read_reply_data( buffer, 8 - size );
+    }
+    return req->u.reply.reply_header.error;
+}
+
+
 /***********************************************************************
  *           server_call_unlocked
  */
 unsigned int server_call_unlocked( void *req_ptr )
 {
     struct __server_request_info * const req = req_ptr;
+    struct deferred_calls *calls = ntdll_get_thread_data()->deferred_calls;
     unsigned int ret;
 
+    if (calls && calls->count)
+    {
+        if (is_batch_allowed( req->u.req.request_header.req )) return send_batch( calls, req );
+        if ((ret = send_batch( calls, NULL ))) return ret;
+    }
     if ((ret = send_request( req ))) return ret;
     return wait_reply( req );
 }
@@ -297,6 +426,73 @@ unsigned int CDECL wine_server_call( void *req_ptr )
 }
 
 
+/***********************************************************************
+ *           server_call_deferred
+ *
+ * Queue a server call whose result isn't needed. It is sent along with the
+ * next server call of the thread, saving a round-trip. The request can't
+ * return reply data.
+ */
+unsigned int server_call_deferred( void *req_ptr )
+{
+    struct __server_request_info * const req = req_ptr;
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    struct deferred_calls *calls = thread_data->deferred_calls;
+    data_size_t size = sizeof(req->u.req) + ((req->u.req.request_header.request_size + 7) & ~7);
+    sigset_t old_set;
+    unsigned int i;
+    char *ptr;
+
+    if (req->u.req.request_header.reply_size || size > sizeof(calls->data))
+        return wine_server_call( req );
+    if (!calls && !(calls = thread_data->deferred_calls = calloc( 1, sizeof(*calls) )))
+        return wine_server_call( req );
+
+    pthread_sigmask( SIG_BLOCK, &server_block_set, &old_set );
+    if ((calls->count == DEFERRED_CALLS_MAX || size > sizeof(calls->data) - calls->size) &&
+        send_batch( calls, NULL ))
+    {
+        pthread_sigmask( SIG_SETMASK, &old_set, NULL );
+        return wine_server_call( req );
+    }
+
+    ptr = calls->data + calls->size;
+    memcpy( ptr, &req->u.req, sizeof(req->u.req) );
+    ptr += sizeof(req->u.req);
+    for (i = 0; i < req->data_count; i++)
+    {
+        memcpy( ptr, req->data[i].ptr, req->data[i].size );
+        ptr += req->data[i].size;
+    }
+    memset( ptr, 0, calls->data + calls->size + size - ptr );
+    calls->size += size;
+    calls->count++;
+    pthread_sigmask( SIG_SETMASK, &old_set, NULL );
+
+    memset( &req->u.reply, 0, sizeof(req->u.reply) );
+    return STATUS_SUCCESS;
+}
+
+
+/***********************************************************************
+ *           flush_deferred_calls
+ *
+ * Send the queued server calls of an exiting thread and free the queue.
+ * Signals must be blocked.
+ */
+void flush_deferred_calls(void)
+{
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    struct deferred_calls *calls = thread_data->deferred_calls;
+
+    if (!calls) return;
+    /* don't come back here if the server pipe is already gone */
+    thread_data->deferred_calls = NULL;
+    if (calls->count) send_batch( calls, NULL );
+    free( calls );
+}
+
+
 /***********************************************************************
  *           server_enter_uninterrupted_section
  */
@@ -997,6 +1193,62 @@ static int remove_fd_from_cache( HANDLE handle )
 }
 
 
+/***********************************************************************/
+/* handle table mirror support */
+
+static const handle_table_shm_t *handle_shm;
+
+
+/***********************************************************************
+ *           init_handle_shm
+ *
+ * Map the mirror of the process handle table maintained by the server.
+ */
+static void init_handle_shm(void)
+{
+    HANDLE handle = 0;
+    SIZE_T size = 0;
+    void *ptr = NULL;
+    NTSTATUS ret;
+
+    SERVER_START_REQ( get_handle_shm )
+    {
+        if (!(ret = wine_server_call( req ))) handle = wine_server_ptr_handle( reply->handle );
+    }
+    SERVER_END_REQ;
+    if (ret) return;
+
+    ret = NtMapViewOfSection( handle, NtCurrentProcess(), &ptr, 0, 0, NULL, &size,
+                              ViewShare, 0, PAGE_READONLY );
+    NtClose( handle );
+    if (ret)
+    {
+        WARN( "failed to map the handle table, status %x\n", ret );
+        return;
+    }
+    handle_shm = ptr;
+}
+
+
+/***********************************************************************
+ *           get_handle_shm
+ *
+ * Retrieve the state of a handle of the current process from the mirror of the handle table.
+ * Return FALSE if the handle is not mirrored, in which case the server has to be asked.
+ */
+BOOL get_handle_shm( HANDLE handle, unsigned int *access, unsigned int *flags )
+{
+    unsigned int idx = (wine_server_obj_handle( handle ) >> 2) - 1;
+    const handle_shm_t *entry;
+
+    if (!handle_shm || idx >= handle_shm->count) return FALSE;
+    entry = &handle_shm->entries[idx];
+    if (!(*flags = entry->flags)) return TRUE;
+    *access = entry->access;
+    return TRUE;
+}
+
+
 /***********************************************************************
  *           server_get_unix_fd
  *
@@ -1008,7 +1260,7 @@ int server_get_unix_fd( HANDLE handle, unsigned int wanted_access, int *unix_fd,
     sigset_t sigset;
     obj_handle_t fd_handle;
     int ret, fd = -1;
-    unsigned int access = 0;
+    unsigned int access = 0, flags;
 
     *unix_fd = -1;
     *needs_close = 0;
@@ -1017,6 +1269,14 @@ int server_get_unix_fd( HANDLE handle, unsigned int wanted_access, int *unix_fd,
     ret = get_cached_fd( handle, &fd, type, &access, options );
     if (ret != STATUS_INVALID_HANDLE) goto done;
 
+    /* invalid handles and objects without fd don't need the server; the access is checked */
+    /* last, once the server had a chance to report an error for the unix fd itself */
+    if (get_handle_shm( handle, &access, &flags ))
+    {
+        if (!(flags & HANDLE_SHM_IN_USE)) return STATUS_INVALID_HANDLE;
+        if (flags & HANDLE_SHM_NO_FD) return STATUS_OBJECT_TYPE_MISMATCH;
+    }
+
     server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
     ret = get_cached_fd( handle, &fd, type, &access, options );
     if (ret == STATUS_INVALID_HANDLE)
@@ -1058,6 +1318,60 @@ done:
 }
 
 
+/***********************************************************************
+ *           server_init_io_notify
+ *
+ * Create the pipe used by server_notify_io(). Must be called from a thread with a TEB.
+ */
+BOOL server_init_io_notify(void)
+{
+    NTSTATUS status;
+    sigset_t sigset;
+    int fds[2];
+
+    if (io_notify_fd != -1) return TRUE;
+
+    server_enter_uninterrupted_section( &io_notify_mutex, &sigset );
+    if (io_notify_fd == -1 && server_pipe( fds ) != -1)
+    {
+        wine_server_send_fd( fds[0] );
+        SERVER_START_REQ( set_io_notify_fd )
+        {
+            req->fd = fds[0];
+            status = wine_server_call( req );
+        }
+        SERVER_END_REQ;
+        close( fds[0] );
+        if (!status) io_notify_fd = fds[1];
+        else close( fds[1] );
+    }
+    server_leave_uninterrupted_section( &io_notify_mutex, &sigset );
+    return io_notify_fd != -1;
+}
+
+
+/***********************************************************************
+ *           server_notify_io
+ *
+ * Report the completion of an I/O that the server doesn't know about: set the event, or
+ * signal the file if there is none, and queue the completion if the file has a port.
+ * This doesn't need a TEB, so it can be used from pthreads. The server applies the
+ * completions in order, and before it closes a handle of the process.
+ */
+void server_notify_io( HANDLE handle, HANDLE event, ULONG_PTR cvalue, NTSTATUS status, ULONG_PTR info )
+{
+    io_notify_t notify;
+
+    memset( &notify, 0, sizeof(notify) );
+    notify.handle      = wine_server_obj_handle( handle );
+    notify.event       = wine_server_obj_handle( event );
+    notify.cvalue      = cvalue;
+    notify.information = info;
+    notify.status      = status;
+    while (write( io_notify_fd, &notify, sizeof(notify) ) == -1 && errno == EINTR) /* nothing */;
+}
+
+
 /***********************************************************************
  *           wine_server_fd_to_handle
  */
@@ -1583,6 +1897,8 @@ void server_init_process_done(void)
     NTSTATUS status;
     int suspend, needs_close, unixdir;
 
+    init_handle_shm();
+
     if (peb->ProcessParameters->CurrentDirectory.Handle &&
         !server_get_unix_fd( peb->ProcessParameters->CurrentDirectory.Handle,
                              FILE_TRAVERSE, &unixdir, &needs_close, NULL, NULL ))
@@ -1682,6 +1998,14 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source, HANDLE
 
     if (dest) *dest = 0;
 
+    if (source_process == NtCurrentProcess() && dest_process == NtCurrentProcess())
+    {
+        unsigned int handle_access, flags;
+
+        if (get_handle_shm( source, &handle_access, &flags ) && !(flags & HANDLE_SHM_IN_USE))
+            return STATUS_INVALID_HANDLE;
+    }
+
     if ((options & DUPLICATE_CLOSE_SOURCE) && source_process != NtCurrentProcess())
     {
         apc_call_t call;
@@ -1703,6 +2027,12 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source, HANDLE
         return result.dup_handle.status;
     }
 
+    if (options & DUPLICATE_CLOSE_SOURCE)
+    {
+        uring_close_handle( source );
+        sock_close_handle( source );
+    }
+
     server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
 
     /* always remove the cached fd; if the server request fails we'll just
@@ -1727,6 +2057,7 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source, HANDLE
 
     server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
 
+    if (options & DUPLICATE_CLOSE_SOURCE) fsync_close( source );
     if (fd != -1) close( fd );
     return ret;
 }
@@ -1742,6 +2073,9 @@ NTSTATUS WINAPI NtClose( HANDLE handle )
     NTSTATUS ret;
     int fd;
 
+    uring_close_handle( handle );
+    sock_close_handle( handle );
+
     server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
 
     /* always remove the cached fd; if the server request fails we'll just
@@ -1757,6 +2091,7 @@ NTSTATUS WINAPI NtClose( HANDLE handle )
 
     server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
 
+    fsync_close( handle );
     if (fd != -1) close( fd );
 
     if (ret != STATUS_INVALID_HANDLE || !handle) return ret;
@@ -1768,3 +2103,35 @@ NTSTATUS WINAPI NtClose( HANDLE handle )
     }
     return ret;
 }
+
+
+/***********************************************************************
+ *           close_handle_deferred
+ *
+ * Close a handle when the result isn't needed, sending the request along
+ * with the next server call. The handle must not be used by other threads.
+ */
+void close_handle_deferred( HANDLE handle )
+{
+    sigset_t sigset;
+    int fd;
+
+    uring_close_handle( handle );
+    sock_close_handle( handle );
+
+    server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
+
+    fd = remove_fd_from_cache( handle );
+
+    SERVER_START_REQ( close_handle )
+    {
+        req->handle = wine_server_obj_handle( handle );
+        server_call_deferred( req );
+    }
+    SERVER_END_REQ;
+
+    server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
+
+    fsync_close( handle );
+    if (fd != -1) close( fd );
+}
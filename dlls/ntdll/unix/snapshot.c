@@ -0,0 +1,366 @@
+/*
+ * Loader snapshot
+ *
+ * Copyright (C) 2021 Wine contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#if 0
+#pragma makedep unix
+#endif
+
+#include "config.h"
+#include "wine/port.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+#include "wine/rbtree.h"
+#include "wine/debug.h"
+#include "unix_private.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(module);
+
+/* When WINELOADERSNAPSHOT is set in the environment, the results of the
+ * lookups done by the loader are stored in the loader-snapshot file of the
+ * prefix when the process exits, and the following processes reuse them
+ * instead of doing the lookups again. A record is keyed by everything the
+ * lookup depends on, or carries enough state for the caller to check that
+ * it is still valid, so that a stale snapshot is never trusted.
+ */
+
+#define SNAPSHOT_MAGIC       0x70616e73  /* "snap" */
+#define SNAPSHOT_VERSION     1
+#define SNAPSHOT_MAX_RECORDS 8192
+#define SNAPSHOT_MAX_SIZE    (4 * 1024 * 1024)
+
+struct snapshot_header
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int count;
+};
+
+struct snapshot_record_header
+{
+    unsigned short type;
+    unsigned short machine;
+    unsigned short key_size;
+    unsigned short data_size;
+};
+
+struct snapshot_record
+{
+    struct wine_rb_entry          entry;
+    struct snapshot_record_header header;
+    BOOL                          used;     /* looked up or added by this process */
+    unsigned char                 buffer[1];  /* key followed by data */
+};
+
+struct snapshot_key
+{
+    unsigned short type;
+    unsigned short machine;
+    unsigned short size;
+    const void    *data;
+};
+
+static pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int snapshot_state;   /* 0 if not initialized yet, 1 if enabled, -1 if disabled */
+static BOOL snapshot_dirty;  /* records have been added since the file was loaded */
+static unsigned int snapshot_count;
+static char *snapshot_path;
+
+static int compare_snapshot_record( const void *key, const struct wine_rb_entry *entry )
+{
+    const struct snapshot_key *k = key;
+    const struct snapshot_record *record = WINE_RB_ENTRY_VALUE( entry, struct snapshot_record, entry );
+
+    if (k->type != record->header.type) return k->type < record->header.type ? -1 : 1;
+    if (k->machine != record->header.machine) return k->machine < record->header.machine ? -1 : 1;
+    if (k->size != record->header.key_size) return k->size < record->header.key_size ? -1 : 1;
+    return memcmp( k->data, record->buffer, k->size );
+}
+
+static struct wine_rb_tree snapshot_tree = { compare_snapshot_record };
+
+
+/***********************************************************************
+ *           add_snapshot_record
+ *
+ * Add a record to the tree, replacing any existing record with the same key.
+ * The snapshot_mutex must be held by the caller.
+ */
+static struct snapshot_record *add_snapshot_record( const struct snapshot_record_header *header,
+                                                    const void *key, const void *data )
+{
+    struct snapshot_key k = { header->type, header->machine, header->key_size, key };
+    struct snapshot_record *record;
+    struct wine_rb_entry *entry;
+
+    if ((entry = wine_rb_get( &snapshot_tree, &k )))
+    {
+        wine_rb_remove( &snapshot_tree, entry );
+        free( WINE_RB_ENTRY_VALUE( entry, struct snapshot_record, entry ));
+        snapshot_count--;
+    }
+    if (!(record = malloc( offsetof( struct snapshot_record, buffer[header->key_size + header->data_size] ))))
+        return NULL;
+    record->header = *header;
+    record->used = FALSE;
+    memcpy( record->buffer, key, header->key_size );
+    memcpy( record->buffer + header->key_size, data, header->data_size );
+    wine_rb_put( &snapshot_tree, &k, &record->entry );
+    snapshot_count++;
+    return record;
+}
+
+
+/***********************************************************************
+ *           read_snapshot_file
+ *
+ * Load the records of the snapshot file. If merge is set, records that
+ * are already in the tree are kept.
+ * The snapshot_mutex must be held by the caller.
+ */
+static void read_snapshot_file( BOOL merge )
+{
+    const struct snapshot_header *header;
+    const struct snapshot_record_header *rec;
+    struct snapshot_key k;
+    struct stat st;
+    size_t pos;
+    char *buffer;
+    unsigned int i;
+    int fd;
+
+    if ((fd = open( snapshot_path, O_RDONLY | O_CLOEXEC )) == -1) return;
+    if (fstat( fd, &st ) == -1 || st.st_size < sizeof(*header) || st.st_size > SNAPSHOT_MAX_SIZE ||
+        !(buffer = malloc( st.st_size )))
+    {
+        close( fd );
+        return;
+    }
+    if (pread( fd, buffer, st.st_size, 0 ) != st.st_size) goto done;
+
+    header = (const struct snapshot_header *)buffer;
+    if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION) goto done;
+
+    for (i = 0, pos = sizeof(*header); i < header->count; i++)
+    {
+        if (pos + sizeof(*rec) > st.st_size) break;
+        rec = (const struct snapshot_record_header *)(buffer + pos);
+        pos += sizeof(*rec);
+        if (pos + rec->key_size + rec->data_size > st.st_size) break;
+        k.type = rec->type;
+        k.machine = rec->machine;
+        k.size = rec->key_size;
+        k.data = buffer + pos;
+        if (!merge || !wine_rb_get( &snapshot_tree, &k ))
+            add_snapshot_record( rec, buffer + pos, buffer + pos + rec->key_size );
+        pos += rec->key_size + rec->data_size;
+        pos = (pos + 3) & ~3;
+    }
+    TRACE( "loaded %u records from %s\n", snapshot_count, debugstr_a(snapshot_path) );
+
+done:
+    free( buffer );
+    close( fd );
+}
+
+
+/***********************************************************************
+ *           init_snapshot
+ *
+ * The snapshot_mutex must be held by the caller.
+ */
+static BOOL init_snapshot(void)
+{
+    const char *env;
+
+    if (snapshot_state) return snapshot_state > 0;
+
+    snapshot_state = -1;
+    if (!(env = getenv( "WINELOADERSNAPSHOT" )) || !atoi( env ) || !config_dir) return FALSE;
+    if (!(snapshot_path = malloc( strlen( config_dir ) + sizeof("/loader-snapshot") ))) return FALSE;
+    strcpy( snapshot_path, config_dir );
+    strcat( snapshot_path, "/loader-snapshot" );
+    read_snapshot_file( FALSE );
+    snapshot_state = 1;
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           loader_snapshot_enabled
+ */
+BOOL loader_snapshot_enabled(void)
+{
+    BOOL ret;
+
+    if (snapshot_state) return snapshot_state > 0;
+    pthread_mutex_lock( &snapshot_mutex );
+    ret = init_snapshot();
+    pthread_mutex_unlock( &snapshot_mutex );
+    return ret;
+}
+
+
+/***********************************************************************
+ *           get_loader_snapshot
+ *
+ * Retrieve the data of a snapshot record for the current machine.
+ * Returns STATUS_NOT_SUPPORTED if the snapshot is disabled.
+ */
+NTSTATUS CDECL get_loader_snapshot( ULONG type, const void *key, ULONG key_size, void *data, ULONG *size )
+{
+    struct snapshot_key k = { type, current_machine, key_size, key };
+    struct snapshot_record *record;
+    struct wine_rb_entry *entry;
+    NTSTATUS status = STATUS_NOT_FOUND;
+
+    if (snapshot_state < 0) return STATUS_NOT_SUPPORTED;
+    if (key_size > 0xffff) return STATUS_NOT_FOUND;
+
+    pthread_mutex_lock( &snapshot_mutex );
+    if (!init_snapshot()) status = STATUS_NOT_SUPPORTED;
+    else if ((entry = wine_rb_get( &snapshot_tree, &k )))
+    {
+        record = WINE_RB_ENTRY_VALUE( entry, struct snapshot_record, entry );
+        record->used = TRUE;
+        if (*size >= record->header.data_size)
+        {
+            memcpy( data, record->buffer + key_size, record->header.data_size );
+            status = STATUS_SUCCESS;
+        }
+        else status = STATUS_BUFFER_TOO_SMALL;
+        *size = record->header.data_size;
+    }
+    pthread_mutex_unlock( &snapshot_mutex );
+    return status;
+}
+
+
+/***********************************************************************
+ *           set_loader_snapshot
+ *
+ * Store the data of a snapshot record for the current machine.
+ */
+void CDECL set_loader_snapshot( ULONG type, const void *key, ULONG key_size, const void *data, ULONG size )
+{
+    struct snapshot_record_header header = { type, current_machine, key_size, size };
+    struct snapshot_key k = { type, current_machine, key_size, key };
+    struct snapshot_record *record;
+    struct wine_rb_entry *entry;
+
+    if (snapshot_state < 0 || key_size > 0xffff || size > 0xffff) return;
+
+    pthread_mutex_lock( &snapshot_mutex );
+    if (!init_snapshot()) goto done;
+
+    if ((entry = wine_rb_get( &snapshot_tree, &k )))
+    {
+        record = WINE_RB_ENTRY_VALUE( entry, struct snapshot_record, entry );
+        if (record->header.data_size == size && !memcmp( record->buffer + key_size, data, size ))
+        {
+            record->used = TRUE;
+            goto done;
+        }
+    }
+    if ((record = add_snapshot_record( &header, key, data )))
+    {
+        record->used = TRUE;
+        snapshot_dirty = TRUE;
+    }
+
+done:
+    pthread_mutex_unlock( &snapshot_mutex );
+}
+
+
+/***********************************************************************
+ *           save_loader_snapshot
+ *
+ * Write the snapshot file if records have been added. Called on process exit.
+ */
+void save_loader_snapshot(void)
+{
+    static const char padding[3];
+    struct snapshot_header header = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION, 0 };
+    struct snapshot_record *record;
+    unsigned int pass, len, total = sizeof(header);
+    char *tmp;
+    FILE *f;
+
+    if (snapshot_state <= 0 || !snapshot_dirty) return;
+
+    pthread_mutex_lock( &snapshot_mutex );
+
+    /* pick up what the other processes have saved in the meantime */
+    read_snapshot_file( TRUE );
+
+    if (!(tmp = malloc( strlen( snapshot_path ) + 16 ))) goto done;
+    sprintf( tmp, "%s.%x", snapshot_path, (int)getpid() );
+    if (!(f = fopen( tmp, "wb" ))) goto done;
+
+    /* records used by this process come first, so that they are kept when the file is full */
+    fwrite( &header, sizeof(header), 1, f );
+    for (pass = 0; pass < 2; pass++)
+    {
+        WINE_RB_FOR_EACH_ENTRY( record, &snapshot_tree, struct snapshot_record, entry )
+        {
+            if (record->used != !pass) continue;
+            len = (record->header.key_size + record->header.data_size + 3) & ~3;
+            if (header.count == SNAPSHOT_MAX_RECORDS) break;
+            if (total + sizeof(record->header) + len > SNAPSHOT_MAX_SIZE) break;
+            fwrite( &record->header, sizeof(record->header), 1, f );
+            fwrite( record->buffer, record->header.key_size + record->header.data_size, 1, f );
+            fwrite( padding, len - record->header.key_size - record->header.data_size, 1, f );
+            total += sizeof(record->header) + len;
+            header.count++;
+        }
+    }
+    fseek( f, 0, SEEK_SET );
+    fwrite( &header, sizeof(header), 1, f );
+
+    if (fclose( f ) || rename( tmp, snapshot_path ) == -1)
+    {
+        WARN( "failed to save %s: %s\n", debugstr_a(snapshot_path), strerror(errno) );
+        unlink( tmp );
+    }
+    else TRACE( "saved %u records to %s\n", header.count, debugstr_a(snapshot_path) );
+
+done:
+    free( tmp );
+    snapshot_dirty = FALSE;
+    pthread_mutex_unlock( &snapshot_mutex );
+}
@@ -25,8 +25,14 @@
 #include "config.h"
 #define _GNU_SOURCE /* for struct in6_pktinfo */
 #include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
 #ifdef HAVE_IFADDRS_H
 # include <ifaddrs.h>
 #endif
@@ -82,6 +88,7 @@
 #include "wsipx.h"
 #include "af_irda.h"
 #include "wine/afd.h"
+#include "wine/rbtree.h"
 
 #include "unix_private.h"
 
@@ -150,6 +157,8 @@ struct async_transmit_ioctl
     LARGE_INTEGER offset;
 };
 
+static inline BOOL is_reactor_thread(void);
+
 static NTSTATUS sock_errno_to_status( int err )
 {
     switch (err)
@@ -191,7 +200,7 @@ static NTSTATUS sock_errno_to_status( int err )
 
         case 0:                 return STATUS_SUCCESS;
         default:
-            FIXME( "unknown errno %d\n", err );
+            if (!is_reactor_thread()) FIXME( "unknown errno %d\n", err );
             return STATUS_UNSUCCESSFUL;
     }
 }
@@ -518,7 +527,7 @@ static NTSTATUS try_recv( int fd, struct async_recv_ioctl *async, ULONG_PTR *siz
         if ((async->unix_flags & MSG_OOB) && errno == EINVAL)
             errno = EWOULDBLOCK;
 
-        if (errno != EWOULDBLOCK) WARN( "recvmsg: %s\n", strerror( errno ) );
+        if (errno != EWOULDBLOCK && !is_reactor_thread()) WARN( "recvmsg: %s\n", strerror( errno ) );
         return sock_errno_to_status( errno );
     }
 
@@ -581,6 +590,555 @@ static NTSTATUS async_recv_proc( void *user, ULONG_PTR *info, NTSTATUS status )
     return status;
 }
 
+/* When WINESOCKREACTOR is set in the environment, overlapped receives and
+ * sends that can't be completed immediately are not queued as server asyncs,
+ * but handed to a per-process epoll reactor. A thread is started on demand
+ * to wait for the sockets to become ready; it retries the operations, fills
+ * the I/O status block and reports the completion through server_notify_io(),
+ * and exits once no socket has been waited for for a while.
+ *
+ * The reactor thread is a plain pthread, it doesn't have a TEB and can't make
+ * server calls or print debug messages. The sockets are tracked by handle,
+ * along with the identity of the unix socket; a handle that was closed behind
+ * our back, and reused for another socket, doesn't match the entry anymore.
+ *
+ * Since the server doesn't see these requests, the pending and reported
+ * events used by WSAEventSelect() and WSAAsyncSelect() aren't reset when
+ * they complete, and a receive after a local shutdown is not failed early.
+ * Requests with an APC, for out-of-band data, peeking, control headers or
+ * with an address always go through the server. */
+
+#ifdef HAVE_SYS_EPOLL_H
+
+#define REACTOR_IDLE_TIMEOUT 500   /* time in ms before the reactor thread exits */
+#define REACTOR_MAX_EVENTS   64    /* number of events retrieved at once */
+
+struct reactor_socket
+{
+    struct wine_rb_entry entry;   /* entry in reactor sockets tree */
+    HANDLE               handle;  /* socket handle */
+    int                  fd;      /* private copy of the unix fd */
+    dev_t                dev;     /* identity of the unix socket */
+    ino_t                ino;
+    unsigned int         events;  /* epoll events currently waited for */
+    struct list          recv_q;  /* pending receives */
+    struct list          send_q;  /* pending sends */
+};
+
+struct reactor_request
+{
+    struct list              entry;       /* entry in socket queue, then in completing requests */
+    struct list              done_entry;  /* entry in the list of the thread completing it */
+    struct reactor_socket   *sock;        /* socket while the request is queued */
+    HANDLE                   handle;      /* socket handle, for reporting the completion */
+    HANDLE                   event;       /* event to signal */
+    ULONG_PTR                cvalue;      /* completion value */
+    IO_STATUS_BLOCK         *io;          /* I/O status block */
+    DWORD                    tid;         /* thread that started the request */
+    NTSTATUS                 status;      /* final status */
+    ULONG_PTR                information; /* number of bytes transferred */
+    struct async_recv_ioctl *recv;        /* receive parameters */
+    struct async_send_ioctl *send;        /* send parameters */
+};
+
+static NTSTATUS try_send( int fd, struct async_send_ioctl *async );
+
+static int reactor_status = -1;  /* -1 if not initialized yet, otherwise enabled flag */
+static int reactor_fd = -1;
+static pthread_mutex_t reactor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reactor_cond = PTHREAD_COND_INITIALIZER;  /* signaled when requests are completed */
+static struct wine_rb_tree reactor_sockets;
+static unsigned int socket_count;
+static struct list completing_requests = LIST_INIT( completing_requests );
+static BOOL thread_running;
+static pthread_t reactor_thread_id;
+
+static int compare_reactor_socket( const void *key, const struct wine_rb_entry *entry )
+{
+    const struct reactor_socket *sock = WINE_RB_ENTRY_VALUE( entry, const struct reactor_socket, entry );
+    ULONG_PTR handle = (ULONG_PTR)key, sock_handle = (ULONG_PTR)sock->handle;
+
+    return (handle > sock_handle) - (handle < sock_handle);
+}
+
+static void init_reactor(void)
+{
+    const char *env = getenv( "WINESOCKREACTOR" );
+
+    reactor_status = 0;
+    if (!env || !atoi( env )) return;
+
+    if ((reactor_fd = epoll_create( 128 )) == -1)
+    {
+        WARN( "failed to create epoll fd, errno %d\n", errno );
+        return;
+    }
+    fcntl( reactor_fd, F_SETFD, FD_CLOEXEC );
+    wine_rb_init( &reactor_sockets, compare_reactor_socket );
+
+    TRACE( "using socket reactor\n" );
+    reactor_status = 1;
+}
+
+static BOOL do_reactor(void)
+{
+    if (reactor_status == -1)
+    {
+        sigset_t sigset;
+
+        server_enter_uninterrupted_section( &reactor_mutex, &sigset );
+        if (reactor_status == -1) init_reactor();
+        server_leave_uninterrupted_section( &reactor_mutex, &sigset );
+    }
+    return reactor_status > 0;
+}
+
+/* the reactor thread has no TEB, the functions it shares with the other threads must not trace */
+static inline BOOL is_reactor_thread(void)
+{
+    return reactor_status > 0 && pthread_equal( pthread_self(), reactor_thread_id );
+}
+
+/* find the reactor entry of a socket; called with the mutex held */
+static struct reactor_socket *find_reactor_socket( HANDLE handle )
+{
+    struct wine_rb_entry *entry;
+
+    if (!(entry = wine_rb_get( &reactor_sockets, handle ))) return NULL;
+    return WINE_RB_ENTRY_VALUE( entry, struct reactor_socket, entry );
+}
+
+/* wait for the events needed by the queued requests, and free the socket entry
+ * once there are none left; called with the mutex held */
+static BOOL update_reactor_socket( struct reactor_socket *sock )
+{
+    unsigned int events = 0;
+    struct epoll_event ev;
+
+    if (!list_empty( &sock->recv_q )) events |= EPOLLIN;
+    if (!list_empty( &sock->send_q )) events |= EPOLLOUT;
+
+    if (!events)
+    {
+        /* the handle's own fd still refers to the socket, so remove it explicitly */
+        if (sock->events) epoll_ctl( reactor_fd, EPOLL_CTL_DEL, sock->fd, NULL );
+        wine_rb_remove( &reactor_sockets, &sock->entry );
+        socket_count--;
+        close( sock->fd );
+        free( sock );
+        return TRUE;
+    }
+    if (events == sock->events) return TRUE;
+
+    memset( &ev, 0, sizeof(ev) );
+    ev.events = events;
+    ev.data.u64 = (ULONG_PTR)sock->handle;
+    if (epoll_ctl( reactor_fd, sock->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, sock->fd, &ev ) == -1)
+        return FALSE;
+    sock->events = events;
+    return TRUE;
+}
+
+/* move a request out of its socket queue; called with the mutex held */
+static void finish_reactor_request( struct reactor_request *req, NTSTATUS status, struct list *done )
+{
+    req->status = status;
+    req->sock = NULL;
+    list_remove( &req->entry );
+    list_add_tail( &completing_requests, &req->entry );
+    list_add_tail( done, &req->done_entry );
+}
+
+/* drop the entry of a handle that now refers to another socket, the requests queued
+ * on it belong to a closed handle and can't be reported on it; called with the mutex held */
+static void remove_stale_socket( struct reactor_socket *sock, struct list *done )
+{
+    struct reactor_request *req, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE( req, next, &sock->recv_q, struct reactor_request, entry )
+    {
+        req->handle = 0;
+        req->cvalue = 0;
+        finish_reactor_request( req, STATUS_CANCELLED, done );
+    }
+    LIST_FOR_EACH_ENTRY_SAFE( req, next, &sock->send_q, struct reactor_request, entry )
+    {
+        req->handle = 0;
+        req->cvalue = 0;
+        req->information = req->send->sent_len;
+        finish_reactor_request( req, STATUS_CANCELLED, done );
+    }
+    update_reactor_socket( sock );
+}
+
+/* find or create the reactor entry of a socket; called with the mutex held */
+static struct reactor_socket *get_reactor_socket( HANDLE handle, int fd, const struct stat *st,
+                                                  struct list *done )
+{
+    struct reactor_socket *sock;
+
+    if ((sock = find_reactor_socket( handle )))
+    {
+        if (sock->dev == st->st_dev && sock->ino == st->st_ino) return sock;
+        remove_stale_socket( sock, done );
+    }
+
+    if (!(sock = malloc( sizeof(*sock) ))) return NULL;
+    /* keep our own fd, the cached one is closed with the handle */
+    if ((sock->fd = dup( fd )) == -1)
+    {
+        free( sock );
+        return NULL;
+    }
+    fcntl( sock->fd, F_SETFD, FD_CLOEXEC );
+    sock->handle = handle;
+    sock->dev = st->st_dev;
+    sock->ino = st->st_ino;
+    sock->events = 0;
+    list_init( &sock->recv_q );
+    list_init( &sock->send_q );
+    wine_rb_put( &reactor_sockets, handle, &sock->entry );
+    socket_count++;
+    return sock;
+}
+
+/* fill the I/O status block of the requests and report their completion */
+static void complete_reactor_requests( struct list *done )
+{
+    struct reactor_request *req, *next;
+    sigset_t sigset;
+
+    LIST_FOR_EACH_ENTRY_SAFE( req, next, done, struct reactor_request, done_entry )
+    {
+        if (req->recv) release_fileio( &req->recv->io );
+        else release_fileio( &req->send->io );
+
+        req->io->Information = req->information;
+        __atomic_store_n( &req->io->Status, req->status, __ATOMIC_RELEASE );
+        server_notify_io( req->handle, req->event, req->cvalue, req->status, req->information );
+
+        server_enter_uninterrupted_section( &reactor_mutex, &sigset );
+        list_remove( &req->entry );
+        pthread_cond_broadcast( &reactor_cond );
+        server_leave_uninterrupted_section( &reactor_mutex, &sigset );
+        free( req );
+    }
+}
+
+/* retry the requests of a socket that was reported ready; called with the mutex held */
+static void process_reactor_socket( struct reactor_socket *sock, unsigned int events, struct list *done )
+{
+    struct reactor_request *req, *next;
+    NTSTATUS status;
+
+    if (events & ~EPOLLOUT)
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( req, next, &sock->recv_q, struct reactor_request, entry )
+        {
+            if ((status = try_recv( sock->fd, req->recv, &req->information )) == STATUS_DEVICE_NOT_READY)
+                break;
+            finish_reactor_request( req, status, done );
+        }
+    }
+    if (events & ~EPOLLIN)
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( req, next, &sock->send_q, struct reactor_request, entry )
+        {
+            status = try_send( sock->fd, req->send );
+            req->information = req->send->sent_len;
+            if (status == STATUS_DEVICE_NOT_READY) break;
+            finish_reactor_request( req, status, done );
+        }
+    }
+    update_reactor_socket( sock );
+}
+
+static void *reactor_thread( void *arg )
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    struct reactor_socket *sock;
+    struct list done;
+    sigset_t sigset;
+    int i, count;
+    BOOL idle;
+
+    reactor_thread_id = pthread_self();
+    for (;;)
+    {
+        count = epoll_wait( reactor_fd, events, REACTOR_MAX_EVENTS, REACTOR_IDLE_TIMEOUT );
+        list_init( &done );
+
+        server_enter_uninterrupted_section( &reactor_mutex, &sigset );
+        for (i = 0; i < count; i++)
+        {
+            if (!(sock = find_reactor_socket( (HANDLE)(ULONG_PTR)events[i].data.u64 ))) continue;
+            process_reactor_socket( sock, events[i].events, &done );
+        }
+        if ((idle = (count <= 0 && !socket_count)))
+        {
+            thread_running = FALSE;
+            memset( &reactor_thread_id, 0, sizeof(reactor_thread_id) );
+        }
+        server_leave_uninterrupted_section( &reactor_mutex, &sigset );
+
+        if (idle) break;
+        complete_reactor_requests( &done );
+    }
+    return NULL;
+}
+
+/* start the reactor thread */
+static BOOL start_reactor_thread(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    sigset_t all_set, old_set;
+    int ret;
+
+    /* the thread has no TEB, it must not run the signal handlers */
+    sigfillset( &all_set );
+    pthread_sigmask( SIG_SETMASK, &all_set, &old_set );
+    pthread_attr_init( &attr );
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+    pthread_attr_setstacksize( &attr, 0x10000 );
+    ret = pthread_create( &thread, &attr, reactor_thread, NULL );
+    pthread_attr_destroy( &attr );
+    pthread_sigmask( SIG_SETMASK, &old_set, NULL );
+    if (!ret) return TRUE;
+
+    WARN( "failed to start reactor thread, error %d\n", ret );
+    return FALSE;
+}
+
+/* check whether a request that would block can be completed without the server */
+static BOOL can_use_reactor( PIO_APC_ROUTINE apc, int unix_flags, const WSABUF *control,
+                             const struct WS_sockaddr *addr )
+{
+    if (apc || control || addr || (unix_flags & (MSG_OOB | MSG_PEEK))) return FALSE;
+    return do_reactor() && server_init_io_notify();
+}
+
+/* check whether requests of the same direction are already waiting in the reactor,
+ * new ones have to be queued after them to keep the data in order */
+static BOOL reactor_has_pending( HANDLE handle, BOOL send )
+{
+    struct reactor_socket *sock;
+    sigset_t sigset;
+    BOOL ret = FALSE;
+
+    if (reactor_status <= 0 || !__atomic_load_n( &socket_count, __ATOMIC_RELAXED )) return FALSE;
+
+    server_enter_uninterrupted_section( &reactor_mutex, &sigset );
+    if ((sock = find_reactor_socket( handle )))
+        ret = !list_empty( send ? &sock->send_q : &sock->recv_q );
+    server_leave_uninterrupted_section( &reactor_mutex, &sigset );
+    return ret;
+}
+
+/* set the signaled state of the socket, when there is no event to report the completion */
+static NTSTATUS set_socket_signaled( HANDLE handle, int signaled )
+{
+    NTSTATUS status;
+
+    SERVER_START_REQ( set_fd_signaled )
+    {
+        req->handle   = wine_server_obj_handle( handle );
+        req->signaled = signaled;
+        status = wine_server_call( req );
+    }
+    SERVER_END_REQ;
+    return status;
+}
+
+/* queue a receive or send that would block in the reactor; on success the async belongs to the reactor */
+static NTSTATUS reactor_queue( HANDLE handle, int fd, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
+                               IO_STATUS_BLOCK *io, struct async_recv_ioctl *recv, struct async_send_ioctl *send )
+{
+    struct reactor_request *req;
+    struct reactor_socket *sock;
+    struct list done = LIST_INIT( done );
+    int unix_fd, needs_close;
+    unsigned int options;
+    struct stat st;
+    sigset_t sigset;
+    NTSTATUS status;
+    BOOL start = FALSE;
+
+    if (recv ? !can_use_reactor( apc, recv->unix_flags, recv->control, recv->addr )
+             : !can_use_reactor( apc, send->unix_flags, NULL, send->addr ))
+        return STATUS_NOT_SUPPORTED;
+
+    /* requests on synchronous handles are waited for by the server */
+    if (server_get_unix_fd( handle, 0, &unix_fd, &needs_close, NULL, &options )) return STATUS_NOT_SUPPORTED;
+    if (needs_close) close( unix_fd );
+    if (options & (FILE_SYNCHRONOUS_IO_ALERT | FILE_SYNCHRONOUS_IO_NONALERT)) return STATUS_NOT_SUPPORTED;
+    if (fstat( fd, &st ) == -1) return STATUS_NOT_SUPPORTED;
+
+    if (!(req = malloc( sizeof(*req) ))) return STATUS_NOT_SUPPORTED;
+    req->handle      = handle;
+    req->event       = event;
+    req->cvalue      = (ULONG_PTR)apc_user;
+    req->io          = io;
+    req->tid         = GetCurrentThreadId();
+    req->status      = STATUS_PENDING;
+    req->information = 0;
+    req->recv        = recv;
+    req->send        = send;
+
+    io->Information = 0;
+    io->Status = STATUS_PENDING;
+    if (event) NtResetEvent( event, NULL );
+    else if (set_socket_signaled( handle, 0 ))
+    {
+        free( req );
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    status = STATUS_NOT_SUPPORTED;
+    server_enter_uninterrupted_section( &reactor_mutex, &sigset );
+    if ((sock = get_reactor_socket( handle, fd, &st, &done )))
+    {
+        req->sock = sock;
+        list_add_tail( recv ? &sock->recv_q : &sock->send_q, &req->entry );
+        if (update_reactor_socket( sock ))
+        {
+            if (!thread_running) start = thread_running = TRUE;
+            status = STATUS_PENDING;
+        }
+        else
+        {
+            WARN( "failed to wait for socket %p, errno %d\n", handle, errno );
+            list_remove( &req->entry );
+            update_reactor_socket( sock );
+        }
+    }
+    server_leave_uninterrupted_section( &reactor_mutex, &sigset );
+
+    complete_reactor_requests( &done );
+    if (status != STATUS_PENDING)
+    {
+        if (!event) set_socket_signaled( handle, 1 );
+        free( req );
+        return status;
+    }
+    if (!start || start_reactor_thread()) return STATUS_PENDING;
+
+    /* take the request back if nobody completed it in the meantime */
+    server_enter_uninterrupted_section( &reactor_mutex, &sigset );
+    thread_running = FALSE;
+    if ((sock = req->sock))
+    {
+        list_remove( &req->entry );
+        update_reactor_socket( sock );
+        status = STATUS_NOT_SUPPORTED;
+    }
+    else status = STATUS_PENDING;
+    server_leave_uninterrupted_section( &reactor_mutex, &sigset );
+
+    if (status != STATUS_PENDING)
+    {
+        if (!event) set_socket_signaled( handle, 1 );
+        free( req );
+    }
+    return status;
+}
+
+/* cancel the requests of a socket; io is NULL to cancel all of them */
+static BOOL reactor_cancel( HANDLE handle, IO_STATUS_BLOCK *io, BOOL only_thread )
+{
+    struct reactor_request *req, *next;
+    struct reactor_socket *sock;
+    struct list done = LIST_INIT( done );
+    DWORD tid = GetCurrentThreadId();
+    sigset_t sigset;
+
+    server_enter_uninterrupted_section( &reactor_mutex, &sigset );
+    if ((sock = find_reactor_socket( handle )))
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( req, next, &sock->recv_q, struct reactor_request, entry )
+        {
+            if ((io && req->io != io) || (only_thread && req->tid != tid)) continue;
+            finish_reactor_request( req, STATUS_CANCELLED, &done );
+        }
+        LIST_FOR_EACH_ENTRY_SAFE( req, next, &sock->send_q, struct reactor_request, entry )
+        {
+            if ((io && req->io != io) || (only_thread && req->tid != tid)) continue;
+            req->information = req->send->sent_len;
+            finish_reactor_request( req, STATUS_CANCELLED, &done );
+        }
+        update_reactor_socket( sock );
+    }
+    server_leave_uninterrupted_section( &reactor_mutex, &sigset );
+
+    if (list_empty( &done )) return FALSE;
+    complete_reactor_requests( &done );
+    return TRUE;
+}
+
+/* cancel the requests started on a handle; returns TRUE if some were found */
+BOOL sock_cancel_io( HANDLE handle, IO_STATUS_BLOCK *io, BOOL only_thread )
+{
+    if (reactor_status <= 0) return FALSE;
+    return reactor_cancel( handle, io, only_thread );
+}
+
+/* cancel the pending requests on a handle before it's closed, and wait for
+ * those being completed, they need it for reporting the completion */
+void sock_close_handle( HANDLE handle )
+{
+    struct reactor_request *req;
+    sigset_t sigset;
+    BOOL found;
+
+    if (reactor_status <= 0) return;
+
+    reactor_cancel( handle, NULL, FALSE );
+
+    server_enter_uninterrupted_section( &reactor_mutex, &sigset );
+    do
+    {
+        found = FALSE;
+        LIST_FOR_EACH_ENTRY( req, &completing_requests, struct reactor_request, entry )
+        {
+            if (req->handle != handle) continue;
+            found = TRUE;
+            break;
+        }
+        if (found) pthread_cond_wait( &reactor_cond, &reactor_mutex );
+    } while (found);
+    server_leave_uninterrupted_section( &reactor_mutex, &sigset );
+}
+
+#else  /* HAVE_SYS_EPOLL_H */
+
+static inline BOOL is_reactor_thread(void)
+{
+    return FALSE;
+}
+
+static inline BOOL reactor_has_pending( HANDLE handle, BOOL send )
+{
+    return FALSE;
+}
+
+static inline NTSTATUS reactor_queue( HANDLE handle, int fd, HANDLE event, PIO_APC_ROUTINE apc,
+                                      void *apc_user, IO_STATUS_BLOCK *io,
+                                      struct async_recv_ioctl *recv, struct async_send_ioctl *send )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+BOOL sock_cancel_io( HANDLE handle, IO_STATUS_BLOCK *io, BOOL only_thread )
+{
+    return FALSE;
+}
+
+void sock_close_handle( HANDLE handle )
+{
+}
+
+#endif  /* HAVE_SYS_EPOLL_H */
+
 static NTSTATUS sock_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user, IO_STATUS_BLOCK *io,
                            int fd, const WSABUF *buffers, unsigned int count, WSABUF *control,
                            struct WS_sockaddr *addr, int *addr_len, DWORD *ret_flags, int unix_flags, int force_async )
@@ -624,7 +1182,13 @@ static NTSTATUS sock_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
     async->addr_len = addr_len;
     async->ret_flags = ret_flags;
 
-    status = try_recv( fd, async, &information );
+    if (force_async && reactor_has_pending( handle, FALSE ))
+    {
+        information = 0;
+        status = STATUS_DEVICE_NOT_READY;
+    }
+    else
+        status = try_recv( fd, async, &information );
 
     if (status != STATUS_SUCCESS && status != STATUS_BUFFER_OVERFLOW && status != STATUS_DEVICE_NOT_READY)
     {
@@ -633,7 +1197,11 @@ static NTSTATUS sock_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
     }
 
     if (status == STATUS_DEVICE_NOT_READY && force_async)
+    {
+        if (reactor_queue( handle, fd, event, apc, apc_user, io, async, NULL ) == STATUS_PENDING)
+            return STATUS_PENDING;
         status = STATUS_PENDING;
+    }
 
     SERVER_START_REQ( recv_socket )
     {
@@ -856,7 +1424,7 @@ static NTSTATUS try_send( int fd, struct async_send_ioctl *async )
         }
         else if (errno != EINTR)
         {
-            if (errno != EWOULDBLOCK) WARN( "sendmsg: %s\n", strerror( errno ) );
+            if (errno != EWOULDBLOCK && !is_reactor_thread()) WARN( "sendmsg: %s\n", strerror( errno ) );
             return sock_errno_to_status( errno );
         }
     }
@@ -930,7 +1498,10 @@ static NTSTATUS sock_send( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
     async->iov_cursor = 0;
     async->sent_len = 0;
 
-    status = try_send( fd, async );
+    if (force_async && reactor_has_pending( handle, TRUE ))
+        status = STATUS_DEVICE_NOT_READY;
+    else
+        status = try_send( fd, async );
 
     if (status != STATUS_SUCCESS && status != STATUS_DEVICE_NOT_READY)
     {
@@ -939,7 +1510,11 @@ static NTSTATUS sock_send( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
     }
 
     if (status == STATUS_DEVICE_NOT_READY && force_async)
+    {
+        if (reactor_queue( handle, fd, event, apc, apc_user, io, NULL, async ) == STATUS_PENDING)
+            return STATUS_PENDING;
         status = STATUS_PENDING;
+    }
 
     SERVER_START_REQ( send_socket )
     {
@@ -1056,6 +1056,7 @@ static void contexts_from_server( CONTEXT *context, context_t server_contexts[2]
  */
 static void pthread_exit_wrapper( int status )
 {
+    flush_deferred_calls();
     close( ntdll_get_thread_data()->wait_fd[0] );
     close( ntdll_get_thread_data()->wait_fd[1] );
     close( ntdll_get_thread_data()->reply_fd );
@@ -1420,6 +1421,7 @@ static DECLSPEC_NORETURN void exit_thread( int status )
  */
 void exit_process( int status )
 {
+    save_loader_snapshot();
     pthread_sigmask( SIG_BLOCK, &server_block_set, NULL );
     signal_exit_thread( get_unix_exit_code( status ), process_exit_wrapper, NtCurrentTeb() );
 }
@@ -62,6 +62,8 @@ struct ntdll_thread_data
     void              *param;         /* thread entry point parameter */
     void              *jmp_buf;       /* setjmp buffer for exception handling */
     void              *heap;          /* thread local heap data */
+    struct deferred_calls *deferred_calls; /* server calls waiting to be sent */
+    unsigned int       fsync_owned;   /* fsync slot heading the list of owned mutexes */
 };
 
 C_ASSERT( sizeof(struct ntdll_thread_data) <= sizeof(((TEB *)0)->GdiTebBatch) );
@@ -123,6 +125,7 @@ extern const char *home_dir DECLSPEC_HIDDEN;
 extern const char *data_dir DECLSPEC_HIDDEN;
 extern const char *build_dir DECLSPEC_HIDDEN;
 extern const char *config_dir DECLSPEC_HIDDEN;
+extern const char *server_dir DECLSPEC_HIDDEN;
 extern const char *user_name DECLSPEC_HIDDEN;
 extern const char **dll_paths DECLSPEC_HIDDEN;
 extern PEB *peb DECLSPEC_HIDDEN;
@@ -165,9 +168,14 @@ extern NTSTATUS load_main_exe( const WCHAR *name, const char *unix_name, const W
                                void **module ) DECLSPEC_HIDDEN;
 extern NTSTATUS load_start_exe( WCHAR **image, void **module ) DECLSPEC_HIDDEN;
 extern NTSTATUS get_builtin_init_funcs( void *handle, void **funcs, SIZE_T len, SIZE_T *retlen ) DECLSPEC_HIDDEN;
+extern const IMAGE_BASE_RELOCATION *process_relocation_block( void *module, const IMAGE_BASE_RELOCATION *rel,
+                                                              INT_PTR delta ) DECLSPEC_HIDDEN;
 extern void start_server( BOOL debug ) DECLSPEC_HIDDEN;
 
 extern unsigned int server_call_unlocked( void *req_ptr ) DECLSPEC_HIDDEN;
+extern unsigned int server_call_deferred( void *req_ptr ) DECLSPEC_HIDDEN;
+extern void close_handle_deferred( HANDLE handle ) DECLSPEC_HIDDEN;
+extern void flush_deferred_calls(void) DECLSPEC_HIDDEN;
 extern void server_enter_uninterrupted_section( pthread_mutex_t *mutex, sigset_t *sigset ) DECLSPEC_HIDDEN;
 extern void server_leave_uninterrupted_section( pthread_mutex_t *mutex, sigset_t *sigset ) DECLSPEC_HIDDEN;
 extern unsigned int server_select( const select_op_t *select_op, data_size_t size, UINT flags,
@@ -179,12 +187,37 @@ extern unsigned int server_queue_process_apc( HANDLE process, const apc_call_t *
                                               apc_result_t *result ) DECLSPEC_HIDDEN;
 extern int server_get_unix_fd( HANDLE handle, unsigned int wanted_access, int *unix_fd,
                                int *needs_close, enum server_fd_type *type, unsigned int *options ) DECLSPEC_HIDDEN;
+extern BOOL server_init_io_notify(void) DECLSPEC_HIDDEN;
+extern void server_notify_io( HANDLE handle, HANDLE event, ULONG_PTR cvalue, NTSTATUS status,
+                              ULONG_PTR info ) DECLSPEC_HIDDEN;
 extern void wine_server_send_fd( int fd ) DECLSPEC_HIDDEN;
 extern void process_exit_wrapper( int status ) DECLSPEC_HIDDEN;
 extern size_t server_init_process(void) DECLSPEC_HIDDEN;
 extern void server_init_process_done(void) DECLSPEC_HIDDEN;
 extern void server_init_thread( void *entry_point, BOOL *suspend ) DECLSPEC_HIDDEN;
 extern int server_pipe( int fd[2] ) DECLSPEC_HIDDEN;
+extern BOOL get_handle_shm( HANDLE handle, unsigned int *access, unsigned int *flags ) DECLSPEC_HIDDEN;
+
+extern void fsync_close( HANDLE handle ) DECLSPEC_HIDDEN;
+extern NTSTATUS fsync_set_event( HANDLE handle, LONG *prev_state ) DECLSPEC_HIDDEN;
+extern NTSTATUS fsync_reset_event( HANDLE handle, LONG *prev_state ) DECLSPEC_HIDDEN;
+extern NTSTATUS fsync_release_semaphore( HANDLE handle, ULONG count, ULONG *previous ) DECLSPEC_HIDDEN;
+extern NTSTATUS fsync_release_mutex( HANDLE handle, LONG *prev_count ) DECLSPEC_HIDDEN;
+extern NTSTATUS fsync_wait_objects( DWORD count, const HANDLE *handles, BOOLEAN wait_any,
+                                    BOOLEAN alertable, const LARGE_INTEGER *timeout ) DECLSPEC_HIDDEN;
+
+extern NTSTATUS uring_read_file( HANDLE handle, int fd, int needs_close, HANDLE event, PIO_APC_ROUTINE apc,
+                                 void *apc_user, IO_STATUS_BLOCK *io, void *buffer, ULONG length,
+                                 ULONGLONG offset ) DECLSPEC_HIDDEN;
+extern NTSTATUS uring_write_file( HANDLE handle, int fd, int needs_close, HANDLE event, PIO_APC_ROUTINE apc,
+                                  void *apc_user, IO_STATUS_BLOCK *io, const void *buffer, ULONG length,
+                                  ULONGLONG offset ) DECLSPEC_HIDDEN;
+extern NTSTATUS uring_read_file_scatter( HANDLE handle, int fd, int needs_close, HANDLE event,
+                                         PIO_APC_ROUTINE apc, void *apc_user, IO_STATUS_BLOCK *io,
+                                         FILE_SEGMENT_ELEMENT *segments, ULONG length,
+                                         ULONGLONG offset ) DECLSPEC_HIDDEN;
+extern BOOL uring_cancel_io( HANDLE handle, IO_STATUS_BLOCK *io, BOOL only_thread ) DECLSPEC_HIDDEN;
+extern void uring_close_handle( HANDLE handle ) DECLSPEC_HIDDEN;
 
 extern void fpux_to_fpu( I386_FLOATING_SAVE_AREA *fpu, const XSAVE_FORMAT *fpux ) DECLSPEC_HIDDEN;
 extern void fpu_to_fpux( XSAVE_FORMAT *fpux, const I386_FLOATING_SAVE_AREA *fpu ) DECLSPEC_HIDDEN;
@@ -269,6 +302,8 @@ extern NTSTATUS serial_DeviceIoControl( HANDLE device, HANDLE event, PIO_APC_ROU
 extern NTSTATUS serial_FlushBuffersFile( int fd ) DECLSPEC_HIDDEN;
 extern NTSTATUS sock_ioctl( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user, IO_STATUS_BLOCK *io,
                             ULONG code, void *in_buffer, ULONG in_size, void *out_buffer, ULONG out_size ) DECLSPEC_HIDDEN;
+extern BOOL sock_cancel_io( HANDLE handle, IO_STATUS_BLOCK *io, BOOL only_thread ) DECLSPEC_HIDDEN;
+extern void sock_close_handle( HANDLE handle ) DECLSPEC_HIDDEN;
 extern NTSTATUS tape_DeviceIoControl( HANDLE device, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
                                       IO_STATUS_BLOCK *io, ULONG code, void *in_buffer,
                                       ULONG in_size, void *out_buffer, ULONG out_size ) DECLSPEC_HIDDEN;
@@ -424,6 +459,13 @@ enum loadorder
 extern void set_load_order_app_name( const WCHAR *app_name ) DECLSPEC_HIDDEN;
 extern enum loadorder get_load_order( const UNICODE_STRING *nt_name ) DECLSPEC_HIDDEN;
 
+extern BOOL loader_snapshot_enabled(void) DECLSPEC_HIDDEN;
+extern NTSTATUS CDECL get_loader_snapshot( ULONG type, const void *key, ULONG key_size,
+                                           void *data, ULONG *size ) DECLSPEC_HIDDEN;
+extern void CDECL set_loader_snapshot( ULONG type, const void *key, ULONG key_size,
+                                       const void *data, ULONG size ) DECLSPEC_HIDDEN;
+extern void save_loader_snapshot(void) DECLSPEC_HIDDEN;
+
 static inline size_t ntdll_wcslen( const WCHAR *str )
 {
     const WCHAR *s = str;
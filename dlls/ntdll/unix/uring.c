@@ -0,0 +1,644 @@
+/*
+ * Asynchronous file I/O with io_uring
+ *
+ * Copyright (C) 2021 Wine contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#if 0
+#pragma makedep unix
+#endif
+
+#include "config.h"
+#include "wine/port.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#define NONAMELESSUNION
+#include "windef.h"
+#include "winternl.h"
+#include "wine/list.h"
+#include "wine/server.h"
+#include "wine/debug.h"
+#include "unix_private.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(uring);
+
+/* When WINEIOURING is set in the environment, overlapped reads and writes
+ * at an explicit offset on regular files are submitted to an io_uring
+ * instead of being done synchronously by the calling thread, so that many
+ * of them can be in flight at the same time. A thread is started on demand
+ * to collect the results, and exits once no request has been pending for a
+ * while.
+ *
+ * The completion thread is a plain pthread, it doesn't have a TEB and can't
+ * make server calls. It fills the I/O status block, and reports the result
+ * through server_notify_io(), which sets the event, or the file object when
+ * there is no event, and posts the completion if the file is bound to a
+ * port. The server knows the binding, so nothing is tracked here. Since the
+ * thread has no TEB, it must not print debug messages either.
+ *
+ * Requests with an APC always go through the normal path. The functions
+ * below return STATUS_NOT_SUPPORTED when the request has to be done
+ * synchronously instead. */
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+
+#define URING_ENTRIES      256   /* size of the submission queue */
+#define URING_IDLE_TIMEOUT 500   /* time in ms before the completion thread exits */
+
+struct uring_request
+{
+    struct list      entry;       /* entry in pending requests list */
+    HANDLE           handle;      /* file handle, for reporting the completion */
+    HANDLE           thread;      /* id of the thread that queued the request, for NtCancelIoFile */
+    int              fd;          /* unix fd */
+    int              needs_close; /* whether the fd has to be closed on completion */
+    HANDLE           event;       /* event to signal */
+    ULONG_PTR        cvalue;      /* completion value */
+    IO_STATUS_BLOCK *io;          /* I/O status block */
+    unsigned char    opcode;      /* IORING_OP_* */
+    void            *buffer;      /* buffer for reads and writes */
+    ULONG            length;      /* total transfer size */
+    ULONGLONG        offset;      /* file offset */
+    unsigned int     iov_count;   /* number of segments for scattered reads */
+    struct iovec     iov[1];      /* segments for scattered reads */
+};
+
+static int uring_status = -1;  /* -1 if not initialized yet, otherwise enabled flag */
+static int uring_fd = -1;
+static struct io_uring_sqe *uring_sqes;
+static unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+static unsigned int *cq_head, *cq_tail, *cq_mask;
+static struct io_uring_cqe *uring_cqes;
+static unsigned int sq_entries;
+
+static pthread_mutex_t uring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uring_cond = PTHREAD_COND_INITIALIZER;  /* signaled when requests complete */
+static struct list pending_requests = LIST_INIT( pending_requests );
+static unsigned int pending_count;  /* number of requests and cancel entries in the ring */
+static BOOL thread_running;
+
+static inline int io_uring_setup( unsigned int entries, struct io_uring_params *params )
+{
+    return syscall( __NR_io_uring_setup, entries, params );
+}
+
+static inline int io_uring_enter( unsigned int to_submit, unsigned int min_complete, unsigned int flags )
+{
+    return syscall( __NR_io_uring_enter, uring_fd, to_submit, min_complete, flags, NULL, 0 );
+}
+
+static inline int io_uring_register( unsigned int opcode, void *arg, unsigned int count )
+{
+    return syscall( __NR_io_uring_register, uring_fd, opcode, arg, count );
+}
+
+/* check that the kernel supports the operations we need */
+static BOOL check_uring_ops(void)
+{
+    static const unsigned char ops[] = { IORING_OP_READV, IORING_OP_READ, IORING_OP_WRITE,
+                                         IORING_OP_ASYNC_CANCEL };
+    struct io_uring_probe *probe;
+    unsigned int i;
+    BOOL ret = FALSE;
+
+    if (!(probe = calloc( 1, sizeof(*probe) + 256 * sizeof(probe->ops[0]) ))) return FALSE;
+    if (!io_uring_register( IORING_REGISTER_PROBE, probe, 256 ))
+    {
+        for (i = 0; i < ARRAY_SIZE(ops); i++)
+            if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) break;
+        ret = (i == ARRAY_SIZE(ops));
+    }
+    free( probe );
+    return ret;
+}
+
+static void init_uring(void)
+{
+    const char *env = getenv( "WINEIOURING" );
+    struct io_uring_params params;
+    size_t ring_size, sqes_size;
+    char *ring;
+    void *sqes;
+
+    uring_status = 0;
+    if (!env || !atoi( env )) return;
+
+    memset( &params, 0, sizeof(params) );
+    if ((uring_fd = io_uring_setup( URING_ENTRIES, &params )) == -1)
+    {
+        WARN( "io_uring not available, errno %d\n", errno );
+        return;
+    }
+    fcntl( uring_fd, F_SETFD, FD_CLOEXEC );
+
+    /* the rings are mapped with a single mmap since Linux 5.4 */
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !check_uring_ops())
+    {
+        WARN( "io_uring doesn't support the needed features\n" );
+        goto error;
+    }
+
+    ring_size = max( params.sq_off.array + params.sq_entries * sizeof(unsigned int),
+                     params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) );
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring = mmap( NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 uring_fd, IORING_OFF_SQ_RING );
+    if (ring == MAP_FAILED) goto error;
+    sqes = mmap( NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 uring_fd, IORING_OFF_SQES );
+    if (sqes == MAP_FAILED)
+    {
+        munmap( ring, ring_size );
+        goto error;
+    }
+
+    sq_head    = (unsigned int *)(ring + params.sq_off.head);
+    sq_tail    = (unsigned int *)(ring + params.sq_off.tail);
+    sq_mask    = (unsigned int *)(ring + params.sq_off.ring_mask);
+    sq_array   = (unsigned int *)(ring + params.sq_off.array);
+    cq_head    = (unsigned int *)(ring + params.cq_off.head);
+    cq_tail    = (unsigned int *)(ring + params.cq_off.tail);
+    cq_mask    = (unsigned int *)(ring + params.cq_off.ring_mask);
+    uring_cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+    uring_sqes = sqes;
+    /* the completion queue is twice as large, so limiting the number of pending
+     * entries to the submission queue size is enough to never overflow it */
+    sq_entries = params.sq_entries;
+
+    TRACE( "using io_uring, %u entries\n", sq_entries );
+    uring_status = 1;
+    return;
+
+error:
+    close( uring_fd );
+    uring_fd = -1;
+}
+
+static BOOL do_uring(void)
+{
+    if (uring_status == -1)
+    {
+        sigset_t sigset;
+
+        server_enter_uninterrupted_section( &uring_mutex, &sigset );
+        if (uring_status == -1) init_uring();
+        server_leave_uninterrupted_section( &uring_mutex, &sigset );
+    }
+    return uring_status > 0;
+}
+
+/* errno_to_status() may print a message, which can't be done without a TEB */
+static NTSTATUS uring_errno_to_status( int err, unsigned char opcode )
+{
+    switch (err)
+    {
+    case ECANCELED: return STATUS_CANCELLED;
+    case EFAULT:    return opcode == IORING_OP_WRITE ? STATUS_INVALID_USER_BUFFER : STATUS_ACCESS_VIOLATION;
+    case EBADF:     return STATUS_INVALID_HANDLE;
+    case ENOSPC:    return STATUS_DISK_FULL;
+    case EINVAL:    return STATUS_INVALID_PARAMETER;
+    case EIO:       return STATUS_DEVICE_NOT_READY;
+    case EISDIR:    return STATUS_INVALID_DEVICE_REQUEST;
+    default:        return STATUS_UNSUCCESSFUL;
+    }
+}
+
+/* retrieve the final status of a request, store it in the I/O status block and report it */
+static void complete_request( struct uring_request *req, int res )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    ULONG total = 0;
+    ssize_t ret = 0;
+
+    if (res >= 0) total = res;
+    else if (req->opcode == IORING_OP_READV || (res != -EAGAIN && res != -EINTR))
+        status = uring_errno_to_status( -res, req->opcode );
+
+    /* short transfers happen at the end of the file, but also when the request was
+     * interrupted; finish them synchronously. The caller probed the buffer for write
+     * access, so the write watches have already been triggered. */
+    while (!status && total < req->length && req->opcode != IORING_OP_READV)
+    {
+        if (req->opcode == IORING_OP_READ)
+            ret = pread( req->fd, (char *)req->buffer + total, req->length - total, req->offset + total );
+        else
+            ret = pwrite( req->fd, (char *)req->buffer + total, req->length - total, req->offset + total );
+        if (ret > 0) total += ret;
+        else if (!ret) break;
+        else if (errno == EINTR) continue;
+        else
+        {
+            if (!total) status = uring_errno_to_status( errno, req->opcode );
+            break;
+        }
+    }
+    if (!status && !total && req->opcode != IORING_OP_WRITE) status = STATUS_END_OF_FILE;
+
+    if (req->needs_close) close( req->fd );
+
+    req->io->Information = total;
+    __atomic_store_n( &req->io->u.Status, status, __ATOMIC_RELEASE );
+    server_notify_io( req->handle, req->event, req->cvalue, status, total );
+}
+
+/* collect the results that are available, and wait for more while requests are pending */
+static void process_completions(void)
+{
+    struct uring_request *req;
+    struct io_uring_cqe *cqe;
+    unsigned int head, tail;
+    sigset_t sigset;
+    int res;
+
+    for (;;)
+    {
+        head = *cq_head;
+        tail = __atomic_load_n( cq_tail, __ATOMIC_ACQUIRE );
+        if (head == tail)
+        {
+            if (!__atomic_load_n( &pending_count, __ATOMIC_ACQUIRE )) break;
+            io_uring_enter( 0, 1, IORING_ENTER_GETEVENTS );
+            continue;
+        }
+
+        cqe = &uring_cqes[head & *cq_mask];
+        req = (struct uring_request *)(ULONG_PTR)cqe->user_data;
+        res = cqe->res;
+        __atomic_store_n( cq_head, head + 1, __ATOMIC_RELEASE );
+
+        /* cancel entries don't have a request */
+        if (req) complete_request( req, res );
+
+        server_enter_uninterrupted_section( &uring_mutex, &sigset );
+        if (req) list_remove( &req->entry );
+        pending_count--;
+        pthread_cond_broadcast( &uring_cond );
+        server_leave_uninterrupted_section( &uring_mutex, &sigset );
+        free( req );
+    }
+}
+
+/* collect results until no request has been pending for the given time */
+static void reap_requests( int idle_timeout )
+{
+    struct pollfd pfd;
+    sigset_t sigset;
+    BOOL done;
+
+    for (;;)
+    {
+        process_completions();
+
+        if (idle_timeout)
+        {
+            pfd.fd = uring_fd;
+            pfd.events = POLLIN;
+            poll( &pfd, 1, idle_timeout );
+        }
+
+        server_enter_uninterrupted_section( &uring_mutex, &sigset );
+        if ((done = !pending_count)) thread_running = FALSE;
+        server_leave_uninterrupted_section( &uring_mutex, &sigset );
+        if (done) break;
+    }
+}
+
+static void *uring_thread( void *arg )
+{
+    reap_requests( URING_IDLE_TIMEOUT );
+    return NULL;
+}
+
+/* start the completion thread; if that fails, collect the results ourselves */
+static void start_uring_thread(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    sigset_t all_set, old_set;
+    int ret;
+
+    /* the thread has no TEB, it must not run the signal handlers */
+    sigfillset( &all_set );
+    pthread_sigmask( SIG_SETMASK, &all_set, &old_set );
+    pthread_attr_init( &attr );
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+    pthread_attr_setstacksize( &attr, 0x10000 );
+    ret = pthread_create( &thread, &attr, uring_thread, NULL );
+    pthread_attr_destroy( &attr );
+    pthread_sigmask( SIG_SETMASK, &old_set, NULL );
+    if (!ret) return;
+
+    WARN( "failed to start completion thread, error %d\n", ret );
+    reap_requests( 0 );
+}
+
+/* add an entry to the submission queue and submit it; called with the mutex held */
+static BOOL submit_sqe( const struct io_uring_sqe *entry )
+{
+    unsigned int tail = *sq_tail, index = tail & *sq_mask;
+    int ret;
+
+    uring_sqes[index] = *entry;
+    sq_array[index] = index;
+    __atomic_store_n( sq_tail, tail + 1, __ATOMIC_RELEASE );
+
+    while ((ret = io_uring_enter( 1, 0, 0 )) == -1 && errno == EINTR) /* nothing */;
+    if (ret == 1)
+    {
+        pending_count++;
+        return TRUE;
+    }
+
+    WARN( "failed to submit request, errno %d\n", ret == -1 ? errno : 0 );
+    /* the kernel only consumes entries in io_uring_enter, so we can take it back */
+    if (__atomic_load_n( sq_head, __ATOMIC_ACQUIRE ) == tail) *sq_tail = tail;
+    return FALSE;
+}
+
+/* set the signaled state of the file, when there is no event to report the completion */
+static NTSTATUS set_file_signaled( HANDLE handle, int signaled )
+{
+    NTSTATUS status;
+
+    SERVER_START_REQ( set_fd_signaled )
+    {
+        req->handle   = wine_server_obj_handle( handle );
+        req->signaled = signaled;
+        status = wine_server_call( req );
+    }
+    SERVER_END_REQ;
+    return status;
+}
+
+/* submit a request to the ring; on success the request belongs to the completion thread */
+static NTSTATUS submit_request( struct uring_request *req )
+{
+    struct io_uring_sqe sqe;
+    sigset_t sigset;
+    NTSTATUS status = STATUS_NOT_SUPPORTED;
+    BOOL start = FALSE;
+
+    TRACE( "%p: op %u offset %s length %u\n",
+           req->io, req->opcode, wine_dbgstr_longlong(req->offset), req->length );
+
+    memset( &sqe, 0, sizeof(sqe) );
+    sqe.opcode    = req->opcode;
+    sqe.fd        = req->fd;
+    sqe.off       = req->offset;
+    sqe.user_data = (ULONG_PTR)req;
+    if (req->opcode == IORING_OP_READV)
+    {
+        sqe.addr = (ULONG_PTR)req->iov;
+        sqe.len  = req->iov_count;
+    }
+    else
+    {
+        sqe.addr = (ULONG_PTR)req->buffer;
+        sqe.len  = req->length;
+    }
+
+    req->io->Information = 0;
+    req->io->u.Status = STATUS_PENDING;
+    if (req->event) NtResetEvent( req->event, NULL );
+    else if (set_file_signaled( req->handle, 0 )) return STATUS_NOT_SUPPORTED;
+
+    server_enter_uninterrupted_section( &uring_mutex, &sigset );
+    if (pending_count < sq_entries && submit_sqe( &sqe ))
+    {
+        list_add_tail( &pending_requests, &req->entry );
+        if (!thread_running) start = thread_running = TRUE;
+        status = STATUS_PENDING;
+    }
+    server_leave_uninterrupted_section( &uring_mutex, &sigset );
+
+    if (status != STATUS_PENDING)
+    {
+        if (!req->event) set_file_signaled( req->handle, 1 );
+    }
+    else if (start) start_uring_thread();
+    return status;
+}
+
+static struct uring_request *alloc_request( HANDLE handle, int fd, int needs_close, HANDLE event,
+                                            ULONG_PTR cvalue, IO_STATUS_BLOCK *io, unsigned int iov_count )
+{
+    struct uring_request *req;
+
+    if (!(req = malloc( max( sizeof(*req), offsetof( struct uring_request, iov[iov_count] ))))) return NULL;
+    req->handle      = handle;
+    req->thread      = NtCurrentTeb()->ClientId.UniqueThread;
+    req->fd          = fd;
+    req->needs_close = needs_close;
+    req->event       = event;
+    req->cvalue      = cvalue;
+    req->io          = io;
+    req->iov_count   = iov_count;
+    return req;
+}
+
+/* check whether an overlapped request can be submitted to the ring */
+static BOOL can_use_uring( PIO_APC_ROUTINE apc )
+{
+    if (apc) return FALSE;
+    return do_uring() && server_init_io_notify();
+}
+
+/* submit an overlapped read from a regular file */
+NTSTATUS uring_read_file( HANDLE handle, int fd, int needs_close, HANDLE event, PIO_APC_ROUTINE apc,
+                          void *apc_user, IO_STATUS_BLOCK *io, void *buffer, ULONG length, ULONGLONG offset )
+{
+    struct uring_request *req;
+    NTSTATUS status;
+
+    if (!length || !can_use_uring( apc )) return STATUS_NOT_SUPPORTED;
+    if (!(req = alloc_request( handle, fd, needs_close, event, (ULONG_PTR)apc_user, io, 0 )))
+        return STATUS_NOT_SUPPORTED;
+    req->opcode = IORING_OP_READ;
+    req->buffer = buffer;
+    req->length = length;
+    req->offset = offset;
+    if ((status = submit_request( req )) != STATUS_PENDING) free( req );
+    return status;
+}
+
+/* submit an overlapped write to a regular file */
+NTSTATUS uring_write_file( HANDLE handle, int fd, int needs_close, HANDLE event, PIO_APC_ROUTINE apc,
+                           void *apc_user, IO_STATUS_BLOCK *io, const void *buffer, ULONG length,
+                           ULONGLONG offset )
+{
+    struct uring_request *req;
+    NTSTATUS status;
+
+    if (!length || !can_use_uring( apc )) return STATUS_NOT_SUPPORTED;
+    if (!(req = alloc_request( handle, fd, needs_close, event, (ULONG_PTR)apc_user, io, 0 )))
+        return STATUS_NOT_SUPPORTED;
+    req->opcode = IORING_OP_WRITE;
+    req->buffer = (void *)buffer;
+    req->length = length;
+    req->offset = offset;
+    if ((status = submit_request( req )) != STATUS_PENDING) free( req );
+    return status;
+}
+
+/* submit an overlapped read from a regular file into page-sized segments */
+NTSTATUS uring_read_file_scatter( HANDLE handle, int fd, int needs_close, HANDLE event,
+                                  PIO_APC_ROUTINE apc, void *apc_user, IO_STATUS_BLOCK *io,
+                                  FILE_SEGMENT_ELEMENT *segments, ULONG length, ULONGLONG offset )
+{
+    struct uring_request *req;
+    unsigned int i, count = (length + page_size - 1) / page_size;
+    NTSTATUS status;
+
+    if (!length || count > IOV_MAX || !can_use_uring( apc )) return STATUS_NOT_SUPPORTED;
+    if (!(req = alloc_request( handle, fd, needs_close, event, (ULONG_PTR)apc_user, io, count )))
+        return STATUS_NOT_SUPPORTED;
+    for (i = 0; i < count; i++)
+    {
+        req->iov[i].iov_base = segments[i].Buffer;
+        req->iov[i].iov_len  = min( length - i * page_size, page_size );
+        /* trigger the write watches now, the completion thread can't handle them */
+        if (!virtual_check_buffer_for_write( req->iov[i].iov_base, req->iov[i].iov_len ))
+        {
+            free( req );
+            return STATUS_NOT_SUPPORTED;
+        }
+    }
+    req->opcode = IORING_OP_READV;
+    req->buffer = NULL;
+    req->length = length;
+    req->offset = offset;
+    if ((status = submit_request( req )) != STATUS_PENDING) free( req );
+    return status;
+}
+
+/* ask the kernel to cancel the pending requests of a handle; they complete with STATUS_CANCELLED,
+ * or normally if the kernel already started them */
+BOOL uring_cancel_io( HANDLE handle, IO_STATUS_BLOCK *io, BOOL only_thread )
+{
+    HANDLE thread = NtCurrentTeb()->ClientId.UniqueThread;
+    struct uring_request *req;
+    struct io_uring_sqe sqe;
+    sigset_t sigset;
+    BOOL found = FALSE;
+
+    if (uring_status <= 0 || !__atomic_load_n( &pending_count, __ATOMIC_ACQUIRE )) return FALSE;
+
+    server_enter_uninterrupted_section( &uring_mutex, &sigset );
+    LIST_FOR_EACH_ENTRY( req, &pending_requests, struct uring_request, entry )
+    {
+        if (req->handle != handle) continue;
+        if (io && req->io != io) continue;
+        if (only_thread && req->thread != thread) continue;
+        found = TRUE;
+
+        if (pending_count >= sq_entries) continue;  /* no room for the cancel entry */
+        memset( &sqe, 0, sizeof(sqe) );
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.addr   = (ULONG_PTR)req;
+        submit_sqe( &sqe );
+    }
+    server_leave_uninterrupted_section( &uring_mutex, &sigset );
+
+    TRACE( "%p: found %u\n", handle, found );
+    return found;
+}
+
+/* wait for the pending requests on a handle before it's closed, they need it for the completion */
+void uring_close_handle( HANDLE handle )
+{
+    struct uring_request *req;
+    sigset_t sigset;
+    BOOL found;
+
+    if (uring_status <= 0 || !__atomic_load_n( &pending_count, __ATOMIC_ACQUIRE )) return;
+
+    server_enter_uninterrupted_section( &uring_mutex, &sigset );
+    do
+    {
+        found = FALSE;
+        LIST_FOR_EACH_ENTRY( req, &pending_requests, struct uring_request, entry )
+        {
+            if (req->handle != handle) continue;
+            found = TRUE;
+            break;
+        }
+        if (found) pthread_cond_wait( &uring_cond, &uring_mutex );
+    } while (found);
+    server_leave_uninterrupted_section( &uring_mutex, &sigset );
+}
+
+#else  /* HAVE_LINUX_IO_URING_H */
+
+NTSTATUS uring_read_file( HANDLE handle, int fd, int needs_close, HANDLE event, PIO_APC_ROUTINE apc,
+                          void *apc_user, IO_STATUS_BLOCK *io, void *buffer, ULONG length, ULONGLONG offset )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+NTSTATUS uring_write_file( HANDLE handle, int fd, int needs_close, HANDLE event, PIO_APC_ROUTINE apc,
+                           void *apc_user, IO_STATUS_BLOCK *io, const void *buffer, ULONG length,
+                           ULONGLONG offset )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+NTSTATUS uring_read_file_scatter( HANDLE handle, int fd, int needs_close, HANDLE event,
+                                  PIO_APC_ROUTINE apc, void *apc_user, IO_STATUS_BLOCK *io,
+                                  FILE_SEGMENT_ELEMENT *segments, ULONG length, ULONGLONG offset )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+BOOL uring_cancel_io( HANDLE handle, IO_STATUS_BLOCK *io, BOOL only_thread )
+{
+    return FALSE;
+}
+
+void uring_close_handle( HANDLE handle )
+{
+}
+
+#endif  /* HAVE_LINUX_IO_URING_H */
@@ -26,9 +26,12 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <signal.h>
 #include <sys/types.h>
 #ifdef HAVE_SYS_SOCKET_H
@@ -167,6 +170,16 @@ static const BYTE VIRTUAL_Win32Flags[16] =
 static struct wine_rb_tree views_tree;
 static pthread_mutex_t virtual_mutex;
 
+/* Operations that only change the pages of an existing view (protecting or committing pages,
+ * handling page faults, reading into a buffer) look up the view without locking, and then only
+ * hold the view lock selected by the view address. Everything else holds virtual_mutex and all
+ * the view locks.
+ * views_seq is incremented around every change to the views tree, so that lookups can detect
+ * that they raced with one; view structures are never unmapped, so walking the tree is safe. */
+#define VIEW_LOCKS 16
+static pthread_mutex_t view_locks[VIEW_LOCKS];
+static unsigned int views_seq;
+
 static const UINT page_shift = 12;
 static const UINT_PTR page_mask = 0xfff;
 static const UINT_PTR granularity_mask = 0xffff;
@@ -1015,6 +1028,41 @@ static BOOL alloc_pages_vprot( const void *addr, size_t size )
 }
 
 
+/***********************************************************************
+ *           get_view_lock
+ */
+static inline pthread_mutex_t *get_view_lock( const void *base )
+{
+    return &view_locks[((UINT_PTR)base >> 16) % VIEW_LOCKS];
+}
+
+
+/***********************************************************************
+ *           lock_virtual
+ *
+ * Lock the whole virtual memory state, for operations that may change the views tree.
+ */
+static void lock_virtual( sigset_t *sigset )
+{
+    unsigned int i;
+
+    server_enter_uninterrupted_section( &virtual_mutex, sigset );
+    for (i = 0; i < VIEW_LOCKS; i++) mutex_lock( &view_locks[i] );
+}
+
+
+/***********************************************************************
+ *           unlock_virtual
+ */
+static void unlock_virtual( sigset_t *sigset )
+{
+    unsigned int i = VIEW_LOCKS;
+
+    while (i--) mutex_unlock( &view_locks[i] );
+    server_leave_uninterrupted_section( &virtual_mutex, sigset );
+}
+
+
 /***********************************************************************
  *           compare_view
  *
@@ -1114,12 +1162,12 @@ static void VIRTUAL_Dump(void)
     struct file_view *view;
 
     TRACE( "Dump of all virtual memory views:\n" );
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
     WINE_RB_FOR_EACH_ENTRY( view, &views_tree, struct file_view, entry )
     {
         dump_view( view );
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
 }
 #endif
 
@@ -1127,7 +1175,7 @@ static void VIRTUAL_Dump(void)
 /***********************************************************************
  *           find_view
  *
- * Find the view containing a given address. virtual_mutex must be held by caller.
+ * Find the view containing a given address. virtual_mutex or a view lock must be held by caller.
  *
  * PARAMS
  *      addr  [I] Address
@@ -1155,6 +1203,156 @@ static struct file_view *find_view( const void *addr, size_t size )
 }
 
 
+/***********************************************************************
+ *           find_view_lockless
+ *
+ * Find the view containing a given address without holding any lock. Returns FALSE if the
+ * views tree is being modified; otherwise the result is only valid if views_unchanged()
+ * succeeds for the returned sequence number once the caller is done with it.
+ */
+static BOOL find_view_lockless( const void *addr, size_t size, struct file_view **ret, unsigned int *seq )
+{
+    struct wine_rb_entry *ptr;
+    unsigned int depth = 0;
+
+    *ret = NULL;
+    if ((*seq = __atomic_load_n( &views_seq, __ATOMIC_ACQUIRE )) & 1) return FALSE;
+    if ((const char *)addr + size < (const char *)addr) return TRUE; /* overflow */
+
+    ptr = __atomic_load_n( &views_tree.root, __ATOMIC_RELAXED );
+    while (ptr)
+    {
+        struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+        const char *base = __atomic_load_n( &view->base, __ATOMIC_RELAXED );
+        size_t view_size = __atomic_load_n( &view->size, __ATOMIC_RELAXED );
+
+        /* a concurrent rebalancing may send us around in circles */
+        if (++depth > 16 * sizeof(void *)) return FALSE;
+
+        if (base > (const char *)addr) ptr = __atomic_load_n( &ptr->left, __ATOMIC_RELAXED );
+        else if (base + view_size <= (const char *)addr) ptr = __atomic_load_n( &ptr->right, __ATOMIC_RELAXED );
+        else if (base + view_size < (const char *)addr + size) break;  /* size too large */
+        else
+        {
+            *ret = view;
+            break;
+        }
+    }
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           views_unchanged
+ *
+ * Check that the views tree hasn't been modified since a lockless lookup.
+ */
+static inline BOOL views_unchanged( unsigned int seq )
+{
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    return __atomic_load_n( &views_seq, __ATOMIC_RELAXED ) == seq;
+}
+
+
+/***********************************************************************
+ *           begin_views_update
+ *
+ * Start modifying the views tree. virtual_mutex and all the view locks must be held by caller.
+ */
+static inline void begin_views_update(void)
+{
+    __atomic_store_n( &views_seq, views_seq + 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+}
+
+
+/***********************************************************************
+ *           end_views_update
+ */
+static inline void end_views_update(void)
+{
+    __atomic_store_n( &views_seq, views_seq + 1, __ATOMIC_RELEASE );
+}
+
+
+/***********************************************************************
+ *           lock_view
+ *
+ * Find the view containing a given address, and lock it for changing its pages. The returned
+ * lock must be passed to unlock_view(). sigset is NULL when called from a signal handler.
+ *
+ * virtual_mutex must not be taken until the view is unlocked, since a thread holding
+ * virtual_mutex may be waiting for the view lock.
+ */
+static pthread_mutex_t *lock_view( const void *addr, size_t size, struct file_view **view, sigset_t *sigset )
+{
+    pthread_mutex_t *lock;
+    unsigned int i, seq;
+
+    if (sigset) pthread_sigmask( SIG_BLOCK, &server_block_set, sigset );
+
+    for (i = 0; i < 4; i++)
+    {
+        if (!find_view_lockless( addr, size, view, &seq )) continue;
+        lock = get_view_lock( *view ? __atomic_load_n( &(*view)->base, __ATOMIC_RELAXED ) : NULL );
+        mutex_lock( lock );
+        /* the tree can't change while we hold one of the view locks */
+        if (views_unchanged( seq )) return lock;
+        mutex_unlock( lock );
+    }
+
+    /* too much contention with tree updates, lock all the views instead */
+    for (i = 0; i < VIEW_LOCKS; i++) mutex_lock( &view_locks[i] );
+    *view = find_view( addr, size );
+    return NULL;
+}
+
+
+/***********************************************************************
+ *           unlock_view
+ */
+static void unlock_view( pthread_mutex_t *lock, sigset_t *sigset )
+{
+    unsigned int i = VIEW_LOCKS;
+
+    if (lock) mutex_unlock( lock );
+    else while (i--) mutex_unlock( &view_locks[i] );
+
+    if (sigset) pthread_sigmask( SIG_SETMASK, sigset, NULL );
+}
+
+
+/***********************************************************************
+ *           lock_buffer
+ *
+ * Lock the view containing a buffer, for checking and updating the protections of its pages.
+ * The whole virtual memory state is locked instead if the buffer isn't inside a single view.
+ */
+static pthread_mutex_t *lock_buffer( const void *addr, size_t size, BOOL *locked_all, sigset_t *sigset )
+{
+    struct file_view *view;
+    pthread_mutex_t *lock = lock_view( addr, size, &view, sigset );
+
+    if ((*locked_all = !view))
+    {
+        unlock_view( lock, sigset );
+        lock_virtual( sigset );
+        lock = NULL;
+    }
+    return lock;
+}
+
+
+/***********************************************************************
+ *           unlock_buffer
+ */
+static void unlock_buffer( pthread_mutex_t *lock, BOOL locked_all, sigset_t *sigset )
+{
+    if (locked_all) unlock_virtual( sigset );
+    else unlock_view( lock, sigset );
+}
+
+
 /***********************************************************************
  *           get_zero_bits_mask
  */
@@ -1545,7 +1743,9 @@ static void delete_view( struct file_view *view ) /* [in] View */
     set_page_vprot( view->base, view->size, 0 );
     if (mmap_is_in_reserved_area( view->base, view->size ))
         free_ranges_remove_view( view );
+    begin_views_update();
     wine_rb_remove( &views_tree, &view->entry );
+    end_views_update();
     *(struct file_view **)view = next_free_view;
     next_free_view = view;
 }
@@ -1591,7 +1791,9 @@ static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t siz
     view->protect = vprot;
     set_page_vprot( base, size, vprot );
 
+    begin_views_update();
     wine_rb_put( &views_tree, view->base, &view->entry );
+    end_views_update();
     if (mmap_is_in_reserved_area( view->base, view->size ))
         free_ranges_insert_view( view );
 
@@ -2183,14 +2385,275 @@ static NTSTATUS map_pe_header( void *ptr, size_t size, int fd, BOOL *removable )
 }
 
 
+/* Cache of relocated images, shared between the processes of a prefix.
+ * The relocated image is stored in the server directory with the same layout as in memory,
+ * so that the next processes loading the DLL at the same address can map it copy-on-write. */
+
+#define RELOC_CACHE_MAX_SIZE (256 * 1024 * 1024)  /* the oldest images are removed past that size */
+
+static int reloc_cache_dir = -2;  /* fd of the cache directory, -1 if disabled, -2 if not initialized yet */
+/* same protections as a newly created image view, the sections protections are set afterwards */
+static const unsigned int reloc_cache_vprot = VPROT_COMMITTED | VPROT_READ | VPROT_EXEC | VPROT_WRITECOPY;
+
+static BOOL init_reloc_cache(void)
+{
+    const char *env;
+    char *path;
+
+    if (reloc_cache_dir != -2) return reloc_cache_dir != -1;
+
+    reloc_cache_dir = -1;
+    if (!(env = getenv( "WINERELOCCACHE" )) || !atoi( env ) || !server_dir) return FALSE;
+    if (!(path = malloc( strlen( server_dir ) + sizeof("/reloc") ))) return FALSE;
+    strcpy( path, server_dir );
+    strcat( path, "/reloc" );
+    if (mkdir( path, 0700 ) == -1 && errno != EEXIST) WARN( "cannot create %s\n", debugstr_a(path) );
+    reloc_cache_dir = open( path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    TRACE( "caching relocated images in %s\n", debugstr_a(path) );
+    free( path );
+    return reloc_cache_dir != -1;
+}
+
+/***********************************************************************
+ *           get_reloc_cache_name
+ *
+ * Build the cache file name of an image relocated at ptr. Returns FALSE if the image cannot be cached.
+ */
+static BOOL get_reloc_cache_name( char *name, size_t len, const struct stat *st, const IMAGE_NT_HEADERS *nt,
+                                  const IMAGE_SECTION_HEADER *sec, void *ptr, void *orig_base )
+{
+    const IMAGE_DATA_DIRECTORY *relocs = &nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+    int i;
+
+    if (!orig_base || ptr == orig_base) return FALSE;
+    if (nt->OptionalHeader.Magic != IMAGE_NT_OPTIONAL_HDR_MAGIC) return FALSE;
+    if (nt->OptionalHeader.ImageBase != (ULONG_PTR)orig_base) return FALSE;
+    /* leave the cases that the loader doesn't relocate, or fails to relocate, to the loader */
+    if (!(nt->FileHeader.Characteristics & IMAGE_FILE_DLL)) return FALSE;
+    if (nt->FileHeader.Characteristics & IMAGE_FILE_RELOCS_STRIPPED) return FALSE;
+    if (!relocs->Size || !relocs->VirtualAddress) return FALSE;
+    for (i = 0; i < nt->FileHeader.NumberOfSections; i++)
+        if ((sec[i].Characteristics & IMAGE_SCN_MEM_SHARED) && (sec[i].Characteristics & IMAGE_SCN_MEM_WRITE))
+            return FALSE;
+    if (!init_reloc_cache()) return FALSE;
+
+    /* the times are compared with nanosecond precision where available, so that
+     * an update within the same second isn't mistaken for the cached file */
+#if defined(HAVE_STRUCT_STAT_ST_MTIM) && defined(HAVE_STRUCT_STAT_ST_CTIM)
+    snprintf( name, len, "%llx-%llx-%llx-%llx.%lx-%llx.%lx-%lx", (unsigned long long)st->st_dev,
+              (unsigned long long)st->st_ino, (unsigned long long)st->st_size,
+              (unsigned long long)st->st_mtime, (long)st->st_mtim.tv_nsec,
+              (unsigned long long)st->st_ctime, (long)st->st_ctim.tv_nsec, (UINT_PTR)ptr );
+#else
+    snprintf( name, len, "%llx-%llx-%llx-%llx-%llx-%lx", (unsigned long long)st->st_dev,
+              (unsigned long long)st->st_ino, (unsigned long long)st->st_size,
+              (unsigned long long)st->st_mtime, (unsigned long long)st->st_ctime, (UINT_PTR)ptr );
+#endif
+    return TRUE;
+}
+
+/***********************************************************************
+ *           map_cached_image
+ *
+ * Map a relocated image from the cache into an existing view.
+ * virtual_mutex must be held by caller.
+ */
+static BOOL map_cached_image( struct file_view *view, const char *name )
+{
+    IMAGE_NT_HEADERS *nt;
+    struct stat st;
+    BOOL ret = FALSE;
+    int fd;
+
+    if ((fd = openat( reloc_cache_dir, name, O_RDONLY | O_CLOEXEC )) == -1) return FALSE;
+    if (!fstat( fd, &st ) && st.st_size == view->size &&
+        !map_file_into_view( view, fd, 0, view->size, 0, reloc_cache_vprot, FALSE ))
+    {
+        /* the cache file is complete if it has been renamed, but check the header anyway */
+        nt = (IMAGE_NT_HEADERS *)((char *)view->base + ((IMAGE_DOS_HEADER *)view->base)->e_lfanew);
+        if ((char *)(nt + 1) <= (char *)view->base + view->size &&
+            nt->OptionalHeader.ImageBase == (ULONG_PTR)view->base)
+            ret = TRUE;
+        else
+        {
+            WARN( "invalid cached image %s\n", debugstr_a(name) );
+            anon_mmap_fixed( view->base, view->size, get_unix_prot( reloc_cache_vprot ), 0 );
+            set_page_vprot( view->base, view->size, reloc_cache_vprot );
+        }
+    }
+    close( fd );
+    return ret;
+}
+
+/***********************************************************************
+ *           relocate_image
+ *
+ * Apply the base relocations to an image mapped at a different address than its preferred base.
+ * All the relocations are checked first, so that the image is never left half relocated.
+ */
+static BOOL relocate_image( char *ptr, SIZE_T size, IMAGE_NT_HEADERS *nt )
+{
+    const IMAGE_DATA_DIRECTORY *dir = &nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+    const IMAGE_BASE_RELOCATION *rel, *end;
+    INT_PTR delta = ptr - (char *)nt->OptionalHeader.ImageBase;
+    const USHORT *relocs;
+    UINT i, count;
+
+    if (dir->VirtualAddress >= size || dir->Size > size - dir->VirtualAddress) return FALSE;
+    rel = (const IMAGE_BASE_RELOCATION *)(ptr + dir->VirtualAddress);
+    end = (const IMAGE_BASE_RELOCATION *)(ptr + dir->VirtualAddress + dir->Size);
+
+    while (rel < end - 1 && rel->SizeOfBlock)
+    {
+        if (rel->SizeOfBlock < sizeof(*rel) || rel->SizeOfBlock > (const char *)end - (const char *)rel)
+            return FALSE;
+        count = (rel->SizeOfBlock - sizeof(*rel)) / sizeof(USHORT);
+        relocs = (const USHORT *)(rel + 1);
+        for (i = 0; i < count; i++)
+        {
+            if (rel->VirtualAddress + (relocs[i] & 0xfff) + 2 * sizeof(DWORD) > size) return FALSE;
+            switch (relocs[i] >> 12)
+            {
+            case IMAGE_REL_BASED_ABSOLUTE:
+            case IMAGE_REL_BASED_HIGH:
+            case IMAGE_REL_BASED_LOW:
+            case IMAGE_REL_BASED_HIGHLOW:
+            case IMAGE_REL_BASED_DIR64:
+            case IMAGE_REL_BASED_THUMB_MOV32:
+                break;
+            default:
+                return FALSE;
+            }
+        }
+        rel = (const IMAGE_BASE_RELOCATION *)(relocs + count);
+    }
+
+    TRACE_(module)( "relocating from %p to %p\n", (void *)nt->OptionalHeader.ImageBase, ptr );
+    rel = (const IMAGE_BASE_RELOCATION *)(ptr + dir->VirtualAddress);
+    while (rel < end - 1 && rel->SizeOfBlock) rel = process_relocation_block( ptr, rel, delta );
+    nt->OptionalHeader.ImageBase = (ULONG_PTR)ptr;
+    return TRUE;
+}
+
+struct reloc_cache_file
+{
+    time_t time;
+    off_t  size;
+    char   name[128];
+};
+
+static int compare_reloc_cache_files( const void *a, const void *b )
+{
+    const struct reloc_cache_file *file1 = a, *file2 = b;
+
+    if (file1->time != file2->time) return file1->time < file2->time ? -1 : 1;
+    return 0;
+}
+
+/***********************************************************************
+ *           trim_reloc_cache
+ *
+ * Remove the oldest images once the cache has grown over its size limit.
+ * The files are never modified once stored, so their time is the time they were added.
+ */
+static void trim_reloc_cache(void)
+{
+    struct reloc_cache_file *files = NULL, *new_files;
+    unsigned int i, count = 0, size = 0;
+    unsigned long long total = 0;
+    struct dirent *de;
+    struct stat st;
+    DIR *dir;
+    int fd;
+
+    /* a new open file description, so that concurrent readers don't share the position */
+    if ((fd = openat( reloc_cache_dir, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC )) == -1) return;
+    if (!(dir = fdopendir( fd )))
+    {
+        close( fd );
+        return;
+    }
+    while ((de = readdir( dir )))
+    {
+        if (de->d_name[0] == '.' || strlen( de->d_name ) >= sizeof(files->name)) continue;
+        if (strstr( de->d_name, ".tmp" )) continue;  /* being written */
+        if (fstatat( reloc_cache_dir, de->d_name, &st, AT_SYMLINK_NOFOLLOW ) == -1) continue;
+        if (!S_ISREG( st.st_mode )) continue;
+        if (count == size)
+        {
+            size = max( 64, size * 2 );
+            if (!(new_files = realloc( files, size * sizeof(*files) ))) break;
+            files = new_files;
+        }
+        files[count].time = st.st_mtime;
+        files[count].size = st.st_size;
+        strcpy( files[count].name, de->d_name );
+        total += st.st_size;
+        count++;
+    }
+    closedir( dir );
+
+    if (total > RELOC_CACHE_MAX_SIZE)
+    {
+        /* make some room at once, rather than scanning again on every new image */
+        qsort( files, count, sizeof(*files), compare_reloc_cache_files );
+        for (i = 0; i < count && total > RELOC_CACHE_MAX_SIZE / 4 * 3; i++)
+        {
+            TRACE_(module)( "removing %s from the cache\n", debugstr_a(files[i].name) );
+            if (!unlinkat( reloc_cache_dir, files[i].name, 0 )) total -= files[i].size;
+        }
+    }
+    free( files );
+}
+
+/***********************************************************************
+ *           add_cached_image
+ *
+ * Store an image relocated at base in the cache, for the next processes loading it at the same address.
+ * This writes the whole image, so virtual_mutex must not be held by caller.
+ */
+static void add_cached_image( const void *base, SIZE_T size, const char *name )
+{
+    char tmp[160];
+    SIZE_T pos;
+    ssize_t ret;
+    int fd;
+
+    snprintf( tmp, sizeof(tmp), "%s.%d.tmp", name, getpid() );
+    if ((fd = openat( reloc_cache_dir, tmp, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600 )) == -1) return;
+
+    /* write fails instead of faulting if the view doesn't allow reading, or has been unmapped */
+    for (pos = 0; pos < size; pos += ret)
+    {
+        if ((ret = write( fd, (const char *)base + pos, size - pos )) > 0) continue;
+        if (ret == -1 && errno == EINTR) ret = 0;
+        else goto failed;
+    }
+    /* another process may have stored the same image in the meantime, replacing it is harmless */
+    if (renameat( reloc_cache_dir, tmp, reloc_cache_dir, name ) == -1) goto failed;
+    close( fd );
+    TRACE_(module)( "added %s to the cache\n", debugstr_a(name) );
+    trim_reloc_cache();
+    return;
+
+failed:
+    WARN( "failed to cache relocated image %s\n", debugstr_a(name) );
+    unlinkat( reloc_cache_dir, tmp, 0 );
+    close( fd );
+}
+
+
 /***********************************************************************
  *           map_image_into_view
  *
  * Map an executable (PE format) image into an existing view.
+ * If the image has been relocated and should be added to the cache, its cache name is returned
+ * in cache_name, otherwise cache_name is set to an empty string.
  * virtual_mutex must be held by caller.
  */
 static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filename, int fd, void *orig_base,
-                                     SIZE_T header_size, ULONG image_flags, int shared_fd, BOOL removable )
+                                     SIZE_T header_size, ULONG image_flags, int shared_fd, BOOL removable,
+                                     char *cache_name, size_t cache_name_len )
 {
     IMAGE_DOS_HEADER *dos;
     IMAGE_NT_HEADERS *nt;
@@ -2204,8 +2667,10 @@ static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filena
     char *header_end, *header_start;
     char *ptr = view->base;
     SIZE_T total_size = view->size;
+    BOOL cache;
 
     TRACE_(module)( "mapping PE file %s at %p-%p\n", debugstr_w(filename), ptr, ptr + total_size );
+    cache_name[0] = 0;
 
     /* map the header */
 
@@ -2256,6 +2721,22 @@ static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filena
         return STATUS_SUCCESS;
     }
 
+    /* map the already relocated image from the cache if possible */
+
+    cache = get_reloc_cache_name( cache_name, cache_name_len, &st, nt, sections, ptr, orig_base );
+    if (cache)
+    {
+        if (map_cached_image( view, cache_name ))
+        {
+            TRACE_(module)( "mapped %s from cache %s\n", debugstr_w(filename), debugstr_a(cache_name) );
+            cache_name[0] = 0;
+            goto set_protections;
+        }
+        /* the header may have been overwritten */
+        if ((status = map_pe_header( view->base, header_size, fd, &removable ))) return status;
+        memset( ptr + header_size, 0, header_end - (ptr + header_size) );
+        status = STATUS_INVALID_IMAGE_FORMAT;
+    }
 
     /* map all the sections */
 
@@ -2347,8 +2828,12 @@ static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filena
         }
     }
 
+    /* the image is stored in the cache by the caller, once virtual_mutex is released */
+    if (cache && !relocate_image( view->base, view->size, nt )) cache_name[0] = 0;
+
     /* set the image protections */
 
+set_protections:
     set_vprot( view, ptr, ROUND_SIZE( 0, header_size ), VPROT_COMMITTED | VPROT_READ );
 
     sec = sections;
@@ -2447,8 +2932,10 @@ static NTSTATUS virtual_map_image( HANDLE mapping, ACCESS_MASK access, void **ad
     struct file_view *view;
     NTSTATUS status;
     sigset_t sigset;
+    char cache_name[128];
     void *base;
 
+    cache_name[0] = 0;
     if ((status = server_get_unix_fd( mapping, 0, &unix_fd, &needs_close, NULL, NULL )))
         return status;
 
@@ -2460,7 +2947,7 @@ static NTSTATUS virtual_map_image( HANDLE mapping, ACCESS_MASK access, void **ad
     }
 
     status = STATUS_INVALID_PARAMETER;
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
 
     base = wine_server_get_ptr( image_info->base );
     if ((ULONG_PTR)base != image_info->base) base = NULL;
@@ -2472,7 +2959,8 @@ static NTSTATUS virtual_map_image( HANDLE mapping, ACCESS_MASK access, void **ad
     if (status) goto done;
 
     status = map_image_into_view( view, filename, unix_fd, base, image_info->header_size,
-                                  image_info->image_flags, shared_fd, needs_close );
+                                  image_info->image_flags, shared_fd, needs_close,
+                                  cache_name, sizeof(cache_name) );
     if (status == STATUS_SUCCESS)
     {
         SERVER_START_REQ( map_view )
@@ -2492,10 +2980,15 @@ static NTSTATUS virtual_map_image( HANDLE mapping, ACCESS_MASK access, void **ad
         *size_ptr = size;
         VIRTUAL_DEBUG_DUMP_VIEW( view );
     }
-    else delete_view( view );
+    else
+    {
+        delete_view( view );
+        cache_name[0] = 0;
+    }
 
 done:
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
+    if (cache_name[0]) add_cached_image( *addr_ptr, size, cache_name );
     if (needs_close) close( unix_fd );
     if (shared_needs_close) close( shared_fd );
     return status;
@@ -2589,7 +3082,7 @@ static NTSTATUS virtual_map_section( HANDLE handle, PVOID *addr_ptr, ULONG_PTR z
 
     if ((res = server_get_unix_fd( handle, 0, &unix_handle, &needs_close, NULL, NULL ))) return res;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
 
     res = map_view( &view, base, size, alloc_type & MEM_TOP_DOWN, vprot, zero_bits );
     if (res) goto done;
@@ -2620,7 +3113,7 @@ static NTSTATUS virtual_map_section( HANDLE handle, PVOID *addr_ptr, ULONG_PTR z
     else delete_view( view );
 
 done:
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
     if (needs_close) close( unix_handle );
     return res;
 }
@@ -2671,6 +3164,7 @@ void virtual_init(void)
     pthread_mutexattr_init( &attr );
     pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
     pthread_mutex_init( &virtual_mutex, &attr );
+    for (i = 0; i < VIEW_LOCKS; i++) pthread_mutex_init( &view_locks[i], &attr );
     pthread_mutexattr_destroy( &attr );
 
     if (preload_info && *preload_info)
@@ -2835,7 +3329,7 @@ NTSTATUS virtual_create_builtin_view( void *module, const UNICODE_STRING *nt_nam
     void *base = wine_server_get_ptr( info->base );
     int i;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
     status = create_view( &view, base, size, SEC_IMAGE | SEC_FILE | VPROT_SYSTEM |
                           VPROT_COMMITTED | VPROT_READ | VPROT_WRITECOPY | VPROT_EXEC );
     if (!status)
@@ -2874,7 +3368,7 @@ NTSTATUS virtual_create_builtin_view( void *module, const UNICODE_STRING *nt_nam
         }
         else delete_view( view );
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
 
     return status;
 }
@@ -2989,7 +3483,7 @@ NTSTATUS virtual_alloc_teb( TEB **ret_teb, ULONG_PTR zero_bits )
     SIZE_T block_size = signal_stack_mask + 1;
     UINT_PTR zero_bits_mask = get_zero_bits_mask( zero_bits );
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
 
     ptr = &next_free_teb;
     do { ptr = *(void **)ptr; }
@@ -3023,7 +3517,7 @@ NTSTATUS virtual_alloc_teb( TEB **ret_teb, ULONG_PTR zero_bits )
             if ((status = NtAllocateVirtualMemory( NtCurrentProcess(), &ptr, zero_bits,
                                                    &total, MEM_RESERVE, PAGE_READWRITE )))
             {
-                server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+                unlock_virtual( &sigset );
                 return status;
             }
             teb_block = ptr;
@@ -3034,14 +3528,14 @@ NTSTATUS virtual_alloc_teb( TEB **ret_teb, ULONG_PTR zero_bits )
                                  MEM_COMMIT, PAGE_READWRITE );
     }
     *ret_teb = teb = init_teb( ptr, !!NtCurrentTeb()->WowTebOffset );
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
 
     if ((status = signal_alloc_thread( teb )))
     {
-        server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+        lock_virtual( &sigset );
         *(void **)ptr = next_free_teb;
         next_free_teb = ptr;
-        server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+        unlock_virtual( &sigset );
     }
     return status;
 }
@@ -3075,13 +3569,13 @@ void virtual_free_teb( TEB *teb )
         NtFreeVirtualMemory( GetCurrentProcess(), &ptr, &size, MEM_RELEASE );
     }
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
     list_remove( &thread_data->entry );
     ptr = teb;
     if (!is_win64) ptr = (char *)ptr - teb_offset;
     *(void **)ptr = next_free_teb;
     next_free_teb = ptr;
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
 }
 
 
@@ -3095,7 +3589,7 @@ NTSTATUS virtual_clear_tls_index( ULONG index )
 
     if (index < TLS_MINIMUM_AVAILABLE)
     {
-        server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+        lock_virtual( &sigset );
         LIST_FOR_EACH_ENTRY( thread_data, &teb_list, struct ntdll_thread_data, entry )
         {
             TEB *teb = CONTAINING_RECORD( thread_data, TEB, GdiTebBatch );
@@ -3106,14 +3600,14 @@ NTSTATUS virtual_clear_tls_index( ULONG index )
 #endif
             teb->TlsSlots[index] = 0;
         }
-        server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+        unlock_virtual( &sigset );
     }
     else
     {
         index -= TLS_MINIMUM_AVAILABLE;
         if (index >= 8 * sizeof(peb->TlsExpansionBitmapBits)) return STATUS_INVALID_PARAMETER;
 
-        server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+        lock_virtual( &sigset );
         LIST_FOR_EACH_ENTRY( thread_data, &teb_list, struct ntdll_thread_data, entry )
         {
             TEB *teb = CONTAINING_RECORD( thread_data, TEB, GdiTebBatch );
@@ -3128,7 +3622,7 @@ NTSTATUS virtual_clear_tls_index( ULONG index )
 #endif
             if (teb->TlsExpansionSlots) teb->TlsExpansionSlots[index] = 0;
         }
-        server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+        unlock_virtual( &sigset );
     }
     return STATUS_SUCCESS;
 }
@@ -3152,7 +3646,7 @@ NTSTATUS virtual_alloc_thread_stack( INITIAL_TEB *stack, ULONG_PTR zero_bits, SI
     if (size < 1024 * 1024) size = 1024 * 1024;  /* Xlib needs a large stack */
     size = (size + 0xffff) & ~0xffff;  /* round to 64K boundary */
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
 
     if ((status = map_view( &view, NULL, size + extra_size, FALSE,
                             VPROT_READ | VPROT_WRITE | VPROT_COMMITTED, zero_bits )) != STATUS_SUCCESS)
@@ -3193,7 +3687,7 @@ NTSTATUS virtual_alloc_thread_stack( INITIAL_TEB *stack, ULONG_PTR zero_bits, SI
     stack->StackBase = (char *)view->base + view->size;
     stack->StackLimit = (char *)view->base + 2 * page_size;
 done:
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
     return status;
 }
 
@@ -3328,9 +3822,11 @@ NTSTATUS virtual_handle_fault( void *addr, DWORD err, void *stack )
 {
     NTSTATUS ret = STATUS_ACCESS_VIOLATION;
     char *page = ROUND_ADDR( addr, page_mask );
+    struct file_view *view;
+    pthread_mutex_t *lock;
     BYTE vprot;
 
-    mutex_lock( &virtual_mutex );  /* no need for signal masking inside signal handler */
+    lock = lock_view( page, page_size, &view, NULL );  /* no need for signal masking inside signal handler */
     vprot = get_page_vprot( page );
     if (!is_inside_signal_stack( stack ) && (vprot & VPROT_GUARD))
     {
@@ -3357,7 +3853,7 @@ NTSTATUS virtual_handle_fault( void *addr, DWORD err, void *stack )
                 ret = STATUS_SUCCESS;
         }
     }
-    mutex_unlock( &virtual_mutex );
+    unlock_view( lock, NULL );
     return ret;
 }
 
@@ -3397,14 +3893,17 @@ void *virtual_setup_exception( void *stack_ptr, size_t size, EXCEPTION_RECORD *r
     }
     else if (stack < stack_info.limit)
     {
-        mutex_lock( &virtual_mutex );  /* no need for signal masking inside signal handler */
+        struct file_view *view;
+        pthread_mutex_t *lock;
+
+        lock = lock_view( stack, 1, &view, NULL );  /* no need for signal masking inside signal handler */
         if ((get_page_vprot( stack ) & VPROT_GUARD) &&
             grow_thread_stack( ROUND_ADDR( stack, page_mask ), &stack_info ))
         {
             rec->ExceptionCode = STATUS_STACK_OVERFLOW;
             rec->NumberParameters = 0;
         }
-        mutex_unlock( &virtual_mutex );
+        unlock_view( lock, NULL );
     }
 #if defined(VALGRIND_MAKE_MEM_UNDEFINED)
     VALGRIND_MAKE_MEM_UNDEFINED( stack, size );
@@ -3448,19 +3947,20 @@ unsigned int virtual_locked_server_call( void *req_ptr )
     sigset_t sigset;
     void *addr = req->reply_data;
     data_size_t size = req->u.req.request_header.reply_size;
-    BOOL has_write_watch = FALSE;
+    BOOL has_write_watch = FALSE, locked_all;
+    pthread_mutex_t *lock;
     unsigned int ret = STATUS_ACCESS_VIOLATION;
 
     if (!size) return wine_server_call( req_ptr );
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock = lock_buffer( addr, size, &locked_all, &sigset );
     if (!(ret = check_write_access( addr, size, &has_write_watch )))
     {
         ret = server_call_unlocked( req );
         if (has_write_watch) update_write_watches( addr, size, wine_server_reply_size( req ));
     }
     else memset( &req->u.reply, 0, sizeof(req->u.reply) );
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_buffer( lock, locked_all, &sigset );
     return ret;
 }
 
@@ -3471,20 +3971,21 @@ unsigned int virtual_locked_server_call( void *req_ptr )
 ssize_t virtual_locked_read( int fd, void *addr, size_t size )
 {
     sigset_t sigset;
-    BOOL has_write_watch = FALSE;
+    BOOL has_write_watch = FALSE, locked_all;
+    pthread_mutex_t *lock;
     int err = EFAULT;
 
     ssize_t ret = read( fd, addr, size );
     if (ret != -1 || errno != EFAULT) return ret;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock = lock_buffer( addr, size, &locked_all, &sigset );
     if (!check_write_access( addr, size, &has_write_watch ))
     {
         ret = read( fd, addr, size );
         err = errno;
         if (has_write_watch) update_write_watches( addr, size, max( 0, ret ));
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_buffer( lock, locked_all, &sigset );
     errno = err;
     return ret;
 }
@@ -3496,20 +3997,21 @@ ssize_t virtual_locked_read( int fd, void *addr, size_t size )
 ssize_t virtual_locked_pread( int fd, void *addr, size_t size, off_t offset )
 {
     sigset_t sigset;
-    BOOL has_write_watch = FALSE;
+    BOOL has_write_watch = FALSE, locked_all;
+    pthread_mutex_t *lock;
     int err = EFAULT;
 
     ssize_t ret = pread( fd, addr, size, offset );
     if (ret != -1 || errno != EFAULT) return ret;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock = lock_buffer( addr, size, &locked_all, &sigset );
     if (!check_write_access( addr, size, &has_write_watch ))
     {
         ret = pread( fd, addr, size, offset );
         err = errno;
         if (has_write_watch) update_write_watches( addr, size, max( 0, ret ));
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_buffer( lock, locked_all, &sigset );
     errno = err;
     return ret;
 }
@@ -3528,7 +4030,7 @@ ssize_t virtual_locked_recvmsg( int fd, struct msghdr *hdr, int flags )
     ssize_t ret = recvmsg( fd, hdr, flags );
     if (ret != -1 || errno != EFAULT) return ret;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
     for (i = 0; i < hdr->msg_iovlen; i++)
         if (check_write_access( hdr->msg_iov[i].iov_base, hdr->msg_iov[i].iov_len, &has_write_watch ))
             break;
@@ -3540,7 +4042,7 @@ ssize_t virtual_locked_recvmsg( int fd, struct msghdr *hdr, int flags )
     if (has_write_watch)
         while (i--) update_write_watches( hdr->msg_iov[i].iov_base, hdr->msg_iov[i].iov_len, 0 );
 
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
     errno = err;
     return ret;
 }
@@ -3552,13 +4054,23 @@ ssize_t virtual_locked_recvmsg( int fd, struct msghdr *hdr, int flags )
 BOOL virtual_is_valid_code_address( const void *addr, SIZE_T size )
 {
     struct file_view *view;
+    pthread_mutex_t *lock;
+    unsigned int seq;
     BOOL ret = FALSE;
     sigset_t sigset;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
-    if ((view = find_view( addr, size )))
-        ret = !(view->protect & VPROT_SYSTEM);  /* system views are not visible to the app */
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    /* this is called for every frame when unwinding, try to avoid locking */
+    if (find_view_lockless( addr, size, &view, &seq ))
+    {
+        /* system views are not visible to the app */
+        if (view) ret = !(__atomic_load_n( &view->protect, __ATOMIC_RELAXED ) & VPROT_SYSTEM);
+        if (views_unchanged( seq )) return ret;
+        ret = FALSE;
+    }
+
+    lock = lock_view( addr, size, &view, &sigset );
+    if (view) ret = !(view->protect & VPROT_SYSTEM);
+    unlock_view( lock, &sigset );
     return ret;
 }
 
@@ -3645,7 +4157,7 @@ SIZE_T virtual_uninterrupted_read_memory( const void *addr, void *buffer, SIZE_T
 
     if (!size) return 0;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
     if ((view = find_view( addr, size )))
     {
         if (!(view->protect & VPROT_SYSTEM))
@@ -3661,7 +4173,7 @@ SIZE_T virtual_uninterrupted_read_memory( const void *addr, void *buffer, SIZE_T
             }
         }
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
     return bytes_read;
 }
 
@@ -3681,13 +4193,13 @@ NTSTATUS virtual_uninterrupted_write_memory( void *addr, const void *buffer, SIZ
 
     if (!size) return STATUS_SUCCESS;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
     if (!(ret = check_write_access( addr, size, &has_write_watch )))
     {
         memcpy( addr, buffer, size );
         if (has_write_watch) update_write_watches( addr, size, size );
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
     return ret;
 }
 
@@ -3702,7 +4214,7 @@ void virtual_set_force_exec( BOOL enable )
     struct file_view *view;
     sigset_t sigset;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
     if (!force_exec_prot != !enable)  /* change all existing views */
     {
         force_exec_prot = enable;
@@ -3715,7 +4227,7 @@ void virtual_set_force_exec( BOOL enable )
             mprotect_range( view->base, view->size, commit, 0 );
         }
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
 }
 
 struct free_range
@@ -3797,6 +4309,7 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG_PTR z
     unsigned int vprot;
     BOOL is_dos_memory = FALSE;
     struct file_view *view;
+    pthread_mutex_t *lock;
     sigset_t sigset;
     SIZE_T size = *size_ptr;
     NTSTATUS status = STATUS_SUCCESS;
@@ -3873,10 +4386,10 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG_PTR z
 
     /* Reserve the memory */
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
-
     if ((type & MEM_RESERVE) || !base)
     {
+        lock_virtual( &sigset );
+
         if (!(status = get_vprot_flags( protect, &vprot, FALSE )))
         {
             if (type & MEM_COMMIT) vprot |= VPROT_COMMITTED;
@@ -3889,15 +4402,17 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG_PTR z
 
             if (status == STATUS_SUCCESS) base = view->base;
         }
+
+        if (!status) VIRTUAL_DEBUG_DUMP_VIEW( view );
+
+        unlock_virtual( &sigset );
     }
-    else if (type & MEM_RESET)
-    {
-        if (!(view = find_view( base, size ))) status = STATUS_NOT_MAPPED_VIEW;
-        else madvise( base, size, MADV_DONTNEED );
-    }
-    else  /* commit the pages */
+    else  /* the views tree doesn't change, only the view needs to be locked */
     {
-        if (!(view = find_view( base, size ))) status = STATUS_NOT_MAPPED_VIEW;
+        lock = lock_view( base, size, &view, &sigset );
+
+        if (!view) status = STATUS_NOT_MAPPED_VIEW;
+        else if (type & MEM_RESET) madvise( base, size, MADV_DONTNEED );
         else if (view->protect & SEC_FILE) status = STATUS_ALREADY_COMMITTED;
         else if (!(status = set_protection( view, base, size, protect )) && (view->protect & SEC_RESERVE))
         {
@@ -3910,11 +4425,11 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG_PTR z
             }
             SERVER_END_REQ;
         }
-    }
 
-    if (!status) VIRTUAL_DEBUG_DUMP_VIEW( view );
+        if (!status) VIRTUAL_DEBUG_DUMP_VIEW( view );
 
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+        unlock_view( lock, &sigset );
+    }
 
     if (status == STATUS_SUCCESS)
     {
@@ -3982,7 +4497,7 @@ NTSTATUS WINAPI NtFreeVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T *si
     size = ROUND_SIZE( addr, size );
     base = ROUND_ADDR( addr, page_mask );
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
 
     /* avoid freeing the DOS area when a broken app passes a NULL pointer */
     if (!base)
@@ -4022,7 +4537,7 @@ NTSTATUS WINAPI NtFreeVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T *si
         status = STATUS_INVALID_PARAMETER;
     }
 
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
     return status;
 }
 
@@ -4035,6 +4550,7 @@ NTSTATUS WINAPI NtProtectVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T
                                         ULONG new_prot, ULONG *old_prot )
 {
     struct file_view *view;
+    pthread_mutex_t *lock;
     sigset_t sigset;
     NTSTATUS status = STATUS_SUCCESS;
     char *base;
@@ -4076,9 +4592,9 @@ NTSTATUS WINAPI NtProtectVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T
     size = ROUND_SIZE( addr, size );
     base = ROUND_ADDR( addr, page_mask );
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock = lock_view( base, size, &view, &sigset );
 
-    if ((view = find_view( base, size )))
+    if (view)
     {
         /* Make sure all the pages are committed */
         if (get_committed_size( view, base, &vprot ) >= size && (vprot & VPROT_COMMITTED))
@@ -4092,7 +4608,7 @@ NTSTATUS WINAPI NtProtectVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T
 
     if (!status) VIRTUAL_DEBUG_DUMP_VIEW( view );
 
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_view( lock, &sigset );
 
     if (status == STATUS_SUCCESS)
     {
@@ -4196,7 +4712,7 @@ static NTSTATUS get_basic_memory_info( HANDLE process, LPCVOID addr,
 
     /* Find the view containing the address */
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
     ptr = views_tree.root;
     while (ptr)
     {
@@ -4265,7 +4781,7 @@ static NTSTATUS get_basic_memory_info( HANDLE process, LPCVOID addr,
             if ((get_page_vprot( ptr ) ^ vprot) & ~VPROT_WRITEWATCH) break;
         info->RegionSize = ptr - base;
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
 
     if (res_len) *res_len = sizeof(*info);
     return STATUS_SUCCESS;
@@ -4292,7 +4808,7 @@ static NTSTATUS get_working_set_ex( HANDLE process, LPCVOID addr,
         if (!once++) WARN( "unable to open /proc/self/pagemap\n" );
     }
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
     for (p = info; (UINT_PTR)(p + 1) <= (UINT_PTR)info + len; p++)
     {
         BYTE vprot;
@@ -4320,7 +4836,7 @@ static NTSTATUS get_working_set_ex( HANDLE process, LPCVOID addr,
                 p->VirtualAttributes.Win32Protection = get_win32_prot( vprot, view->protect );
         }
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
 
     if (f)
         fclose( f );
@@ -4595,7 +5111,7 @@ NTSTATUS WINAPI NtUnmapViewOfSection( HANDLE process, PVOID addr )
         return status;
     }
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
     if ((view = find_view( addr, 0 )) && !is_view_valloc( view ))
     {
         if (view->protect & VPROT_SYSTEM)
@@ -4609,7 +5125,7 @@ NTSTATUS WINAPI NtUnmapViewOfSection( HANDLE process, PVOID addr )
                 {
                     TRACE( "not freeing in-use builtin %p\n", view->base );
                     builtin->refcount--;
-                    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+                    unlock_virtual( &sigset );
                     return STATUS_SUCCESS;
                 }
             }
@@ -4628,7 +5144,7 @@ NTSTATUS WINAPI NtUnmapViewOfSection( HANDLE process, PVOID addr )
         }
         else FIXME( "failed to unmap %p %x\n", view->base, status );
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
     return status;
 }
 
@@ -4754,7 +5270,7 @@ NTSTATUS WINAPI NtFlushVirtualMemory( HANDLE process, LPCVOID *addr_ptr,
         return result.virtual_flush.status;
     }
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
     if (!(view = find_view( addr, *size_ptr ))) status = STATUS_INVALID_PARAMETER;
     else
     {
@@ -4764,7 +5280,7 @@ NTSTATUS WINAPI NtFlushVirtualMemory( HANDLE process, LPCVOID *addr_ptr,
         if (msync( addr, *size_ptr, MS_ASYNC )) status = STATUS_NOT_MAPPED_DATA;
 #endif
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
     return status;
 }
 
@@ -4791,7 +5307,7 @@ NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T
     TRACE( "%p %x %p-%p %p %lu\n", process, flags, base, (char *)base + size,
            addresses, *count );
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
 
     if (is_write_watch_range( base, size ))
     {
@@ -4810,7 +5326,7 @@ NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T
     }
     else status = STATUS_INVALID_PARAMETER;
 
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
     return status;
 }
 
@@ -4831,14 +5347,14 @@ NTSTATUS WINAPI NtResetWriteWatch( HANDLE process, PVOID base, SIZE_T size )
 
     if (!size) return STATUS_INVALID_PARAMETER;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
 
     if (is_write_watch_range( base, size ))
         reset_write_watches( base, size );
     else
         status = STATUS_INVALID_PARAMETER;
 
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
     return status;
 }
 
@@ -4915,7 +5431,7 @@ NTSTATUS WINAPI NtAreMappedFilesTheSame(PVOID addr1, PVOID addr2)
 
     TRACE("%p %p\n", addr1, addr2);
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    lock_virtual( &sigset );
 
     view1 = find_view( addr1, 0 );
     view2 = find_view( addr2, 0 );
@@ -4939,7 +5455,7 @@ NTSTATUS WINAPI NtAreMappedFilesTheSame(PVOID addr1, PVOID addr2)
         SERVER_END_REQ;
     }
 
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    unlock_virtual( &sigset );
     return status;
 }
 
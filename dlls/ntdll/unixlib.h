@@ -26,7 +26,14 @@
 struct _DISPATCHER_CONTEXT;
 
 /* increment this when you change the function table */
-#define NTDLL_UNIXLIB_VERSION 125
+#define NTDLL_UNIXLIB_VERSION 126
+
+/* record types of the loader snapshot */
+enum loader_snapshot_type
+{
+    SNAPSHOT_LOAD_ORDER,  /* load order of a module for a given registry state */
+    SNAPSHOT_DLL_SEARCH,  /* search path element where a dll was found */
+};
 
 struct unix_funcs
 {
@@ -74,6 +81,10 @@ struct unix_funcs
     NTSTATUS      (CDECL *init_unix_lib)( void *module, DWORD reason, const void *ptr_in, void *ptr_out );
     NTSTATUS      (CDECL *unwind_builtin_dll)( ULONG type, struct _DISPATCHER_CONTEXT *dispatch,
                                                CONTEXT *context );
+    NTSTATUS      (CDECL *get_loader_snapshot)( ULONG type, const void *key, ULONG key_size,
+                                                void *data, ULONG *size );
+    void          (CDECL *set_loader_snapshot)( ULONG type, const void *key, ULONG key_size,
+                                                const void *data, ULONG size );
 };
 
 #endif /* __NTDLL_UNIXLIB_H */
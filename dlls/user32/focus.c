@@ -397,8 +397,18 @@ HWND WINAPI GetFocus(void)
  */
 HWND WINAPI GetForegroundWindow(void)
 {
+    desktop_shm_t *shm;
     HWND ret = 0;
 
+    if ((shm = get_desktop_shm()))
+    {
+        SHARED_READ_BEGIN( shm );
+        ret = wine_server_ptr_handle( shm->foreground );
+        SHARED_READ_END( shm );
+        shm_fast_path_hit( __FUNCTION__ );
+        return ret;
+    }
+
     SERVER_START_REQ( get_thread_input )
     {
         req->tid = 0;
@@ -325,22 +325,36 @@ void WINAPI mouse_event( DWORD dwFlags, DWORD dx, DWORD dy,
  */
 BOOL WINAPI DECLSPEC_HOTPATCH GetCursorPos( POINT *pt )
 {
+    desktop_shm_t *shm;
     BOOL ret;
     DWORD last_change;
     UINT dpi;
 
     if (!pt) return FALSE;
 
-    SERVER_START_REQ( set_cursor )
+    if ((shm = get_desktop_shm()))
     {
-        if ((ret = !wine_server_call( req )))
+        SHARED_READ_BEGIN( shm );
+        pt->x = shm->cursor_x;
+        pt->y = shm->cursor_y;
+        last_change = shm->cursor_last_change;
+        SHARED_READ_END( shm );
+        shm_fast_path_hit( __FUNCTION__ );
+        ret = TRUE;
+    }
+    else
+    {
+        SERVER_START_REQ( set_cursor )
         {
-            pt->x = reply->new_x;
-            pt->y = reply->new_y;
-            last_change = reply->last_change;
+            if ((ret = !wine_server_call( req )))
+            {
+                pt->x = reply->new_x;
+                pt->y = reply->new_y;
+                last_change = reply->last_change;
+            }
         }
+        SERVER_END_REQ;
     }
-    SERVER_END_REQ;
 
     /* query new position from graphics driver if we haven't updated recently */
     if (ret && GetTickCount() - last_change > 100) ret = USER_Driver->pGetCursorPos( pt );
@@ -527,6 +541,7 @@ SHORT WINAPI DECLSPEC_HOTPATCH GetAsyncKeyState( INT key )
  */
 DWORD WINAPI GetQueueStatus( UINT flags )
 {
+    queue_shm_t *shm;
     DWORD ret;
 
     if (flags & ~(QS_ALLINPUT | QS_ALLPOSTMESSAGE | QS_SMRESULT))
@@ -537,6 +552,23 @@ DWORD WINAPI GetQueueStatus( UINT flags )
 
     check_for_events( flags );
 
+    if ((shm = get_queue_shm()))
+    {
+        UINT wake_bits, changed_bits;
+
+        SHARED_READ_BEGIN( shm );
+        wake_bits = shm->wake_bits;
+        changed_bits = shm->changed_bits;
+        SHARED_READ_END( shm );
+
+        /* the server only needs to be called when there are changed bits to clear */
+        if (!(changed_bits & flags))
+        {
+            shm_fast_path_hit( __FUNCTION__ );
+            return MAKELONG( 0, wake_bits & flags );
+        }
+    }
+
     SERVER_START_REQ( get_queue_status )
     {
         req->clear_bits = flags;
@@ -553,10 +585,20 @@ DWORD WINAPI GetQueueStatus( UINT flags )
  */
 BOOL WINAPI GetInputState(void)
 {
+    queue_shm_t *shm;
     DWORD ret;
 
     check_for_events( QS_INPUT );
 
+    if ((shm = get_queue_shm()))
+    {
+        SHARED_READ_BEGIN( shm );
+        ret = shm->wake_bits & (QS_KEY | QS_MOUSEBUTTON);
+        SHARED_READ_END( shm );
+        shm_fast_path_hit( __FUNCTION__ );
+        return ret;
+    }
+
     SERVER_START_REQ( get_queue_status )
     {
         req->clear_bits = 0;
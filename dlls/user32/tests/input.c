@@ -4610,6 +4610,60 @@ static void send_alt_tab(void)
     empty_message_queue();
 }
 
+static DWORD WINAPI set_cursor_thread( void *arg )
+{
+    POINT *pt = arg;
+    SetCursorPos( pt->x, pt->y );
+    return 0;
+}
+
+/* the queue bits, cursor position and foreground window must follow changes
+ * made by other threads and by the server */
+static void test_published_state(void)
+{
+    DWORD status, tid = GetCurrentThreadId();
+    POINT pt, pos = { 123, 87 };
+    HANDLE thread;
+    HWND hwnd;
+    MSG msg;
+    BOOL ret;
+
+    empty_message_queue();
+    status = GetQueueStatus( QS_ALLINPUT );
+    ok( !HIWORD(status), "got status %#x\n", status );
+
+    ret = PostThreadMessageA( tid, WM_USER, 0, 0 );
+    ok( ret, "PostThreadMessageA failed, error %u\n", GetLastError() );
+    status = GetQueueStatus( QS_POSTMESSAGE );
+    ok( status == MAKELONG( QS_POSTMESSAGE, QS_POSTMESSAGE ), "got status %#x\n", status );
+    /* the changed bit is cleared, the wake bit stays set */
+    status = GetQueueStatus( QS_POSTMESSAGE );
+    ok( status == MAKELONG( 0, QS_POSTMESSAGE ), "got status %#x\n", status );
+    status = GetQueueStatus( QS_POSTMESSAGE );
+    ok( status == MAKELONG( 0, QS_POSTMESSAGE ), "got status %#x\n", status );
+
+    ret = PeekMessageA( &msg, 0, WM_USER, WM_USER, PM_REMOVE );
+    ok( ret, "no message\n" );
+    status = GetQueueStatus( QS_POSTMESSAGE );
+    ok( !status, "got status %#x after removing the message\n", status );
+
+    thread = CreateThread( NULL, 0, set_cursor_thread, &pos, 0, NULL );
+    ok( !WaitForSingleObject( thread, 5000 ), "thread didn't exit\n" );
+    CloseHandle( thread );
+    ret = GetCursorPos( &pt );
+    ok( ret, "GetCursorPos failed\n" );
+    ok( pt.x == pos.x && pt.y == pos.y, "got cursor at (%d,%d)\n", pt.x, pt.y );
+
+    hwnd = CreateWindowA( "static", NULL, WS_POPUP | WS_VISIBLE, 0, 0, 100, 100, NULL, NULL, NULL, NULL );
+    ok( hwnd != NULL, "CreateWindowA failed, error %u\n", GetLastError() );
+    SetForegroundWindow( hwnd );
+    empty_message_queue();
+    if (GetForegroundWindow() != hwnd) skip( "couldn't make the window foreground\n" );
+    DestroyWindow( hwnd );
+    empty_message_queue();
+    ok( GetForegroundWindow() != hwnd, "foreground window still set after destroying it\n" );
+}
+
 static void test_ClipCursor(void)
 {
     WNDCLASSA cls;
@@ -4830,6 +4884,7 @@ START_TEST(input)
     else
         win_skip("GetCurrentInputMessageSource is not available\n");
 
+    test_published_state();
     SetCursorPos( pos.x, pos.y );
 
     if(pGetPointerType)
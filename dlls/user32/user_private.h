@@ -30,6 +30,7 @@
 #include "winternl.h"
 #include "hidusage.h"
 #include "wine/heap.h"
+#include "wine/server_protocol.h"
 
 #define GET_WORD(ptr)  (*(const WORD *)(ptr))
 #define GET_DWORD(ptr) (*(const DWORD *)(ptr))
@@ -205,6 +206,9 @@ struct user_thread_info
     HWND                          top_window;             /* Desktop window */
     HWND                          msg_window;             /* HWND_MESSAGE parent window */
     struct rawinput_thread_data  *rawinput;               /* RawInput thread local data / buffer */
+    queue_shm_t                  *queue_shm;              /* Queue data published by the server */
+    desktop_shm_t                *desktop_shm;            /* Desktop data published by the server */
+    BOOL                          shm_checked;            /* Did we already try to map the above? */
 };
 
 C_ASSERT( sizeof(struct user_thread_info) <= sizeof(((TEB *)0)->Win32ClientInfo) );
@@ -284,6 +288,24 @@ extern BOOL USER_IsExitingThread( DWORD tid ) DECLSPEC_HIDDEN;
 
 extern BOOL USER_SetWindowPos( WINDOWPOS * winpos, int parent_x, int parent_y ) DECLSPEC_HIDDEN;
 
+extern queue_shm_t *get_queue_shm(void) DECLSPEC_HIDDEN;
+extern desktop_shm_t *get_desktop_shm(void) DECLSPEC_HIDDEN;
+extern void free_shared_memory(void) DECLSPEC_HIDDEN;
+extern void shm_fast_path_hit( const char *func ) DECLSPEC_HIDDEN;
+
+/* read an object published by the server, retrying while it is being updated */
+#define SHARED_READ_BEGIN( shm ) \
+    do { \
+        unsigned int __seq; \
+        do { \
+            while ((__seq = (shm)->seq) & 1) YieldProcessor(); \
+            MemoryBarrier();
+
+#define SHARED_READ_END( shm ) \
+            MemoryBarrier(); \
+        } while ((shm)->seq != __seq); \
+    } while (0)
+
 typedef LRESULT (*winproc_callback_t)( HWND hwnd, UINT msg, WPARAM wp, LPARAM lp,
                                        LRESULT *result, void *arg );
 
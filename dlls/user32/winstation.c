@@ -36,6 +36,8 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(winstation);
 
+static LONG shm_fast_path_count;
+
 
 /* callback for enumeration functions */
 struct enum_proc_lparam
@@ -460,11 +462,98 @@ BOOL WINAPI SetThreadDesktop( HDESK handle )
         thread_info->top_window = 0;
         thread_info->msg_window = 0;
         if (key_state_info) key_state_info->time = 0;
+        free_shared_memory();
     }
     return ret;
 }
 
 
+/* map the queue and desktop data that the server publishes for the current thread */
+static void map_shared_memory( struct user_thread_info *thread_info )
+{
+    HANDLE queue = 0, desktop = 0;
+    void *queue_ptr = NULL, *desktop_ptr = NULL;
+    SIZE_T size;
+
+    thread_info->shm_checked = TRUE;
+
+    SERVER_START_REQ( get_shared_memory )
+    {
+        if (!wine_server_call( req ))
+        {
+            queue   = wine_server_ptr_handle( reply->queue );
+            desktop = wine_server_ptr_handle( reply->desktop );
+        }
+    }
+    SERVER_END_REQ;
+
+    if (!queue || !desktop)
+    {
+        WARN( "shared memory not available, using server calls\n" );
+        if (queue) NtClose( queue );
+        if (desktop) NtClose( desktop );
+        return;
+    }
+
+    size = 0;
+    if (!NtMapViewOfSection( queue, GetCurrentProcess(), &queue_ptr, 0, 0, NULL,
+                             &size, ViewShare, 0, PAGE_READONLY ))
+    {
+        size = 0;
+        if (!NtMapViewOfSection( desktop, GetCurrentProcess(), &desktop_ptr, 0, 0, NULL,
+                                 &size, ViewShare, 0, PAGE_READONLY ))
+        {
+            thread_info->queue_shm   = queue_ptr;
+            thread_info->desktop_shm = desktop_ptr;
+        }
+        else NtUnmapViewOfSection( GetCurrentProcess(), queue_ptr );
+    }
+    NtClose( queue );
+    NtClose( desktop );
+}
+
+
+/* get the queue data published by the server, or NULL if not available */
+queue_shm_t *get_queue_shm(void)
+{
+    struct user_thread_info *thread_info = get_user_thread_info();
+
+    if (!thread_info->shm_checked) map_shared_memory( thread_info );
+    return thread_info->queue_shm;
+}
+
+
+/* get the desktop data published by the server, or NULL if not available */
+desktop_shm_t *get_desktop_shm(void)
+{
+    struct user_thread_info *thread_info = get_user_thread_info();
+
+    if (!thread_info->shm_checked) map_shared_memory( thread_info );
+    return thread_info->desktop_shm;
+}
+
+
+/* unmap the shared data, it will be mapped again on the next access */
+void free_shared_memory(void)
+{
+    struct user_thread_info *thread_info = get_user_thread_info();
+
+    if (thread_info->queue_shm) NtUnmapViewOfSection( GetCurrentProcess(), (void *)thread_info->queue_shm );
+    if (thread_info->desktop_shm) NtUnmapViewOfSection( GetCurrentProcess(), (void *)thread_info->desktop_shm );
+    thread_info->queue_shm   = NULL;
+    thread_info->desktop_shm = NULL;
+    thread_info->shm_checked = FALSE;
+}
+
+
+/* account for a query answered from the shared memory without a server call */
+void shm_fast_path_hit( const char *func )
+{
+    LONG count = InterlockedIncrement( &shm_fast_path_count );
+    TRACE( "%s: %d calls answered from shared memory\n", func, count );
+}
+
+
 /******************************************************************************
  *              EnumDesktopsA   (USER32.@)
  */
@@ -827,6 +827,121 @@ static void test_poll_completion_port(void)
     CloseHandle(event);
 }
 
+/* Several polls pending at once, some of them on the same socket; an event on
+ * one socket should complete exactly the polls which wait for it. */
+static void test_poll_multiple(void)
+{
+    char buffers[3][offsetof(struct afd_poll_params, sockets[2])];
+    struct afd_poll_params *params[3];
+    struct sockaddr_in addrs[3];
+    IO_STATUS_BLOCK io[3];
+    HANDLE events[3];
+    SOCKET sockets[3], sender;
+    unsigned int i;
+    int ret, len;
+
+    sender = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(sender != INVALID_SOCKET, "failed to create socket, error %u\n", WSAGetLastError());
+
+    for (i = 0; i < ARRAY_SIZE(sockets); ++i)
+    {
+        sockets[i] = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        ok(sockets[i] != INVALID_SOCKET, "failed to create socket, error %u\n", WSAGetLastError());
+        memset(&addrs[i], 0, sizeof(addrs[i]));
+        addrs[i].sin_family = AF_INET;
+        addrs[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ret = bind(sockets[i], (struct sockaddr *)&addrs[i], sizeof(addrs[i]));
+        ok(!ret, "got error %u\n", WSAGetLastError());
+        len = sizeof(addrs[i]);
+        ret = getsockname(sockets[i], (struct sockaddr *)&addrs[i], &len);
+        ok(!ret, "got error %u\n", WSAGetLastError());
+
+        events[i] = CreateEventW(NULL, TRUE, FALSE, NULL);
+        params[i] = (struct afd_poll_params *)buffers[i];
+        memset(buffers[i], 0, sizeof(buffers[i]));
+        params[i]->timeout = -1000 * 10000;
+    }
+
+    /* The first poll waits for sockets 0 and 1, the second for socket 1 and
+     * the third for socket 2. */
+    params[0]->count = 2;
+    params[0]->sockets[0].socket = sockets[0];
+    params[0]->sockets[0].flags = AFD_POLL_READ;
+    params[0]->sockets[1].socket = sockets[1];
+    params[0]->sockets[1].flags = AFD_POLL_READ;
+    params[1]->count = 1;
+    params[1]->sockets[0].socket = sockets[1];
+    params[1]->sockets[0].flags = AFD_POLL_READ;
+    params[2]->count = 1;
+    params[2]->sockets[0].socket = sockets[2];
+    params[2]->sockets[0].flags = AFD_POLL_READ;
+
+    for (i = 0; i < ARRAY_SIZE(params); ++i)
+    {
+        ret = NtDeviceIoControlFile((HANDLE)sockets[i], events[i], NULL, NULL, &io[i], IOCTL_AFD_POLL,
+                params[i], sizeof(buffers[i]), params[i], sizeof(buffers[i]));
+        ok(ret == STATUS_PENDING, "got %#x\n", ret);
+    }
+
+    ret = sendto(sender, "x", 1, 0, (struct sockaddr *)&addrs[1], sizeof(addrs[1]));
+    ok(ret == 1, "got %d, error %u\n", ret, WSAGetLastError());
+
+    for (i = 0; i < 2; ++i)
+    {
+        ret = WaitForSingleObject(events[i], 1000);
+        ok(!ret, "poll %u: got %#x\n", i, ret);
+        ok(!io[i].Status, "poll %u: got %#x\n", i, io[i].Status);
+        ok(io[i].Information == offsetof(struct afd_poll_params, sockets[1]),
+                "poll %u: got %#Ix\n", i, io[i].Information);
+        ok(params[i]->count == 1, "poll %u: got count %u\n", i, params[i]->count);
+        ok(params[i]->sockets[0].socket == sockets[1], "poll %u: got socket %#Ix\n", i, params[i]->sockets[0].socket);
+        ok(params[i]->sockets[0].flags == AFD_POLL_READ, "poll %u: got flags %#x\n", i, params[i]->sockets[0].flags);
+        ok(!params[i]->sockets[0].status, "poll %u: got status %#x\n", i, params[i]->sockets[0].status);
+    }
+
+    ret = WaitForSingleObject(events[2], 100);
+    ok(ret == WAIT_TIMEOUT, "got %#x\n", ret);
+
+    /* Closing a socket only completes the polls which wait for it. */
+
+    ResetEvent(events[0]);
+    params[0]->count = 1;
+    params[0]->sockets[0].socket = sockets[0];
+    params[0]->sockets[0].flags = AFD_POLL_READ;
+    ret = NtDeviceIoControlFile((HANDLE)sockets[1], events[0], NULL, NULL, &io[0], IOCTL_AFD_POLL,
+            params[0], sizeof(buffers[0]), params[0], sizeof(buffers[0]));
+    ok(ret == STATUS_PENDING, "got %#x\n", ret);
+
+    closesocket(sockets[0]);
+
+    ret = WaitForSingleObject(events[0], 1000);
+    ok(!ret, "got %#x\n", ret);
+    ok(!io[0].Status, "got %#x\n", io[0].Status);
+    ok(params[0]->count == 1, "got count %u\n", params[0]->count);
+    ok(params[0]->sockets[0].socket == sockets[0], "got socket %#Ix\n", params[0]->sockets[0].socket);
+    ok(params[0]->sockets[0].flags == AFD_POLL_CLOSE, "got flags %#x\n", params[0]->sockets[0].flags);
+
+    ret = WaitForSingleObject(events[2], 100);
+    ok(ret == WAIT_TIMEOUT, "got %#x\n", ret);
+
+    ret = sendto(sender, "x", 1, 0, (struct sockaddr *)&addrs[2], sizeof(addrs[2]));
+    ok(ret == 1, "got %d, error %u\n", ret, WSAGetLastError());
+
+    ret = WaitForSingleObject(events[2], 1000);
+    ok(!ret, "got %#x\n", ret);
+    ok(!io[2].Status, "got %#x\n", io[2].Status);
+    ok(params[2]->count == 1, "got count %u\n", params[2]->count);
+    ok(params[2]->sockets[0].socket == sockets[2], "got socket %#Ix\n", params[2]->sockets[0].socket);
+    ok(params[2]->sockets[0].flags == AFD_POLL_READ, "got flags %#x\n", params[2]->sockets[0].flags);
+
+    for (i = 0; i < ARRAY_SIZE(sockets); ++i)
+    {
+        if (i) closesocket(sockets[i]);
+        CloseHandle(events[i]);
+    }
+    closesocket(sender);
+}
+
 static void test_recv(void)
 {
     const struct sockaddr_in bind_addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
@@ -1752,6 +1867,7 @@ START_TEST(afd)
     test_open_device();
     test_poll();
     test_poll_completion_port();
+    test_poll_multiple();
     test_recv();
     test_event_select();
     test_get_events();
@@ -11454,10 +11454,183 @@ static void test_set_only_options(void)
     }
 }
 
+#define ECHO_CONNECTIONS 8
+#define ECHO_ROUNDS      10
+#define ECHO_SIZE        512
+
+struct echo_conn
+{
+    SOCKET client, server;
+    OVERLAPPED client_recv, client_send, server_recv, server_send;
+    char client_buf[ECHO_SIZE], server_buf[ECHO_SIZE], send_buf[ECHO_SIZE];
+    DWORD echoed, rounds;
+};
+
+static BOOL echo_post_recv(SOCKET s, OVERLAPPED *ovl, char *buf)
+{
+    DWORD flags = 0;
+    WSABUF wsabuf;
+    int ret;
+
+    wsabuf.buf = buf;
+    wsabuf.len = ECHO_SIZE;
+    memset(ovl, 0, sizeof(*ovl));
+    ret = WSARecv(s, &wsabuf, 1, NULL, &flags, ovl, NULL);
+    ok(!ret || WSAGetLastError() == ERROR_IO_PENDING, "WSARecv failed, error %u\n", WSAGetLastError());
+    return !ret || WSAGetLastError() == ERROR_IO_PENDING;
+}
+
+static BOOL echo_post_send(SOCKET s, OVERLAPPED *ovl, char *buf, DWORD len)
+{
+    WSABUF wsabuf;
+    int ret;
+
+    wsabuf.buf = buf;
+    wsabuf.len = len;
+    memset(ovl, 0, sizeof(*ovl));
+    ret = WSASend(s, &wsabuf, 1, NULL, 0, ovl, NULL);
+    ok(!ret || WSAGetLastError() == ERROR_IO_PENDING, "WSASend failed, error %u\n", WSAGetLastError());
+    return !ret || WSAGetLastError() == ERROR_IO_PENDING;
+}
+
+static void echo_fill(struct echo_conn *conn, DWORD index)
+{
+    DWORD i;
+
+    for (i = 0; i < ECHO_SIZE; i++) conn->send_buf[i] = (index + conn->rounds * ECHO_SIZE + i) % 251;
+}
+
+/* every connection sends a message and waits for the server side to echo it
+ * back, all the sockets being driven by a single completion port */
+static void test_iocp_echo(void)
+{
+    DWORD i, size, index, done = 0, mismatch = 0;
+    struct echo_conn *conns, *conn;
+    OVERLAPPED *ovl;
+    ULONG_PTR key;
+    HANDLE port;
+    BOOL ret;
+
+    conns = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, ECHO_CONNECTIONS * sizeof(*conns));
+    port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+    ok(port != NULL, "failed to create port, error %u\n", GetLastError());
+
+    for (i = 0; i < ECHO_CONNECTIONS; i++)
+    {
+        conn = &conns[i];
+        tcp_socketpair(&conn->client, &conn->server);
+        CreateIoCompletionPort((HANDLE)conn->client, port, i * 2, 0);
+        CreateIoCompletionPort((HANDLE)conn->server, port, i * 2 + 1, 0);
+    }
+
+    for (i = 0; i < ECHO_CONNECTIONS; i++)
+    {
+        conn = &conns[i];
+        echo_post_recv(conn->server, &conn->server_recv, conn->server_buf);
+        echo_post_recv(conn->client, &conn->client_recv, conn->client_buf);
+        echo_fill(conn, i);
+        echo_post_send(conn->client, &conn->client_send, conn->send_buf, ECHO_SIZE);
+    }
+
+    while (done < ECHO_CONNECTIONS)
+    {
+        ret = GetQueuedCompletionStatus(port, &size, &key, &ovl, 10000);
+        ok(ret, "failed to get completion, error %u\n", GetLastError());
+        if (!ret) break;
+        index = key / 2;
+        conn = &conns[index];
+
+        if (ovl == &conn->server_recv)
+        {
+            /* echo what was received, and receive again once it's sent */
+            ok(size, "connection %u: got empty receive\n", index);
+            if (!size) break;
+            echo_post_send(conn->server, &conn->server_send, conn->server_buf, size);
+        }
+        else if (ovl == &conn->server_send)
+        {
+            echo_post_recv(conn->server, &conn->server_recv, conn->server_buf);
+        }
+        else if (ovl == &conn->client_recv)
+        {
+            ok(size && conn->echoed + size <= ECHO_SIZE, "connection %u: got %u bytes\n", index, size);
+            if (!size || conn->echoed + size > ECHO_SIZE) break;
+            if (memcmp(conn->client_buf, conn->send_buf + conn->echoed, size)) mismatch++;
+            conn->echoed += size;
+            if (conn->echoed == ECHO_SIZE)
+            {
+                conn->echoed = 0;
+                if (++conn->rounds == ECHO_ROUNDS)
+                {
+                    done++;
+                    continue;
+                }
+                echo_fill(conn, index);
+                echo_post_send(conn->client, &conn->client_send, conn->send_buf, ECHO_SIZE);
+            }
+            echo_post_recv(conn->client, &conn->client_recv, conn->client_buf);
+        }
+        else ok(ovl == &conn->client_send, "connection %u: got unexpected overlapped %p\n", index, ovl);
+    }
+    ok(done == ECHO_CONNECTIONS, "%u connections finished\n", done);
+    ok(!mismatch, "%u echoed messages don't match\n", mismatch);
+
+    /* a pending receive can be cancelled */
+    conn = &conns[0];
+    ret = CancelIoEx((HANDLE)conn->server, &conn->server_recv);
+    ok(ret, "CancelIoEx failed, error %u\n", GetLastError());
+    ret = GetQueuedCompletionStatus(port, &size, &key, &ovl, 1000);
+    ok(!ret && GetLastError() == ERROR_OPERATION_ABORTED, "got %d, error %u\n", ret, GetLastError());
+    ok(ovl == &conn->server_recv, "got overlapped %p\n", ovl);
+    ok(!size, "got size %u\n", size);
+
+    /* the other receives still pending on the server side are aborted by closing the sockets */
+    for (i = 0; i < ECHO_CONNECTIONS; i++)
+    {
+        closesocket(conns[i].client);
+        closesocket(conns[i].server);
+    }
+    while (GetQueuedCompletionStatus(port, &size, &key, &ovl, 1000) || ovl)
+        ;
+
+    CloseHandle(port);
+    HeapFree(GetProcessHeap(), 0, conns);
+}
+
+/* run the echo test again in a child process, which completes the pending
+ * I/O in its own epoll reactor on Wine */
+static void test_iocp_echo_reactor(void)
+{
+    STARTUPINFOA si = { sizeof(si) };
+    PROCESS_INFORMATION pi;
+    char cmdline[MAX_PATH + 32], **argv;
+    BOOL ret;
+
+    winetest_get_mainargs(&argv);
+    sprintf(cmdline, "\"%s\" sock echo_reactor", argv[0]);
+    SetEnvironmentVariableA("WINESOCKREACTOR", "1");
+    ret = CreateProcessA(argv[0], cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi);
+    SetEnvironmentVariableA("WINESOCKREACTOR", NULL);
+    ok(ret, "CreateProcess failed, error %u\n", GetLastError());
+    if (!ret) return;
+    wait_child_process(pi.hProcess);
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+}
+
 START_TEST( sock )
 {
+    char **argv;
     int i;
 
+    if (winetest_get_mainargs(&argv) > 2 && !strcmp(argv[2], "echo_reactor"))
+    {
+        Init();
+        test_iocp_echo();
+        Exit();
+        return;
+    }
+
 /* Leave these tests at the beginning. They depend on WSAStartup not having been
  * called, which is done by Init() below. */
     test_WithoutWSAStartup();
@@ -11525,6 +11698,8 @@ START_TEST( sock )
     test_nonblocking_async_recv();
     test_empty_recv();
     test_timeout();
+    test_iocp_echo();
+    test_iocp_echo_reactor();
 
     /* this is an io heavy test, do it at the end so the kernel doesn't start dropping packets */
     test_send();
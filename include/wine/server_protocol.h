@@ -256,6 +256,18 @@ typedef struct
 
 
 
+typedef struct
+{
+    obj_handle_t    handle;
+    obj_handle_t    event;
+    apc_param_t     cvalue;
+    apc_param_t     information;
+    unsigned int    status;
+    int             __pad;
+} io_notify_t;
+
+
+
 struct hw_msg_source
 {
     unsigned int    device;
@@ -819,6 +831,74 @@ typedef struct
 
 
 
+typedef volatile struct
+{
+    unsigned int         seq;
+    int                  cursor_x;
+    int                  cursor_y;
+    unsigned int         cursor_last_change;
+    rectangle_t          cursor_clip;
+    user_handle_t        foreground;
+} desktop_shm_t;
+
+typedef volatile struct
+{
+    unsigned int         seq;
+    unsigned int         wake_bits;
+    unsigned int         changed_bits;
+} queue_shm_t;
+
+
+
+
+enum fsync_type
+{
+    FSYNC_NONE,
+    FSYNC_AUTO_EVENT,
+    FSYNC_MANUAL_EVENT,
+    FSYNC_SEMAPHORE,
+    FSYNC_MUTEX,
+    FSYNC_OWNER_LIST
+};
+
+typedef volatile struct
+{
+    int                  type;
+    int                  state;
+    int                  count;
+    int                  abandoned;
+    int                  server_waiters;
+    unsigned int         next;
+    unsigned int         prev;
+    int                  __pad;
+} fsync_slot_t;
+
+
+
+
+#define HANDLE_SHM_IN_USE   0x01
+#define HANDLE_SHM_INHERIT  0x02
+#define HANDLE_SHM_PROTECT  0x04
+#define HANDLE_SHM_NO_FD    0x08
+
+typedef volatile struct
+{
+    unsigned int         access;
+    unsigned short       type;
+    unsigned short       flags;
+} handle_shm_t;
+
+typedef volatile struct
+{
+    unsigned int         count;
+    unsigned int         __pad;
+    handle_shm_t         entries[1];
+} handle_table_shm_t;
+
+
+
+
+
 struct new_process_request
 {
     struct request_header __header;
@@ -926,6 +1006,8 @@ struct init_first_thread_request
     int          debug_level;
     int          reply_fd;
     int          wait_fd;
+    char         nice_limit;
+    char __pad_33[7];
 };
 struct init_first_thread_reply
 {
@@ -1204,6 +1286,24 @@ struct get_apc_result_reply
 
 
 
+
+
+struct batch_request
+{
+    struct request_header __header;
+    /* VARARG(requests,bytes); */
+    char __pad_12[4];
+};
+struct batch_reply
+{
+    struct reply_header __header;
+    unsigned int count;
+    /* VARARG(replies,bytes); */
+    char __pad_12[4];
+};
+
+
+
 struct close_handle_request
 {
     struct request_header __header;
@@ -1252,6 +1352,20 @@ struct dup_handle_reply
 
 
 
+struct get_handle_shm_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_handle_shm_reply
+{
+    struct reply_header __header;
+    obj_handle_t handle;
+    unsigned int count;
+};
+
+
+
 struct make_temporary_request
 {
     struct request_header __header;
@@ -1521,6 +1635,58 @@ struct query_semaphore_reply
 };
 
 
+struct get_fsync_shm_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_fsync_shm_reply
+{
+    struct reply_header __header;
+    obj_handle_t handle;
+    unsigned int count;
+};
+
+
+struct get_fsync_slot_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+};
+struct get_fsync_slot_reply
+{
+    struct reply_header __header;
+    unsigned int slot;
+    int          type;
+    unsigned int access;
+    char __pad_20[4];
+};
+
+
+struct get_fsync_owner_list_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_fsync_owner_list_reply
+{
+    struct reply_header __header;
+    unsigned int slot;
+    char __pad_12[4];
+};
+
+
+struct fsync_wake_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+};
+struct fsync_wake_reply
+{
+    struct reply_header __header;
+};
+
+
 struct open_semaphore_request
 {
     struct request_header __header;
@@ -2622,6 +2788,20 @@ struct get_queue_status_reply
 
 
 
+struct get_shared_memory_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_shared_memory_reply
+{
+    struct reply_header __header;
+    obj_handle_t queue;
+    obj_handle_t desktop;
+};
+
+
+
 struct get_process_idle_event_request
 {
     struct request_header __header;
@@ -2702,6 +2882,7 @@ struct send_hardware_message_reply
     char __pad_28[4];
 };
 #define SEND_HWMSG_INJECTED    0x01
+#define SEND_HWMSG_RAWINPUT    0x02
 
 
 
@@ -2727,9 +2908,9 @@ struct get_message_reply
     int             x;
     int             y;
     unsigned int    time;
-    unsigned int    active_hooks;
     data_size_t     total;
     /* VARARG(data,message_data); */
+    char __pad_52[4];
 };
 
 
@@ -3839,6 +4020,8 @@ struct set_foreground_window_request
 {
     struct request_header __header;
     user_handle_t  handle;
+    unsigned int   time;
+    char __pad_20[4];
 };
 struct set_foreground_window_reply
 {
@@ -3867,6 +4050,8 @@ struct set_active_window_request
 {
     struct request_header __header;
     user_handle_t  handle;
+    unsigned int   internal_msg;
+    char __pad_20[4];
 };
 struct set_active_window_reply
 {
@@ -3946,6 +4131,20 @@ enum caret_state
 
 
 
+struct get_active_hooks_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_active_hooks_reply
+{
+    struct reply_header __header;
+    unsigned int   active_hooks;
+    char __pad_12[4];
+};
+
+
+
 struct set_hook_request
 {
     struct request_header __header;
@@ -5004,6 +5203,28 @@ struct remove_completion_reply
 };
 
 
+struct completion_packet
+{
+    apc_param_t   ckey;
+    apc_param_t   cvalue;
+    apc_param_t   information;
+    unsigned int  status;
+    int           __pad;
+};
+
+
+struct remove_completions_request
+{
+    struct request_header __header;
+    obj_handle_t  handle;
+};
+struct remove_completions_reply
+{
+    struct reply_header __header;
+    /* VARARG(packets,completion_packets); */
+};
+
+
 
 struct query_completion_request
 {
@@ -5050,6 +5271,32 @@ struct add_fd_completion_reply
 
 
 
+struct set_io_notify_fd_request
+{
+    struct request_header __header;
+    int            fd;
+};
+struct set_io_notify_fd_reply
+{
+    struct reply_header __header;
+};
+
+
+
+struct set_fd_signaled_request
+{
+    struct request_header __header;
+    obj_handle_t   handle;
+    int            signaled;
+    char __pad_20[4];
+};
+struct set_fd_signaled_reply
+{
+    struct reply_header __header;
+};
+
+
+
 struct set_fd_completion_mode_request
 {
     struct request_header __header;
@@ -5177,7 +5424,7 @@ struct set_cursor_request
     int            y;
     rectangle_t    clip;
     unsigned int   clip_msg;
-    char __pad_52[4];
+    unsigned int   change_msg;
 };
 struct set_cursor_reply
 {
@@ -5435,9 +5682,11 @@ enum request
     REQ_resume_thread,
     REQ_queue_apc,
     REQ_get_apc_result,
+    REQ_batch,
     REQ_close_handle,
     REQ_set_handle_info,
     REQ_dup_handle,
+    REQ_get_handle_shm,
     REQ_make_temporary,
     REQ_open_process,
     REQ_open_thread,
@@ -5455,6 +5704,10 @@ enum request
     REQ_create_semaphore,
     REQ_release_semaphore,
     REQ_query_semaphore,
+    REQ_get_fsync_shm,
+    REQ_get_fsync_slot,
+    REQ_get_fsync_owner_list,
+    REQ_fsync_wake,
     REQ_open_semaphore,
     REQ_create_file,
     REQ_open_file_object,
@@ -5521,6 +5774,7 @@ enum request
     REQ_set_queue_fd,
     REQ_set_queue_mask,
     REQ_get_queue_status,
+    REQ_get_shared_memory,
     REQ_get_process_idle_event,
     REQ_send_message,
     REQ_post_quit_message,
@@ -5597,6 +5851,7 @@ enum request
     REQ_set_capture_window,
     REQ_set_caret_window,
     REQ_set_caret_info,
+    REQ_get_active_hooks,
     REQ_set_hook,
     REQ_remove_hook,
     REQ_start_hook_chain,
@@ -5661,9 +5916,12 @@ enum request
     REQ_open_completion,
     REQ_add_completion,
     REQ_remove_completion,
+    REQ_remove_completions,
     REQ_query_completion,
     REQ_set_completion_info,
     REQ_add_fd_completion,
+    REQ_set_io_notify_fd,
+    REQ_set_fd_signaled,
     REQ_set_fd_completion_mode,
     REQ_set_fd_disp_info,
     REQ_set_fd_name_info,
@@ -5691,6 +5949,22 @@ enum request
     REQ_NB_REQUESTS
 };
 
+static inline int is_batch_allowed( enum request req )
+{
+    switch (req)
+    {
+    case REQ_init_first_thread:
+    case REQ_init_thread:
+    case REQ_terminate_process:
+    case REQ_terminate_thread:
+    case REQ_batch:
+    case REQ_select:
+        return 0;
+    default:
+        return req < REQ_NB_REQUESTS;
+    }
+}
+
 union generic_request
 {
     struct request_max_size max_size;
@@ -5716,9 +5990,11 @@ union generic_request
     struct resume_thread_request resume_thread_request;
     struct queue_apc_request queue_apc_request;
     struct get_apc_result_request get_apc_result_request;
+    struct batch_request batch_request;
     struct close_handle_request close_handle_request;
     struct set_handle_info_request set_handle_info_request;
     struct dup_handle_request dup_handle_request;
+    struct get_handle_shm_request get_handle_shm_request;
     struct make_temporary_request make_temporary_request;
     struct open_process_request open_process_request;
     struct open_thread_request open_thread_request;
@@ -5736,6 +6012,10 @@ union generic_request
     struct create_semaphore_request create_semaphore_request;
     struct release_semaphore_request release_semaphore_request;
     struct query_semaphore_request query_semaphore_request;
+    struct get_fsync_shm_request get_fsync_shm_request;
+    struct get_fsync_slot_request get_fsync_slot_request;
+    struct get_fsync_owner_list_request get_fsync_owner_list_request;
+    struct fsync_wake_request fsync_wake_request;
     struct open_semaphore_request open_semaphore_request;
     struct create_file_request create_file_request;
     struct open_file_object_request open_file_object_request;
@@ -5802,6 +6082,7 @@ union generic_request
     struct set_queue_fd_request set_queue_fd_request;
     struct set_queue_mask_request set_queue_mask_request;
     struct get_queue_status_request get_queue_status_request;
+    struct get_shared_memory_request get_shared_memory_request;
     struct get_process_idle_event_request get_process_idle_event_request;
     struct send_message_request send_message_request;
     struct post_quit_message_request post_quit_message_request;
@@ -5878,6 +6159,7 @@ union generic_request
     struct set_capture_window_request set_capture_window_request;
     struct set_caret_window_request set_caret_window_request;
     struct set_caret_info_request set_caret_info_request;
+    struct get_active_hooks_request get_active_hooks_request;
     struct set_hook_request set_hook_request;
     struct remove_hook_request remove_hook_request;
     struct start_hook_chain_request start_hook_chain_request;
@@ -5942,9 +6224,12 @@ union generic_request
     struct open_completion_request open_completion_request;
     struct add_completion_request add_completion_request;
     struct remove_completion_request remove_completion_request;
+    struct remove_completions_request remove_completions_request;
     struct query_completion_request query_completion_request;
     struct set_completion_info_request set_completion_info_request;
     struct add_fd_completion_request add_fd_completion_request;
+    struct set_io_notify_fd_request set_io_notify_fd_request;
+    struct set_fd_signaled_request set_fd_signaled_request;
     struct set_fd_completion_mode_request set_fd_completion_mode_request;
     struct set_fd_disp_info_request set_fd_disp_info_request;
     struct set_fd_name_info_request set_fd_name_info_request;
@@ -5995,9 +6280,11 @@ union generic_reply
     struct resume_thread_reply resume_thread_reply;
     struct queue_apc_reply queue_apc_reply;
     struct get_apc_result_reply get_apc_result_reply;
+    struct batch_reply batch_reply;
     struct close_handle_reply close_handle_reply;
     struct set_handle_info_reply set_handle_info_reply;
     struct dup_handle_reply dup_handle_reply;
+    struct get_handle_shm_reply get_handle_shm_reply;
     struct make_temporary_reply make_temporary_reply;
     struct open_process_reply open_process_reply;
     struct open_thread_reply open_thread_reply;
@@ -6015,6 +6302,10 @@ union generic_reply
     struct create_semaphore_reply create_semaphore_reply;
     struct release_semaphore_reply release_semaphore_reply;
     struct query_semaphore_reply query_semaphore_reply;
+    struct get_fsync_shm_reply get_fsync_shm_reply;
+    struct get_fsync_slot_reply get_fsync_slot_reply;
+    struct get_fsync_owner_list_reply get_fsync_owner_list_reply;
+    struct fsync_wake_reply fsync_wake_reply;
     struct open_semaphore_reply open_semaphore_reply;
     struct create_file_reply create_file_reply;
     struct open_file_object_reply open_file_object_reply;
@@ -6081,6 +6372,7 @@ union generic_reply
     struct set_queue_fd_reply set_queue_fd_reply;
     struct set_queue_mask_reply set_queue_mask_reply;
     struct get_queue_status_reply get_queue_status_reply;
+    struct get_shared_memory_reply get_shared_memory_reply;
     struct get_process_idle_event_reply get_process_idle_event_reply;
     struct send_message_reply send_message_reply;
     struct post_quit_message_reply post_quit_message_reply;
@@ -6157,6 +6449,7 @@ union generic_reply
     struct set_capture_window_reply set_capture_window_reply;
     struct set_caret_window_reply set_caret_window_reply;
     struct set_caret_info_reply set_caret_info_reply;
+    struct get_active_hooks_reply get_active_hooks_reply;
     struct set_hook_reply set_hook_reply;
     struct remove_hook_reply remove_hook_reply;
     struct start_hook_chain_reply start_hook_chain_reply;
@@ -6221,9 +6514,12 @@ union generic_reply
     struct open_completion_reply open_completion_reply;
     struct add_completion_reply add_completion_reply;
     struct remove_completion_reply remove_completion_reply;
+    struct remove_completions_reply remove_completions_reply;
     struct query_completion_reply query_completion_reply;
     struct set_completion_info_reply set_completion_info_reply;
     struct add_fd_completion_reply add_fd_completion_reply;
+    struct set_io_notify_fd_reply set_io_notify_fd_reply;
+    struct set_fd_signaled_reply set_fd_signaled_reply;
     struct set_fd_completion_mode_reply set_fd_completion_mode_reply;
     struct set_fd_disp_info_reply set_fd_disp_info_reply;
     struct set_fd_name_info_reply set_fd_name_info_reply;
@@ -6252,7 +6548,7 @@ union generic_reply
 
 /* ### protocol_version begin ### */
 
-#define SERVER_PROTOCOL_VERSION 726
+#define SERVER_PROTOCOL_VERSION 735
 
 /* ### protocol_version end ### */
 
@@ -101,6 +101,32 @@ struct comp_msg
     unsigned int  status;
 };
 
+/* messages are recycled through a free list, to avoid a heap allocation for each completion */
+#define MAX_FREE_MSGS 4096
+static struct list free_msgs = LIST_INIT( free_msgs );
+static unsigned int free_msg_count;
+
+static struct comp_msg *alloc_comp_msg(void)
+{
+    struct list *ptr = list_head( &free_msgs );
+
+    if (!ptr) return mem_alloc( sizeof(struct comp_msg) );
+    list_remove( ptr );
+    free_msg_count--;
+    return LIST_ENTRY( ptr, struct comp_msg, queue_entry );
+}
+
+static void free_comp_msg( struct comp_msg *msg )
+{
+    if (free_msg_count >= MAX_FREE_MSGS)
+    {
+        free( msg );
+        return;
+    }
+    list_add_head( &free_msgs, &msg->queue_entry );
+    free_msg_count++;
+}
+
 static void completion_destroy( struct object *obj)
 {
     struct completion *completion = (struct completion *) obj;
@@ -108,7 +134,8 @@ static void completion_destroy( struct object *obj)
 
     LIST_FOR_EACH_ENTRY_SAFE( tmp, next, &completion->queue, struct comp_msg, queue_entry )
     {
-        free( tmp );
+        list_remove( &tmp->queue_entry );
+        free_comp_msg( tmp );
     }
 }
 
@@ -153,7 +180,7 @@ struct completion *get_completion_obj( struct process *process, obj_handle_t han
 void add_completion( struct completion *completion, apc_param_t ckey, apc_param_t cvalue,
                      unsigned int status, apc_param_t information )
 {
-    struct comp_msg *msg = mem_alloc( sizeof( *msg ) );
+    struct comp_msg *msg = alloc_comp_msg();
 
     if (!msg)
         return;
@@ -231,7 +258,41 @@ DECL_HANDLER(remove_completion)
         reply->cvalue = msg->cvalue;
         reply->status = msg->status;
         reply->information = msg->information;
-        free( msg );
+        free_comp_msg( msg );
+    }
+
+    release_object( completion );
+}
+
+/* get several completions from completion port */
+DECL_HANDLER(remove_completions)
+{
+    struct completion* completion = get_completion_obj( current->process, req->handle, IO_COMPLETION_MODIFY_STATE );
+    struct completion_packet *packets;
+    struct comp_msg *msg;
+    data_size_t i, count;
+
+    if (!completion) return;
+
+    count = min( get_reply_max_size() / sizeof(*packets), completion->depth );
+    if (get_reply_max_size() < sizeof(*packets))
+        set_error( STATUS_INVALID_PARAMETER );
+    else if (!count)
+        set_error( STATUS_PENDING );
+    else if ((packets = set_reply_data_size( count * sizeof(*packets) )))
+    {
+        for (i = 0; i < count; i++)
+        {
+            msg = LIST_ENTRY( list_head( &completion->queue ), struct comp_msg, queue_entry );
+            list_remove( &msg->queue_entry );
+            packets[i].ckey        = msg->ckey;
+            packets[i].cvalue      = msg->cvalue;
+            packets[i].information = msg->information;
+            packets[i].status      = msg->status;
+            packets[i].__pad       = 0;
+            free_comp_msg( msg );
+        }
+        completion->depth -= count;
     }
 
     release_object( completion );
@@ -184,7 +184,15 @@ static struct object_type *create_object_type( struct object *root, unsigned int
 
 static void directory_dump( struct object *obj, int verbose )
 {
-    fputs( "Directory\n", stderr );
+    struct directory *dir = (struct directory *)obj;
+
+    fputs( "Directory", stderr );
+    if (verbose && dir->entries)
+    {
+        fputc( ' ', stderr );
+        dump_namespace( dir->entries );
+    }
+    fputc( '\n', stderr );
 }
 
 static struct object *directory_lookup_name( struct object *obj, struct unicode_str *name,
@@ -246,7 +254,7 @@ static void directory_destroy( struct object *obj )
 {
     struct directory *dir = (struct directory *)obj;
     assert( obj->ops == &directory_ops );
-    free( dir->entries );
+    free_namespace( dir->entries );
 }
 
 static struct directory *create_directory( struct object *root, const struct unicode_str *name,
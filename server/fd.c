@@ -374,14 +374,25 @@ static file_pos_t max_unix_offset = OFF_T_MAX;
 
 struct timeout_user
 {
-    struct list           entry;      /* entry in sorted timeout list */
+    struct list           entry;      /* entry in expired timeouts list */
+    unsigned int          index;      /* index in the timeout heap, or -1 once expired */
+    unsigned int          seq;        /* insertion order, to break ties */
     abstime_t             when;       /* timeout expiry */
     timeout_callback      callback;   /* callback function */
     void                 *private;    /* callback private data */
 };
 
-static struct list abs_timeout_list = LIST_INIT(abs_timeout_list); /* sorted absolute timeouts list */
-static struct list rel_timeout_list = LIST_INIT(rel_timeout_list); /* sorted relative timeouts list */
+/* binary min-heap of timeouts, ordered by expiry time */
+struct timeout_heap
+{
+    struct timeout_user **users;      /* heap array */
+    unsigned int          count;      /* number of timeouts in the heap */
+    unsigned int          size;       /* allocated size of the array */
+};
+
+static struct timeout_heap abs_timeouts;  /* absolute timeouts heap */
+static struct timeout_heap rel_timeouts;  /* relative timeouts heap */
+static unsigned int timeout_seq;
 timeout_t current_time;
 timeout_t monotonic_time;
 
@@ -478,43 +489,98 @@ void set_current_time(void)
     if (user_shared_data) set_user_shared_data_time();
 }
 
+/* check whether a timeout expires before another one; relative timeouts are stored negated,
+ * and timeouts that expire at the same time are run in order of insertion */
+static inline int timeout_before( const struct timeout_user *a, const struct timeout_user *b )
+{
+    abstime_t a_when = a->when > 0 ? a->when : -a->when;
+    abstime_t b_when = b->when > 0 ? b->when : -b->when;
+
+    if (a_when != b_when) return a_when < b_when;
+    return (int)(a->seq - b->seq) < 0;
+}
+
+static inline void set_heap_entry( struct timeout_heap *heap, unsigned int index, struct timeout_user *user )
+{
+    heap->users[index] = user;
+    user->index = index;
+}
+
+/* move a timeout up or down the heap until it's at the right place */
+static void sift_timeout( struct timeout_heap *heap, unsigned int index )
+{
+    struct timeout_user *user = heap->users[index];
+    unsigned int parent, child;
+
+    while (index && timeout_before( user, heap->users[parent = (index - 1) / 2] ))
+    {
+        set_heap_entry( heap, index, heap->users[parent] );
+        index = parent;
+    }
+    while ((child = 2 * index + 1) < heap->count)
+    {
+        if (child + 1 < heap->count && timeout_before( heap->users[child + 1], heap->users[child] )) child++;
+        if (!timeout_before( heap->users[child], user )) break;
+        set_heap_entry( heap, index, heap->users[child] );
+        index = child;
+    }
+    set_heap_entry( heap, index, user );
+}
+
+static int insert_timeout( struct timeout_heap *heap, struct timeout_user *user )
+{
+    if (heap->count == heap->size)
+    {
+        unsigned int new_size = max( 64, heap->size * 2 );
+        struct timeout_user **new_users;
+
+        if (!(new_users = realloc( heap->users, new_size * sizeof(*new_users) )))
+        {
+            set_error( STATUS_NO_MEMORY );
+            return 0;
+        }
+        heap->users = new_users;
+        heap->size  = new_size;
+    }
+    set_heap_entry( heap, heap->count++, user );
+    sift_timeout( heap, user->index );
+    return 1;
+}
+
+static void remove_heap_timeout( struct timeout_heap *heap, struct timeout_user *user )
+{
+    unsigned int index = user->index;
+
+    user->index = -1;
+    if (index == --heap->count) return;
+    set_heap_entry( heap, index, heap->users[heap->count] );
+    sift_timeout( heap, index );
+}
+
 /* add a timeout user */
 struct timeout_user *add_timeout_user( timeout_t when, timeout_callback func, void *private )
 {
     struct timeout_user *user;
-    struct list *ptr;
 
     if (!(user = mem_alloc( sizeof(*user) ))) return NULL;
     user->when     = timeout_to_abstime( when );
+    user->seq      = timeout_seq++;
     user->callback = func;
     user->private  = private;
 
-    /* Now insert it in the linked list */
-
-    if (user->when > 0)
-    {
-        LIST_FOR_EACH( ptr, &abs_timeout_list )
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            if (timeout->when >= user->when) break;
-        }
-    }
-    else
+    if (!insert_timeout( user->when > 0 ? &abs_timeouts : &rel_timeouts, user ))
     {
-        LIST_FOR_EACH( ptr, &rel_timeout_list )
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            if (timeout->when <= user->when) break;
-        }
+        free( user );
+        return NULL;
     }
-    list_add_before( ptr, &user->entry );
     return user;
 }
 
 /* remove a timeout user */
 void remove_timeout_user( struct timeout_user *user )
 {
-    list_remove( &user->entry );
+    if (user->index != -1) remove_heap_timeout( user->when > 0 ? &abs_timeouts : &rel_timeouts, user );
+    else list_remove( &user->entry );  /* expired, waiting for its callback */
     free( user );
 }
 
@@ -959,31 +1025,31 @@ static int get_next_timeout(void)
 {
     int ret = user_shared_data ? user_shared_data_timeout : -1;
 
-    if (!list_empty( &abs_timeout_list ) || !list_empty( &rel_timeout_list ))
+    if (abs_timeouts.count || rel_timeouts.count)
     {
         struct list expired_list, *ptr;
 
-        /* first remove all expired timers from the list */
+        /* first remove all expired timers from the heaps */
 
         list_init( &expired_list );
-        while ((ptr = list_head( &abs_timeout_list )) != NULL)
+        while (abs_timeouts.count)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            struct timeout_user *timeout = abs_timeouts.users[0];
 
             if (timeout->when <= current_time)
             {
-                list_remove( &timeout->entry );
+                remove_heap_timeout( &abs_timeouts, timeout );
                 list_add_tail( &expired_list, &timeout->entry );
             }
             else break;
         }
-        while ((ptr = list_head( &rel_timeout_list )) != NULL)
+        while (rel_timeouts.count)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            struct timeout_user *timeout = rel_timeouts.users[0];
 
             if (-timeout->when <= monotonic_time)
             {
-                list_remove( &timeout->entry );
+                remove_heap_timeout( &rel_timeouts, timeout );
                 list_add_tail( &expired_list, &timeout->entry );
             }
             else break;
@@ -999,18 +1065,18 @@ static int get_next_timeout(void)
             free( timeout );
         }
 
-        if ((ptr = list_head( &abs_timeout_list )) != NULL)
+        if (abs_timeouts.count)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            struct timeout_user *timeout = abs_timeouts.users[0];
             timeout_t diff = (timeout->when - current_time + 9999) / 10000;
             if (diff > INT_MAX) diff = INT_MAX;
             else if (diff < 0) diff = 0;
             if (ret == -1 || diff < ret) ret = diff;
         }
 
-        if ((ptr = list_head( &rel_timeout_list )) != NULL)
+        if (rel_timeouts.count)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            struct timeout_user *timeout = rel_timeouts.users[0];
             timeout_t diff = (-timeout->when - monotonic_time + 9999) / 10000;
             if (diff > INT_MAX) diff = INT_MAX;
             else if (diff < 0) diff = 0;
@@ -2153,6 +2219,33 @@ void allow_fd_caching( struct fd *fd )
     fd->cacheable = 1;
 }
 
+/* attach a unix fd to a pseudo fd, or detach the current one if unix_fd is -1 */
+/* the fd can be cached by the clients while a unix fd is attached if cacheable is set */
+/* if the function fails the unix fd is closed */
+int set_pseudo_fd_unix_fd( struct fd *fd, int unix_fd, int cacheable )
+{
+    assert( !fd->inode );
+
+    if (fd->poll_index != -1)
+    {
+        remove_poll_user( fd, fd->poll_index );
+        fd->poll_index = -1;
+    }
+    if (fd->unix_fd != -1) close( fd->unix_fd );
+    fd->unix_fd = unix_fd;
+    fd->cacheable = 0;
+    if (unix_fd == -1) return 1;
+
+    if ((fd->poll_index = add_poll_user( fd )) == -1)
+    {
+        close( fd->unix_fd );
+        fd->unix_fd = -1;
+        return 0;
+    }
+    fd->cacheable = cacheable;
+    return 1;
+}
+
 /* check if fd is on a removable device */
 int is_fd_removable( struct fd *fd )
 {
@@ -2940,6 +3033,39 @@ DECL_HANDLER(add_fd_completion)
     }
 }
 
+/* apply an I/O completion that the client reported through its notification pipe */
+void fd_notify_io( struct process *process, const io_notify_t *notify )
+{
+    struct event *event;
+    struct fd *fd;
+
+    if (notify->event && (event = get_event_obj( process, notify->event, EVENT_MODIFY_STATE )))
+    {
+        set_event( event );
+        release_object( event );
+    }
+    if ((fd = get_handle_fd_obj( process, notify->handle, 0 )))
+    {
+        if (notify->cvalue && fd->completion)
+            add_completion( fd->completion, fd->comp_key, notify->cvalue, notify->status, notify->information );
+        if (!notify->event && is_fd_overlapped( fd )) set_fd_signaled( fd, 1 );
+        release_object( fd );
+    }
+}
+
+/* set the signaled state of an overlapped file around an I/O that the server doesn't know about */
+DECL_HANDLER(set_fd_signaled)
+{
+    struct fd *fd = get_handle_fd_obj( current->process, req->handle, 0 );
+
+    if (fd)
+    {
+        if (is_fd_overlapped( fd )) set_fd_signaled( fd, req->signaled );
+        else set_error( STATUS_INVALID_PARAMETER );
+        release_object( fd );
+    }
+}
+
 /* set fd completion information */
 DECL_HANDLER(set_fd_completion_mode)
 {
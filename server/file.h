@@ -99,6 +99,7 @@ extern void set_fd_events( struct fd *fd, int events );
 extern obj_handle_t lock_fd( struct fd *fd, file_pos_t offset, file_pos_t count, int shared, int wait );
 extern void unlock_fd( struct fd *fd, file_pos_t offset, file_pos_t count );
 extern void allow_fd_caching( struct fd *fd );
+extern int set_pseudo_fd_unix_fd( struct fd *fd, int unix_fd, int cacheable );
 extern void set_fd_signaled( struct fd *fd, int signaled );
 extern char *dup_fd_name( struct fd *root, const char *name );
 extern void get_nt_name( struct fd *fd, struct unicode_str *name );
@@ -190,6 +191,11 @@ extern struct object *create_user_data_mapping( struct object *root, const struc
                                                 unsigned int attr, const struct security_descriptor *sd );
 extern struct object *create_hypervisor_data_mapping( struct object *root, const struct unicode_str *name,
                                                       unsigned int attr, const struct security_descriptor *sd );
+extern struct object *create_shared_mapping( mem_size_t size, void **ptr );
+
+/* update an object published with create_shared_mapping, see desktop_shm_t */
+#define SHARED_WRITE_BEGIN( shm ) __atomic_add_fetch( &(shm)->seq, 1, __ATOMIC_SEQ_CST )
+#define SHARED_WRITE_END( shm )   __atomic_add_fetch( &(shm)->seq, 1, __ATOMIC_SEQ_CST )
 
 /* device functions */
 
@@ -239,6 +245,7 @@ extern int async_waiting( struct async_queue *queue );
 extern void async_terminate( struct async *async, unsigned int status );
 extern void async_wake_up( struct async_queue *queue, unsigned int status );
 extern struct completion *fd_get_completion( struct fd *fd, apc_param_t *p_key );
+extern void fd_notify_io( struct process *process, const io_notify_t *notify );
 extern void fd_copy_completion( struct fd *src, struct fd *dst );
 extern struct iosb *create_iosb( const void *in_data, data_size_t in_size, data_size_t out_size );
 extern struct iosb *async_get_iosb( struct async *async );
@@ -0,0 +1,371 @@
+/*
+ * Client-side synchronization objects support
+ *
+ * Copyright (C) 2021 Wine contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * When WINEFSYNC is set in the environment, the state of events, semaphores
+ * and mutexes is kept in an array of fsync_slot_t shared with all the
+ * clients, which signal and wait for them with atomic operations and
+ * futexes without calling the server. The server still creates, names
+ * and destroys the objects, and handles the waits that can't be done on
+ * the client side (alertable waits, wait-all, waits mixing other objects).
+ *
+ * Server-side waiters are counted in the slot; a client that changes the
+ * state of an object with server-side waiters sends a fsync_wake request
+ * so that the server checks its wait queue again.
+ *
+ * A mutex is owned by a thread id stored in its slot. Each thread that owns
+ * mutexes has a FSYNC_OWNER_LIST slot heading a list of them, linked through
+ * the next/prev fields of the slots. The list of a thread is only modified by
+ * the thread itself, or by the server while the thread is blocked in a server
+ * call or after it died, so that its mutexes can be abandoned without looking
+ * at every slot.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+#include <unistd.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "file.h"
+#include "handle.h"
+#include "thread.h"
+#include "request.h"
+
+#define FSYNC_SLOTS 65536  /* number of slots in the shared array */
+
+static int fsync_enabled = -1;
+static struct object *fsync_mapping;
+static fsync_slot_t *fsync_slots;
+static unsigned int *free_slots;      /* stack of freed slots */
+static unsigned int free_slot_count;
+static unsigned int next_slot = 1;    /* first never used slot, slot 0 is never allocated */
+static struct object **slot_objects;  /* object of each allocated slot */
+static int unlisted_owners;           /* a mutex owner couldn't get a list, abandon has to scan all slots */
+
+/* check if client-side synchronization objects are enabled */
+int do_fsync(void)
+{
+#ifdef __linux__
+    if (fsync_enabled == -1)
+    {
+        const char *env = getenv( "WINEFSYNC" );
+        fsync_enabled = env && atoi( env );
+        if (fsync_enabled && debug_level) fprintf( stderr, "wineserver: using fsync\n" );
+    }
+    return fsync_enabled;
+#else
+    return 0;
+#endif
+}
+
+/* create the shared slot array on first use */
+static int init_fsync_slots(void)
+{
+    void *ptr;
+
+    if (fsync_slots) return 1;
+    if (!(free_slots = mem_alloc( FSYNC_SLOTS * sizeof(*free_slots) ))) return 0;
+    if (!(slot_objects = mem_alloc( FSYNC_SLOTS * sizeof(*slot_objects) ))) goto failed;
+    if (!(fsync_mapping = create_shared_mapping( FSYNC_SLOTS * sizeof(fsync_slot_t), &ptr ))) goto failed;
+
+    make_object_permanent( fsync_mapping );
+    fsync_slots = ptr;
+    return 1;
+
+failed:
+    free( slot_objects );
+    free( free_slots );
+    slot_objects = NULL;
+    free_slots = NULL;
+    return 0;
+}
+
+/* allocate a slot for a new object, return 0 if the object can only be used through the server */
+unsigned int fsync_alloc_slot( enum fsync_type type, int state, int count, struct object *obj )
+{
+    unsigned int index;
+    fsync_slot_t *slot;
+
+    if (!do_fsync()) return 0;
+    if (!init_fsync_slots())
+    {
+        clear_error();
+        return 0;
+    }
+    if (free_slot_count) index = free_slots[--free_slot_count];
+    else if (next_slot < FSYNC_SLOTS) index = next_slot++;
+    else return 0;
+
+    slot = &fsync_slots[index];
+    slot->state = state;
+    slot->count = count;
+    slot->abandoned = 0;
+    slot->server_waiters = 0;
+    slot->next = slot->prev = 0;
+    slot_objects[index] = obj;
+    __atomic_store_n( &slot->type, type, __ATOMIC_SEQ_CST );
+    return index;
+}
+
+/* free the slot of a destroyed object */
+void fsync_free_slot( unsigned int index )
+{
+    if (!index) return;
+    slot_objects[index] = NULL;
+    /* a mutex still in the list of its owner is freed when the owner abandons it */
+    if (fsync_slots[index].prev) return;
+    __atomic_store_n( &fsync_slots[index].type, FSYNC_NONE, __ATOMIC_SEQ_CST );
+    free_slots[free_slot_count++] = index;
+}
+
+fsync_slot_t *get_fsync_slot( unsigned int index )
+{
+    return &fsync_slots[index];
+}
+
+/* wake up the client threads waiting on a slot */
+void fsync_wake_clients( unsigned int index )
+{
+#ifdef __linux__
+    static const int futex_wake = 1;  /* FUTEX_WAKE, shared between processes */
+    syscall( __NR_futex, &fsync_slots[index].state, futex_wake, INT_MAX, NULL, 0, 0 );
+#endif
+}
+
+/* add a mutex slot to the list of mutexes owned by a thread */
+void fsync_add_owned( struct thread *thread, unsigned int index )
+{
+    fsync_slot_t *head, *slot = &fsync_slots[index];
+
+    if (!thread->fsync_owned &&
+        !(thread->fsync_owned = fsync_alloc_slot( FSYNC_OWNER_LIST, 0, 0, NULL )))
+    {
+        unlisted_owners = 1;
+        return;
+    }
+    head = &fsync_slots[thread->fsync_owned];
+    slot->next = head->next;
+    slot->prev = thread->fsync_owned;
+    if (head->next) fsync_slots[head->next].prev = index;
+    head->next = index;
+}
+
+/* remove a mutex slot from the list of its owner */
+void fsync_remove_owned( unsigned int index )
+{
+    fsync_slot_t *slot = &fsync_slots[index];
+
+    if (!slot->prev) return;
+    fsync_slots[slot->prev].next = slot->next;
+    if (slot->next) fsync_slots[slot->next].prev = slot->prev;
+    slot->next = slot->prev = 0;
+}
+
+/* remove and return the next mutex still owned by a dead thread, NULL when there are none left */
+struct object *fsync_next_owned( struct thread *thread )
+{
+    fsync_slot_t *head, *slot;
+    unsigned int index;
+
+    if (!fsync_slots) return NULL;
+
+    /* the thread may have been killed in the middle of a list update, so don't trust the links */
+    while (thread->fsync_owned)
+    {
+        head = &fsync_slots[thread->fsync_owned];
+        if (!(index = head->next) || index >= next_slot)
+        {
+            head->next = 0;
+            fsync_free_slot( thread->fsync_owned );
+            thread->fsync_owned = 0;
+            break;
+        }
+        slot = &fsync_slots[index];
+        head->next = slot->next < next_slot ? slot->next : 0;
+        if (head->next) fsync_slots[head->next].prev = thread->fsync_owned;
+        slot->next = slot->prev = 0;
+
+        if (slot->type != FSYNC_MUTEX) continue;
+        if (!slot_objects[index]) fsync_free_slot( index );  /* the mutex was destroyed while owned */
+        else if (__atomic_load_n( &slot->state, __ATOMIC_SEQ_CST ) == thread->id)
+            return slot_objects[index];
+    }
+
+    if (unlisted_owners)
+    {
+        for (index = 1; index < next_slot; index++)
+        {
+            slot = &fsync_slots[index];
+            if (slot->type == FSYNC_MUTEX && slot_objects[index] &&
+                __atomic_load_n( &slot->state, __ATOMIC_SEQ_CST ) == thread->id)
+                return slot_objects[index];
+        }
+    }
+    return NULL;
+}
+
+/* add a wait queue entry to an object that has a slot */
+int fsync_add_queue( struct object *obj, unsigned int index, struct wait_queue_entry *entry )
+{
+    /* must be visible to the clients before the state is checked */
+    if (index) __atomic_add_fetch( &fsync_slots[index].server_waiters, 1, __ATOMIC_SEQ_CST );
+    entry->fsync_slot = index;
+    return add_queue( obj, entry );
+}
+
+/* remove a wait queue entry from an object that has a slot */
+void fsync_remove_queue( struct object *obj, unsigned int index, struct wait_queue_entry *entry )
+{
+    if (index) __atomic_sub_fetch( &fsync_slots[index].server_waiters, 1, __ATOMIC_SEQ_CST );
+    remove_queue( obj, entry );
+}
+
+/* atomically take the object of a wait queue entry that was found signaled */
+/* return 0 if a client took it in the meantime, the wait must then go on */
+int fsync_acquire( struct wait_queue_entry *entry, struct thread *thread )
+{
+    fsync_slot_t *slot;
+    int current;
+
+    if (!entry->fsync_slot) return 1;
+    slot = &fsync_slots[entry->fsync_slot];
+
+    switch (slot->type)
+    {
+    case FSYNC_AUTO_EVENT:
+        current = 1;
+        return __atomic_compare_exchange_n( &slot->state, &current, 0, 0,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST );
+    case FSYNC_SEMAPHORE:
+        current = __atomic_load_n( &slot->state, __ATOMIC_SEQ_CST );
+        while (current > 0)
+        {
+            if (__atomic_compare_exchange_n( &slot->state, &current, current - 1, 0,
+                                             __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ))
+                return 1;
+        }
+        return 0;
+    case FSYNC_MUTEX:
+        if (__atomic_load_n( &slot->state, __ATOMIC_SEQ_CST ) == thread->id) return 1;
+        current = 0;
+        return __atomic_compare_exchange_n( &slot->state, &current, thread->id, 0,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST );
+    }
+    return 1;
+}
+
+/* give back an object taken by fsync_acquire when the rest of a wait-all is not satisfied */
+void fsync_undo_acquire( struct wait_queue_entry *entry, struct thread *thread )
+{
+    fsync_slot_t *slot;
+
+    if (!entry->fsync_slot) return;
+    slot = &fsync_slots[entry->fsync_slot];
+
+    switch (slot->type)
+    {
+    case FSYNC_AUTO_EVENT:
+        __atomic_store_n( &slot->state, 1, __ATOMIC_SEQ_CST );
+        break;
+    case FSYNC_SEMAPHORE:
+        __atomic_add_fetch( &slot->state, 1, __ATOMIC_SEQ_CST );
+        break;
+    case FSYNC_MUTEX:
+        /* only a mutex that was free has been taken, an owned one has a recursion count */
+        if (slot->count) return;
+        __atomic_store_n( &slot->state, 0, __ATOMIC_SEQ_CST );
+        break;
+    default:
+        return;
+    }
+    /* clients may have gone back to sleep while we held it */
+    fsync_wake_clients( entry->fsync_slot );
+}
+
+/* retrieve the client-side synchronization objects mapping */
+DECL_HANDLER(get_fsync_shm)
+{
+    if (!do_fsync())
+    {
+        set_error( STATUS_NOT_IMPLEMENTED );
+        return;
+    }
+    if (!init_fsync_slots()) return;
+    reply->handle = alloc_handle( current->process, fsync_mapping,
+                                  SECTION_MAP_READ | SECTION_MAP_WRITE | SECTION_QUERY, 0 );
+    reply->count = FSYNC_SLOTS;
+}
+
+/* retrieve the slot of a synchronization object */
+DECL_HANDLER(get_fsync_slot)
+{
+    struct object *obj;
+    unsigned int index;
+
+    if (!(obj = get_handle_obj( current->process, req->handle, 0, NULL ))) return;
+
+    if (!(index = get_event_fsync_slot( obj )) &&
+        !(index = get_semaphore_fsync_slot( obj )))
+        index = get_mutex_fsync_slot( obj );
+
+    reply->slot   = index;
+    reply->type   = index ? fsync_slots[index].type : FSYNC_NONE;
+    reply->access = get_handle_access( current->process, req->handle );
+    release_object( obj );
+}
+
+/* retrieve the slot heading the list of mutexes owned by the current thread */
+DECL_HANDLER(get_fsync_owner_list)
+{
+    if (!do_fsync())
+    {
+        set_error( STATUS_NOT_IMPLEMENTED );
+        return;
+    }
+    if (!current->fsync_owned &&
+        !(current->fsync_owned = fsync_alloc_slot( FSYNC_OWNER_LIST, 0, 0, NULL )))
+    {
+        set_error( STATUS_INSUFFICIENT_RESOURCES );
+        return;
+    }
+    reply->slot = current->fsync_owned;
+}
+
+/* wake up the server-side waiters of an object signaled by a client */
+DECL_HANDLER(fsync_wake)
+{
+    struct object *obj;
+
+    if (!(obj = get_handle_obj( current->process, req->handle, 0, NULL ))) return;
+    wake_up( obj, 0 );
+    release_object( obj );
+}
@@ -27,12 +27,14 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
 #include "windef.h"
 #include "winternl.h"
 
+#include "file.h"
 #include "handle.h"
 #include "process.h"
 #include "thread.h"
@@ -53,6 +55,8 @@ struct handle_table
     int                  last;        /* last used entry */
     int                  free;        /* first entry that may be free */
     struct handle_entry *entries;     /* handle entries */
+    struct object       *shm_mapping; /* mapping of the client-visible mirror, created on demand */
+    handle_table_shm_t  *shm;         /* client-visible mirror of the entries */
 };
 
 static struct handle_table *global_table;
@@ -65,6 +69,8 @@ static struct handle_table *global_table;
 
 #define MIN_HANDLE_ENTRIES  32
 #define MAX_HANDLE_ENTRIES  0x00ffffff
+#define SHM_HANDLE_ENTRIES  65536  /* number of entries mirrored for the client */
+#define SHM_TABLE_SIZE      offsetof( handle_table_shm_t, entries[SHM_HANDLE_ENTRIES] )
 
 
 /* handle to table index conversion */
@@ -115,6 +121,27 @@ static void release_object_from_handle( struct object *obj )
     release_object( obj );
 }
 
+/* update the client-visible mirror of a handle table entry */
+static void update_handle_shm( struct handle_table *table, int index )
+{
+    const struct handle_entry *entry = table->entries + index;
+    handle_shm_t *shm;
+
+    if (!table->shm || index >= SHM_HANDLE_ENTRIES) return;
+    shm = &table->shm->entries[index];
+    if (!entry->ptr)
+    {
+        shm->flags = 0;
+        return;
+    }
+    shm->access = entry->access & ~RESERVED_ALL;
+    shm->type   = entry->ptr->ops->type->index;
+    shm->flags  = HANDLE_SHM_IN_USE;
+    if (entry->access & RESERVED_INHERIT) shm->flags |= HANDLE_SHM_INHERIT;
+    if (entry->access & RESERVED_CLOSE_PROTECT) shm->flags |= HANDLE_SHM_PROTECT;
+    if (entry->ptr->ops->get_fd == no_get_fd) shm->flags |= HANDLE_SHM_NO_FD;
+}
+
 static void handle_table_dump( struct object *obj, int verbose );
 static void handle_table_destroy( struct object *obj );
 
@@ -186,6 +213,11 @@ static void handle_table_destroy( struct object *obj )
         }
     }
     free( table->entries );
+    if (table->shm_mapping)
+    {
+        munmap( (void *)table->shm, SHM_TABLE_SIZE );
+        release_object( table->shm_mapping );
+    }
 }
 
 /* close all the process handles and free the handle table */
@@ -209,6 +241,8 @@ struct handle_table *alloc_handle_table( struct process *process, int count )
     table->count   = count;
     table->last    = -1;
     table->free    = 0;
+    table->shm_mapping = NULL;
+    table->shm     = NULL;
     if ((table->entries = mem_alloc( count * sizeof(*table->entries) ))) return table;
     release_object( table );
     return NULL;
@@ -248,6 +282,7 @@ static obj_handle_t alloc_entry( struct handle_table *table, void *obj, unsigned
     table->free = i + 1;
     entry->ptr    = grab_object_for_handle( obj );
     entry->access = access;
+    update_handle_shm( table, i );
     return index_to_handle(i);
 }
 
@@ -430,6 +465,7 @@ unsigned int close_handle( struct process *process, obj_handle_t handle )
     if (!obj->ops->close_handle( obj, process, handle )) return STATUS_HANDLE_NOT_CLOSABLE;
     entry->ptr = NULL;
     table = handle_is_global(handle) ? global_table : process->handles;
+    update_handle_shm( table, entry - table->entries );
     if (entry < table->entries + table->free) table->free = entry - table->entries;
     if (entry == table->entries + table->last) shrink_handle_table( table );
     release_object_from_handle( obj );
@@ -542,6 +578,7 @@ static int set_handle_flags( struct process *process, obj_handle_t handle, int m
     mask  = (mask << RESERVED_SHIFT) & RESERVED_ALL;
     flags = (flags << RESERVED_SHIFT) & mask;
     entry->access = (entry->access & ~mask) | flags;
+    if (!handle_is_global( handle )) update_handle_shm( process->handles, handle_to_index( handle ));
     return (old_access & RESERVED_ALL) >> RESERVED_SHIFT;
 }
 
@@ -590,6 +627,7 @@ obj_handle_t duplicate_handle( struct process *src, obj_handle_t src_handle, str
         {
             if (attr & OBJ_INHERIT) access |= RESERVED_INHERIT;
             entry->access = access;
+            if (!handle_is_global( src_handle )) update_handle_shm( src->handles, handle_to_index( src_handle ));
             res = src_handle;
         }
         else
@@ -642,7 +680,11 @@ unsigned int get_handle_table_count( struct process *process )
 /* close a handle */
 DECL_HANDLER(close_handle)
 {
-    unsigned int err = close_handle( current->process, req->handle );
+    unsigned int err;
+
+    /* completions written before the close still need the handle */
+    flush_io_notify( current->process );
+    err = close_handle( current->process, req->handle );
     set_error( err );
 }
 
@@ -660,6 +702,7 @@ DECL_HANDLER(dup_handle)
     reply->handle = 0;
     if ((src = get_process_from_handle( req->src_process, PROCESS_DUP_HANDLE )))
     {
+        if (req->options & DUPLICATE_CLOSE_SOURCE) flush_io_notify( src );
         if (req->options & DUPLICATE_MAKE_GLOBAL)
         {
             reply->handle = duplicate_handle( src, req->src_handle, NULL,
@@ -678,6 +721,30 @@ DECL_HANDLER(dup_handle)
     }
 }
 
+/* retrieve the client-visible mirror of the handle table */
+DECL_HANDLER(get_handle_shm)
+{
+    struct handle_table *table = current->process->handles;
+    void *ptr;
+    int i;
+
+    if (!table)
+    {
+        set_error( STATUS_PROCESS_IS_TERMINATING );
+        return;
+    }
+    if (!table->shm_mapping)
+    {
+        if (!(table->shm_mapping = create_shared_mapping( SHM_TABLE_SIZE, &ptr ))) return;
+        table->shm = ptr;
+        table->shm->count = SHM_HANDLE_ENTRIES;
+        for (i = 0; i <= table->last; i++) update_handle_shm( table, i );
+    }
+    /* only the server writes to it */
+    reply->handle = alloc_handle( current->process, table->shm_mapping, SECTION_MAP_READ | SECTION_QUERY, 0 );
+    reply->count  = SHM_HANDLE_ENTRIES;
+}
+
 DECL_HANDLER(get_object_info)
 {
     struct object *obj;
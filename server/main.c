@@ -53,6 +53,7 @@ static void usage( FILE *fh )
     fprintf(fh, "   -d[n], --debug[=n]       set debug level to n or +1 if n not specified\n");
     fprintf(fh, "   -f,    --foreground      remain in the foreground for debugging\n");
     fprintf(fh, "   -h,    --help            display this help message\n");
+    fprintf(fh, "   -j[n], --workers[=n]     save the registry in the background using n threads (default: 1)\n");
     fprintf(fh, "   -k[n], --kill[=n]        kill the current wineserver, optionally with signal n\n");
     fprintf(fh, "   -p[n], --persistent[=n]  make server persistent, optionally for n seconds\n");
     fprintf(fh, "   -v,    --version         display version information and exit\n");
@@ -69,6 +70,7 @@ static void parse_args( int argc, char *argv[] )
         {"debug",       2, NULL, 'd'},
         {"foreground",  0, NULL, 'f'},
         {"help",        0, NULL, 'h'},
+        {"workers",     2, NULL, 'j'},
         {"kill",        2, NULL, 'k'},
         {"persistent",  2, NULL, 'p'},
         {"version",     0, NULL, 'v'},
@@ -78,7 +80,7 @@ static void parse_args( int argc, char *argv[] )
 
     server_argv0 = argv[0];
 
-    while ((optc = getopt_long( argc, argv, "d::fhk::p::vw", long_options, NULL )) != -1)
+    while ((optc = getopt_long( argc, argv, "d::fhj::k::p::vw", long_options, NULL )) != -1)
     {
         switch(optc)
         {
@@ -95,6 +97,12 @@ static void parse_args( int argc, char *argv[] )
                 usage(stdout);
                 exit(0);
                 break;
+            case 'j':
+                if (optarg && isdigit(*optarg))
+                    worker_threads = atoi( optarg );
+                else
+                    worker_threads = 1;
+                break;
             case 'k':
                 if (optarg && isdigit(*optarg))
                     ret = kill_lock_owner( atoi( optarg ) );
@@ -146,6 +154,7 @@ int main( int argc, char *argv[] )
     init_signals();
     init_directories( load_intl_file() );
     init_threading();
+    init_workers();
     init_registry();
     main_loop();
     return 0;
@@ -57,9 +57,12 @@ struct mutex
     unsigned int   count;           /* recursion count */
     int            abandoned;       /* has it been abandoned? */
     struct list    entry;           /* entry in owner thread mutex list */
+    unsigned int   fsync_slot;      /* client-side slot holding the owner and count, 0 if none */
 };
 
 static void mutex_dump( struct object *obj, int verbose );
+static int mutex_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void mutex_remove_queue( struct object *obj, struct wait_queue_entry *entry );
 static int mutex_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void mutex_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static void mutex_destroy( struct object *obj );
@@ -70,8 +73,8 @@ static const struct object_ops mutex_ops =
     sizeof(struct mutex),      /* size */
     &mutex_type,               /* type */
     mutex_dump,                /* dump */
-    add_queue,                 /* add_queue */
-    remove_queue,              /* remove_queue */
+    mutex_add_queue,           /* add_queue */
+    mutex_remove_queue,        /* remove_queue */
     mutex_signaled,            /* signaled */
     mutex_satisfied,           /* satisfied */
     mutex_signal,              /* signal */
@@ -113,6 +116,57 @@ static void do_release( struct mutex *mutex )
     wake_up( &mutex->obj, 0 );
 }
 
+/* grab a mutex that has a client-side slot, fsync_acquire already made the thread its owner */
+static void do_fsync_grab( struct mutex *mutex, struct wait_queue_entry *entry )
+{
+    fsync_slot_t *slot = get_fsync_slot( mutex->fsync_slot );
+
+    if (slot->count++) return;
+    fsync_add_owned( get_wait_queue_thread( entry ), mutex->fsync_slot );
+    if (__atomic_exchange_n( &slot->abandoned, 0, __ATOMIC_SEQ_CST )) make_wait_abandoned( entry );
+}
+
+/* release a mutex that has a client-side slot once the recursion count is 0 */
+static void do_fsync_release( struct mutex *mutex )
+{
+    fsync_slot_t *slot = get_fsync_slot( mutex->fsync_slot );
+
+    assert( !slot->count );
+    fsync_remove_owned( mutex->fsync_slot );
+    __atomic_store_n( &slot->state, 0, __ATOMIC_SEQ_CST );
+    fsync_wake_clients( mutex->fsync_slot );
+    wake_up( &mutex->obj, 0 );
+}
+
+/* release a mutex for the current thread, return the previous recursion count */
+static unsigned int release_mutex( struct mutex *mutex )
+{
+    unsigned int prev;
+
+    if (mutex->fsync_slot)
+    {
+        fsync_slot_t *slot = get_fsync_slot( mutex->fsync_slot );
+
+        if (__atomic_load_n( &slot->state, __ATOMIC_SEQ_CST ) != current->id || !slot->count)
+        {
+            set_error( STATUS_MUTANT_NOT_OWNED );
+            return 0;
+        }
+        prev = slot->count--;
+        if (!slot->count) do_fsync_release( mutex );
+        return prev;
+    }
+
+    if (!mutex->count || (mutex->owner != current))
+    {
+        set_error( STATUS_MUTANT_NOT_OWNED );
+        return 0;
+    }
+    prev = mutex->count--;
+    if (!mutex->count) do_release( mutex );
+    return prev;
+}
+
 static struct mutex *create_mutex( struct object *root, const struct unicode_str *name,
                                    unsigned int attr, int owned, const struct security_descriptor *sd )
 {
@@ -126,7 +180,12 @@ static struct mutex *create_mutex( struct object *root, const struct unicode_str
             mutex->count = 0;
             mutex->owner = NULL;
             mutex->abandoned = 0;
-            if (owned) do_grab( mutex, current );
+            if ((mutex->fsync_slot = fsync_alloc_slot( FSYNC_MUTEX, owned ? current->id : 0, owned,
+                                                       &mutex->obj )))
+            {
+                if (owned) fsync_add_owned( current, mutex->fsync_slot );
+            }
+            else if (owned) do_grab( mutex, current );
         }
     }
     return mutex;
@@ -134,29 +193,75 @@ static struct mutex *create_mutex( struct object *root, const struct unicode_str
 
 void abandon_mutexes( struct thread *thread )
 {
+    struct mutex *mutex;
+    struct object *obj;
     struct list *ptr;
 
     while ((ptr = list_head( &thread->mutex_list )) != NULL)
     {
-        struct mutex *mutex = LIST_ENTRY( ptr, struct mutex, entry );
+        mutex = LIST_ENTRY( ptr, struct mutex, entry );
         assert( mutex->owner == thread );
         mutex->count = 0;
         mutex->abandoned = 1;
         do_release( mutex );
     }
+
+    while ((obj = fsync_next_owned( thread )))
+    {
+        fsync_slot_t *slot;
+
+        mutex = (struct mutex *)obj;
+        assert( obj->ops == &mutex_ops );
+        slot = get_fsync_slot( mutex->fsync_slot );
+        slot->count = 0;
+        __atomic_store_n( &slot->abandoned, 1, __ATOMIC_SEQ_CST );
+        do_fsync_release( mutex );
+    }
 }
 
 static void mutex_dump( struct object *obj, int verbose )
 {
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
-    fprintf( stderr, "Mutex count=%u owner=%p\n", mutex->count, mutex->owner );
+    if (mutex->fsync_slot)
+    {
+        fsync_slot_t *slot = get_fsync_slot( mutex->fsync_slot );
+        fprintf( stderr, "Mutex count=%d owner=%04x slot=%u\n",
+                 slot->count, slot->state, mutex->fsync_slot );
+    }
+    else fprintf( stderr, "Mutex count=%u owner=%p\n", mutex->count, mutex->owner );
+}
+
+unsigned int get_mutex_fsync_slot( struct object *obj )
+{
+    if (obj->ops != &mutex_ops) return 0;
+    return ((struct mutex *)obj)->fsync_slot;
+}
+
+static int mutex_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct mutex *mutex = (struct mutex *)obj;
+    assert( obj->ops == &mutex_ops );
+    return fsync_add_queue( obj, mutex->fsync_slot, entry );
+}
+
+static void mutex_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct mutex *mutex = (struct mutex *)obj;
+    assert( obj->ops == &mutex_ops );
+    fsync_remove_queue( obj, mutex->fsync_slot, entry );
 }
 
 static int mutex_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
+
+    if (mutex->fsync_slot)
+    {
+        int owner = __atomic_load_n( &get_fsync_slot( mutex->fsync_slot )->state, __ATOMIC_SEQ_CST );
+        return (!owner || owner == get_wait_queue_thread( entry )->id);
+    }
     return (!mutex->count || (mutex->owner == get_wait_queue_thread( entry )));
 }
 
@@ -165,6 +270,11 @@ static void mutex_satisfied( struct object *obj, struct wait_queue_entry *entry
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
 
+    if (mutex->fsync_slot)
+    {
+        do_fsync_grab( mutex, entry );
+        return;
+    }
     do_grab( mutex, get_wait_queue_thread( entry ));
     if (mutex->abandoned) make_wait_abandoned( entry );
     mutex->abandoned = 0;
@@ -180,13 +290,7 @@ static int mutex_signal( struct object *obj, unsigned int access )
         set_error( STATUS_ACCESS_DENIED );
         return 0;
     }
-    if (!mutex->count || (mutex->owner != current))
-    {
-        set_error( STATUS_MUTANT_NOT_OWNED );
-        return 0;
-    }
-    if (!--mutex->count) do_release( mutex );
-    return 1;
+    return release_mutex( mutex ) != 0;
 }
 
 static void mutex_destroy( struct object *obj )
@@ -194,6 +298,11 @@ static void mutex_destroy( struct object *obj )
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
 
+    if (mutex->fsync_slot)
+    {
+        fsync_free_slot( mutex->fsync_slot );
+        return;
+    }
     if (!mutex->count) return;
     mutex->count = 0;
     do_release( mutex );
@@ -240,12 +349,7 @@ DECL_HANDLER(release_mutex)
     if ((mutex = (struct mutex *)get_handle_obj( current->process, req->handle,
                                                  0, &mutex_ops )))
     {
-        if (!mutex->count || (mutex->owner != current)) set_error( STATUS_MUTANT_NOT_OWNED );
-        else
-        {
-            reply->prev_count = mutex->count;
-            if (!--mutex->count) do_release( mutex );
-        }
+        reply->prev_count = release_mutex( mutex );
         release_object( mutex );
     }
 }
@@ -258,9 +362,21 @@ DECL_HANDLER(query_mutex)
     if ((mutex = (struct mutex *)get_handle_obj( current->process, req->handle,
                                                  MUTANT_QUERY_STATE, &mutex_ops )))
     {
-        reply->count = mutex->count;
-        reply->owned = (mutex->owner == current);
-        reply->abandoned = mutex->abandoned;
+        if (mutex->fsync_slot)
+        {
+            fsync_slot_t *slot = get_fsync_slot( mutex->fsync_slot );
+            int owner = __atomic_load_n( &slot->state, __ATOMIC_SEQ_CST );
+
+            reply->count = owner ? slot->count : 0;
+            reply->owned = (owner == current->id);
+            reply->abandoned = slot->abandoned;
+        }
+        else
+        {
+            reply->count = mutex->count;
+            reply->owned = (mutex->owner == current);
+            reply->abandoned = mutex->abandoned;
+        }
 
         release_object( mutex );
     }
@@ -24,10 +24,22 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_SOCKET_H
+# include <sys/socket.h>
+#endif
+#ifdef HAVE_SYS_IOCTL_H
+# include <sys/ioctl.h>
+#endif
+#ifdef HAVE_SYS_FILIO_H
+# include <sys/filio.h>
+#endif
+#include <unistd.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -63,6 +75,7 @@ struct pipe_end
     process_id_t         client_pid; /* process that created the client */
     process_id_t         server_pid; /* process that created the server */
     data_size_t          buffer_size;/* size of buffered data that doesn't block caller */
+    int                  direct;     /* data is exchanged through a socket attached to the fd */
     struct list          message_queue;
     struct async_queue   read_q;     /* read queue */
     struct async_queue   write_q;    /* write queue */
@@ -147,6 +160,7 @@ static int pipe_end_read( struct fd *fd, struct async *async, file_pos_t pos );
 static int pipe_end_write( struct fd *fd, struct async *async_data, file_pos_t pos );
 static int pipe_end_flush( struct fd *fd, struct async *async );
 static int pipe_end_get_volume_info( struct fd *fd, struct async *async, unsigned int info_class );
+static void pipe_end_queue_async( struct fd *fd, struct async *async, int type, int count );
 static void pipe_end_reselect_async( struct fd *fd, struct async_queue *queue );
 static void pipe_end_get_file_info( struct fd *fd, obj_handle_t handle, unsigned int info_class );
 
@@ -194,7 +208,7 @@ static const struct fd_ops pipe_server_fd_ops =
     pipe_end_get_file_info,       /* get_file_info */
     pipe_end_get_volume_info,     /* get_volume_info */
     pipe_server_ioctl,            /* ioctl */
-    no_fd_queue_async,            /* queue_async */
+    pipe_end_queue_async,         /* queue_async */
     pipe_end_reselect_async       /* reselect_async */
 };
 
@@ -237,7 +251,7 @@ static const struct fd_ops pipe_client_fd_ops =
     pipe_end_get_file_info,       /* get_file_info */
     pipe_end_get_volume_info,     /* get_volume_info */
     pipe_client_ioctl,            /* ioctl */
-    no_fd_queue_async,            /* queue_async */
+    pipe_end_queue_async,         /* queue_async */
     pipe_end_reselect_async       /* reselect_async */
 };
 
@@ -371,6 +385,74 @@ static struct fd *pipe_end_get_fd( struct object *obj )
     return (struct fd *) grab_object( pipe_end->fd );
 }
 
+/* check if the data of byte mode pipes is exchanged directly by the clients */
+static int use_direct_pipes(void)
+{
+    static int direct_pipes = -1;
+
+    if (direct_pipes == -1)
+    {
+        const char *env = getenv( "WINEDIRECTPIPE" );
+        direct_pipes = env && atoi( env );
+        if (direct_pipes && debug_level) fprintf( stderr, "wineserver: using direct pipe data path\n" );
+    }
+    return direct_pipes;
+}
+
+static int is_direct_pipe( struct named_pipe *pipe )
+{
+    return !pipe->message_mode && use_direct_pipes();
+}
+
+/* connect the two ends through a socket pair, so that the clients read and write it directly */
+static void connect_direct_pipe( struct pipe_end *server, struct pipe_end *client )
+{
+    int fds[2];
+
+    if (!is_direct_pipe( server->pipe ) || (server->flags & NAMED_PIPE_NONBLOCKING_MODE)) return;
+
+    /* on failure we simply keep buffering the data in the server */
+    if (socketpair( PF_UNIX, SOCK_STREAM, 0, fds ) == -1) return;
+    fcntl( fds[0], F_SETFL, O_NONBLOCK );
+    fcntl( fds[1], F_SETFL, O_NONBLOCK );
+
+    /* the server end gets a new socket on each connection, so all its handles, including
+     * duplicated ones, have to fetch it again; a client end is only ever connected once */
+    if (!set_pseudo_fd_unix_fd( server->fd, fds[0], 0 ))
+    {
+        close( fds[1] );
+        return;
+    }
+    if (!set_pseudo_fd_unix_fd( client->fd, fds[1], 1 ))
+    {
+        set_pseudo_fd_unix_fd( server->fd, -1, 0 );
+        return;
+    }
+    server->direct = client->direct = 1;
+}
+
+/* close the socket of a direct pipe end, pending I/O on it is aborted */
+static void disconnect_direct_pipe( struct pipe_end *pipe_end, unsigned int status )
+{
+    if (!pipe_end->direct) return;
+
+    /* make sure that the copies of the socket owned by the clients get disconnected too */
+    shutdown( get_unix_fd( pipe_end->fd ), SHUT_RDWR );
+    fd_async_wake_up( pipe_end->fd, ASYNC_TYPE_READ, status );
+    fd_async_wake_up( pipe_end->fd, ASYNC_TYPE_WRITE, status );
+    set_pseudo_fd_unix_fd( pipe_end->fd, -1, 0 );
+    pipe_end->direct = 0;
+}
+
+/* number of bytes that can be read from the socket of a direct pipe end */
+static data_size_t get_direct_pipe_avail( struct pipe_end *pipe_end )
+{
+    int avail;
+
+    if (ioctl( get_unix_fd( pipe_end->fd ), FIONREAD, &avail ) == -1 || avail < 0) return 0;
+    return avail;
+}
+
 static struct pipe_message *queue_message( struct pipe_end *pipe_end, struct iosb *iosb )
 {
     struct pipe_message *message;
@@ -415,6 +497,8 @@ static void pipe_end_disconnect( struct pipe_end *pipe_end, unsigned int status
         ? FILE_PIPE_DISCONNECTED_STATE : FILE_PIPE_CLOSING_STATE;
     fd_async_wake_up( pipe_end->fd, ASYNC_TYPE_WAIT, status );
     async_wake_up( &pipe_end->read_q, status );
+    /* a broken pipe keeps its socket, so that the remaining data can still be read */
+    if (status == STATUS_PIPE_DISCONNECTED) disconnect_direct_pipe( pipe_end, status );
     LIST_FOR_EACH_ENTRY_SAFE( message, next, &pipe_end->message_queue, struct pipe_message, entry )
     {
         async = message->async;
@@ -438,6 +522,7 @@ static void pipe_end_destroy( struct object *obj )
     struct pipe_message *message;
 
     pipe_end_disconnect( pipe_end, STATUS_PIPE_BROKEN );
+    disconnect_direct_pipe( pipe_end, STATUS_PIPE_BROKEN );
 
     while (!list_empty( &pipe_end->message_queue ))
     {
@@ -487,7 +572,15 @@ static void pipe_server_destroy( struct object *obj )
 
 static void named_pipe_device_dump( struct object *obj, int verbose )
 {
-    fputs( "Named pipe device\n", stderr );
+    struct named_pipe_device *device = (struct named_pipe_device *)obj;
+
+    fputs( "Named pipe device", stderr );
+    if (verbose && device->pipes)
+    {
+        fputc( ' ', stderr );
+        dump_namespace( device->pipes );
+    }
+    fputc( '\n', stderr );
 }
 
 static struct object *named_pipe_device_lookup_name( struct object *obj, struct unicode_str *name,
@@ -527,7 +620,7 @@ static void named_pipe_device_destroy( struct object *obj )
 {
     struct named_pipe_device *device = (struct named_pipe_device*)obj;
     assert( obj->ops == &named_pipe_device_ops );
-    free( device->pipes );
+    free_namespace( device->pipes );
 }
 
 struct object *create_named_pipe_device( struct object *root, const struct unicode_str *name,
@@ -706,7 +799,7 @@ static void pipe_end_get_file_info( struct fd *fd, obj_handle_t handle, unsigned
             pipe_info->MaximumInstances    = pipe->maxinstances;
             pipe_info->CurrentInstances    = pipe->instances;
             pipe_info->InboundQuota        = pipe->insize;
-            pipe_info->ReadDataAvailable   = 0; /* FIXME */
+            pipe_info->ReadDataAvailable   = pipe_end->direct ? get_direct_pipe_avail( pipe_end ) : 0; /* FIXME */
             pipe_info->OutboundQuota       = pipe->outsize;
             pipe_info->WriteQuotaAvailable = 0; /* FIXME */
             pipe_info->NamedPipeState      = pipe_end->state;
@@ -960,6 +1053,15 @@ static int pipe_end_write( struct fd *fd, struct async *async, file_pos_t pos )
     return 1;
 }
 
+static void pipe_end_queue_async( struct fd *fd, struct async *async, int type, int count )
+{
+    struct pipe_end *pipe_end = get_fd_user( fd );
+
+    /* only the clients of direct pipes wait for the socket to become ready */
+    if (pipe_end->direct) default_fd_queue_async( fd, async, type, count );
+    else no_fd_queue_async( fd, async, type, count );
+}
+
 static void pipe_end_reselect_async( struct fd *fd, struct async_queue *queue )
 {
     struct pipe_end *pipe_end = get_fd_user( fd );
@@ -970,6 +1072,8 @@ static void pipe_end_reselect_async( struct fd *fd, struct async_queue *queue )
         reselect_write_queue( pipe_end );
     else if (&pipe_end->read_q == queue)
         reselect_read_queue( pipe_end, 0 );
+    else if (pipe_end->direct)
+        default_fd_reselect_async( fd, queue );
 }
 
 static enum server_fd_type pipe_end_get_fd_type( struct fd *fd )
@@ -998,6 +1102,7 @@ static int pipe_end_peek( struct pipe_end *pipe_end )
         break;
     case FILE_PIPE_CLOSING_STATE:
         if (!list_empty( &pipe_end->message_queue )) break;
+        if (pipe_end->direct && get_direct_pipe_avail( pipe_end )) break;
         set_error( STATUS_PIPE_BROKEN );
         return 0;
     default:
@@ -1005,8 +1110,13 @@ static int pipe_end_peek( struct pipe_end *pipe_end )
         return 0;
     }
 
-    LIST_FOR_EACH_ENTRY( message, &pipe_end->message_queue, struct pipe_message, entry )
-        avail += message->iosb->in_size - message->read_pos;
+    if (pipe_end->direct)
+        avail = get_direct_pipe_avail( pipe_end );
+    else
+    {
+        LIST_FOR_EACH_ENTRY( message, &pipe_end->message_queue, struct pipe_message, entry )
+            avail += message->iosb->in_size - message->read_pos;
+    }
     reply_size = min( reply_size, avail );
 
     if (avail && pipe_end->pipe->message_mode)
@@ -1022,7 +1132,13 @@ static int pipe_end_peek( struct pipe_end *pipe_end )
     buffer->NumberOfMessages  = 0;  /* FIXME */
     buffer->MessageLength     = message_length;
 
-    if (reply_size)
+    if (reply_size && pipe_end->direct)
+    {
+        int ret = recv( get_unix_fd( pipe_end->fd ), buffer->Data, reply_size, MSG_PEEK | MSG_DONTWAIT );
+        if (ret < 0) ret = 0;
+        if (ret < reply_size) memset( buffer->Data + ret, 0, reply_size - ret );
+    }
+    else if (reply_size)
     {
         data_size_t write_pos = 0, writing;
         LIST_FOR_EACH_ENTRY( message, &pipe_end->message_queue, struct pipe_message, entry )
@@ -1221,6 +1337,7 @@ static void init_pipe_end( struct pipe_end *pipe_end, struct named_pipe *pipe,
     pipe_end->flags = pipe_flags;
     pipe_end->connection = NULL;
     pipe_end->buffer_size = buffer_size;
+    pipe_end->direct = 0;
     init_async_queue( &pipe_end->read_q );
     init_async_queue( &pipe_end->write_q );
     list_init( &pipe_end->message_queue );
@@ -1247,7 +1364,8 @@ static struct pipe_server *create_pipe_server( struct named_pipe *pipe, unsigned
         release_object( server );
         return NULL;
     }
-    allow_fd_caching( server->pipe_end.fd );
+    /* the fd of a direct pipe server changes on each connection, it is never cached */
+    if (!is_direct_pipe( pipe )) allow_fd_caching( server->pipe_end.fd );
     set_fd_signaled( server->pipe_end.fd, 1 );
     async_wake_up( &pipe->waiters, STATUS_SUCCESS );
     return server;
@@ -1323,6 +1441,7 @@ static struct object *named_pipe_open_file( struct object *obj, unsigned int acc
         server->pipe_end.client_pid = client->client_pid;
         client->server_pid = server->pipe_end.server_pid;
         list_remove( &server->entry );
+        connect_direct_pipe( &server->pipe_end, client );
     }
     return &client->obj;
 }
@@ -43,10 +43,21 @@
 #include "security.h"
 
 
+/* namespaces grow when the average chain length reaches NAMESPACE_MAX_LOAD, and shrink
+ * back when it drops below 1 / NAMESPACE_MIN_LOAD, never below their initial size */
+#define NAMESPACE_MAX_LOAD  2
+#define NAMESPACE_MIN_LOAD  8
+#define NAMESPACE_MAX_BITS  20
+
 struct namespace
 {
-    unsigned int        hash_size;       /* size of hash table */
-    struct list         names[1];        /* array of hash entry lists */
+    unsigned int        hash_bits;       /* log2 of the size of hash table */
+    unsigned int        min_bits;        /* initial size of the hash table */
+    unsigned int        count;           /* number of names in the namespace */
+    unsigned int        resizes;         /* statistics: number of hash table resizes */
+    unsigned int        lookups;         /* statistics: number of lookups */
+    unsigned int        compares;        /* statistics: number of names compared during lookups */
+    struct list        *names;           /* array of hash entry lists */
 };
 
 
@@ -134,11 +145,64 @@ void *memdup( const void *data, size_t len )
 
 /*****************************************************************/
 
+/* hash a name; the multiplicative mixing spreads the string hash over the top bits */
+static inline unsigned int hash_name( const WCHAR *name, data_size_t len )
+{
+    return hash_strW( name, len, ~0u ) * 0x9e3779b1;
+}
+
+static inline struct list *get_hash_list( const struct namespace *namespace, unsigned int hash )
+{
+    return &namespace->names[hash >> (32 - namespace->hash_bits)];
+}
+
+/* rehash all the names of a namespace to a new hash table size */
+static void resize_namespace( struct namespace *namespace, unsigned int bits )
+{
+    struct list *names, *old_names = namespace->names;
+    struct object_name *ptr, *next;
+    unsigned int i, old_size = 1 << namespace->hash_bits;
+
+    /* failing to resize only makes lookups slower */
+    if (!(names = malloc( (1 << bits) * sizeof(*names) ))) return;
+    for (i = 0; i < 1u << bits; i++) list_init( &names[i] );
+
+    namespace->names = names;
+    namespace->hash_bits = bits;
+    namespace->resizes++;
+    for (i = 0; i < old_size; i++)
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( ptr, next, &old_names[i], struct object_name, entry )
+        {
+            list_remove( &ptr->entry );
+            list_add_tail( get_hash_list( namespace, ptr->hash ), &ptr->entry );
+        }
+    }
+    free( old_names );
+}
+
 void namespace_add( struct namespace *namespace, struct object_name *ptr )
 {
-    unsigned int hash = hash_strW( ptr->name, ptr->len, namespace->hash_size );
+    if (namespace->count >= NAMESPACE_MAX_LOAD << namespace->hash_bits &&
+        namespace->hash_bits < NAMESPACE_MAX_BITS)
+        resize_namespace( namespace, namespace->hash_bits + 1 );
 
-    list_add_head( &namespace->names[hash], &ptr->entry );
+    ptr->namespace = namespace;
+    ptr->hash = hash_name( ptr->name, ptr->len );
+    list_add_head( get_hash_list( namespace, ptr->hash ), &ptr->entry );
+    namespace->count++;
+}
+
+/* remove a name from its namespace */
+static void namespace_remove( struct namespace *namespace, struct object_name *ptr )
+{
+    list_remove( &ptr->entry );
+    ptr->namespace = NULL;
+    namespace->count--;
+
+    if (namespace->hash_bits > namespace->min_bits &&
+        namespace->count < (1u << namespace->hash_bits) / NAMESPACE_MIN_LOAD)
+        resize_namespace( namespace, namespace->hash_bits - 1 );
 }
 
 /* allocate a name for an object */
@@ -150,6 +214,7 @@ static struct object_name *alloc_name( const struct unicode_str *name )
     {
         ptr->len = name->len;
         ptr->parent = NULL;
+        ptr->namespace = NULL;
         memcpy( ptr->name, name->str, name->len );
     }
     return ptr;
@@ -444,19 +509,20 @@ void release_object( void *ptr )
 }
 
 /* find an object by its name; the refcount is incremented */
-struct object *find_object( const struct namespace *namespace, const struct unicode_str *name,
+struct object *find_object( struct namespace *namespace, const struct unicode_str *name,
                             unsigned int attributes )
 {
-    const struct list *list;
-    struct list *p;
+    const struct object_name *ptr;
+    unsigned int hash;
 
     if (!name || !name->len) return NULL;
 
-    list = &namespace->names[ hash_strW( name->str, name->len, namespace->hash_size ) ];
-    LIST_FOR_EACH( p, list )
+    hash = hash_name( name->str, name->len );
+    namespace->lookups++;
+    LIST_FOR_EACH_ENTRY( ptr, get_hash_list( namespace, hash ), const struct object_name, entry )
     {
-        const struct object_name *ptr = LIST_ENTRY( p, struct object_name, entry );
-        if (ptr->len != name->len) continue;
+        if (ptr->hash != hash || ptr->len != name->len) continue;
+        namespace->compares++;
         if (attributes & OBJ_CASE_INSENSITIVE)
         {
             if (!memicmp_strW( ptr->name, name->str, name->len ))
@@ -477,7 +543,7 @@ struct object *find_object_index( const struct namespace *namespace, unsigned in
     unsigned int i;
 
     /* FIXME: not efficient at all */
-    for (i = 0; i < namespace->hash_size; i++)
+    for (i = 0; i < 1u << namespace->hash_bits; i++)
     {
         const struct object_name *ptr;
         LIST_FOR_EACH_ENTRY( ptr, &namespace->names[i], const struct object_name, entry )
@@ -493,17 +559,50 @@ struct object *find_object_index( const struct namespace *namespace, unsigned in
 struct namespace *create_namespace( unsigned int hash_size )
 {
     struct namespace *namespace;
-    unsigned int i;
+    unsigned int i, bits = 1;
+
+    while (bits < NAMESPACE_MAX_BITS && (1u << bits) < hash_size) bits++;
 
-    namespace = mem_alloc( sizeof(*namespace) + (hash_size - 1) * sizeof(namespace->names[0]) );
-    if (namespace)
+    if (!(namespace = mem_alloc( sizeof(*namespace) ))) return NULL;
+    if (!(namespace->names = mem_alloc( (1 << bits) * sizeof(namespace->names[0]) )))
     {
-        namespace->hash_size      = hash_size;
-        for (i = 0; i < hash_size; i++) list_init( &namespace->names[i] );
+        free( namespace );
+        return NULL;
     }
+    namespace->hash_bits = bits;
+    namespace->min_bits  = bits;
+    namespace->count     = 0;
+    namespace->resizes   = 0;
+    namespace->lookups   = 0;
+    namespace->compares  = 0;
+    for (i = 0; i < 1u << bits; i++) list_init( &namespace->names[i] );
     return namespace;
 }
 
+/* free a namespace */
+void free_namespace( struct namespace *namespace )
+{
+    if (!namespace) return;
+    free( namespace->names );
+    free( namespace );
+}
+
+/* dump the hash table statistics of a namespace */
+void dump_namespace( const struct namespace *namespace )
+{
+    unsigned int i, len, max_len = 0, used = 0, size = 1 << namespace->hash_bits;
+
+    for (i = 0; i < size; i++)
+    {
+        if (!(len = list_count( &namespace->names[i] ))) continue;
+        if (len > max_len) max_len = len;
+        used++;
+    }
+    fprintf( stderr, "names=%u buckets=%u used=%u max_chain=%u resizes=%u lookups=%u compares=%u",
+             namespace->count, size, used, max_len, namespace->resizes,
+             namespace->lookups, namespace->compares );
+}
+
 /* functions for unimplemented/default object operations */
 
 int no_add_queue( struct object *obj, struct wait_queue_entry *entry )
@@ -690,7 +789,8 @@ int no_link_name( struct object *obj, struct object_name *name, struct object *p
 
 void default_unlink_name( struct object *obj, struct object_name *name )
 {
-    list_remove( &name->entry );
+    if (name->namespace) namespace_remove( name->namespace, name );
+    else list_remove( &name->entry );
 }
 
 struct object *no_open_file( struct object *obj, unsigned int access, unsigned int sharing,
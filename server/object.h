@@ -131,6 +131,8 @@ struct object_name
     struct list         entry;           /* entry in the hash list */
     struct object      *obj;             /* object owning this name */
     struct object      *parent;          /* parent object */
+    struct namespace   *namespace;       /* namespace containing the name, if any */
+    unsigned int        hash;            /* full hash value of the name */
     data_size_t         len;             /* name length in bytes */
     WCHAR               name[1];
 };
@@ -140,6 +142,7 @@ struct wait_queue_entry
     struct list         entry;
     struct object      *obj;
     struct thread_wait *wait;
+    unsigned int        fsync_slot;  /* client-side slot of the object, 0 if none */
 };
 
 extern void *mem_alloc( size_t size );  /* malloc wrapper */
@@ -159,12 +162,14 @@ extern void *open_named_object( struct object *parent, const struct object_ops *
                                 const struct unicode_str *name, unsigned int attributes );
 extern void unlink_named_object( struct object *obj );
 extern struct namespace *create_namespace( unsigned int hash_size );
+extern void free_namespace( struct namespace *namespace );
+extern void dump_namespace( const struct namespace *namespace );
 extern void free_kernel_objects( struct object *obj );
 /* grab/release_object can take any pointer, but you better make sure */
 /* that the thing pointed to starts with a struct object... */
 extern struct object *grab_object( void *obj );
 extern void release_object( void *obj );
-extern struct object *find_object( const struct namespace *namespace, const struct unicode_str *name,
+extern struct object *find_object( struct namespace *namespace, const struct unicode_str *name,
                                    unsigned int attributes );
 extern struct object *find_object_index( const struct namespace *namespace, unsigned int index );
 extern int no_add_queue( struct object *obj, struct wait_queue_entry *entry );
@@ -217,10 +222,31 @@ extern struct event *get_event_obj( struct process *process, obj_handle_t handle
 extern struct keyed_event *get_keyed_event_obj( struct process *process, obj_handle_t handle, unsigned int access );
 extern void set_event( struct event *event );
 extern void reset_event( struct event *event );
+extern unsigned int get_event_fsync_slot( struct object *obj );
 
 /* mutex functions */
 
 extern void abandon_mutexes( struct thread *thread );
+extern unsigned int get_mutex_fsync_slot( struct object *obj );
+
+/* semaphore functions */
+
+extern unsigned int get_semaphore_fsync_slot( struct object *obj );
+
+/* client-side synchronization functions */
+
+extern int do_fsync(void);
+extern unsigned int fsync_alloc_slot( enum fsync_type type, int state, int count, struct object *obj );
+extern void fsync_free_slot( unsigned int index );
+extern fsync_slot_t *get_fsync_slot( unsigned int index );
+extern void fsync_wake_clients( unsigned int index );
+extern void fsync_add_owned( struct thread *thread, unsigned int index );
+extern void fsync_remove_owned( unsigned int index );
+extern struct object *fsync_next_owned( struct thread *thread );
+extern int fsync_add_queue( struct object *obj, unsigned int index, struct wait_queue_entry *entry );
+extern void fsync_remove_queue( struct object *obj, unsigned int index, struct wait_queue_entry *entry );
+extern int fsync_acquire( struct wait_queue_entry *entry, struct thread *thread );
+extern void fsync_undo_acquire( struct wait_queue_entry *entry, struct thread *thread );
 
 /* serial functions */
 
@@ -236,6 +262,15 @@ extern void generate_debug_event( struct thread *thread, int code, const void *a
 extern void resume_delayed_debug_events( struct thread *thread );
 extern void generate_startup_debug_events( struct process *process );
 
+/* worker thread functions */
+
+typedef void (*work_func_t)( void *arg );
+
+extern int worker_threads;
+extern void init_workers(void);
+extern void queue_work( work_func_t work, work_func_t done, void *arg );
+extern void flush_work(void);
+
 /* registry functions */
 
 extern unsigned int supported_machines_count;
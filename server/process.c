@@ -30,6 +30,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <fcntl.h>
 #ifdef HAVE_SYS_SOCKET_H
 # include <sys/socket.h>
 #endif
@@ -79,6 +80,7 @@ static int process_signaled( struct object *obj, struct wait_queue_entry *entry
 static unsigned int process_map_access( struct object *obj, unsigned int access );
 static struct security_descriptor *process_get_sd( struct object *obj );
 static void process_poll_event( struct fd *fd, int event );
+static void io_notify_poll_event( struct fd *fd, int event );
 static struct list *process_get_kernel_obj_list( struct object *obj );
 static void process_destroy( struct object *obj );
 static void terminate_process( struct process *process, struct thread *skip, int exit_code );
@@ -119,6 +121,18 @@ static const struct fd_ops process_fd_ops =
     NULL                         /* cancel async */
 };
 
+static const struct fd_ops io_notify_fd_ops =
+{
+    NULL,                        /* get_poll_events */
+    io_notify_poll_event,        /* poll_event */
+    NULL,                        /* flush */
+    NULL,                        /* get_fd_type */
+    NULL,                        /* ioctl */
+    NULL,                        /* queue_async */
+    NULL,                        /* reselect_async */
+    NULL                         /* cancel async */
+};
+
 /* process startup info */
 
 struct startup_info
@@ -612,6 +626,7 @@ struct process *create_process( int fd, struct process *parent, unsigned int fla
     process->debug_event     = NULL;
     process->handles         = NULL;
     process->msg_fd          = NULL;
+    process->io_notify_fd    = NULL;
     process->sigkill_timeout = NULL;
     process->unix_pid        = -1;
     process->exit_code       = STILL_ACTIVE;
@@ -735,6 +750,7 @@ static void process_destroy( struct object *obj )
     }
     if (process->console) release_object( process->console );
     if (process->msg_fd) release_object( process->msg_fd );
+    if (process->io_notify_fd) release_object( process->io_notify_fd );
     if (process->idle_event) release_object( process->idle_event );
     if (process->id) free_ptid( process->id );
     if (process->token) release_object( process->token );
@@ -827,6 +843,36 @@ static void process_poll_event( struct fd *fd, int event )
     else if (event & POLLIN) receive_fd( process );
 }
 
+/* apply the I/O completions that the client wrote to its notification pipe */
+void flush_io_notify( struct process *process )
+{
+    io_notify_t notify[64];
+    ssize_t i, ret;
+
+    if (!process->io_notify_fd) return;
+
+    while ((ret = read( get_unix_fd( process->io_notify_fd ), notify, sizeof(notify) )) > 0)
+    {
+        /* the client writes single entries, which are small enough to be atomic */
+        for (i = 0; i < ret / sizeof(notify[0]); i++) fd_notify_io( process, &notify[i] );
+        if (ret < sizeof(notify)) break;
+    }
+    clear_error();
+}
+
+static void io_notify_poll_event( struct fd *fd, int event )
+{
+    struct process *process = get_fd_user( fd );
+    assert( process->obj.ops == &process_ops );
+
+    if (event & POLLIN) flush_io_notify( process );
+    if (event & (POLLERR | POLLHUP))
+    {
+        release_object( process->io_notify_fd );
+        process->io_notify_fd = NULL;
+    }
+}
+
 static void startup_info_destroy( struct object *obj )
 {
     struct startup_info *info = (struct startup_info *)obj;
@@ -934,6 +980,8 @@ static void process_killed( struct process *process )
     close_process_handles( process );
     if (process->idle_event) release_object( process->idle_event );
     process->idle_event = NULL;
+    if (process->io_notify_fd) release_object( process->io_notify_fd );
+    process->io_notify_fd = NULL;
     assert( !process->console );
 
     while ((ptr = list_head( &process->rawinput_devices )))
@@ -1910,3 +1958,30 @@ DECL_HANDLER(list_processes)
         }
     }
 }
+
+/* set the pipe on which the process writes io_notify_t completions */
+DECL_HANDLER(set_io_notify_fd)
+{
+    struct process *process = current->process;
+    int fd = thread_get_inflight_fd( current, req->fd );
+
+    if (fd == -1)
+    {
+        set_error( STATUS_INVALID_HANDLE );
+        return;
+    }
+    if (process->io_notify_fd)
+    {
+        close( fd );
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+    if (fcntl( fd, F_SETFL, O_NONBLOCK ) == -1)
+    {
+        file_set_error();
+        close( fd );
+        return;
+    }
+    if ((process->io_notify_fd = create_anonymous_fd( &io_notify_fd_ops, fd, &process->obj, 0 )))
+        set_fd_events( process->io_notify_fd, POLLIN );
+}
@@ -49,6 +49,7 @@ struct process
     struct debug_event  *debug_event;     /* debug event being sent to debugger */
     struct handle_table *handles;         /* handle entries */
     struct fd           *msg_fd;          /* fd for sendmsg/recvmsg */
+    struct fd           *io_notify_fd;    /* pipe for I/O completions from threads without a server connection */
     process_id_t         id;              /* id of the process */
     process_id_t         group_id;        /* group id of the process */
     unsigned int         session_id;      /* session id */
@@ -115,6 +116,7 @@ extern void remove_process_thread( struct process *process,
 extern void suspend_process( struct process *process );
 extern void resume_process( struct process *process );
 extern void kill_process( struct process *process, int violent_death );
+extern void flush_io_notify( struct process *process );
 extern void kill_console_processes( struct thread *renderer, int exit_code );
 extern void detach_debugged_processes( struct debug_obj *debug_obj, int exit_code );
 extern void enum_processes( int (*cb)(struct process*, void*), void *user);
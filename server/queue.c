@@ -25,6 +25,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #ifdef HAVE_POLL_H
 # include <poll.h>
 #endif
@@ -141,6 +142,8 @@ struct msg_queue
     struct hook_table     *hooks;           /* hook table */
     timeout_t              last_get_msg;    /* time of last get message call */
     int                    keystate_lock;   /* owns an input keystate lock */
+    struct object         *shared_mapping;  /* mapping of the shared memory, created on demand */
+    queue_shm_t           *shared;          /* queue bits published to the client */
 };
 
 struct hotkey
@@ -308,6 +311,8 @@ static struct msg_queue *create_msg_queue( struct thread *thread, struct thread_
         queue->hooks           = NULL;
         queue->last_get_msg    = current_time;
         queue->keystate_lock   = 0;
+        queue->shared_mapping  = NULL;
+        queue->shared          = NULL;
         list_init( &queue->send_result );
         list_init( &queue->callback_result );
         list_init( &queue->pending_timers );
@@ -403,6 +408,21 @@ static struct message *alloc_hardware_message( lparam_t info, struct hw_msg_sour
     return msg;
 }
 
+/* publish the cursor and foreground window to the client shared memory */
+void update_desktop_shm( struct desktop *desktop )
+{
+    desktop_shm_t *shared = desktop->shared;
+
+    if (!shared) return;
+    SHARED_WRITE_BEGIN( shared );
+    shared->cursor_x           = desktop->cursor.x;
+    shared->cursor_y           = desktop->cursor.y;
+    shared->cursor_last_change = desktop->cursor.last_change;
+    shared->cursor_clip        = desktop->cursor.clip;
+    shared->foreground         = desktop->foreground_input ? desktop->foreground_input->active : 0;
+    SHARED_WRITE_END( shared );
+}
+
 static int update_desktop_cursor_pos( struct desktop *desktop, user_handle_t win, int x, int y )
 {
     struct thread_input *input;
@@ -415,6 +435,7 @@ static int update_desktop_cursor_pos( struct desktop *desktop, user_handle_t win
     desktop->cursor.x = x;
     desktop->cursor.y = y;
     desktop->cursor.last_change = get_tick_count();
+    update_desktop_shm( desktop );
 
     if (win && (thread = get_window_thread( win )))
     {
@@ -499,6 +520,7 @@ static void set_clip_rectangle( struct desktop *desktop, const rectangle_t *rect
         desktop->cursor.clip = new_rect;
     }
     else desktop->cursor.clip = top_rect;
+    update_desktop_shm( desktop );
 
     if (desktop->cursor.clip_msg && send_clip_msg)
         post_desktop_message( desktop, desktop->cursor.clip_msg, rect != NULL, 0 );
@@ -515,6 +537,7 @@ static void set_foreground_input( struct desktop *desktop, struct thread_input *
     if (desktop->foreground_input == input) return;
     set_clip_rectangle( desktop, NULL, 1 );
     desktop->foreground_input = input;
+    update_desktop_shm( desktop );
 }
 
 /* get the hook table for a given thread */
@@ -539,6 +562,18 @@ static inline int is_signaled( struct msg_queue *queue )
     return ((queue->wake_bits & queue->wake_mask) || (queue->changed_bits & queue->changed_mask));
 }
 
+/* publish the queue bits to the client shared memory */
+static void update_queue_shm( struct msg_queue *queue )
+{
+    queue_shm_t *shared = queue->shared;
+
+    if (!shared) return;
+    SHARED_WRITE_BEGIN( shared );
+    shared->wake_bits    = queue->wake_bits;
+    shared->changed_bits = queue->changed_bits;
+    SHARED_WRITE_END( shared );
+}
+
 /* set some queue bits */
 static inline void set_queue_bits( struct msg_queue *queue, unsigned int bits )
 {
@@ -549,6 +584,7 @@ static inline void set_queue_bits( struct msg_queue *queue, unsigned int bits )
     }
     queue->wake_bits |= bits;
     queue->changed_bits |= bits;
+    update_queue_shm( queue );
     if (is_signaled( queue )) wake_up( &queue->obj, 0 );
 }
 
@@ -557,6 +593,7 @@ static inline void clear_queue_bits( struct msg_queue *queue, unsigned int bits
 {
     queue->wake_bits &= ~bits;
     queue->changed_bits &= ~bits;
+    update_queue_shm( queue );
     if (!(queue->wake_bits & (QS_KEY | QS_MOUSEBUTTON)))
     {
         if (queue->keystate_lock) unlock_input_keystate( queue->input );
@@ -1116,6 +1153,11 @@ static void msg_queue_destroy( struct object *obj )
     release_object( queue->input );
     if (queue->hooks) release_object( queue->hooks );
     if (queue->fd) release_object( queue->fd );
+    if (queue->shared_mapping)
+    {
+        munmap( (void *)queue->shared, sizeof(*queue->shared) );
+        release_object( queue->shared_mapping );
+    }
 }
 
 static void msg_queue_poll_event( struct fd *fd, int event )
@@ -1158,6 +1200,7 @@ static inline void thread_input_cleanup_window( struct msg_queue *queue, user_ha
     if (window == input->menu_owner) input->menu_owner = 0;
     if (window == input->move_size) input->move_size = 0;
     if (window == input->caret) set_caret_window( input, 0 );
+    update_desktop_shm( input->desktop );
 }
 
 /* check if the specified window can be set in the input data of a given queue */
@@ -1213,6 +1256,7 @@ int attach_thread_input( struct thread *thread_from, struct thread *thread_to )
 
     ret = assign_thread_input( thread_from, input );
     if (ret) memset( input->keystate, 0, sizeof(input->keystate) );
+    update_desktop_shm( input->desktop );
     release_object( input );
     return ret;
 }
@@ -1244,6 +1288,7 @@ void detach_thread_input( struct thread *thread_from )
             release_object( thread );
         }
         assign_thread_input( thread_from, input );
+        update_desktop_shm( input->desktop );
         release_object( input );
     }
 }
@@ -1844,6 +1889,7 @@ static int queue_mouse_message( struct desktop *desktop, user_handle_t win, cons
     };
 
     desktop->cursor.last_change = get_tick_count();
+    update_desktop_shm( desktop );
     flags = input->mouse.flags;
     time  = input->mouse.time;
     if (!time) time = desktop->cursor.last_change;
@@ -2522,11 +2568,42 @@ DECL_HANDLER(get_queue_status)
         reply->wake_bits    = queue->wake_bits;
         reply->changed_bits = queue->changed_bits;
         queue->changed_bits &= ~req->clear_bits;
+        update_queue_shm( queue );
     }
     else reply->wake_bits = reply->changed_bits = 0;
 }
 
 
+/* retrieve the shared memory sections of the current thread queue and desktop */
+DECL_HANDLER(get_shared_memory)
+{
+    struct msg_queue *queue = get_current_queue();
+    struct desktop *desktop;
+    void *ptr;
+
+    if (!queue) return;
+    if (!(desktop = get_thread_desktop( current, 0 ))) return;
+
+    if (!queue->shared_mapping && (queue->shared_mapping = create_shared_mapping( sizeof(*queue->shared), &ptr )))
+    {
+        queue->shared = ptr;
+        update_queue_shm( queue );
+    }
+    if (!desktop->shared_mapping && (desktop->shared_mapping = create_shared_mapping( sizeof(*desktop->shared), &ptr )))
+    {
+        desktop->shared = ptr;
+        update_desktop_shm( desktop );
+    }
+
+    if (queue->shared_mapping && desktop->shared_mapping)
+    {
+        reply->queue = alloc_handle( current->process, queue->shared_mapping, SECTION_MAP_READ | SECTION_QUERY, 0 );
+        reply->desktop = alloc_handle( current->process, desktop->shared_mapping, SECTION_MAP_READ | SECTION_QUERY, 0 );
+    }
+    release_object( desktop );
+}
+
+
 /* send a message to a thread queue */
 DECL_HANDLER(send_message)
 {
@@ -2702,6 +2779,7 @@ DECL_HANDLER(get_message)
     }
     if (filter & QS_INPUT) queue->changed_bits &= ~QS_INPUT;
     if (filter & QS_PAINT) queue->changed_bits &= ~QS_PAINT;
+    update_queue_shm( queue );
 
     /* then check for posted messages */
     if ((filter & QS_POSTMESSAGE) &&
@@ -3228,6 +3306,7 @@ DECL_HANDLER(set_active_window)
         {
             reply->previous = queue->input->active;
             queue->input->active = get_user_full_handle( req->handle );
+            update_desktop_shm( desktop );
 
             if (desktop->foreground_input == queue->input && req->handle != reply->previous)
             {
@@ -34,6 +34,9 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -82,16 +85,25 @@ struct key
     WCHAR            *class;       /* key class */
     unsigned short    namelen;     /* length of key name */
     unsigned short    classlen;    /* length of class name */
+    unsigned int      hash;        /* hash of the key name */
+    unsigned int      bucket;      /* bucket in the subkey index of the parent, if it has one */
     struct key       *parent;      /* parent key */
     int               last_subkey; /* last in use subkey */
     int               nb_subkeys;  /* count of allocated subkeys */
+    int               sorted_subkeys; /* count of subkeys sorted at the start of the array */
     struct key      **subkeys;     /* subkeys array */
+    struct key_index *subkey_index; /* hash index of the subkeys array */
     int               last_value;  /* last in use value */
     int               nb_values;   /* count of allocated values in array */
+    int               sorted_values; /* count of values sorted at the start of the array */
     struct key_value *values;      /* values array */
+    struct key_index *value_index; /* hash index of the values array */
     unsigned int      flags;       /* flags */
     timeout_t         modif;       /* last modification time */
     struct list       notify_list; /* list of notifications */
+    struct hive_map  *hive_map;    /* hive holding the subkeys and values if not loaded yet */
+    file_pos_t        hive_pos;    /* offset of the key record in the hive mapping */
+    file_pos_t        hive_offset; /* offset of the key record in the hive file, 0 if not written */
 };
 
 /* key flags */
@@ -108,6 +120,8 @@ struct key_value
 {
     WCHAR            *name;    /* value name */
     unsigned short    namelen; /* length of value name */
+    unsigned int      hash;    /* hash of the value name */
+    unsigned int      bucket;  /* bucket in the value index of the key, if it has one */
     unsigned int      type;    /* value type */
     data_size_t       len;     /* value data length in bytes */
     void             *data;    /* pointer to value data */
@@ -115,6 +129,93 @@ struct key_value
 
 #define MIN_SUBKEYS  8   /* min. number of allocated subkeys per key */
 #define MIN_VALUES   8   /* min. number of allocated values per key */
+#define MIN_INDEXED  32  /* number of subkeys or values from which they are hash indexed */
+
+/* Keys with many subkeys or values use a hash index to find them. New
+ * entries are then appended unsorted to the array, and sorted only when
+ * the entries are enumerated by index or saved. Keys without an index
+ * keep their array fully sorted.
+ *
+ * Each entry stores its bucket, so that it can be removed from the index
+ * without a lookup. Removed entries leave a tombstone in their bucket until
+ * the index is rebuilt. */
+struct key_index
+{
+    unsigned int size;         /* number of buckets, a power of 2 */
+    unsigned int used;         /* number of buckets in use, including tombstones */
+    struct
+    {
+        int          pos;      /* position in the array, -1 for empty buckets, -2 for removed entries */
+        unsigned int hash;     /* hash of the entry name */
+    } buckets[1];
+};
+
+#define INDEX_EMPTY    -1
+#define INDEX_REMOVED  -2
+
+/*
+ * When WINEHIVE is set, the registry branches are also stored in a binary
+ * hive file next to the text file. The hive is mapped in memory at startup
+ * and the keys are created from it only when they are accessed. Periodic
+ * saves append the records of the modified keys to the hive and then update
+ * the root offset in the header, so that the file is always consistent. The
+ * records are built in the main loop, and a worker thread writes them and
+ * syncs the file. The hive is rewritten from scratch once it holds more
+ * unused than used data.
+ * The text file is still written on exit, and it is loaded instead of the
+ * hive if it has been modified since then.
+ *
+ * A key record is a struct hive_key followed by the name and class, the
+ * offsets of the subkey records and the values, each of them being a
+ * struct hive_value followed by the name and data. Everything is 8-byte
+ * aligned, and the subkeys and values are sorted.
+ */
+struct hive_header
+{
+    unsigned int   magic;       /* HIVE_MAGIC */
+    unsigned int   version;     /* HIVE_VERSION */
+    unsigned int   arch;        /* prefix type */
+    unsigned int   reserved;
+    file_pos_t     root;        /* offset of the root key record */
+    file_pos_t     size;        /* size of the valid data, anything past it is ignored */
+    file_pos_t     live;        /* size of the data at the last full rewrite */
+    file_pos_t     text_size;   /* size of the text file when it was last written */
+    file_pos_t     text_mtime;  /* modification time of the text file when it was last written */
+    file_pos_t     text_ino;    /* inode of the text file when it was last written */
+};
+
+#define HIVE_MAGIC   0x56494857  /* "WHIV" */
+#define HIVE_VERSION 1
+#define HIVE_KEY_FLAGS (KEY_SYMLINK | KEY_WOW64)  /* flags stored in the hive */
+
+struct hive_key
+{
+    timeout_t      modif;       /* last modification time */
+    unsigned int   flags;       /* HIVE_KEY_FLAGS */
+    unsigned int   subkeys;     /* number of subkeys */
+    unsigned int   values;      /* number of values */
+    unsigned short namelen;     /* length of the name in bytes */
+    unsigned short classlen;    /* length of the class in bytes */
+};
+
+struct hive_value
+{
+    unsigned int   type;        /* value type */
+    data_size_t    len;         /* data length in bytes */
+    unsigned short namelen;     /* length of the name in bytes */
+    unsigned short reserved[3];
+};
+
+#define HIVE_ALIGN(size) (((size) + 7) & ~(file_pos_t)7)
+
+/* a mapped hive file, referenced by the keys that haven't been loaded from it yet */
+struct hive_map
+{
+    unsigned int   refcount;    /* number of keys and branches referencing the mapping */
+    int            current;     /* mapping of the current hive file, offsets are still valid */
+    const char    *base;        /* base address of the mapping */
+    file_pos_t     size;        /* size of the valid data */
+};
 
 #define MAX_NAME_LEN  256    /* max. length of a key name */
 #define MAX_VALUE_LEN 16383  /* max. length of a value name */
@@ -122,6 +223,12 @@ struct key_value
 /* the root of the registry tree */
 static struct key *root_key;
 
+/* case-insensitive hash of a key or value name */
+static inline unsigned int hash_name( const WCHAR *name, data_size_t len )
+{
+    return hash_strW( name, len, ~0u );
+}
+
 static const timeout_t ticks_1601_to_1970 = (timeout_t)86400 * (369 * 365 + 89) * TICKS_PER_SEC;
 static const timeout_t save_period = 30 * -TICKS_PER_SEC;  /* delay between periodic saves */
 static struct timeout_user *save_timeout_user;  /* saving timer */
@@ -133,15 +240,29 @@ static const WCHAR symlink_value[] = {'S','y','m','b','o','l','i','c','L','i','n
 static const struct unicode_str symlink_str = { symlink_value, sizeof(symlink_value) };
 
 static void set_periodic_save_timer(void);
-static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index );
+static void release_hive_map( struct hive_map *map );
+static struct key_value *find_value( struct key *key, const struct unicode_str *name, int *index );
 
 /* information about where to save a registry branch */
 struct save_branch_info
 {
     struct key  *key;
     const char  *path;
+    char        *hive_path;    /* binary hive file name, NULL if not using a hive */
+    int          hive_fd;      /* unix fd of the hive file, -1 if not opened yet */
+    int          hive_full;    /* the hive needs to be rewritten from scratch */
+    int          text_dirty;   /* the branch changed since the text file was written */
+    struct hive_map   *map;    /* mapping of the hive loaded at startup */
+    struct hive_header header; /* header of the hive file */
+    char        *journal_path; /* journal file name, NULL if not using a journal */
+    FILE        *journal;      /* journal of the changes made since the text file was written */
+    int          journal_valid; /* all the changes since the text file was written are in the journal */
+    file_pos_t   text_size;    /* size of the text file when it was last written */
 };
 
+#define JOURNAL_MIN_SIZE (256 * 1024)  /* journal size below which the text file is never rewritten */
+static const char journal_header[] = "WINE REGISTRY Version 2\n";
+
 #define MAX_SAVE_BRANCH_INFO 3
 static int save_branch_count;
 static struct save_branch_info save_branch_info[MAX_SAVE_BRANCH_INFO];
@@ -274,6 +395,22 @@ static void dump_value( const struct key_value *value, FILE *f )
     fputc( '\n', f );
 }
 
+/* dump the header of a key and its options to a text file */
+static void dump_key( const struct key *key, const struct key *base, FILE *f )
+{
+    fprintf( f, "\n[" );
+    if (key != base) dump_path( key, base, f );
+    fprintf( f, "] %u\n", (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
+    fprintf( f, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
+    if (key->class)
+    {
+        fprintf( f, "#class=\"" );
+        dump_strW( key->class, key->classlen, f, "\"\"" );
+        fprintf( f, "\"\n" );
+    }
+    if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
+}
+
 /* save a registry and all its subkeys to a text file */
 static void save_subkeys( const struct key *key, const struct key *base, FILE *f )
 {
@@ -284,22 +421,94 @@ static void save_subkeys( const struct key *key, const struct key *base, FILE *f
     /* keys with no values but subkeys are saved implicitly by saving the subkeys */
     if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
     {
-        fprintf( f, "\n[" );
-        if (key != base) dump_path( key, base, f );
-        fprintf( f, "] %u\n", (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
-        fprintf( f, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
-        if (key->class)
-        {
-            fprintf( f, "#class=\"" );
-            dump_strW( key->class, key->classlen, f, "\"\"" );
-            fprintf( f, "\"\n" );
-        }
-        if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
+        dump_key( key, base, f );
         for (i = 0; i <= key->last_value; i++) dump_value( &key->values[i], f );
     }
     for (i = 0; i <= key->last_subkey; i++) save_subkeys( key->subkeys[i], base, f );
 }
 
+/*
+ * When WINEREGJOURNAL is set, changes to the branches saved as text files
+ * are appended to a journal as they are made, using the text file format with the [-key] and
+ * "value"=- syntax for deletions. Periodic saves then only need to flush
+ * the journal, and the text file is rewritten in the background once the
+ * journal gets too large. The journal is replayed on top of the text file
+ * at startup; replaying entries already included in the text file is
+ * harmless, so the journal can be emptied after the text file is renamed.
+ */
+
+/* get the branch containing a key, if its changes are journaled */
+static struct save_branch_info *get_journal_branch( const struct key *key )
+{
+    const struct key *parent;
+    int i;
+
+    if (key->flags & KEY_VOLATILE) return NULL;
+    for (parent = key; parent; parent = parent->parent)
+    {
+        for (i = 0; i < save_branch_count; i++)
+        {
+            if (save_branch_info[i].key != parent) continue;
+            if (!save_branch_info[i].journal || !save_branch_info[i].journal_valid) return NULL;
+            return &save_branch_info[i];
+        }
+    }
+    return NULL;
+}
+
+/* stop journaling the changes to a branch, they will be saved by rewriting the text file */
+static void invalidate_journal( const struct key *key )
+{
+    struct save_branch_info *branch = get_journal_branch( key );
+    if (branch) branch->journal_valid = 0;
+}
+
+/* add a new key or a new value of a key to the journal */
+static void journal_key( const struct key *key, const struct key_value *value )
+{
+    struct save_branch_info *branch = get_journal_branch( key );
+
+    if (!branch) return;
+    dump_key( key, branch->key, branch->journal );
+    if (value) dump_value( value, branch->journal );
+}
+
+/* add a deleted value to the journal */
+static void journal_delete_value( const struct key *key, const struct unicode_str *name )
+{
+    struct save_branch_info *branch = get_journal_branch( key );
+
+    if (!branch) return;
+    dump_key( key, branch->key, branch->journal );
+    if (name->len)
+    {
+        fputc( '\"', branch->journal );
+        dump_strW( name->str, name->len, branch->journal, "\"\"" );
+        fputs( "\"=-\n", branch->journal );
+    }
+    else fputs( "@=-\n", branch->journal );
+}
+
+/* add a deleted key to the journal; the parent must be the one it had before being deleted */
+static void journal_delete_key( struct save_branch_info *branch, const struct key *parent,
+                                const struct key *key )
+{
+    if (!branch) return;
+    if (branch->key == key)
+    {
+        branch->journal_valid = 0;
+        return;
+    }
+    fprintf( branch->journal, "\n[-" );
+    if (parent != branch->key)
+    {
+        dump_path( parent, branch->key, branch->journal );
+        fprintf( branch->journal, "\\\\" );
+    }
+    dump_strW( key->name, key->namelen, branch->journal, "[]" );
+    fprintf( branch->journal, "]\n" );
+}
+
 static void dump_operation( const struct key *key, const struct key_value *value, const char *op )
 {
     fprintf( stderr, "%s key ", op );
@@ -459,12 +668,15 @@ static void key_destroy( struct object *obj )
         free( key->values[i].data );
     }
     free( key->values );
+    free( key->value_index );
     for (i = 0; i <= key->last_subkey; i++)
     {
         key->subkeys[i]->parent = NULL;
         release_object( key->subkeys[i] );
     }
     free( key->subkeys );
+    free( key->subkey_index );
+    if (key->hive_map) release_hive_map( key->hive_map );
     /* unconditionally notify everything waiting on this key */
     while ((ptr = list_head( &key->notify_list )))
     {
@@ -522,16 +734,24 @@ static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
         key->name        = NULL;
         key->class       = NULL;
         key->namelen     = name->len;
+        key->hash        = hash_name( name->str, name->len );
         key->classlen    = 0;
         key->flags       = 0;
         key->last_subkey = -1;
         key->nb_subkeys  = 0;
+        key->sorted_subkeys = 0;
         key->subkeys     = NULL;
+        key->subkey_index = NULL;
         key->nb_values   = 0;
         key->last_value  = -1;
+        key->sorted_values = 0;
         key->values      = NULL;
+        key->value_index = NULL;
         key->modif       = modif;
         key->parent      = NULL;
+        key->hive_map    = NULL;
+        key->hive_pos    = 0;
+        key->hive_offset = 0;
         list_init( &key->notify_list );
         if (name->len && !(key->name = memdup( name->str, name->len )))
         {
@@ -591,6 +811,398 @@ static void touch_key( struct key *key, unsigned int change )
         check_notify( k, change, 0 );
 }
 
+/* compare two key or value names */
+static int compare_names( const WCHAR *name1, data_size_t len1, const WCHAR *name2, data_size_t len2 )
+{
+    int res = memicmp_strW( name1, name2, min( len1, len2 ));
+    if (!res) res = len1 - len2;
+    return res;
+}
+
+static int compare_subkeys( const void *p1, const void *p2 )
+{
+    const struct key *key1 = *(struct key * const *)p1;
+    const struct key *key2 = *(struct key * const *)p2;
+    return compare_names( key1->name, key1->namelen, key2->name, key2->namelen );
+}
+
+static int compare_values( const void *p1, const void *p2 )
+{
+    const struct key_value *value1 = p1;
+    const struct key_value *value2 = p2;
+    return compare_names( value1->name, value1->namelen, value2->name, value2->namelen );
+}
+
+/* sort the unsorted entries at the end of an array and merge them with the sorted ones */
+static void merge_sorted( void *array, int count, int sorted, size_t size,
+                          int (*compare)( const void *, const void * ) )
+{
+    char *base = array, *tail;
+    int i = sorted - 1, j = count - sorted - 1, pos = count - 1;
+
+    qsort( base + sorted * size, count - sorted, size, compare );
+    if (!sorted) return;
+    if (!(tail = malloc( (count - sorted) * size )))
+    {
+        qsort( base, count, size, compare );
+        return;
+    }
+    memcpy( tail, base + sorted * size, (count - sorted) * size );
+    while (j >= 0)
+    {
+        if (i >= 0 && compare( base + i * size, tail + j * size ) > 0)
+            memcpy( base + pos-- * size, base + i-- * size, size );
+        else
+            memcpy( base + pos-- * size, tail + j-- * size, size );
+    }
+    free( tail );
+}
+
+/* allocate a hash index for the specified number of entries */
+static struct key_index *alloc_index( int count )
+{
+    struct key_index *index;
+    unsigned int size = 2 * MIN_INDEXED;
+
+    while (size < 2 * count) size *= 2;
+    if (!(index = malloc( sizeof(*index) + (size - 1) * sizeof(index->buckets[0]) ))) return NULL;
+    index->size = size;
+    index->used = 0;
+    memset( index->buckets, 0xff, size * sizeof(index->buckets[0]) );
+    return index;
+}
+
+/* check if an index has room for a new entry, otherwise it needs to be rebuilt */
+static inline int index_has_room( const struct key_index *index, int count )
+{
+    return index->size >= 2 * count && index->size > 2 * index->used;
+}
+
+/* add an entry at the specified position in the array to a hash index, return its bucket */
+static unsigned int add_to_index( struct key_index *index, unsigned int hash, int pos )
+{
+    unsigned int i;
+
+    for (i = hash & (index->size - 1); index->buckets[i].pos >= 0; i = (i + 1) & (index->size - 1))
+        ;
+    if (index->buckets[i].pos == INDEX_EMPTY) index->used++;
+    index->buckets[i].pos  = pos;
+    index->buckets[i].hash = hash;
+    return i;
+}
+
+/* remove the entry in the specified bucket from a hash index */
+static inline void remove_from_index( struct key_index *index, unsigned int bucket )
+{
+    /* the bucket may be part of the probe sequence of other entries */
+    index->buckets[bucket].pos = INDEX_REMOVED;
+}
+
+/* remove an entry from the subkeys array, keeping the sorted part sorted */
+static void remove_subkey_entry( struct key *key, int pos )
+{
+    struct key_index *index = key->subkey_index;
+    int i;
+
+    if (index) remove_from_index( index, key->subkeys[pos]->bucket );
+    if (pos < key->sorted_subkeys)
+    {
+        for (i = pos; i < key->sorted_subkeys - 1; i++)
+        {
+            key->subkeys[i] = key->subkeys[i + 1];
+            if (index) index->buckets[key->subkeys[i]->bucket].pos = i;
+        }
+        pos = --key->sorted_subkeys;
+    }
+    /* the unsorted entries can be reordered, fill the hole with the last one */
+    if (pos < key->last_subkey)
+    {
+        key->subkeys[pos] = key->subkeys[key->last_subkey];
+        if (index) index->buckets[key->subkeys[pos]->bucket].pos = pos;
+    }
+    key->last_subkey--;
+}
+
+/* remove an entry from the values array, keeping the sorted part sorted */
+static void remove_value_entry( struct key *key, int pos )
+{
+    struct key_index *index = key->value_index;
+    int i;
+
+    if (index) remove_from_index( index, key->values[pos].bucket );
+    if (pos < key->sorted_values)
+    {
+        for (i = pos; i < key->sorted_values - 1; i++)
+        {
+            key->values[i] = key->values[i + 1];
+            if (index) index->buckets[key->values[i].bucket].pos = i;
+        }
+        pos = --key->sorted_values;
+    }
+    /* the unsorted entries can be reordered, fill the hole with the last one */
+    if (pos < key->last_value)
+    {
+        key->values[pos] = key->values[key->last_value];
+        if (index) index->buckets[key->values[pos].bucket].pos = pos;
+    }
+    key->last_value--;
+}
+
+/* rebuild the subkeys index after the array has been reordered or has grown */
+static void build_subkey_index( struct key *key )
+{
+    struct key_index *index = key->subkey_index;
+    int i, count = key->last_subkey + 1;
+
+    if (!index && count < MIN_INDEXED) return;
+    if (!index || index->size < 2 * count)
+    {
+        if (!(index = alloc_index( count )))
+        {
+            /* fall back to a sorted array */
+            merge_sorted( key->subkeys, count, key->sorted_subkeys, sizeof(*key->subkeys), compare_subkeys );
+            key->sorted_subkeys = count;
+            free( key->subkey_index );
+            key->subkey_index = NULL;
+            return;
+        }
+        free( key->subkey_index );
+        key->subkey_index = index;
+    }
+    else
+    {
+        memset( index->buckets, 0xff, index->size * sizeof(index->buckets[0]) );
+        index->used = 0;
+    }
+
+    for (i = 0; i < count; i++) key->subkeys[i]->bucket = add_to_index( index, key->subkeys[i]->hash, i );
+}
+
+/* rebuild the values index after the array has been reordered or has grown */
+static void build_value_index( struct key *key )
+{
+    struct key_index *index = key->value_index;
+    int i, count = key->last_value + 1;
+
+    if (!index && count < MIN_INDEXED) return;
+    if (!index || index->size < 2 * count)
+    {
+        if (!(index = alloc_index( count )))
+        {
+            /* fall back to a sorted array */
+            merge_sorted( key->values, count, key->sorted_values, sizeof(*key->values), compare_values );
+            key->sorted_values = count;
+            free( key->value_index );
+            key->value_index = NULL;
+            return;
+        }
+        free( key->value_index );
+        key->value_index = index;
+    }
+    else
+    {
+        memset( index->buckets, 0xff, index->size * sizeof(index->buckets[0]) );
+        index->used = 0;
+    }
+
+    for (i = 0; i < count; i++) key->values[i].bucket = add_to_index( index, key->values[i].hash, i );
+}
+
+/* make sure the subkeys are sorted, for enumerating them by index */
+static void sort_subkeys( struct key *key )
+{
+    if (key->sorted_subkeys > key->last_subkey) return;
+    merge_sorted( key->subkeys, key->last_subkey + 1, key->sorted_subkeys,
+                  sizeof(*key->subkeys), compare_subkeys );
+    key->sorted_subkeys = key->last_subkey + 1;
+    build_subkey_index( key );
+}
+
+/* make sure the values are sorted, for enumerating them by index */
+static void sort_values( struct key *key )
+{
+    if (key->sorted_values > key->last_value) return;
+    merge_sorted( key->values, key->last_value + 1, key->sorted_values,
+                  sizeof(*key->values), compare_values );
+    key->sorted_values = key->last_value + 1;
+    build_value_index( key );
+}
+
+/* release a reference to a hive mapping */
+static void release_hive_map( struct hive_map *map )
+{
+    if (--map->refcount) return;
+    munmap( (void *)map->base, map->size );
+    free( map );
+}
+
+/* get a pointer to some data in a hive mapping, checking that it is inside the valid data */
+static const void *get_hive_data( const struct hive_map *map, file_pos_t pos, file_pos_t size )
+{
+    if (pos < sizeof(struct hive_header) || pos > map->size || size > map->size - pos) return NULL;
+    return map->base + pos;
+}
+
+/* get a key record in a hive mapping, with its subkey offsets and the position of its values */
+static const struct hive_key *get_hive_key( const struct hive_map *map, file_pos_t pos,
+                                            const file_pos_t **offsets, file_pos_t *values_pos )
+{
+    const struct hive_key *rec;
+    file_pos_t size;
+
+    if (pos & 7) return NULL;
+    if (!(rec = get_hive_data( map, pos, sizeof(*rec) ))) return NULL;
+    if (rec->namelen > MAX_NAME_LEN * sizeof(WCHAR) || ((rec->namelen | rec->classlen) & 1)) return NULL;
+    size = HIVE_ALIGN( sizeof(*rec) + rec->namelen + rec->classlen );
+    if (!(*offsets = get_hive_data( map, pos + size, (file_pos_t)rec->subkeys * sizeof(**offsets) )))
+        return NULL;
+    *values_pos = pos + size + (file_pos_t)rec->subkeys * sizeof(**offsets);
+    return rec;
+}
+
+/* get a value record in a hive mapping, and move the position to the next one */
+static const struct hive_value *get_hive_value( const struct hive_map *map, file_pos_t *pos )
+{
+    const struct hive_value *rec;
+    file_pos_t size;
+
+    if (!(rec = get_hive_data( map, *pos, sizeof(*rec) ))) return NULL;
+    if (rec->namelen > MAX_VALUE_LEN * sizeof(WCHAR) || (rec->namelen & 1)) return NULL;
+    size = HIVE_ALIGN( sizeof(*rec) + rec->namelen + (file_pos_t)rec->len );
+    if (!get_hive_data( map, *pos, size )) return NULL;
+    *pos += size;
+    return rec;
+}
+
+/* create a key from a hive record, without loading its subkeys and values yet */
+static struct key *load_hive_key( struct hive_map *map, file_pos_t pos )
+{
+    const struct hive_key *rec;
+    const file_pos_t *offsets;
+    struct unicode_str name;
+    file_pos_t values_pos;
+    struct key *key;
+
+    if (!(rec = get_hive_key( map, pos, &offsets, &values_pos ))) return NULL;
+    name.str = (const WCHAR *)(rec + 1);
+    name.len = rec->namelen;
+    if (!(key = alloc_key( &name, rec->modif ))) return NULL;
+    key->flags = rec->flags & HIVE_KEY_FLAGS;
+    if (rec->classlen && (key->class = memdup( name.str + name.len / sizeof(WCHAR), rec->classlen )))
+        key->classlen = rec->classlen;
+    if (rec->subkeys || rec->values)
+    {
+        key->hive_map = map;
+        key->hive_pos = pos;
+        map->refcount++;
+    }
+    if (map->current) key->hive_offset = pos;
+    return key;
+}
+
+/* create the subkeys and values of a key that haven't been loaded from its hive yet */
+static void load_key_contents( struct key *key )
+{
+    struct hive_map *map = key->hive_map;
+    const struct hive_key *rec;
+    const struct hive_value *val;
+    const file_pos_t *offsets;
+    file_pos_t pos;
+    unsigned int i;
+    int ok = 0;
+
+    if (!map) return;
+    key->hive_map = NULL;
+
+    if (!(rec = get_hive_key( map, key->hive_pos, &offsets, &pos ))) goto done;
+    if (rec->subkeys)
+    {
+        int count = max( rec->subkeys, MIN_SUBKEYS );
+        if (!(key->subkeys = malloc( count * sizeof(*key->subkeys) ))) goto done;
+        key->nb_subkeys = count;
+        for (i = 0; i < rec->subkeys; i++)
+        {
+            struct key *subkey;
+
+            if (!(subkey = load_hive_key( map, offsets[i] ))) goto done;
+            subkey->parent = key;
+            key->subkeys[++key->last_subkey] = subkey;
+        }
+    }
+    if (rec->values)
+    {
+        int count = max( rec->values, MIN_VALUES );
+        if (!(key->values = malloc( count * sizeof(*key->values) ))) goto done;
+        key->nb_values = count;
+        for (i = 0; i < rec->values; i++)
+        {
+            struct key_value *value = &key->values[key->last_value + 1];
+            const char *data;
+
+            if (!(val = get_hive_value( map, &pos ))) goto done;
+            data = (const char *)(val + 1);
+            value->name = NULL;
+            value->data = NULL;
+            if (val->namelen && !(value->name = memdup( data, val->namelen ))) goto done;
+            if (val->len && !(value->data = memdup( data + val->namelen, val->len )))
+            {
+                free( value->name );
+                goto done;
+            }
+            value->namelen = val->namelen;
+            value->hash    = hash_name( value->name, value->namelen );
+            value->type    = val->type;
+            value->len     = val->len;
+            key->last_value++;
+        }
+    }
+    ok = 1;
+
+done:
+    /* the hive records are sorted */
+    key->sorted_subkeys = key->last_subkey + 1;
+    key->sorted_values  = key->last_value + 1;
+    build_subkey_index( key );
+    build_value_index( key );
+    if (!ok)
+    {
+        fprintf( stderr, "wineserver: could not load registry key from hive: " );
+        dump_path( key, NULL, stderr );
+        fprintf( stderr, "\n" );
+    }
+    release_hive_map( map );
+}
+
+/* get the number of subkeys and values of a key, without loading them from the hive */
+static void get_key_counts( struct key *key, int *subkeys, int *values )
+{
+    const struct hive_key *rec;
+    const file_pos_t *offsets;
+    file_pos_t pos;
+
+    if (key->hive_map && (rec = get_hive_key( key->hive_map, key->hive_pos, &offsets, &pos )))
+    {
+        *subkeys = rec->subkeys;
+        *values  = rec->values;
+        return;
+    }
+    load_key_contents( key );
+    *subkeys = key->last_subkey + 1;
+    *values  = key->last_value + 1;
+}
+
+/* sort the subkeys and values of a key and all its non-volatile subkeys, loading them if needed */
+static void sort_key_tree( struct key *key )
+{
+    int i;
+
+    if (key->flags & KEY_VOLATILE) return;
+    load_key_contents( key );
+    sort_subkeys( key );
+    sort_values( key );
+    for (i = 0; i <= key->last_subkey; i++) sort_key_tree( key->subkeys[i] );
+}
+
 /* try to grow the array of subkeys; return 1 if OK, 0 on error */
 static int grow_subkeys( struct key *key )
 {
@@ -639,6 +1251,11 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
         for (i = ++parent->last_subkey; i > index; i--)
             parent->subkeys[i] = parent->subkeys[i-1];
         parent->subkeys[index] = key;
+        if (!parent->subkey_index) parent->sorted_subkeys++;
+        if (parent->subkey_index && index_has_room( parent->subkey_index, parent->last_subkey + 1 ))
+            key->bucket = add_to_index( parent->subkey_index, key->hash, index );
+        else
+            build_subkey_index( parent );
         if (is_wow6432node( key->name, key->namelen ) && !is_wow6432node( parent->name, parent->namelen ))
             parent->flags |= KEY_WOW64;
     }
@@ -649,14 +1266,13 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
 static void free_subkey( struct key *parent, int index )
 {
     struct key *key;
-    int i, nb_subkeys;
+    int nb_subkeys;
 
     assert( index >= 0 );
     assert( index <= parent->last_subkey );
 
     key = parent->subkeys[index];
-    for (i = index; i < parent->last_subkey; i++) parent->subkeys[i] = parent->subkeys[i + 1];
-    parent->last_subkey--;
+    remove_subkey_entry( parent, index );
     key->flags |= KEY_DELETED;
     key->parent = NULL;
     if (is_wow6432node( key->name, key->namelen )) parent->flags &= ~KEY_WOW64;
@@ -676,11 +1292,31 @@ static void free_subkey( struct key *parent, int index )
 }
 
 /* find the named child of a given key and return its index */
-static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
+static struct key *find_subkey( struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
     data_size_t len;
 
+    load_key_contents( key );
+    if (key->subkey_index)
+    {
+        unsigned int hash = hash_name( name->str, name->len ), mask = key->subkey_index->size - 1;
+
+        for (i = hash & mask; (res = key->subkey_index->buckets[i].pos) != INDEX_EMPTY; i = (i + 1) & mask)
+        {
+            struct key *subkey;
+            if (res == INDEX_REMOVED || key->subkey_index->buckets[i].hash != hash) continue;
+            subkey = key->subkeys[res];
+            if (!compare_names( subkey->name, subkey->namelen, name->str, name->len ))
+            {
+                *index = res;
+                return subkey;
+            }
+        }
+        *index = key->last_subkey + 1;  /* new subkeys are appended to indexed keys */
+        return NULL;
+    }
+
     min = 0;
     max = key->last_subkey;
     while (min <= max)
@@ -871,6 +1507,7 @@ static struct key *create_key( struct key *key, const struct unicode_str *name,
         if (!(key->class = memdup( class->str, key->classlen ))) key->classlen = 0;
     }
     touch_key( key->parent, REG_NOTIFY_CHANGE_NAME );
+    journal_key( key, NULL );
     grab_object( key );
     return key;
 }
@@ -936,11 +1573,13 @@ static void enum_key( struct key *key, int index, int info_class, struct enum_ke
 
     if (index != -1)  /* -1 means use the specified key directly */
     {
+        load_key_contents( key );
         if ((index < 0) || (index > key->last_subkey))
         {
             set_error( STATUS_NO_MORE_ENTRIES );
             return;
         }
+        sort_subkeys( key );
         key = key->subkeys[index];
     }
 
@@ -963,6 +1602,7 @@ static void enum_key( struct key *key, int index, int info_class, struct enum_ke
         break;
     case KeyFullInformation:
     case KeyCachedInformation:
+        load_key_contents( key );
         for (i = 0; i <= key->last_subkey; i++)
         {
             if (key->subkeys[i]->namelen > max_subkey) max_subkey = key->subkeys[i]->namelen;
@@ -986,8 +1626,7 @@ static void enum_key( struct key *key, int index, int info_class, struct enum_ke
         set_error( STATUS_INVALID_PARAMETER );
         return;
     }
-    reply->subkeys = key->last_subkey + 1;
-    reply->values  = key->last_value + 1;
+    get_key_counts( key, &reply->subkeys, &reply->values );
     reply->modif   = key->modif;
     reply->total   = namelen + classlen;
 
@@ -1020,6 +1659,7 @@ static int delete_key( struct key *key, int recurse )
 {
     int index;
     struct key *parent = key->parent;
+    struct unicode_str name;
 
     /* must find parent and index */
     if (key == root_key)
@@ -1035,13 +1675,15 @@ static int delete_key( struct key *key, int recurse )
         return -1;
     }
 
+    load_key_contents( key );
     while (recurse && (key->last_subkey>=0))
         if (0 > delete_key(key->subkeys[key->last_subkey], 1))
             return -1;
 
-    for (index = 0; index <= parent->last_subkey; index++)
-        if (parent->subkeys[index] == key) break;
-    assert( index <= parent->last_subkey );
+    name.str = key->name;
+    name.len = key->namelen;
+    find_subkey( parent, &name, &index );
+    assert( index <= parent->last_subkey && parent->subkeys[index] == key );
 
     /* we can only delete a key that has no subkeys */
     if (key->last_subkey >= 0)
@@ -1082,11 +1724,31 @@ static int grow_values( struct key *key )
 }
 
 /* find the named value of a given key and return its index in the array */
-static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index )
+static struct key_value *find_value( struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
     data_size_t len;
 
+    load_key_contents( key );
+    if (key->value_index)
+    {
+        unsigned int hash = hash_name( name->str, name->len ), mask = key->value_index->size - 1;
+
+        for (i = hash & mask; (res = key->value_index->buckets[i].pos) != INDEX_EMPTY; i = (i + 1) & mask)
+        {
+            struct key_value *value;
+            if (res == INDEX_REMOVED || key->value_index->buckets[i].hash != hash) continue;
+            value = &key->values[res];
+            if (!compare_names( value->name, value->namelen, name->str, name->len ))
+            {
+                *index = res;
+                return value;
+            }
+        }
+        *index = key->last_value + 1;  /* new values are appended to indexed keys */
+        return NULL;
+    }
+
     min = 0;
     max = key->last_value;
     while (min <= max)
@@ -1128,8 +1790,17 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
     value = &key->values[index];
     value->name    = new_name;
     value->namelen = name->len;
+    value->hash    = hash_name( name->str, name->len );
     value->len     = 0;
     value->data    = NULL;
+    if (!key->value_index) key->sorted_values++;
+    if (key->value_index && index_has_room( key->value_index, key->last_value + 1 ))
+        value->bucket = add_to_index( key->value_index, value->hash, index );
+    else if (key->last_value + 1 >= MIN_INDEXED)
+    {
+        build_value_index( key );
+        value = find_value( key, name, &index );  /* the array gets sorted if the index can't be allocated */
+    }
     return value;
 }
 
@@ -1184,6 +1855,7 @@ static void set_value( struct key *key, const struct unicode_str *name,
     value->len   = len;
     value->data  = ptr;
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
+    journal_key( key, value );
     if (debug_level > 1) dump_operation( key, value, "Set" );
 }
 
@@ -1224,12 +1896,14 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
         return;
     }
 
+    load_key_contents( key );
     if (i < 0 || i > key->last_value) set_error( STATUS_NO_MORE_ENTRIES );
     else
     {
         void *data;
         data_size_t namelen, maxlen;
 
+        sort_values( key );
         value = &key->values[i];
         reply->type = value->type;
         namelen = value->namelen;
@@ -1270,29 +1944,15 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
     }
 }
 
-/* delete a value */
-static void delete_value( struct key *key, const struct unicode_str *name )
+/* remove a value from the values array of a key */
+static void remove_value( struct key *key, int index )
 {
-    struct key_value *value;
-    int i, index, nb_values;
-
-    if (key->flags & KEY_PREDEF)
-    {
-        set_error( STATUS_INVALID_HANDLE );
-        return;
-    }
+    struct key_value *value = &key->values[index];
+    int nb_values;
 
-    if (!(value = find_value( key, name, &index )))
-    {
-        set_error( STATUS_OBJECT_NAME_NOT_FOUND );
-        return;
-    }
-    if (debug_level > 1) dump_operation( key, value, "Delete" );
     free( value->name );
     free( value->data );
-    for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
-    key->last_value--;
-    touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
+    remove_value_entry( key, index );
 
     /* try to shrink the array */
     nb_values = key->nb_values;
@@ -1307,6 +1967,29 @@ static void delete_value( struct key *key, const struct unicode_str *name )
     }
 }
 
+/* delete a value */
+static void delete_value( struct key *key, const struct unicode_str *name )
+{
+    struct key_value *value;
+    int index;
+
+    if (key->flags & KEY_PREDEF)
+    {
+        set_error( STATUS_INVALID_HANDLE );
+        return;
+    }
+
+    if (!(value = find_value( key, name, &index )))
+    {
+        set_error( STATUS_OBJECT_NAME_NOT_FOUND );
+        return;
+    }
+    if (debug_level > 1) dump_operation( key, value, "Delete" );
+    remove_value( key, index );
+    touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
+    journal_delete_value( key, name );
+}
+
 /* get the registry key corresponding to an hkey handle */
 static struct key *get_hkey_obj( obj_handle_t hkey, unsigned int access )
 {
@@ -1459,6 +2142,40 @@ static struct key *load_key( struct key *base, const char *buffer, int prefix_le
     return create_key_recursive( base, &name, 0 );
 }
 
+/* delete a key listed as [-name] in the input file */
+static void load_deleted_key( struct key *base, const char *buffer, int prefix_len,
+                              struct file_load_info *info )
+{
+    WCHAR *p;
+    struct unicode_str name, token;
+    struct key *key = base;
+    data_size_t len;
+    int index;
+
+    if (!get_file_tmp_space( info, strlen(buffer) * sizeof(WCHAR) )) return;
+
+    len = info->tmplen;
+    if (parse_strW( info->tmp, &len, buffer, ']' ) == -1)
+    {
+        file_read_error( "Malformed key", info );
+        return;
+    }
+
+    p = info->tmp;
+    while (prefix_len && *p) { if (*p++ == '\\') prefix_len--; }
+    name.str = p;
+    name.len = len - (p - info->tmp + 1) * sizeof(WCHAR);
+
+    token.str = NULL;
+    if (!get_path_token( &name, &token )) return;
+    while (token.len)
+    {
+        if (!(key = find_subkey( key, &token, &index ))) return;  /* nothing to delete */
+        get_path_token( &name, &token );
+    }
+    if (key != base) delete_key( key, 1 );
+}
+
 /* update the modification time of a key (and its parents) after it has been loaded from a file */
 static void update_key_time( struct key *key, timeout_t modif )
 {
@@ -1581,6 +2298,11 @@ static struct key_value *parse_value_name( struct key *key, const char *buffer,
     if (buffer[*len] != '=') goto error;
     (*len)++;
     while (isspace(buffer[*len])) (*len)++;
+    if (buffer[*len] == '-' && !buffer[*len + 1])  /* deleted value */
+    {
+        if ((value = find_value( key, &name, &index ))) remove_value( key, index );
+        return NULL;
+    }
     if (!(value = find_value( key, &name, &index ))) value = insert_value( key, &name, index );
     return value;
 
@@ -1723,6 +2445,13 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
             {
                 update_key_time( subkey, modif );
                 release_object( subkey );
+                subkey = NULL;
+            }
+            if (p[1] == '-')  /* deleted key */
+            {
+                if (prefix_len == -1) prefix_len = get_prefix_len( key, p + 2, &info );
+                load_deleted_key( key, p + 2, prefix_len, &info );
+                break;
             }
             if (prefix_len == -1) prefix_len = get_prefix_len( key, p + 1, &info );
             if (!(subkey = load_key( key, p + 1, prefix_len, &info, &modif )))
@@ -1777,28 +2506,193 @@ static void load_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/* check if the registry branches are stored in binary hives */
+static int do_hive(void)
+{
+    static int use_hive = -1;
+
+    if (use_hive == -1)
+    {
+        const char *env = getenv( "WINEHIVE" );
+        use_hive = env && atoi( env );
+        if (use_hive && debug_level) fprintf( stderr, "wineserver: using registry hives\n" );
+    }
+    return use_hive;
+}
+
+/* check if the changes to the text branches are journaled */
+static int do_journal(void)
+{
+    static int use_journal = -1;
+
+    if (use_journal == -1)
+    {
+        const char *env = getenv( "WINEREGJOURNAL" );
+        use_journal = env && atoi( env );
+        if (use_journal && debug_level) fprintf( stderr, "wineserver: using registry journals\n" );
+    }
+    return use_journal;
+}
+
+/* build the name of the hive or journal file of a branch from the name of its text file */
+static char *get_branch_file_path( const char *path, const char *new_ext )
+{
+    const char *ext = strrchr( path, '.' );
+    size_t len = ext ? ext - path : strlen( path );
+    char *ret;
+
+    if ((ret = mem_alloc( len + strlen( new_ext ) + 1 )))
+    {
+        memcpy( ret, path, len );
+        strcpy( ret + len, new_ext );
+    }
+    return ret;
+}
+
+/* store the identity of the text file of a branch, to detect changes made while the server wasn't running */
+static void get_text_stamp( const char *path, struct hive_header *header )
+{
+    struct stat st;
+
+    if (stat( path, &st ) == -1) memset( &st, 0, sizeof(st) );
+    header->text_size  = st.st_size;
+    header->text_mtime = st.st_mtime;
+    header->text_ino   = st.st_ino;
+}
+
+/* map the hive of a registry branch, if it is still in sync with the text file */
+static int load_init_hive( struct save_branch_info *info, struct key *key )
+{
+    struct hive_header *header = &info->header, text;
+    const struct hive_key *rec;
+    const file_pos_t *offsets;
+    struct hive_map *map;
+    file_pos_t pos;
+    struct stat st;
+    void *base;
+    int fd;
+
+    if ((fd = open( info->hive_path, O_RDWR )) == -1) return 0;
+    if (pread( fd, header, sizeof(*header), 0 ) != sizeof(*header)) goto failed;
+    if (header->magic != HIVE_MAGIC || header->version != HIVE_VERSION) goto failed;
+    if (fstat( fd, &st ) == -1 || header->size > (file_pos_t)st.st_size || header->size <= sizeof(*header)) goto failed;
+    if (header->arch != PREFIX_32BIT && header->arch != PREFIX_64BIT) goto failed;
+    if (prefix_type != PREFIX_UNKNOWN && header->arch != prefix_type) goto failed;
+
+    get_text_stamp( info->path, &text );
+    if (text.text_size != header->text_size || text.text_mtime != header->text_mtime ||
+        text.text_ino != header->text_ino)
+    {
+        if (debug_level) fprintf( stderr, "wineserver: %s has changed, not using %s\n",
+                                  info->path, info->hive_path );
+        goto failed;
+    }
+
+    if (!(map = mem_alloc( sizeof(*map) ))) goto failed;
+    if ((base = mmap( NULL, header->size, PROT_READ, MAP_PRIVATE, fd, 0 )) == MAP_FAILED)
+    {
+        free( map );
+        goto failed;
+    }
+    map->refcount = 1;
+    map->current  = 1;
+    map->base     = base;
+    map->size     = header->size;
+    if (!(rec = get_hive_key( map, header->root, &offsets, &pos )))
+    {
+        release_hive_map( map );
+        goto failed;
+    }
+
+    key->modif = rec->modif;
+    key->flags |= rec->flags & HIVE_KEY_FLAGS;
+    key->hive_offset = header->root;
+    if (rec->subkeys || rec->values)
+    {
+        key->hive_map = map;
+        key->hive_pos = header->root;
+        map->refcount++;
+    }
+    prefix_type = header->arch;
+    info->map = map;
+    info->hive_fd = fd;
+    info->hive_full = 0;
+    return 1;
+
+failed:
+    close( fd );
+    return 0;
+}
+
+/* replay the journal of a branch on top of its text file, and open it to record the new changes */
+static void open_journal( struct save_branch_info *info, struct key *key )
+{
+    struct stat st;
+    FILE *f;
+
+    if (!stat( info->path, &st )) info->text_size = st.st_size;
+    if (!(info->journal_path = get_branch_file_path( info->path, ".jnl" ))) return;
+
+    if ((f = fopen( info->journal_path, "r" )))
+    {
+        load_keys( key, info->journal_path, f, 0 );
+        fclose( f );
+        clear_error();
+        /* a journal left by a previous server is removed once the text file holds its changes */
+        if (!do_journal()) make_dirty( key );
+    }
+    if (!do_journal())
+    {
+        if (!f)
+        {
+            free( info->journal_path );
+            info->journal_path = NULL;
+        }
+        return;
+    }
+    if (!(info->journal = fopen( info->journal_path, "a" ))) return;
+    if (fstat( fileno( info->journal ), &st ) == -1 || !st.st_size) fputs( journal_header, info->journal );
+    /* the replayed changes still need to be written to the text file */
+    else if (st.st_size > strlen( journal_header )) make_dirty( key );
+    info->journal_valid = 1;
+}
+
 /* load one of the initial registry files */
 static int load_init_registry_from_file( const char *filename, struct key *key )
 {
-    FILE *f;
+    struct save_branch_info *info;
+    FILE *f = NULL;
+
+    assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
 
-    if ((f = fopen( filename, "r" )))
+    info = &save_branch_info[save_branch_count];
+    memset( info, 0, sizeof(*info) );
+    info->path = filename;
+    info->hive_fd = -1;
+    info->hive_full = 1;
+
+    if (do_hive() && (info->hive_path = get_branch_file_path( filename, ".hiv" )) && load_init_hive( info, key ))
+    {
+        if (debug_level) fprintf( stderr, "wineserver: loaded registry hive %s\n", info->hive_path );
+    }
+    else if ((f = fopen( filename, "r" )))
     {
         load_keys( key, filename, f, 0 );
         fclose( f );
         if (get_error() == STATUS_NOT_REGISTRY_FILE)
         {
             fprintf( stderr, "%s is not a valid registry file\n", filename );
+            free( info->hive_path );
             return 1;
         }
     }
+    if (info->hive_path && info->hive_fd == -1) get_text_stamp( filename, &info->header );
+    if (!info->hive_path) open_journal( info, key );  /* replays a leftover journal even if disabled */
 
-    assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
-
-    save_branch_info[save_branch_count].path = filename;
-    save_branch_info[save_branch_count++].key = (struct key *)grab_object( key );
+    save_branch_count++;
+    info->key = (struct key *)grab_object( key );
     make_object_permanent( &key->obj );
-    return (f != NULL);
+    return (f != NULL || info->hive_fd != -1);
 }
 
 static WCHAR *format_user_registry_path( const SID *sid, struct unicode_str *path )
@@ -1998,6 +2892,7 @@ static void save_registry( struct key *key, obj_handle_t handle )
     int fd;
 
     if (!(file = get_file_obj( current->process, handle, FILE_WRITE_DATA ))) return;
+    sort_key_tree( key );
     fd = dup( get_file_unix_fd( file ) );
     release_object( file );
     if (fd != -1)
@@ -2016,19 +2911,14 @@ static void save_registry( struct key *key, obj_handle_t handle )
     }
 }
 
-/* save a registry branch to a file */
-static int save_branch( struct key *key, const char *path )
+/* open the file to save a registry branch to, using a temp file in the same directory if possible */
+static int open_branch_file( const char *path, char **tmp_ret )
 {
     struct stat st;
-    char *p, *tmp = NULL;
-    int fd, count = 0, ret = 0;
-    FILE *f;
+    char *p, *tmp;
+    int fd, count = 0;
 
-    if (!(key->flags & KEY_DIRTY))
-    {
-        if (debug_level > 1) dump_operation( key, NULL, "Not saving clean" );
-        return 1;
-    }
+    *tmp_ret = NULL;
 
     /* test the file type */
 
@@ -2039,14 +2929,14 @@ static int save_branch( struct key *key, const char *path )
         if (!lstat( path, &st ) && (!S_ISREG(st.st_mode) || st.st_nlink > 1))
         {
             ftruncate( fd, 0 );
-            goto save;
+            return fd;
         }
         close( fd );
     }
 
     /* create a temp file in the same directory */
 
-    if (!(tmp = malloc( strlen(path) + 20 ))) goto done;
+    if (!(tmp = malloc( strlen(path) + 20 ))) return -1;
     strcpy( tmp, path );
     if ((p = strrchr( tmp, '/' ))) p++;
     else p = tmp;
@@ -2054,18 +2944,25 @@ static int save_branch( struct key *key, const char *path )
     {
         sprintf( p, "reg%lx%04x.tmp", (long) getpid(), count++ );
         if ((fd = open( tmp, O_CREAT | O_EXCL | O_WRONLY, 0666 )) != -1) break;
-        if (errno != EEXIST) goto done;
-        close( fd );
+        if (errno != EEXIST)
+        {
+            free( tmp );
+            return -1;
+        }
     }
+    *tmp_ret = tmp;
+    return fd;
+}
 
-    /* now save to it */
+/* write a registry branch to an opened file; this may be called from a worker thread */
+static int write_branch_file( struct key *key, const char *path, int fd )
+{
+    FILE *f;
 
- save:
     if (!(f = fdopen( fd, "w" )))
     {
-        if (tmp) unlink( tmp );
         close( fd );
-        goto done;
+        return 0;
     }
 
     if (debug_level > 1)
@@ -2075,32 +2972,554 @@ static int save_branch( struct key *key, const char *path )
     }
 
     save_all_subkeys( key, f );
-    ret = !fclose(f);
+    return !fclose(f);
+}
 
+/* move the temp file to its final name once the branch has been written */
+static int close_branch_file( const char *path, char *tmp, int ret )
+{
     if (tmp)
     {
         /* if successfully written, rename to final name */
         if (ret) ret = !rename( tmp, path );
         if (!ret) unlink( tmp );
+        free( tmp );
     }
+    return ret;
+}
+
+/* save a registry branch to a file */
+static int save_branch( struct key *key, const char *path )
+{
+    char *tmp;
+    int fd, ret;
 
+    if (!(key->flags & KEY_DIRTY))
+    {
+        if (debug_level > 1) dump_operation( key, NULL, "Not saving clean" );
+        return 1;
+    }
+
+    if ((fd = open_branch_file( path, &tmp )) == -1) return 0;
+    sort_key_tree( key );
+    ret = write_branch_file( key, path, fd );
+    if ((ret = close_branch_file( path, tmp, ret ))) make_clean( key );
+    return ret;
+}
+
+#define HIVE_MIN_GARBAGE (1024 * 1024)  /* unused hive data below which it is never rewritten */
+
+/* records to append to a hive file */
+struct hive_writer
+{
+    char        *data;   /* buffer for the records */
+    size_t       size;   /* size of the records */
+    size_t       alloc;  /* allocated size of the buffer */
+    file_pos_t   base;   /* file offset where the buffer will be written */
+    int          full;   /* writing a new file, all the keys need to be written */
+    int          error;  /* out of memory */
+};
+
+/* allocate space for a record in the buffer and return its file offset, or 0 on error */
+static file_pos_t alloc_hive_record( struct hive_writer *w, file_pos_t size, void **ptr )
+{
+    size = HIVE_ALIGN( size );
+    if (w->size + size > w->alloc)
+    {
+        size_t new_alloc = max( 2 * w->alloc, 65536 );
+        char *new_data;
+
+        while (new_alloc < w->size + size) new_alloc *= 2;
+        if (!(new_data = realloc( w->data, new_alloc )))
+        {
+            w->error = 1;
+            return 0;
+        }
+        w->data = new_data;
+        w->alloc = new_alloc;
+    }
+    *ptr = w->data + w->size;
+    memset( *ptr, 0, size );
+    w->size += size;
+    return w->base + w->size - size;
+}
+
+/* copy a key record and all its subkeys from a hive mapping; return 0 on error */
+static file_pos_t copy_hive_key( struct hive_writer *w, const struct hive_map *map, file_pos_t pos )
+{
+    const struct hive_key *rec;
+    const file_pos_t *offsets;
+    file_pos_t *new_offsets = NULL, values_pos, end, ret = 0;
+    size_t header_size;
+    unsigned int i;
+    char *ptr;
+
+    if (!(rec = get_hive_key( map, pos, &offsets, &values_pos ))) return 0;
+    end = values_pos;
+    for (i = 0; i < rec->values; i++) if (!get_hive_value( map, &end )) return 0;
+
+    if (rec->subkeys && !(new_offsets = malloc( rec->subkeys * sizeof(*new_offsets) )))
+    {
+        w->error = 1;
+        return 0;
+    }
+    for (i = 0; i < rec->subkeys; i++)
+        if (!(new_offsets[i] = copy_hive_key( w, map, offsets[i] ))) goto done;
+
+    if ((ret = alloc_hive_record( w, end - pos, (void **)&ptr )))
+    {
+        header_size = (const char *)offsets - (const char *)rec;
+        memcpy( ptr, rec, header_size );
+        ptr += header_size;
+        memcpy( ptr, new_offsets, rec->subkeys * sizeof(*new_offsets) );
+        ptr += rec->subkeys * sizeof(*new_offsets);
+        memcpy( ptr, map->base + values_pos, end - values_pos );
+    }
 done:
-    free( tmp );
-    if (ret) make_clean( key );
+    free( new_offsets );
     return ret;
 }
 
+/* write the record of a key and of the subkeys that changed since the last save; return 0 on error */
+static file_pos_t write_hive_key( struct hive_writer *w, struct key *key )
+{
+    struct hive_key *rec;
+    struct hive_value *val;
+    file_pos_t *offsets = NULL, size, pos;
+    char *ptr;
+    int i, count = 0;
+
+    if (!w->full && key->hive_offset && !(key->flags & KEY_DIRTY)) return key->hive_offset;
+
+    if (key->flags & KEY_DIRTY) load_key_contents( key );
+    if (key->hive_map)
+    {
+        if ((pos = copy_hive_key( w, key->hive_map, key->hive_pos )))
+        {
+            key->hive_offset = pos;
+            return pos;
+        }
+        if (w->error) return 0;
+        load_key_contents( key );  /* the record is corrupted, save what can be loaded from it */
+    }
+
+    sort_subkeys( key );
+    sort_values( key );
+    if (key->last_subkey >= 0 && !(offsets = malloc( (key->last_subkey + 1) * sizeof(*offsets) )))
+    {
+        w->error = 1;
+        return 0;
+    }
+    for (i = 0; i <= key->last_subkey; i++)
+    {
+        if (key->subkeys[i]->flags & KEY_VOLATILE) continue;
+        if (!(offsets[count++] = write_hive_key( w, key->subkeys[i] )))
+        {
+            free( offsets );
+            return 0;
+        }
+    }
+
+    size = HIVE_ALIGN( sizeof(*rec) + key->namelen + key->classlen ) + count * sizeof(*offsets);
+    for (i = 0; i <= key->last_value; i++)
+        size += HIVE_ALIGN( sizeof(*val) + key->values[i].namelen + key->values[i].len );
+
+    if ((pos = alloc_hive_record( w, size, (void **)&rec )))
+    {
+        rec->modif    = key->modif;
+        rec->flags    = key->flags & HIVE_KEY_FLAGS;
+        rec->subkeys  = count;
+        rec->values   = key->last_value + 1;
+        rec->namelen  = key->namelen;
+        rec->classlen = key->classlen;
+        ptr = (char *)(rec + 1);
+        if (key->namelen) memcpy( ptr, key->name, key->namelen );
+        if (key->classlen) memcpy( ptr + key->namelen, key->class, key->classlen );
+        ptr = (char *)rec + HIVE_ALIGN( sizeof(*rec) + key->namelen + key->classlen );
+        memcpy( ptr, offsets, count * sizeof(*offsets) );
+        ptr += count * sizeof(*offsets);
+        for (i = 0; i <= key->last_value; i++)
+        {
+            const struct key_value *value = &key->values[i];
+
+            val = (struct hive_value *)ptr;
+            val->type    = value->type;
+            val->len     = value->len;
+            val->namelen = value->namelen;
+            if (value->namelen) memcpy( val + 1, value->name, value->namelen );
+            if (value->len) memcpy( (char *)(val + 1) + value->namelen, value->data, value->len );
+            ptr += HIVE_ALIGN( sizeof(*val) + value->namelen + value->len );
+        }
+        key->hive_offset = pos;
+    }
+    free( offsets );
+    return pos;
+}
+
+/* a save of a branch to its hive, the records are written by a worker thread */
+struct hive_save
+{
+    struct hive_writer w;       /* records to write */
+    struct hive_header header;  /* new header of the hive */
+    char              *tmp;     /* temp file name of a new hive, NULL if writing directly to the file */
+    int                fd;      /* unix fd of the hive file */
+    int                ret;     /* result of the write */
+};
+
+/* prepare the save of a branch to its hive, appending the modified keys or rewriting the whole file */
+/* return 1 if the hive needs to be written, 0 if there's nothing to do, -1 on error */
+static int prepare_hive_save( struct save_branch_info *info, int write_header, struct hive_save *save )
+{
+    struct key *key = info->key;
+
+    if (!info->hive_full && info->header.size - info->header.live > max( info->header.live, HIVE_MIN_GARBAGE ))
+        info->hive_full = 1;
+    if (!info->hive_full && !(key->flags & KEY_DIRTY) && !write_header)
+    {
+        if (debug_level > 1) dump_operation( key, NULL, "Not saving clean" );
+        return 0;
+    }
+
+    memset( &save->w, 0, sizeof(save->w) );
+    save->header = info->header;
+    save->tmp = NULL;
+    save->fd = info->hive_fd;
+    save->ret = 0;
+    save->w.full = info->hive_full;
+    save->w.base = save->w.full ? sizeof(save->header) : save->header.size;
+    if (save->w.full)
+    {
+        if ((save->fd = open_branch_file( info->hive_path, &save->tmp )) == -1) return -1;
+        save->header.magic    = HIVE_MAGIC;
+        save->header.version  = HIVE_VERSION;
+        save->header.reserved = 0;
+    }
+    save->header.arch = prefix_type;
+
+    if (save->w.full || (key->flags & KEY_DIRTY))
+    {
+        if (debug_level > 1)
+        {
+            fprintf( stderr, "%s: ", info->hive_path );
+            dump_operation( key, NULL, save->w.full ? "rewriting" : "saving" );
+        }
+        if (!(save->header.root = write_hive_key( &save->w, key )))
+        {
+            free( save->w.data );
+            if (save->w.full)
+            {
+                close( save->fd );
+                close_branch_file( info->hive_path, save->tmp, 0 );
+            }
+            /* some keys may now have offsets that were not written */
+            info->hive_full = 1;
+            return -1;
+        }
+        save->header.size = save->w.base + save->w.size;
+        if (save->w.full) save->header.live = save->header.size;
+    }
+    /* the records hold the current state, later changes will be in the next save */
+    make_clean( key );
+    return 1;
+}
+
+/* write the records and the header of a hive save; this may be called from a worker thread */
+static void write_hive_save( struct hive_save *save )
+{
+    if (save->w.size)
+    {
+        if (pwrite( save->fd, save->w.data, save->w.size, save->w.base ) != save->w.size) return;
+        /* the records must be on disk before the header points to them */
+        if (fsync( save->fd ) == -1) return;
+    }
+    save->ret = (pwrite( save->fd, &save->header, sizeof(save->header), 0 ) == sizeof(save->header));
+}
+
+/* complete a hive save from the main loop, return its result */
+static int finish_hive_save( struct save_branch_info *info, struct hive_save *save )
+{
+    free( save->w.data );
+    if (!save->ret)
+    {
+        if (save->w.full)
+        {
+            close( save->fd );
+            close_branch_file( info->hive_path, save->tmp, 0 );
+        }
+        /* some keys may now have offsets that were not written */
+        info->hive_full = 1;
+        return 0;
+    }
+
+    if (save->w.full)
+    {
+        if (!close_branch_file( info->hive_path, save->tmp, 1 ))
+        {
+            close( save->fd );
+            info->hive_full = 1;
+            return 0;
+        }
+        if (info->hive_fd != -1) close( info->hive_fd );
+        info->hive_fd = save->fd;
+        info->hive_full = 0;
+        if (info->map)
+        {
+            /* the offsets of the records that are still mapped are not valid in the new file */
+            info->map->current = 0;
+            release_hive_map( info->map );
+            info->map = NULL;
+        }
+    }
+    info->header = save->header;
+    return 1;
+}
+
+/* save a registry branch to its hive right away */
+static int save_hive_branch( struct save_branch_info *info, int write_header )
+{
+    struct hive_save save;
+    int ret;
+
+    if ((ret = prepare_hive_save( info, write_header, &save )) <= 0) return !ret;
+    write_hive_save( &save );
+    return finish_hive_save( info, &save );
+}
+
+/* save a branch that uses a hive on exit, writing its text file too if it has changed */
+static int flush_hive_branch( struct save_branch_info *info )
+{
+    struct key *key = info->key;
+    char *tmp;
+    int fd, ret;
+
+    if (!info->text_dirty && !(key->flags & KEY_DIRTY)) return save_hive_branch( info, 0 );
+
+    if ((fd = open_branch_file( info->path, &tmp )) == -1) return 0;
+    sort_key_tree( key );
+    ret = write_branch_file( key, info->path, fd );
+    if (!close_branch_file( info->path, tmp, ret )) return 0;
+    info->text_dirty = 0;
+    get_text_stamp( info->path, &info->header );
+    return save_hive_branch( info, 1 );
+}
+
+/* save a branch that uses a text file on exit, the journal is not needed anymore after that */
+static int flush_text_branch( struct save_branch_info *info )
+{
+    if (info->journal && (fflush( info->journal ) || ftell( info->journal ) > strlen( journal_header )))
+        make_dirty( info->key );
+    if (!save_branch( info->key, info->path )) return 0;
+    if (info->journal)
+    {
+        fclose( info->journal );
+        info->journal = NULL;
+    }
+    if (info->journal_path) unlink( info->journal_path );
+    return 1;
+}
+
+/* requests that modify the registry, blocked while a periodic save is in progress */
+static const enum request registry_write_requests[] =
+{
+    REQ_create_key,
+    REQ_delete_key,
+    REQ_set_key_value,
+    REQ_delete_key_value,
+    REQ_load_registry,
+    REQ_unload_registry
+};
+
+/* a periodic save running on a worker thread */
+struct save_job
+{
+    int count;                        /* number of branches to save */
+    int          locked;              /* registry writes are blocked until the text files are written */
+    timeout_t    start;               /* time when the save started */
+    timeout_t    stall;               /* time spent in the main loop */
+    timeout_t    lock_time;           /* time when the write requests were locked */
+    struct
+    {
+        struct save_branch_info *info; /* branch being saved */
+        char        *tmp;             /* temp file name, NULL if writing directly to the file */
+        int          fd;              /* unix fd of the opened file */
+        int          ret;             /* result of the write */
+        struct hive_save hive;        /* hive save, for the branches that use a hive */
+    } branches[MAX_SAVE_BRANCH_INFO];
+};
+
+/* flush the journal of a branch; return 1 if it holds all the changes and is still small enough */
+static int flush_journal( struct save_branch_info *info )
+{
+    if (!info->journal) return 0;
+    if (fflush( info->journal ) || ferror( info->journal )) info->journal_valid = 0;
+    if (!info->journal_valid) return 0;
+    return ftell( info->journal ) <= max( JOURNAL_MIN_SIZE, info->text_size / 4 );
+}
+
+/* empty the journal of a branch once the text file holds all the changes */
+static void reset_journal( struct save_branch_info *info )
+{
+    struct stat st;
+
+    if (!stat( info->path, &st )) info->text_size = st.st_size;
+    if (!info->journal)
+    {
+        if (!info->journal_path) return;
+        unlink( info->journal_path );
+        free( info->journal_path );
+        info->journal_path = NULL;
+        return;
+    }
+    fflush( info->journal );
+    clearerr( info->journal );
+    if (!ftruncate( fileno( info->journal ), 0 ) &&
+        fputs( journal_header, info->journal ) >= 0 && !fflush( info->journal ))
+    {
+        info->journal_valid = 1;
+        return;
+    }
+    /* the old entries must not be replayed on top of the new text file */
+    fclose( info->journal );
+    info->journal = NULL;
+    unlink( info->journal_path );
+}
+
+/* print the time during which a registry save kept the clients waiting */
+static void report_save_time( timeout_t stall, timeout_t blocked )
+{
+    if (!debug_level) return;
+    fprintf( stderr, "wineserver: registry saved, main loop stalled %u.%03u ms, writes blocked %u.%03u ms\n",
+             (unsigned int)(stall / 10000), (unsigned int)(stall / 10 % 1000),
+             (unsigned int)(blocked / 10000), (unsigned int)(blocked / 10 % 1000) );
+}
+
+/* write the branches of a periodic save, called on a worker thread */
+static void save_job_work( void *arg )
+{
+    struct save_job *job = arg;
+    int i;
+
+    for (i = 0; i < job->count; i++)
+    {
+        if (job->branches[i].info->hive_path) write_hive_save( &job->branches[i].hive );
+        else job->branches[i].ret = write_branch_file( job->branches[i].info->key, job->branches[i].info->path,
+                                                       job->branches[i].fd );
+    }
+}
+
+/* complete a periodic save, called from the main loop */
+static void save_job_done( void *arg )
+{
+    struct save_job *job = arg;
+    timeout_t start = monotonic_counter(), end;
+    int i, chdir_ok = (fchdir( config_dir_fd ) != -1);
+
+    for (i = 0; i < job->count; i++)
+    {
+        struct save_branch_info *info = job->branches[i].info;
+
+        if (info->hive_path)
+        {
+            /* the new hive can't be renamed into place without the config dir */
+            if (!chdir_ok) job->branches[i].hive.ret = 0;
+            finish_hive_save( info, &job->branches[i].hive );
+            continue;
+        }
+        if (!chdir_ok)
+        {
+            free( job->branches[i].tmp );
+            continue;
+        }
+        if (close_branch_file( info->path, job->branches[i].tmp, job->branches[i].ret ))
+        {
+            make_clean( info->key );
+            reset_journal( info );
+        }
+    }
+    if (chdir_ok && fchdir( server_dir_fd ) == -1)
+        fatal_error( "chdir to server dir: %s\n", strerror( errno ));
+    if (job->locked) unlock_requests( registry_write_requests, ARRAY_SIZE(registry_write_requests) );
+
+    end = monotonic_counter();
+    job->stall += end - start;
+    report_save_time( job->stall, job->locked ? end - job->lock_time : 0 );
+    free( job );
+    set_periodic_save_timer();
+}
+
 /* periodic saving of the registry */
 static void periodic_save( void *arg )
 {
-    int i;
+    struct save_job *job;
+    char *tmp;
+    int i, fd, saved = 0;
 
     if (fchdir( config_dir_fd ) == -1) return;
     save_timeout_user = NULL;
+    if (!(job = mem_alloc( sizeof(*job) )))
+    {
+        if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
+        set_periodic_save_timer();
+        return;
+    }
+    job->count = 0;
+    job->locked = 0;
+    job->start = monotonic_counter();
     for (i = 0; i < save_branch_count; i++)
-        save_branch( save_branch_info[i].key, save_branch_info[i].path );
+    {
+        struct save_branch_info *info = &save_branch_info[i];
+        struct key *key = info->key;
+
+        if (info->hive_path)
+        {
+            /* the records are built here, the worker writes them and syncs the file */
+            if (key->flags & KEY_DIRTY)
+            {
+                info->text_dirty = 1;
+                saved++;
+            }
+            if (prepare_hive_save( info, 0, &job->branches[job->count].hive ) <= 0) continue;
+            job->branches[job->count].info = info;
+            job->count++;
+            continue;
+        }
+        if (!(key->flags & KEY_DIRTY))
+        {
+            if (debug_level > 1) dump_operation( key, NULL, "Not saving clean" );
+            continue;
+        }
+        saved++;
+        if (flush_journal( info ))
+        {
+            if (debug_level > 1) dump_operation( key, NULL, "Journaled" );
+            make_clean( key );
+            continue;
+        }
+        if ((fd = open_branch_file( info->path, &tmp )) == -1) continue;
+        /* enumerations must not need to reorder the tree while the worker is writing it */
+        sort_key_tree( key );
+        job->branches[job->count].info = info;
+        job->branches[job->count].tmp  = tmp;
+        job->branches[job->count].fd   = fd;
+        job->branches[job->count].ret  = 0;
+        job->count++;
+        job->locked = 1;
+    }
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
-    set_periodic_save_timer();
+
+    if (!job->count)
+    {
+        if (saved) report_save_time( monotonic_counter() - job->start, 0 );
+        free( job );
+        set_periodic_save_timer();
+        return;
+    }
+
+    /* the tree must not change while the worker is writing the text files */
+    job->lock_time = monotonic_counter();
+    job->stall = job->lock_time - job->start;
+    if (job->locked) lock_requests( registry_write_requests, ARRAY_SIZE(registry_write_requests) );
+    queue_work( save_job_work, save_job_done, job );
 }
 
 /* start the periodic save timer */
@@ -2115,13 +3534,15 @@ void flush_registry(void)
 {
     int i;
 
+    flush_work();  /* complete any pending background save */
     if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
     {
-        if (!save_branch( save_branch_info[i].key, save_branch_info[i].path ))
+        struct save_branch_info *info = &save_branch_info[i];
+
+        if (!(info->hive_path ? flush_hive_branch( info ) : flush_text_branch( info )))
         {
-            fprintf( stderr, "wineserver: could not save registry branch to %s",
-                     save_branch_info[i].path );
+            fprintf( stderr, "wineserver: could not save registry branch to %s", info->path );
             perror( " " );
         }
     }
@@ -2201,7 +3622,10 @@ DECL_HANDLER(delete_key)
 
     if ((key = get_hkey_obj( req->hkey, DELETE )))
     {
-        delete_key( key, 0);
+        struct save_branch_info *branch = get_journal_branch( key );
+        struct key *parent = key->parent;
+
+        if (!delete_key( key, 0 )) journal_delete_key( branch, parent, key );
         release_object( key );
     }
 }
@@ -2321,6 +3745,7 @@ DECL_HANDLER(load_registry)
         int dummy;
         if ((key = create_key( parent, &name, NULL, 0, KEY_WOW64_64KEY, 0, sd, &dummy )))
         {
+            invalidate_journal( key );  /* the loaded keys are only saved by rewriting the branch */
             load_registry( key, req->file );
             release_object( key );
         }
@@ -2347,10 +3772,13 @@ DECL_HANDLER(unload_registry)
         get_req_path( &name, !req->parent );
         if ((key = open_key( parent, &name, access, req->attributes )))
         {
+            struct save_branch_info *branch = get_journal_branch( key );
+            struct key *key_parent = key->parent;
+
             if (key->obj.handle_count)
                 set_error( STATUS_CANNOT_DELETE );
-            else
-                delete_key( key, 1 );     /* FIXME */
+            else if (!delete_key( key, 1 ))     /* FIXME */
+                journal_delete_key( branch, key_parent, key );
             release_object( key );
         }
         release_object( parent );
@@ -22,6 +22,7 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #ifdef HAVE_PWD_H
@@ -295,6 +296,16 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
+/* request that has to wait until its handler is unlocked */
+struct parked_request
+{
+    struct list    entry;
+    struct thread *thread;
+};
+
+static unsigned int request_locks[REQ_NB_REQUESTS];
+static struct list parked_requests = LIST_INIT( parked_requests );
+
 /* call a request handler */
 static void call_req_handler( struct thread *thread )
 {
@@ -331,6 +342,171 @@ static void call_req_handler( struct thread *thread )
     current = NULL;
 }
 
+/* return the next request of a batch, or NULL if there isn't a complete one */
+static const union generic_request *get_batch_request( const void *data, data_size_t size,
+                                                       data_size_t *pos )
+{
+    const union generic_request *req;
+    data_size_t remaining;
+
+    if (size - *pos < sizeof(*req)) return NULL;
+    req = (const union generic_request *)((const char *)data + *pos);
+    remaining = size - *pos - sizeof(*req);
+    if (req->request_header.request_size > (remaining & ~7)) return NULL;
+    *pos += sizeof(*req) + ((req->request_header.request_size + 7) & ~7);
+    return req;
+}
+
+/* check if the handler of a request, or of one of the requests of a batch, is locked */
+static int is_request_locked( struct thread *thread )
+{
+    enum request req = thread->req.request_header.req;
+    const union generic_request *sub;
+    data_size_t pos = 0;
+
+    if (req >= REQ_NB_REQUESTS) return 0;
+    if (request_locks[req]) return 1;
+    if (req != REQ_batch) return 0;
+
+    while ((sub = get_batch_request( thread->req_data, thread->req.request_header.request_size, &pos )))
+        if (sub->request_header.req < REQ_NB_REQUESTS && request_locks[sub->request_header.req]) return 1;
+    return 0;
+}
+
+/* handle a request that has been fully read, unless its handler is currently locked */
+static void dispatch_request( struct thread *thread )
+{
+    struct parked_request *parked;
+
+    if (is_request_locked( thread ) && (parked = mem_alloc( sizeof(*parked) )))
+    {
+        /* stop reading requests from the thread until its current one can be handled */
+        parked->thread = (struct thread *)grab_object( thread );
+        list_add_tail( &parked_requests, &parked->entry );
+        set_fd_events( thread->request_fd, 0 );
+        return;
+    }
+    call_req_handler( thread );
+    free( thread->req_data );
+    thread->req_data = NULL;
+}
+
+/* prevent the handlers of the specified requests from being called */
+/* requests that arrive in the meantime are handled once they are unlocked */
+void lock_requests( const enum request *reqs, unsigned int count )
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) request_locks[reqs[i]]++;
+}
+
+/* unlock request handlers and handle the requests that were waiting for them */
+void unlock_requests( const enum request *reqs, unsigned int count )
+{
+    struct parked_request *parked;
+    struct thread *thread;
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+    {
+        assert( request_locks[reqs[i]] );
+        request_locks[reqs[i]]--;
+    }
+
+    for (;;)
+    {
+        /* handlers may lock or unlock requests themselves, so restart the search every time */
+        LIST_FOR_EACH_ENTRY( parked, &parked_requests, struct parked_request, entry )
+            if (!is_request_locked( parked->thread )) break;
+        if (&parked->entry == &parked_requests) break;
+
+        thread = parked->thread;
+        list_remove( &parked->entry );
+        free( parked );
+        if (thread->state != TERMINATED && thread->request_fd)
+        {
+            set_fd_events( thread->request_fd, POLLIN );
+            dispatch_request( thread );
+        }
+        release_object( thread );
+    }
+}
+
+/* execute several requests in a single round-trip */
+DECL_HANDLER(batch)
+{
+    struct thread *thread = current;
+    union generic_request batch_req = thread->req;
+    void *batch_data = thread->req_data;
+    data_size_t size = get_req_data_size(), max_size = get_reply_max_size();
+    data_size_t pos = 0, reply_pos = 0;
+    const union generic_request *sub;
+    union generic_reply sub_reply;
+    unsigned int count = 0;
+    char *replies = NULL;
+    int valid = 1;
+
+    if (max_size)
+    {
+        if (!(replies = mem_alloc( max_size ))) return;
+        memset( replies, 0, max_size );  /* don't leak anything in the padding */
+    }
+
+    while (pos < size)
+    {
+        enum request req;
+
+        if (!(sub = get_batch_request( batch_data, size, &pos )) ||
+            !is_batch_allowed( (req = sub->request_header.req) ) ||
+            max_size - reply_pos < sizeof(sub_reply) ||
+            sub->request_header.reply_size > ((max_size - reply_pos - sizeof(sub_reply)) & ~7))
+        {
+            valid = 0;
+            break;
+        }
+
+        thread->req = *sub;
+        thread->req_data = (void *)(sub + 1);
+        thread->reply_size = 0;
+        clear_error();
+        memset( &sub_reply, 0, sizeof(sub_reply) );
+
+        if (debug_level) trace_request();
+        req_handlers[req]( &thread->req, &sub_reply );
+        if (!current) break;  /* the thread has been killed */
+
+        sub_reply.reply_header.error = thread->error;
+        sub_reply.reply_header.reply_size = thread->reply_size;
+        if (debug_level) trace_reply( req, &sub_reply );
+
+        memcpy( replies + reply_pos, &sub_reply, sizeof(sub_reply) );
+        reply_pos += sizeof(sub_reply);
+        if (thread->reply_size) memcpy( replies + reply_pos, thread->reply_data, thread->reply_size );
+        reply_pos += (thread->reply_size + 7) & ~7;
+        free( thread->reply_data );
+        thread->reply_data = NULL;
+        thread->reply_size = 0;
+        count++;
+    }
+
+    thread->req = batch_req;
+    thread->req_data = batch_data;
+    if (!current)
+    {
+        free( replies );
+        return;
+    }
+    if (!valid)
+    {
+        free( replies );
+        fatal_protocol_error( thread, "invalid batch request after %u requests\n", count );
+        return;
+    }
+    clear_error();
+    reply->count = count;
+    set_reply_data_ptr( replies, reply_pos );
+}
+
 /* read a request from a thread */
 void read_request( struct thread *thread )
 {
@@ -343,7 +519,7 @@ void read_request( struct thread *thread )
         if (!(thread->req_toread = thread->req.request_header.request_size))
         {
             /* no data, handle request at once */
-            call_req_handler( thread );
+            dispatch_request( thread );
             return;
         }
         if (!(thread->req_data = malloc( thread->req_toread )))
@@ -364,9 +540,7 @@ void read_request( struct thread *thread )
         if (ret <= 0) break;
         if (!(thread->req_toread -= ret))
         {
-            call_req_handler( thread );
-            free( thread->req_data );
-            thread->req_data = NULL;
+            dispatch_request( thread );
             return;
         }
     }
@@ -592,11 +766,25 @@ static void master_socket_poll_event( struct fd *fd, int event )
     }
 }
 
+/* remove the relocated images cached by the client processes */
+static void remove_reloc_cache(void)
+{
+    struct dirent *de;
+    DIR *dir;
+
+    if (!(dir = opendir( "reloc" ))) return;
+    while ((de = readdir( dir ))) if (de->d_name[0] != '.') unlinkat( dirfd( dir ), de->d_name, 0 );
+    closedir( dir );
+    rmdir( "reloc" );
+}
+
 /* remove the socket upon exit */
 static void socket_cleanup(void)
 {
     static int do_it_once;
-    if (!do_it_once++) unlink( server_socket_name );
+    if (do_it_once++) return;
+    unlink( server_socket_name );
+    remove_reloc_cache();
 }
 
 /* create a directory and check its permissions */
@@ -120,21 +120,22 @@ union win_sockaddr
     SOCKADDR_IRDA irda;
 };
 
-static struct list poll_list = LIST_INIT( poll_list );
+struct poll_entry
+{
+    struct list entry;      /* entry in the socket's list of polls */
+    struct poll_req *req;   /* request this entry belongs to */
+    struct sock *sock;
+    int flags;
+};
 
 struct poll_req
 {
-    struct list entry;
     struct async *async;
     struct iosb *iosb;
     struct timeout_user *timeout;
     unsigned int count;
     struct poll_socket_output *output;
-    struct
-    {
-        struct sock *sock;
-        int flags;
-    } sockets[1];
+    struct poll_entry sockets[1];
 };
 
 struct accept_req
@@ -200,6 +201,7 @@ struct sock
     struct async_queue  accept_q;    /* queue for asynchronous accepts */
     struct async_queue  connect_q;   /* queue for asynchronous connects */
     struct async_queue  poll_q;      /* queue for asynchronous polls */
+    struct list         poll_list;   /* poll request entries waiting for this socket */
     struct object      *ifchange_obj; /* the interface change notification object */
     struct list         ifchange_entry; /* entry in ifchange notification list */
     struct list         accept_list; /* list of pending accept requests */
@@ -789,10 +791,12 @@ static void free_poll_req( void *private )
     if (req->timeout) remove_timeout_user( req->timeout );
 
     for (i = 0; i < req->count; ++i)
+    {
+        list_remove( &req->sockets[i].entry );
         release_object( req->sockets[i].sock );
+    }
     release_object( req->async );
     release_object( req->iosb );
-    list_remove( &req->entry );
     free( req );
 }
 
@@ -836,33 +840,29 @@ static int get_poll_flags( struct sock *sock, int event )
 static void complete_async_polls( struct sock *sock, int event, int error )
 {
     int flags = get_poll_flags( sock, event );
-    struct poll_req *req, *next;
+    struct poll_entry *entry, *next;
 
-    LIST_FOR_EACH_ENTRY_SAFE( req, next, &poll_list, struct poll_req, entry )
+    /* only the requests waiting for this socket need to be looked at */
+    LIST_FOR_EACH_ENTRY_SAFE( entry, next, &sock->poll_list, struct poll_entry, entry )
     {
+        struct poll_req *req = entry->req;
         struct iosb *iosb = req->iosb;
-        unsigned int i;
+        unsigned int i = entry - req->sockets;
 
         if (iosb->status != STATUS_PENDING) continue;
+        if (!(entry->flags & flags)) continue;
 
-        for (i = 0; i < req->count; ++i)
-        {
-            if (req->sockets[i].sock != sock) continue;
-            if (!(req->sockets[i].flags & flags)) continue;
+        if (debug_level)
+            fprintf( stderr, "completing poll for socket %p, wanted %#x got %#x\n",
+                     sock, entry->flags, flags );
 
-            if (debug_level)
-                fprintf( stderr, "completing poll for socket %p, wanted %#x got %#x\n",
-                         sock, req->sockets[i].flags, flags );
-
-            req->output[i].flags = req->sockets[i].flags & flags;
-            req->output[i].status = sock_get_ntstatus( error );
+        req->output[i].flags = entry->flags & flags;
+        req->output[i].status = sock_get_ntstatus( error );
 
-            iosb->status = STATUS_SUCCESS;
-            iosb->out_data = req->output;
-            iosb->out_size = req->count * sizeof(*req->output);
-            async_terminate( req->async, STATUS_ALERTED );
-            break;
-        }
+        iosb->status = STATUS_SUCCESS;
+        iosb->out_data = req->output;
+        iosb->out_size = req->count * sizeof(*req->output);
+        async_terminate( req->async, STATUS_ALERTED );
     }
 }
 
@@ -1134,7 +1134,7 @@ static int sock_get_poll_events( struct fd *fd )
 {
     struct sock *sock = get_fd_user( fd );
     unsigned int mask = sock->mask & ~sock->reported_events;
-    struct poll_req *req;
+    struct poll_entry *entry;
     int ev = 0;
 
     assert( sock->obj.ops == &sock_ops );
@@ -1215,17 +1215,8 @@ static int sock_get_poll_events( struct fd *fd )
         break;
     }
 
-    LIST_FOR_EACH_ENTRY( req, &poll_list, struct poll_req, entry )
-    {
-        unsigned int i;
-
-        for (i = 0; i < req->count; ++i)
-        {
-            if (req->sockets[i].sock != sock) continue;
-
-            ev |= poll_flags_from_afd( sock, req->sockets[i].flags );
-        }
-    }
+    LIST_FOR_EACH_ENTRY( entry, &sock->poll_list, struct poll_entry, entry )
+        ev |= poll_flags_from_afd( sock, entry->flags );
 
     return ev;
 }
@@ -1309,7 +1300,7 @@ static int sock_close_handle( struct object *obj, struct process *process, obj_h
     if (sock->obj.handle_count == 1) /* last handle */
     {
         struct accept_req *accept_req, *accept_next;
-        struct poll_req *poll_req, *poll_next;
+        struct poll_entry *entry, *next;
 
         if (sock->accept_recv_req)
             async_terminate( sock->accept_recv_req->async, STATUS_CANCELLED );
@@ -1320,29 +1311,28 @@ static int sock_close_handle( struct object *obj, struct process *process, obj_h
         if (sock->connect_req)
             async_terminate( sock->connect_req->async, STATUS_CANCELLED );
 
-        LIST_FOR_EACH_ENTRY_SAFE( poll_req, poll_next, &poll_list, struct poll_req, entry )
+        /* mark all the entries of a request first, it may wait more than once for the socket */
+        LIST_FOR_EACH_ENTRY( entry, &sock->poll_list, struct poll_entry, entry )
+        {
+            struct poll_req *poll_req = entry->req;
+            unsigned int i = entry - poll_req->sockets;
+
+            if (poll_req->iosb->status != STATUS_PENDING) continue;
+            poll_req->output[i].flags = AFD_POLL_CLOSE;
+            poll_req->output[i].status = 0;
+        }
+
+        LIST_FOR_EACH_ENTRY_SAFE( entry, next, &sock->poll_list, struct poll_entry, entry )
         {
+            struct poll_req *poll_req = entry->req;
             struct iosb *iosb = poll_req->iosb;
-            unsigned int i;
 
             if (iosb->status != STATUS_PENDING) continue;
 
-            for (i = 0; i < poll_req->count; ++i)
-            {
-                if (poll_req->sockets[i].sock == sock)
-                {
-                    iosb->status = STATUS_SUCCESS;
-                    poll_req->output[i].flags = AFD_POLL_CLOSE;
-                    poll_req->output[i].status = 0;
-                }
-            }
-
-            if (iosb->status != STATUS_PENDING)
-            {
-                iosb->out_data = poll_req->output;
-                iosb->out_size = poll_req->count * sizeof(*poll_req->output);
-                async_terminate( poll_req->async, STATUS_ALERTED );
-            }
+            iosb->status = STATUS_SUCCESS;
+            iosb->out_data = poll_req->output;
+            iosb->out_size = poll_req->count * sizeof(*poll_req->output);
+            async_terminate( poll_req->async, STATUS_ALERTED );
         }
     }
 
@@ -1419,6 +1409,7 @@ static struct sock *create_socket(void)
     init_async_queue( &sock->accept_q );
     init_async_queue( &sock->connect_q );
     init_async_queue( &sock->poll_q );
+    list_init( &sock->poll_list );
     memset( sock->errors, 0, sizeof(sock->errors) );
     list_init( &sock->accept_list );
     return sock;
@@ -2867,13 +2858,14 @@ static int poll_socket( struct sock *poll_sock, struct async *async, timeout_t t
         req->sockets[i].sock = (struct sock *)get_handle_obj( current->process, input[i].socket, 0, &sock_ops );
         if (!req->sockets[i].sock)
         {
-            for (j = 0; j < i; ++j) release_object( req->sockets[i].sock );
+            for (j = 0; j < i; ++j) release_object( req->sockets[j].sock );
             if (req->timeout) remove_timeout_user( req->timeout );
             free( req );
             free( output );
             return 0;
         }
         req->sockets[i].flags = input[i].flags;
+        req->sockets[i].req = req;
     }
 
     req->count = count;
@@ -2881,7 +2873,8 @@ static int poll_socket( struct sock *poll_sock, struct async *async, timeout_t t
     req->iosb = async_get_iosb( async );
     req->output = output;
 
-    list_add_tail( &poll_list, &req->entry );
+    for (i = 0; i < count; ++i)
+        list_add_tail( &req->sockets[i].sock->poll_list, &req->sockets[i].entry );
     async_set_completion_callback( async, free_poll_req, req );
     queue_async( &poll_sock->poll_q, async );
 
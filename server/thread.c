@@ -255,6 +255,7 @@ static inline void init_thread_structure( struct thread *thread )
     thread->teb             = 0;
     thread->entry_point     = 0;
     thread->system_regs     = 0;
+    thread->fsync_owned     = 0;
     thread->queue           = NULL;
     thread->wait            = NULL;
     thread->error           = 0;
@@ -896,6 +897,7 @@ static int wait_on( const select_op_t *select_op, unsigned int count, struct obj
     {
         struct object *obj = objects[i];
         entry->wait = wait;
+        entry->fsync_slot = 0;
         if (!obj->ops->add_queue( obj, entry ))
         {
             wait->count = i;
@@ -947,12 +949,20 @@ static int check_wait( struct thread *thread )
          * want to do something when signaled, even if others are not */
         for (i = 0, entry = wait->queues; i < wait->count; i++, entry++)
             not_ok |= !entry->obj->ops->signaled( entry->obj, entry );
-        if (!not_ok) return STATUS_WAIT_0;
+        if (!not_ok)
+        {
+            /* objects with a client-side slot can be taken by a client at any time */
+            for (i = 0, entry = wait->queues; i < wait->count; i++, entry++)
+                if (!fsync_acquire( entry, thread )) break;
+            if (i == wait->count) return STATUS_WAIT_0;
+            while (i--) fsync_undo_acquire( --entry, thread );
+        }
     }
     else
     {
         for (i = 0, entry = wait->queues; i < wait->count; i++, entry++)
-            if (entry->obj->ops->signaled( entry->obj, entry )) return i;
+            if (entry->obj->ops->signaled( entry->obj, entry ) && fsync_acquire( entry, thread ))
+                return i;
     }
 
     if ((wait->flags & SELECT_ALERTABLE) && !list_empty(&thread->user_apc)) return STATUS_USER_APC;
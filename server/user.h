@@ -80,6 +80,8 @@ struct desktop
     unsigned int         users;            /* processes and threads using this desktop */
     struct global_cursor cursor;           /* global cursor information */
     unsigned char        keystate[256];    /* asynchronous key state */
+    struct object       *shared_mapping;   /* mapping of the shared memory, created on demand */
+    desktop_shm_t       *shared;           /* desktop data published to the clients */
 };
 
 /* user handles functions */
@@ -196,6 +198,7 @@ extern void close_process_desktop( struct process *process );
 extern void set_thread_default_desktop( struct thread *thread, struct desktop *desktop, obj_handle_t handle );
 extern void release_thread_desktop( struct thread *thread, int close );
 extern void update_desktop_cursor_win( struct desktop *desktop );
+extern void update_desktop_shm( struct desktop *desktop );
 
 static inline int is_rect_empty( const rectangle_t *rect )
 {
@@ -0,0 +1,267 @@
+/*
+ * Server worker threads
+ *
+ * Copyright (C) 2021 Wine contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * The server state is not thread-safe, so request handlers always run
+ * in the main loop. Worker threads are only used for long operations
+ * that can run on data the main loop doesn't modify in the meantime,
+ * typically by locking the requests that would modify it with
+ * lock_requests(). The completion callback is then called from the
+ * main loop, where server objects can be used again. The periodic
+ * registry save is currently the only user.
+ *
+ * At least one worker is always started. The work is only done
+ * synchronously when it is queued if the work item can't be allocated.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#ifdef HAVE_SYS_POLL_H
+#include <sys/poll.h>
+#endif
+#include <unistd.h>
+
+#include "file.h"
+#include "object.h"
+#include "request.h"
+
+struct work_item
+{
+    struct list   entry;     /* entry in pending or finished list */
+    work_func_t   work;      /* function called on a worker thread */
+    work_func_t   done;      /* function called in the main loop once the work is done */
+    void         *arg;       /* argument for both functions */
+};
+
+struct work_notify
+{
+    struct object    obj;         /* object header */
+    struct fd       *fd;          /* file descriptor for the pipe read side */
+    int              pipe_write;  /* unix fd for the pipe write side */
+};
+
+static void work_notify_dump( struct object *obj, int verbose );
+static void work_notify_destroy( struct object *obj );
+
+static const struct object_ops work_notify_ops =
+{
+    sizeof(struct work_notify),   /* size */
+    &no_type,                     /* type */
+    work_notify_dump,             /* dump */
+    no_add_queue,                 /* add_queue */
+    NULL,                         /* remove_queue */
+    NULL,                         /* signaled */
+    NULL,                         /* satisfied */
+    no_signal,                    /* signal */
+    no_get_fd,                    /* get_fd */
+    default_map_access,           /* map_access */
+    default_get_sd,               /* get_sd */
+    default_set_sd,               /* set_sd */
+    no_get_full_name,             /* get_full_name */
+    no_lookup_name,               /* lookup_name */
+    no_link_name,                 /* link_name */
+    NULL,                         /* unlink_name */
+    no_open_file,                 /* open_file */
+    no_kernel_obj_list,           /* get_kernel_obj_list */
+    no_close_handle,              /* close_handle */
+    work_notify_destroy           /* destroy */
+};
+
+static void work_notify_poll_event( struct fd *fd, int event );
+
+static const struct fd_ops work_notify_fd_ops =
+{
+    NULL,                         /* get_poll_events */
+    work_notify_poll_event,       /* poll_event */
+    NULL,                         /* flush */
+    NULL,                         /* get_fd_type */
+    NULL,                         /* ioctl */
+    NULL,                         /* queue_async */
+    NULL                          /* reselect_async */
+};
+
+int worker_threads = 1;  /* number of worker threads, set from the command line */
+
+static struct work_notify *work_notify;
+static pthread_mutex_t work_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;     /* signaled when work is queued */
+static pthread_cond_t finished_cond = PTHREAD_COND_INITIALIZER; /* signaled when work is finished */
+static struct list pending_work = LIST_INIT( pending_work );
+static struct list finished_work = LIST_INIT( finished_work );
+static unsigned int running_work;  /* number of items currently being processed */
+
+static void work_notify_dump( struct object *obj, int verbose )
+{
+    struct work_notify *notify = (struct work_notify *)obj;
+    fprintf( stderr, "Worker notification fd=%p\n", notify->fd );
+}
+
+static void work_notify_destroy( struct object *obj )
+{
+    struct work_notify *notify = (struct work_notify *)obj;
+    if (notify->fd) release_object( notify->fd );
+    close( notify->pipe_write );
+}
+
+/* call the completion callbacks of all the finished work items */
+static void process_finished_work(void)
+{
+    struct list finished = LIST_INIT( finished );
+    struct work_item *item, *next;
+
+    pthread_mutex_lock( &work_mutex );
+    list_move_tail( &finished, &finished_work );
+    pthread_mutex_unlock( &work_mutex );
+
+    LIST_FOR_EACH_ENTRY_SAFE( item, next, &finished, struct work_item, entry )
+    {
+        list_remove( &item->entry );
+        if (item->done) item->done( item->arg );
+        free( item );
+    }
+}
+
+static void work_notify_poll_event( struct fd *fd, int event )
+{
+    char buffer[64];
+
+    if (event & (POLLERR | POLLHUP))
+    {
+        /* this is not supposed to happen */
+        fprintf( stderr, "wineserver: Error on worker notification pipe\n" );
+        release_object( get_fd_user( fd ) );
+        return;
+    }
+    while (read( get_unix_fd( fd ), buffer, sizeof(buffer) ) == sizeof(buffer)) /* nothing */;
+    process_finished_work();
+}
+
+static void *worker_thread_proc( void *arg )
+{
+    struct work_item *item;
+    struct list *ptr;
+    char dummy = 0;
+
+    pthread_mutex_lock( &work_mutex );
+    for (;;)
+    {
+        while (!(ptr = list_head( &pending_work ))) pthread_cond_wait( &work_cond, &work_mutex );
+        item = LIST_ENTRY( ptr, struct work_item, entry );
+        list_remove( &item->entry );
+        running_work++;
+        pthread_mutex_unlock( &work_mutex );
+
+        item->work( item->arg );
+
+        pthread_mutex_lock( &work_mutex );
+        running_work--;
+        list_add_tail( &finished_work, &item->entry );
+        pthread_cond_broadcast( &finished_cond );
+        write( work_notify->pipe_write, &dummy, 1 );
+    }
+    return NULL;
+}
+
+/* start the worker threads requested on the command line */
+void init_workers(void)
+{
+    sigset_t sigset, old_sigset;
+    pthread_t thread;
+    int i, fd[2];
+
+    if (worker_threads < 1) worker_threads = 1;
+
+    if (pipe( fd ) == -1) goto error;
+    fcntl( fd[0], F_SETFL, O_NONBLOCK );
+    fcntl( fd[1], F_SETFL, O_NONBLOCK );
+    if (!(work_notify = alloc_object( &work_notify_ops )))
+    {
+        close( fd[0] );
+        close( fd[1] );
+        goto error;
+    }
+    work_notify->pipe_write = fd[1];
+    if (!(work_notify->fd = create_anonymous_fd( &work_notify_fd_ops, fd[0], &work_notify->obj, 0 )))
+        goto error;
+    set_fd_events( work_notify->fd, POLLIN );
+    make_object_permanent( &work_notify->obj );
+
+    /* signals are handled by the main loop, keep them blocked in the workers */
+    sigfillset( &sigset );
+    pthread_sigmask( SIG_SETMASK, &sigset, &old_sigset );
+    for (i = 0; i < worker_threads; i++)
+    {
+        if (pthread_create( &thread, NULL, worker_thread_proc, NULL ))
+        {
+            pthread_sigmask( SIG_SETMASK, &old_sigset, NULL );
+            goto error;
+        }
+        pthread_detach( thread );
+    }
+    pthread_sigmask( SIG_SETMASK, &old_sigset, NULL );
+    if (debug_level) fprintf( stderr, "wineserver: started %d worker threads\n", worker_threads );
+    return;
+
+error:
+    fatal_error( "failed to start worker threads: %s\n", strerror( errno ));
+}
+
+/* queue some work for a worker thread, or do it right away if that's not possible */
+void queue_work( work_func_t work, work_func_t done, void *arg )
+{
+    struct work_item *item;
+
+    if (!worker_threads || !(item = mem_alloc( sizeof(*item) )))
+    {
+        work( arg );
+        if (done) done( arg );
+        return;
+    }
+    item->work = work;
+    item->done = done;
+    item->arg  = arg;
+
+    pthread_mutex_lock( &work_mutex );
+    list_add_tail( &pending_work, &item->entry );
+    pthread_cond_signal( &work_cond );
+    pthread_mutex_unlock( &work_mutex );
+}
+
+/* wait for all the queued work to be done and call the completion callbacks */
+void flush_work(void)
+{
+    if (!worker_threads) return;
+
+    pthread_mutex_lock( &work_mutex );
+    while (running_work || !list_empty( &pending_work ))
+        pthread_cond_wait( &finished_cond, &work_mutex );
+    pthread_mutex_unlock( &work_mutex );
+    process_finished_work();
+}